@@ -0,0 +1,316 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_broadcast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+/*
+ * broadcast_bench.c
+ *
+ * Hands a stream of note messages, with a 40 byte SysEx every 64th, from one
+ * producer thread to 1..8 consumer threads that each read all of it. Once through
+ * one broadcast ring, and once the usual way, copying every message into a queue
+ * per consumer (single producer, single consumer, the same slot format). Both are
+ * sized to hold the same number of messages per consumer. The producer yields when
+ * it runs out of room and the consumers when there's nothing to read. Every
+ * consumer checks the sequence number carried by each message, and that no
+ * message arrives damaged
+ *
+ * Then runs three consumers alongside a lossy one that stalls for 2 ms every
+ * 2000 messages, to show it costs the others nothing
+ *
+ */
+
+#define MESSAGES 2000000
+#define SLOTS 4096
+#define MAX_CONSUMERS 8
+#define ROUNDS 3
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// The baseline: one of these per consumer, and the producer writes to them all
+struct copy_queue
+{
+    struct platform_midi_broadcast_slot *slots;
+    unsigned long long head __attribute__((aligned(64)));
+    unsigned long long tail __attribute__((aligned(64)));
+};
+
+static struct platform_midi_broadcast broadcast;
+static struct platform_midi_broadcast_consumer consumers[MAX_CONSUMERS];
+static struct copy_queue queues[MAX_CONSUMERS];
+static int consumerCount;
+static int lossyIndex = -1;
+static volatile int producerDone;
+
+static unsigned long long errors[MAX_CONSUMERS];
+static unsigned long long received[MAX_CONSUMERS];
+
+static int make_message(unsigned int seq, unsigned char *msg)
+{
+    if (seq % 64 == 63)
+    {
+        msg[0] = 0xF0;
+        msg[1] = (seq >> 14) & 0x0F;
+        msg[2] = (seq >> 7) & 0x7F;
+        msg[3] = seq & 0x7F;
+        memset(msg + 4, 0x55, 35);
+        msg[39] = 0xF7;
+        return 40;
+    }
+
+    msg[0] = 0x90 | ((seq >> 14) & 0x0F);
+    msg[1] = (seq >> 7) & 0x7F;
+    msg[2] = seq & 0x7F;
+    return 3;
+}
+
+// The low 18 bits of the message's sequence number, or ~0 if it's damaged
+static unsigned int message_seq(const unsigned char *msg, int size)
+{
+    if (msg[0] == 0xF0)
+    {
+        if (size != 40 || msg[4] != 0x55 || msg[38] != 0x55 || msg[39] != 0xF7)
+        {
+            return ~0u;
+        }
+        return (msg[1] << 14) | (msg[2] << 7) | msg[3];
+    }
+    return size == 3 ? ((msg[0] & 0x0F) << 14) | (msg[1] << 7) | msg[2] : ~0u;
+}
+
+static int queue_push(struct copy_queue *queue, const unsigned char *msg, int size)
+{
+    unsigned long long head = queue->head;
+    unsigned long long needed = (size + PLATFORM_MIDI_BROADCAST_SLOT_DATA - 1) / PLATFORM_MIDI_BROADCAST_SLOT_DATA;
+
+    if (head + needed - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) > SLOTS)
+    {
+        return 0;
+    }
+
+    for (unsigned long long i = 0; i < needed; i++)
+    {
+        struct platform_midi_broadcast_slot *slot = &queue->slots[(head + i) & (SLOTS - 1)];
+        int length = size > PLATFORM_MIDI_BROADCAST_SLOT_DATA ? PLATFORM_MIDI_BROADCAST_SLOT_DATA : size;
+
+        slot->length = length;
+        slot->flags = i + 1 < needed ? PLATFORM_MIDI_BROADCAST_MORE : 0;
+        memcpy(slot->data, msg, length);
+        msg += length;
+        size -= length;
+    }
+
+    __atomic_store_n(&queue->head, head + needed, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int queue_pop(struct copy_queue *queue, unsigned char *buf)
+{
+    unsigned long long tail = queue->tail;
+    int copied = 0;
+
+    if (tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+
+    while (1)
+    {
+        const struct platform_midi_broadcast_slot *slot = &queue->slots[tail++ & (SLOTS - 1)];
+
+        memcpy(buf + copied, slot->data, slot->length);
+        copied += slot->length;
+        if (!(slot->flags & PLATFORM_MIDI_BROADCAST_MORE))
+        {
+            break;
+        }
+    }
+
+    __atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+    return copied;
+}
+
+static void *producer_thread(void *arg)
+{
+    int copies = *(int*)arg;
+    unsigned char msg[64];
+
+    for (unsigned int seq = 0; seq < MESSAGES; seq++)
+    {
+        int size = make_message(seq, msg);
+
+        if (!copies)
+        {
+            while (!platform_midi_broadcast_publish(&broadcast, msg, size))
+            {
+                sched_yield();
+            }
+            continue;
+        }
+
+        for (int c = 0; c < consumerCount; c++)
+        {
+            while (!queue_push(&queues[c], msg, size))
+            {
+                sched_yield();
+            }
+        }
+    }
+
+    __atomic_store_n(&producerDone, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *consumer_thread(void *arg)
+{
+    int index = (int)(size_t)arg;
+    int copies = index >= MAX_CONSUMERS;
+    unsigned char buf[64];
+    unsigned int expected = 0;
+    int stalls = 0;
+
+    index %= MAX_CONSUMERS;
+    while (1)
+    {
+        int size = copies ? queue_pop(&queues[index], buf) : platform_midi_broadcast_read(&broadcast, &consumers[index], buf, sizeof(buf));
+
+        if (!size)
+        {
+            if (__atomic_load_n(&producerDone, __ATOMIC_ACQUIRE) && (copies || __atomic_load_n(&consumers[index].cursor, __ATOMIC_ACQUIRE) == __atomic_load_n(&broadcast.head, __ATOMIC_ACQUIRE)))
+            {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        unsigned int seq = message_seq(buf, size);
+        // A lossy consumer may skip ahead, but never read a damaged message
+        if (index == lossyIndex ? seq == ~0u : seq != expected)
+        {
+            errors[index]++;
+        }
+        expected = (seq + 1) & 0x3FFFF;
+        received[index]++;
+
+        if (index == lossyIndex && received[index] % 2000 == 0 && stalls++ < 100)
+        {
+            struct timespec ts = { 0, 2000000 };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+// Returns nanoseconds per message, from the first publish to the last read
+static double run(int count, int copies)
+{
+    pthread_t producer;
+    pthread_t threads[MAX_CONSUMERS];
+
+    consumerCount = count;
+    producerDone = 0;
+    memset(errors, 0, sizeof(errors));
+    memset(received, 0, sizeof(received));
+
+    for (int c = 0; c < count; c++)
+    {
+        if (copies)
+        {
+            queues[c].head = 0;
+            queues[c].tail = 0;
+        }
+        else
+        {
+            platform_midi_broadcast_subscribe(&broadcast, &consumers[c], c == lossyIndex);
+        }
+    }
+
+    unsigned long long start = now_ns();
+    for (int c = 0; c < count; c++)
+    {
+        pthread_create(&threads[c], NULL, consumer_thread, (void*)(size_t)(c + (copies ? MAX_CONSUMERS : 0)));
+    }
+    pthread_create(&producer, NULL, producer_thread, &copies);
+
+    pthread_join(producer, NULL);
+    for (int c = 0; c < count; c++)
+    {
+        pthread_join(threads[c], NULL);
+    }
+    unsigned long long elapsed = now_ns() - start;
+
+    for (int c = 0; c < count; c++)
+    {
+        if (!copies)
+        {
+            platform_midi_broadcast_unsubscribe(&broadcast, &consumers[c]);
+        }
+        if (c != lossyIndex && (received[c] != MESSAGES || errors[c]))
+        {
+            printf("  consumer %d: received %llu of %d, %llu out of order\n", c, received[c], MESSAGES, errors[c]);
+        }
+    }
+
+    return (double)elapsed / MESSAGES;
+}
+
+int main(int argc, char** argv)
+{
+    if (!platform_midi_broadcast_init(&broadcast, SLOTS))
+    {
+        return 1;
+    }
+    for (int c = 0; c < MAX_CONSUMERS; c++)
+    {
+        queues[c].slots = (struct platform_midi_broadcast_slot*)calloc(SLOTS, sizeof(struct platform_midi_broadcast_slot));
+    }
+
+    printf("%d messages to each of 1-%d consumers, %d slots\n", MESSAGES, MAX_CONSUMERS, SLOTS);
+    for (int count = 1; count <= MAX_CONSUMERS; count *= 2)
+    {
+        double best = 0;
+        double bestCopies = 0;
+
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            double ring = run(count, 0);
+            double copies = run(count, 1);
+
+            if (r == 0 || ring < best)
+            {
+                best = ring;
+            }
+            if (r == 0 || copies < bestCopies)
+            {
+                bestCopies = copies;
+            }
+        }
+
+        printf("%d consumers: broadcast %6.1f ns per message (%5.2f M/s)   %d copies %6.1f ns (%5.2f M/s)\n",
+               count, best, 1e3 / best, count, bestCopies, 1e3 / bestCopies);
+    }
+
+    double without = run(3, 0);
+    lossyIndex = 3;
+    double with = run(4, 0);
+    printf("3 consumers %6.1f ns per message; with a stalling lossy fourth %6.1f ns, which read %llu and lost %llu slots (%llu errors)\n",
+           without, with, received[3], consumers[3].lost, errors[3]);
+
+    for (int c = 0; c < MAX_CONSUMERS; c++)
+    {
+        free(queues[c].slots);
+    }
+    platform_midi_broadcast_deinit(&broadcast);
+    return 0;
+}
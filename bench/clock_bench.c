@@ -0,0 +1,141 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * clock_bench.c
+ *
+ * Sends MIDI clock over the shared-memory backend to a forked follower process,
+ * once paced by sleeping a period after each clock (the way send.c paces) and
+ * once on absolute deadlines, and reports send lateness, accumulated drift and
+ * what the follower recovers
+ *
+ */
+
+#define BPM 240.0
+#define CLOCKS (PLATFORM_MIDI_CLOCK_PPQN * 12)
+
+// Follows clock from the generator until it sees a stop byte
+static void run_follower(int fd)
+{
+    struct platform_midi_shm_options shmOptions = { "clock-bench", NULL, 0 };
+    struct platform_midi_options options = { 0 };
+    options.shm = &shmOptions;
+    options.blocking = 1;
+    struct platform_midi_driver *driver = platform_midi_init_shm("clock_bench-follower", &options);
+    struct platform_midi_clock_follower follower;
+    struct platform_midi_event events[16];
+    unsigned char sysex[256];
+
+    if (!driver)
+    {
+        exit(1);
+    }
+
+    platform_midi_clock_follower_init(&follower);
+
+    // Tell the generator we're attached
+    write(fd, "", 1);
+
+    while (1)
+    {
+        int count = platform_midi_read_events(driver, events, 16, sysex, sizeof(sysex));
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].status == 0xFF)
+            {
+                printf("  follower %7.3f BPM  %s  position %u beats  jitter mean %+6.1f us  stddev %6.1f us  worst %+7.1f us\n",
+                       platform_midi_clock_follower_bpm(&follower),
+                       follower.locked ? "locked  " : "unlocked",
+                       platform_midi_clock_follower_song_position(&follower),
+                       follower.jitter.mean,
+                       platform_midi_clock_stddev(&follower.jitter),
+                       fabs(follower.jitter.min) > fabs(follower.jitter.max) ? follower.jitter.min : follower.jitter.max);
+                platform_midi_deinit(driver);
+                exit(0);
+            }
+
+            platform_midi_clock_follower_feed(&follower, &events[i].status, 1, events[i].timestamp);
+        }
+    }
+}
+
+static void bench_clock(int absolute)
+{
+    struct platform_midi_shm_options shmOptions = { NULL, "clock-bench", 0 };
+    struct platform_midi_options options = { 0 };
+    options.shm = &shmOptions;
+    struct platform_midi_clock_gen gen;
+    unsigned char stop = 0xFF;
+    char ready;
+    int pipefd[2];
+
+    if (0 != pipe(pipefd))
+    {
+        exit(1);
+    }
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        run_follower(pipefd[1]);
+    }
+
+    struct platform_midi_driver *driver = platform_midi_init_shm("clock_bench", &options);
+    if (!driver)
+    {
+        exit(1);
+    }
+
+    read(pipefd[0], &ready, 1);
+
+    platform_midi_clock_gen_init(&gen, driver, BPM);
+    platform_midi_clock_gen_start(&gen);
+    unsigned long long start = gen.origin;
+    double drift = 0;
+
+    for (int i = 0; i < CLOCKS; i++)
+    {
+        unsigned long long deadline = platform_midi_clock_gen_next(&gen);
+
+        if (absolute)
+        {
+            platform_midi_clock_gen_wait(&gen);
+            drift = ((double)platform_midi_clock_now() - (double)deadline) / 1000.0;
+        }
+        else
+        {
+            unsigned long long now = platform_midi_clock_now();
+            platform_midi_write(driver, (const unsigned char*)"\xF8", 1);
+            platform_midi_clock_stats_add(&gen.lateness, now > deadline ? (now - deadline) / 1000.0 : 0);
+            drift = ((double)now - (double)deadline) / 1000.0;
+            gen.ticks++;
+            usleep((useconds_t)(gen.period / 1000));
+        }
+    }
+
+    // drift is how far the last clock ended up from where it belonged
+
+    double elapsed = (platform_midi_clock_now() - start) / 1e9;
+
+    printf("%-8s %d clocks at %.0f BPM in %.3f s: lateness mean %6.1f us  stddev %6.1f us  max %7.1f us  drift %+9.1f us\n",
+           absolute ? "absolute" : "relative", CLOCKS, BPM, elapsed,
+           gen.lateness.mean, platform_midi_clock_stddev(&gen.lateness), gen.lateness.max, drift);
+
+    platform_midi_write(driver, &stop, 1);
+    waitpid(child, NULL, 0);
+    platform_midi_deinit(driver);
+}
+
+int main(int argc, char** argv)
+{
+    bench_clock(0);
+    bench_clock(1);
+    return 0;
+}
@@ -0,0 +1,273 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <algorithm>
+
+/*
+ * coro_bench.cpp
+ *
+ * Compares receiving over the UDP backend with a coroutine parked in
+ * platform_midi::poll_reactor against the loop it replaces, polling
+ * platform_midi_read() on a 1 ms timer: CPU used while idle, and one-way latency
+ * while a forked sender streams timestamped SysEx
+ *
+ */
+
+#define SENDER_PORT 5106
+#define RECEIVER_PORT 5107
+#define IDLE_SECONDS 2
+#define MESSAGES 5000
+#define SEND_INTERVAL_NS 200000ull
+
+// Runs eagerly to completion, with nobody waiting on it
+struct detached
+{
+    struct promise_type
+    {
+        detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { abort(); }
+    };
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// User plus system CPU time of this process
+static double cpu_seconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static struct platform_midi_options udp_options(struct platform_midi_udp_options *udp, unsigned short bindPort, unsigned short peerPort)
+{
+    static const char *backends[] = { "UDP", NULL };
+    struct platform_midi_options options = {};
+
+    *udp = { "127.0.0.1", bindPort, "127.0.0.1", peerPort, 0, 0 };
+    options.backends = backends;
+    options.udp = udp;
+    return options;
+}
+
+// SysEx carrying the send time in 7-bit bytes
+static void encode_time(unsigned char *msg, unsigned long long ns)
+{
+    msg[0] = 0xF0;
+    msg[1] = 0x7D;
+    for (int i = 0; i < 9; i++)
+    {
+        msg[2 + i] = (ns >> (7 * i)) & 0x7F;
+    }
+    msg[11] = 0xF7;
+}
+
+static unsigned long long decode_time(std::span<const unsigned char> msg)
+{
+    unsigned long long ns = 0;
+    for (int i = 0; i < 9; i++)
+    {
+        ns |= (unsigned long long)msg[2 + i] << (7 * i);
+    }
+    return ns;
+}
+
+static detached send_all(platform_midi::driver &midi, bool &done)
+{
+    unsigned char msg[12];
+    unsigned long long deadline = now_ns();
+
+    for (int i = 0; i < MESSAGES; i++)
+    {
+        deadline += SEND_INTERVAL_NS;
+        struct timespec ts = { (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+        encode_time(msg, now_ns());
+        co_await midi.write(msg);
+    }
+
+    unsigned char stop = 0xFF;
+    co_await midi.write(std::span<const unsigned char>(&stop, 1));
+    done = true;
+}
+
+static pid_t start_sender(void)
+{
+    fflush(stdout);
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        struct platform_midi_udp_options udp;
+        struct platform_midi_options options = udp_options(&udp, SENDER_PORT, RECEIVER_PORT);
+        platform_midi::poll_reactor reactor;
+        platform_midi::driver midi(reactor, "coro_bench-sender", &options);
+        bool done = false;
+
+        if (!midi)
+        {
+            exit(1);
+        }
+
+        // Let the receiver get going
+        usleep(100000);
+        send_all(midi, done);
+
+        while (!done)
+        {
+            reactor.run_once(-1);
+        }
+        exit(0);
+    }
+
+    return child;
+}
+
+struct receiver
+{
+    unsigned long long samples[MESSAGES];
+    int count = 0;
+    bool done = false;
+
+    void handle(std::span<const unsigned char> msg)
+    {
+        if (msg.size() == 1 && msg[0] == 0xFF)
+        {
+            done = true;
+        }
+        else if (msg.size() == 12 && msg[0] == 0xF0 && count < MESSAGES)
+        {
+            samples[count++] = now_ns() - decode_time(msg);
+        }
+    }
+
+    void report(const char *name, double cpu, double seconds)
+    {
+        std::sort(samples, samples + count);
+        printf("%-9s under load: received %d/%d  latency p50 %6.1f us  p99 %7.1f us  max %7.1f us  CPU %5.1f%%\n",
+               name, count, MESSAGES,
+               count ? samples[count / 2] / 1e3 : 0,
+               count ? samples[count * 99 / 100] / 1e3 : 0,
+               count ? samples[count - 1] / 1e3 : 0,
+               cpu / seconds * 100);
+    }
+};
+
+static detached receive_all(platform_midi::driver &midi, receiver &r)
+{
+    while (!r.done)
+    {
+        std::span<const unsigned char> msg = co_await midi.next_message();
+        if (msg.empty())
+        {
+            break;
+        }
+        r.handle(msg);
+    }
+}
+
+static void bench_polling(platform_midi::driver &midi)
+{
+    static receiver r;
+    unsigned char buf[256];
+
+    // Idle
+    double cpu = cpu_seconds();
+    unsigned long long end = now_ns() + IDLE_SECONDS * 1000000000ull;
+    while (now_ns() < end)
+    {
+        while (platform_midi_read(midi.get(), buf, sizeof(buf)) > 0)
+        {
+        }
+        usleep(1000);
+    }
+    printf("%-9s idle:       CPU %5.2f%%\n", "polling", (cpu_seconds() - cpu) / IDLE_SECONDS * 100);
+
+    // Under load
+    pid_t child = start_sender();
+    unsigned long long start = now_ns();
+    cpu = cpu_seconds();
+
+    while (!r.done)
+    {
+        int read;
+        while ((read = platform_midi_read(midi.get(), buf, sizeof(buf))) > 0)
+        {
+            r.handle(std::span<const unsigned char>(buf, read));
+        }
+        usleep(1000);
+    }
+
+    r.report("polling", cpu_seconds() - cpu, (now_ns() - start) / 1e9);
+    waitpid(child, NULL, 0);
+}
+
+static void bench_coroutine(platform_midi::poll_reactor &reactor, platform_midi::driver &midi)
+{
+    static receiver r;
+
+    // Idle, with the coroutine parked on the socket
+    receive_all(midi, r);
+
+    double cpu = cpu_seconds();
+    unsigned long long end = now_ns() + IDLE_SECONDS * 1000000000ull;
+    while (now_ns() < end)
+    {
+        reactor.run_once((int)((end - now_ns()) / 1000000ull));
+    }
+    printf("%-9s idle:       CPU %5.2f%%\n", "coroutine", (cpu_seconds() - cpu) / IDLE_SECONDS * 100);
+
+    // Under load
+    pid_t child = start_sender();
+    unsigned long long start = now_ns();
+    cpu = cpu_seconds();
+
+    while (!r.done)
+    {
+        reactor.run_once(-1);
+    }
+
+    r.report("coroutine", cpu_seconds() - cpu, (now_ns() - start) / 1e9);
+    waitpid(child, NULL, 0);
+}
+
+int main(int argc, char** argv)
+{
+    struct platform_midi_udp_options udp;
+    struct platform_midi_options options = udp_options(&udp, RECEIVER_PORT, SENDER_PORT);
+    platform_midi::poll_reactor reactor;
+
+    {
+        platform_midi::driver midi(reactor, "coro_bench", &options);
+        if (!midi)
+        {
+            return 1;
+        }
+        bench_polling(midi);
+    }
+
+    {
+        platform_midi::driver midi(reactor, "coro_bench", &options);
+        if (!midi)
+        {
+            return 1;
+        }
+        bench_coroutine(reactor, midi);
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * dispatch_bench.c
+ *
+ * Writes messages made with the builders to the NULL backend and reads them back,
+ * so that what's measured is the library rather than a device. Built twice by
+ * `make bench`: dispatch_bench calls the backend through the driver's function
+ * pointers, dispatch_bench_static is bound to it with PLATFORM_MIDI_STATIC_BACKEND
+ *
+ */
+
+#define ROUNDS 10
+#define MESSAGES 1000000
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    const char *backends[] = { "NULL", NULL };
+    struct platform_midi_options options = { 0 };
+    unsigned char buf[16];
+    unsigned long long checksum = 0;
+    double best = 0;
+    double bestAvail = 0;
+
+    options.backends = backends;
+    struct platform_midi_driver *driver = platform_midi_init_ex("dispatch_bench", &options);
+    if (!driver)
+    {
+        return 1;
+    }
+
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        unsigned long long start = now_ns();
+
+        for (int i = 0; i < MESSAGES; i++)
+        {
+            platform_midi_write_msg(driver, platform_midi_note_on(i & 0x0F, i & 0x7F, 100));
+
+            if (platform_midi_avail(driver))
+            {
+                checksum += platform_midi_read(driver, buf, sizeof(buf));
+            }
+        }
+
+        double elapsed = (double)(now_ns() - start) / MESSAGES;
+        if (r == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+
+        // Nothing but the call into the backend
+        start = now_ns();
+        for (int i = 0; i < MESSAGES; i++)
+        {
+            checksum += platform_midi_avail(driver);
+        }
+
+        elapsed = (double)(now_ns() - start) / MESSAGES;
+        if (r == 0 || elapsed < bestAvail)
+        {
+            bestAvail = elapsed;
+        }
+    }
+
+#ifdef PLATFORM_MIDI_STATIC_BACKEND
+    const char *mode = "static";
+#else
+    const char *mode = "dynamic";
+#endif
+
+    printf("%-8s write + avail + read: %6.2f ns per message  avail alone: %5.2f ns  (best of %d, checksum %llu)\n",
+           mode, best, bestAvail, ROUNDS, checksum);
+
+    platform_midi_deinit(driver);
+    return 0;
+}
@@ -0,0 +1,172 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * fanout_bench.c
+ *
+ * Measures sending one message to 1..64 ALSA sequencer destinations: once per
+ * destination (an encode and a flush each, like calling platform_midi_write() in
+ * a loop), with platform_midi_write_multi() addressing every destination from one
+ * encoded event, and with one write to the port's subscribers
+ *
+ * Needs a running sequencer (the snd-seq module)
+ *
+ */
+
+#ifdef PLATFORM_MIDI_ALSA
+
+#include <pthread.h>
+
+#define MAX_DESTS 64
+#define ROUNDS 2000
+
+static volatile unsigned long long received;
+static volatile int done;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Counts everything arriving at the sink's ports, so the sender never fills its pool
+static void *run_sink(void *ctx)
+{
+    snd_seq_t *sink = (snd_seq_t*)ctx;
+    snd_seq_event_t *ev;
+
+    while (!done)
+    {
+        if (snd_seq_event_input(sink, &ev) >= 0)
+        {
+            __atomic_add_fetch(&received, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+// Waits for the sink to catch up with what was sent
+static unsigned long long settle(unsigned long long expected)
+{
+    for (int i = 0; i < 1000 && __atomic_load_n(&received, __ATOMIC_RELAXED) < expected; i++)
+    {
+        struct timespec ts = { 0, 1000000 };
+        nanosleep(&ts, NULL);
+    }
+
+    return __atomic_exchange_n(&received, 0, __ATOMIC_RELAXED);
+}
+
+static void report(const char *name, int fanout, unsigned long long start, unsigned long long expected)
+{
+    double elapsed = (now_ns() - start) / 1e3 / ROUNDS;
+    unsigned long long got = settle(expected);
+
+    printf("1 -> %-2d  %-12s %8.2f us per message  %6.0f ns per destination  delivered %llu/%llu\n",
+           fanout, name, elapsed, elapsed * 1e3 / fanout, got, expected);
+}
+
+int main(int argc, char** argv)
+{
+    const char *backends[] = { "ALSA-Sequencer", NULL };
+    struct platform_midi_options options = { 0 };
+    struct platform_midi_dest dests[MAX_DESTS];
+    struct platform_midi_dest subscribers = { PLATFORM_MIDI_DEST_SUBSCRIBERS, 0 };
+    unsigned char msg[3] = { 0x90, 0x3C, 0x7F };
+    snd_seq_t *sink;
+    pthread_t thread;
+
+    options.backends = backends;
+    options.seq_output_pool = 4096;
+    struct platform_midi_driver *driver = platform_midi_init_ex("fanout_bench", &options);
+    if (!driver)
+    {
+        return 1;
+    }
+
+    if (0 != snd_seq_open(&sink, "default", SND_SEQ_OPEN_INPUT, 0))
+    {
+        printf("Failed to open the sink client\n");
+        return 1;
+    }
+
+    snd_seq_set_client_name(sink, "fanout_bench-sink");
+    snd_seq_set_client_pool_input(sink, 4096);
+
+    for (int i = 0; i < MAX_DESTS; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "sink %d", i);
+        dests[i].client = snd_seq_client_id(sink);
+        dests[i].port = snd_seq_create_simple_port(sink, name,
+                                                   SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                                   SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    }
+
+    pthread_create(&thread, NULL, run_sink, sink);
+
+    for (int fanout = 1; fanout <= MAX_DESTS; fanout *= 4)
+    {
+        unsigned long long expected = (unsigned long long)ROUNDS * fanout;
+
+        unsigned long long start = now_ns();
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            for (int i = 0; i < fanout; i++)
+            {
+                platform_midi_write_multi(driver, msg, sizeof(msg), &dests[i], 1);
+            }
+        }
+        report("per-dest", fanout, start, expected);
+
+        start = now_ns();
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            platform_midi_write_multi(driver, msg, sizeof(msg), dests, fanout);
+        }
+        report("write_multi", fanout, start, expected);
+
+        for (int i = 0; i < fanout; i++)
+        {
+            platform_midi_alsa_connect_output(driver, dests[i].client, dests[i].port);
+        }
+
+        start = now_ns();
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            platform_midi_write_multi(driver, msg, sizeof(msg), &subscribers, 1);
+        }
+        report("subscribers", fanout, start, expected);
+
+        for (int i = 0; i < fanout; i++)
+        {
+            snd_seq_disconnect_to(((struct platform_midi_alsa_driver*)driver)->seq_handle,
+                                  ((struct platform_midi_alsa_driver*)driver)->out_port,
+                                  dests[i].client, dests[i].port);
+        }
+    }
+
+    done = 1;
+    // Wake the sink up so it sees we're done
+    platform_midi_write_multi(driver, msg, sizeof(msg), dests, 1);
+    pthread_join(thread, NULL);
+
+    snd_seq_close(sink);
+    platform_midi_deinit(driver);
+    return 0;
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+    printf("The fan-out benchmark needs the ALSA sequencer\n");
+    return 0;
+}
+
+#endif
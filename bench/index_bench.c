@@ -0,0 +1,231 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_index.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * index_bench.c
+ *
+ * Writes an hour of dense controller data (10M events over 16 channels: notes,
+ * CCs, pitch bend, the odd program change and RPN) to an index file, then seeks
+ * to random times with the state written to the NULL backend. For comparison, a
+ * few seeks are done the old way, replaying everything from the start, and the
+ * state each one arrives at is checked against the indexed seek's
+ *
+ */
+
+#define EVENTS 10000000ull
+#define SEEKS 10000
+#define REPLAYS 5
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long*)a;
+    unsigned long long y = *(const unsigned long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+static unsigned int rng = 12345;
+
+static unsigned int next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static int write_file(const char *path)
+{
+    struct platform_midi_index_writer writer;
+    unsigned long long time = 0;
+    unsigned char msg[12];
+
+    if (!platform_midi_index_writer_open(&writer, path))
+    {
+        return 0;
+    }
+
+    unsigned long long count = 0;
+    while (count < EVENTS)
+    {
+        unsigned int r = next_random();
+        unsigned char ch = r & 0x0F;
+        unsigned char value = (r >> 8) & 0x7F;
+        int size = 3;
+
+        // 720 us apart at most, so 10M events come to about an hour
+        time += (r >> 20) % 720;
+
+        switch ((r >> 4) % 16)
+        {
+            case 0: case 1: case 2:
+                msg[0] = 0x90 | ch; msg[1] = 36 + (value % 48); msg[2] = 100;
+                break;
+            case 3: case 4: case 5:
+                msg[0] = 0x80 | ch; msg[1] = 36 + (value % 48); msg[2] = 0;
+                break;
+            case 6:
+                msg[0] = 0xE0 | ch; msg[1] = value; msg[2] = (r >> 16) & 0x7F;
+                break;
+            case 7:
+                if (value < 4)
+                {
+                    msg[0] = 0xC0 | ch; msg[1] = value;
+                    size = 2;
+                }
+                else if (value < 8)
+                {
+                    // Pitch bend sensitivity, as an RPN with data entry
+                    unsigned char rpn[12] = { 0xB0 | ch, 101, 0, 0xB0 | ch, 100, 0, 0xB0 | ch, 6, value, 0xB0 | ch, 38, 0 };
+                    memcpy(msg, rpn, sizeof(rpn));
+                    size = sizeof(rpn);
+                }
+                else
+                {
+                    msg[0] = 0xD0 | ch; msg[1] = value;
+                    size = 2;
+                }
+                break;
+            default:
+                msg[0] = 0xB0 | ch; msg[1] = 1 + (r >> 24) % 16; msg[2] = value;
+                break;
+        }
+
+        if (!platform_midi_index_writer_add(&writer, time, msg, size))
+        {
+            return 0;
+        }
+        count += size == 12 ? 4 : 1;
+    }
+
+    return platform_midi_index_writer_close(&writer);
+}
+
+static int same_state(const struct platform_midi_state *a, const struct platform_midi_state *b)
+{
+    return 0 == memcmp(a, b, offsetof(struct platform_midi_state, changed));
+}
+
+int main(int argc, char** argv)
+{
+    const char *backends[] = { "NULL", NULL };
+    struct platform_midi_options options = { 0 };
+    static struct platform_midi_index index;
+    static struct platform_midi_index replay;
+    static struct platform_midi_state replayed;
+    static unsigned long long samples[SEEKS];
+    unsigned char buf[256];
+
+    options.backends = backends;
+    struct platform_midi_driver *driver = platform_midi_init_ex("index_bench", &options);
+    if (!driver)
+    {
+        return 1;
+    }
+
+    unsigned long long start = now_ns();
+    if (!write_file("index_bench.pmidx"))
+    {
+        return 1;
+    }
+    double writeSeconds = (now_ns() - start) / 1e9;
+
+    start = now_ns();
+    if (!platform_midi_index_open(&index, "index_bench.pmidx"))
+    {
+        return 1;
+    }
+    double openUs = (now_ns() - start) / 1e3;
+
+    printf("%llu events, %.1f minutes: written in %.2f s (%.1f M events/s), %.1f MB with %u checkpoints, open %.1f us\n",
+           index.event_count, index.duration / 60e6, writeSeconds, index.event_count / writeSeconds / 1e6,
+           index.file.size / 1e6, index.entry_count, openUs);
+
+    unsigned long long bytes = 0;
+    for (int i = 0; i < SEEKS; i++)
+    {
+        unsigned long long target = ((unsigned long long)next_random() << 32 | next_random()) % (index.duration + 1);
+
+        start = now_ns();
+        int written = platform_midi_index_seek(&index, target, driver);
+        samples[i] = now_ns() - start;
+
+        if (written < 0)
+        {
+            return 1;
+        }
+        bytes += written;
+
+        while (platform_midi_avail(driver))
+        {
+            platform_midi_read(driver, buf, sizeof(buf));
+        }
+    }
+
+    qsort(samples, SEEKS, sizeof(samples[0]), compare);
+    unsigned long long total = 0;
+    for (int i = 0; i < SEEKS; i++)
+    {
+        total += samples[i];
+    }
+
+    printf("indexed seek, %d random: mean %7.1f us  p50 %7.1f us  p99 %7.1f us  max %7.1f us  (%.0f state bytes written per seek)\n",
+           SEEKS, total / 1e3 / SEEKS, samples[SEEKS / 2] / 1e3, samples[SEEKS * 99 / 100] / 1e3, samples[SEEKS - 1] / 1e3,
+           (double)bytes / SEEKS);
+
+    // The old way: every event from the start, into a state of its own
+    if (!platform_midi_index_open(&replay, "index_bench.pmidx"))
+    {
+        return 1;
+    }
+
+    double replayTotal = 0;
+    for (int i = 0; i < REPLAYS; i++)
+    {
+        unsigned long long target = ((unsigned long long)next_random() << 32 | next_random()) % (index.duration + 1);
+        unsigned long long time;
+        const unsigned char *data;
+        int size;
+
+        start = now_ns();
+        platform_midi_index_seek(&replay, 0, NULL);
+        platform_midi_state_init(&replayed);
+        while ((size = platform_midi_index_next(&replay, &time, &data)) > 0 && time < target)
+        {
+            platform_midi_state_update(&replayed, data, size);
+        }
+        double replayMs = (now_ns() - start) / 1e6;
+        replayTotal += replayMs;
+
+        start = now_ns();
+        platform_midi_index_seek(&index, target, NULL);
+        double seekUs = (now_ns() - start) / 1e3;
+
+        printf("to %5.1f min: replayed in %7.1f ms, indexed seek %6.1f us, states %s\n",
+               target / 60e6, replayMs, seekUs, same_state(&replayed, &index.state) ? "match" : "DIFFER");
+
+        if (!same_state(&replayed, &index.state))
+        {
+            return 1;
+        }
+    }
+
+    printf("replay from the start: mean %.1f ms\n", replayTotal / REPLAYS);
+
+    platform_midi_index_close(&replay);
+    platform_midi_index_close(&index);
+    remove("index_bench.pmidx");
+    platform_midi_deinit(driver);
+    return 0;
+}
@@ -0,0 +1,109 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * jack_bench.c
+ *
+ * Measures how long events sit between the JACK process callback and
+ * platform_midi_read(), by looping the client's output port back into its input
+ *
+ * Build with `make bench JACK=1` and run against a server, e.g. `jackd -d dummy`
+ *
+ */
+
+#ifdef PLATFORM_MIDI_JACK
+
+#include <sched.h>
+#include <string.h>
+
+#define EVENTS 2000
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long*)a;
+    unsigned long long y = *(const unsigned long long*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, unsigned long long *samples, int count)
+{
+    qsort(samples, count, sizeof(samples[0]), compare_ull);
+    printf("%-18s p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name,
+           samples[count / 2] / 1e3, samples[count * 99 / 100] / 1e3, samples[count - 1] / 1e3);
+}
+
+int main(int argc, char** argv)
+{
+    static unsigned long long callbackToRead[EVENTS];
+    static unsigned long long roundTrip[EVENTS];
+    unsigned char msg[3] = { 0x90, 0x3C, 0x7F };
+    unsigned char buf[256];
+    struct platform_midi_jack_event_info info;
+
+    struct platform_midi_driver *driver = platform_midi_init_jack("jack_bench", NULL);
+    if (!driver)
+    {
+        return 1;
+    }
+
+    jack_client_t *client = platform_midi_jack_client(driver);
+    char outName[256];
+    char inName[256];
+    snprintf(outName, sizeof(outName), "%s:out", jack_get_client_name(client));
+    snprintf(inName, sizeof(inName), "%s:in", jack_get_client_name(client));
+
+    if (0 != jack_connect(client, outName, inName))
+    {
+        printf("Failed to connect %s to %s\n", outName, inName);
+        platform_midi_deinit(driver);
+        return 1;
+    }
+
+    printf("%u frames per period at %u Hz (%.2f ms)\n", jack_get_buffer_size(client), jack_get_sample_rate(client),
+           1000.0 * jack_get_buffer_size(client) / jack_get_sample_rate(client));
+
+    for (int i = 0; i < EVENTS; i++)
+    {
+        unsigned long long start = now_ns();
+        int read;
+
+        msg[1] = i & 0x7F;
+        platform_midi_write(driver, msg, sizeof(msg));
+
+        while ((read = platform_midi_read_jack_info(driver, buf, sizeof(buf), &info)) <= 0)
+        {
+            sched_yield();
+        }
+
+        unsigned long long end = now_ns();
+        callbackToRead[i] = end - info.received_ns;
+        roundTrip[i] = end - start;
+    }
+
+    report("callback to read", callbackToRead, EVENTS);
+    report("write to read", roundTrip, EVENTS);
+    printf("Dropped in the process callback: %u\n", platform_midi_jack_dropped(driver));
+
+    platform_midi_deinit(driver);
+    return 0;
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+    printf("Build with `make bench JACK=1` to benchmark the JACK backend\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,249 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_mux.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*
+ * mux_bench.c
+ *
+ * Opens 1 to 256 UDP backend ports on 127.0.0.1 and streams the same total rate
+ * of messages spread across them from a sender thread, which builds the backend's
+ * datagrams itself over one socket. They're received two ways: by the multiplexer
+ * with two workers, and by one thread that sweeps platform_midi_avail() over every
+ * port and sleeps 1 ms whenever a sweep finds nothing. Reported is the CPU time
+ * spent receiving per message, the sender's own excluded. Each message carries a
+ * per-port sequence number, which the handler checks to confirm ordering
+ *
+ */
+
+#define BASE_PORT 5200
+#define MAX_PORTS 256
+#define RATE 20000
+#define SECONDS 1
+#define WORKERS 2
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static unsigned long long cpu_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int portCount;
+static unsigned long long senderCpu;
+static unsigned int expected[MAX_PORTS];
+static unsigned long long received;
+static unsigned long long outOfOrder;
+
+static void handle(void *ctx, int port, const unsigned char *buf, int size)
+{
+    unsigned int seq = ((buf[0] & 0x0F) << 14) | (buf[1] << 7) | buf[2];
+
+    // Only one worker has a port at a time, so its counter needs no lock
+    if (seq != expected[port])
+    {
+        __atomic_add_fetch(&outOfOrder, 1, __ATOMIC_RELAXED);
+    }
+    expected[port] = seq + 1;
+    __atomic_add_fetch(&received, 1, __ATOMIC_RELAXED);
+}
+
+static void put32(unsigned char *out, unsigned int value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+// One message per datagram, round robin over the ports, paced every millisecond
+static void *sender_thread(void *arg)
+{
+    static unsigned int seq[MAX_PORTS];
+    struct sockaddr_in addr;
+    unsigned char dgram[17] = { 'P', 'M', 1, 1 };
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    int port = 0;
+
+    memset(seq, 0, sizeof(seq));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    unsigned long long deadline = now_ns();
+    for (int tick = 0; tick < SECONDS * 1000; tick++)
+    {
+        for (int i = 0; i < RATE / 1000; i++)
+        {
+            unsigned int s = seq[port]++;
+
+            put32(dgram + 4, 0x1000 + port);
+            put32(dgram + 8, s);
+            dgram[12] = 0;
+            dgram[13] = 3;
+            dgram[14] = 0x90 | ((s >> 14) & 0x0F);
+            dgram[15] = (s >> 7) & 0x7F;
+            dgram[16] = s & 0x7F;
+
+            addr.sin_port = htons(BASE_PORT + port);
+            sendto(sock, dgram, sizeof(dgram), 0, (struct sockaddr*)&addr, sizeof(addr));
+            port = (port + 1) % portCount;
+        }
+
+        deadline += 1000000ull;
+        struct timespec ts = { (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+
+    close(sock);
+    senderCpu = cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+static struct platform_midi_driver *open_port(int i)
+{
+    struct platform_midi_udp_options udpOptions = { "127.0.0.1", (unsigned short)(BASE_PORT + i), "127.0.0.1", 5004, 0, 0 };
+    struct platform_midi_options options = { 0 };
+    options.udp = &udpOptions;
+    return platform_midi_init_udp("mux_bench", &options);
+}
+
+// Returns receiving CPU nanoseconds per message. mode 0 sweeps, 1 multiplexes
+static double run(struct platform_midi_driver **drivers, int mode, unsigned long long *wakeups)
+{
+    struct platform_midi_mux mux;
+    pthread_t sender;
+    unsigned char buf[256];
+    unsigned long long total = (unsigned long long)RATE * SECONDS;
+
+    memset(expected, 0, sizeof(expected));
+    received = 0;
+    outOfOrder = 0;
+    *wakeups = 0;
+
+    if (mode == 1)
+    {
+        if (!platform_midi_mux_init(&mux, WORKERS, handle, NULL))
+        {
+            exit(1);
+        }
+        for (int i = 0; i < portCount; i++)
+        {
+            platform_midi_mux_add(&mux, drivers[i]);
+        }
+        platform_midi_mux_start(&mux);
+    }
+
+    unsigned long long cpuStart = cpu_ns(CLOCK_PROCESS_CPUTIME_ID);
+    pthread_create(&sender, NULL, sender_thread, NULL);
+
+    unsigned long long giveUp = now_ns() + (SECONDS + 2) * 1000000000ull;
+    while (__atomic_load_n(&received, __ATOMIC_RELAXED) < total && now_ns() < giveUp)
+    {
+        if (mode == 1)
+        {
+            usleep(10000);
+            continue;
+        }
+
+        int found = 0;
+        for (int i = 0; i < portCount; i++)
+        {
+            while (platform_midi_avail(drivers[i]))
+            {
+                int read = platform_midi_read(drivers[i], buf, sizeof(buf));
+                if (read <= 0)
+                {
+                    break;
+                }
+                handle(NULL, i, buf, read);
+                found = 1;
+            }
+        }
+
+        (*wakeups)++;
+        if (!found)
+        {
+            usleep(1000);
+        }
+    }
+
+    pthread_join(sender, NULL);
+    unsigned long long cpu = cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - cpuStart - senderCpu;
+
+    if (mode == 1)
+    {
+        struct platform_midi_mux_stats stats;
+        platform_midi_mux_get_stats(&mux, &stats);
+        *wakeups = stats.wakeups;
+        platform_midi_mux_deinit(&mux);
+    }
+
+    if (received < total || outOfOrder)
+    {
+        printf("  received %llu of %llu, %llu out of order\n", received, total, outOfOrder);
+    }
+
+    return received ? (double)cpu / received : 0;
+}
+
+int main(int argc, char** argv)
+{
+    static struct platform_midi_driver *drivers[MAX_PORTS];
+    static const int counts[] = { 1, 4, 16, 64, 256 };
+
+    // Without a line from each port as it opens
+    fflush(stdout);
+    int savedStdout = dup(1);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, 1);
+
+    for (int i = 0; i < MAX_PORTS; i++)
+    {
+        drivers[i] = open_port(i);
+        if (!drivers[i])
+        {
+            return 1;
+        }
+    }
+
+    fflush(stdout);
+    dup2(savedStdout, 1);
+    close(devNull);
+    close(savedStdout);
+
+    printf("%d messages/s for %d s over 1-%d UDP ports, %d workers\n", RATE, SECONDS, MAX_PORTS, WORKERS);
+    for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++)
+    {
+        unsigned long long sweeps;
+        unsigned long long wakeups;
+
+        portCount = counts[c];
+        double sweep = run(drivers, 0, &sweeps);
+        double mux = run(drivers, 1, &wakeups);
+
+        printf("%3d ports: avail sweep %6.2f us CPU per message (%6llu sweeps)   multiplexer %6.2f us (%6llu wakeups)\n",
+               portCount, sweep / 1e3, sweeps, mux / 1e3, wakeups);
+    }
+
+    for (int i = 0; i < MAX_PORTS; i++)
+    {
+        platform_midi_deinit(drivers[i]);
+    }
+    return 0;
+}
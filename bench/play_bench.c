@@ -0,0 +1,193 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_play.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * play_bench.c
+ *
+ * Writes a multi-megabyte format 1 file (a tempo track plus 15 tracks of
+ * sixteenth notes in running status) and plays it to the NULL backend: how long
+ * opening takes, how many events per second the decode and merge can keep up
+ * with, and how late writes go out when played in real time
+ *
+ */
+
+#define TRACKS 16
+#define NOTES_PER_TRACK 40000
+#define DIVISION 480
+#define SIXTEENTH (DIVISION / 4)
+#define REALTIME_SECONDS 3
+#define SPIN_NS 2000000ull
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void put32(FILE *file, unsigned int value)
+{
+    fputc(value >> 24, file);
+    fputc(value >> 16, file);
+    fputc(value >> 8, file);
+    fputc(value, file);
+}
+
+static int put_vlq(FILE *file, unsigned int value)
+{
+    unsigned char bytes[4];
+    int count = 0;
+
+    do
+    {
+        bytes[count++] = value & 0x7F;
+        value >>= 7;
+    } while (value);
+
+    for (int i = count - 1; i >= 0; i--)
+    {
+        fputc(bytes[i] | (i ? 0x80 : 0), file);
+    }
+
+    return count;
+}
+
+// tempo in microseconds per quarter note, changed a little every bar to exercise the tempo map
+static void write_file(const char *path, unsigned int tempo)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        exit(1);
+    }
+
+    fwrite("MThd", 1, 4, file);
+    put32(file, 6);
+    fputc(0, file); fputc(1, file);
+    fputc(0, file); fputc(TRACKS, file);
+    fputc(DIVISION >> 8, file); fputc(DIVISION & 0xFF, file);
+
+    for (int t = 0; t < TRACKS; t++)
+    {
+        long lengthPos;
+        unsigned int length = 0;
+
+        fwrite("MTrk", 1, 4, file);
+        lengthPos = ftell(file);
+        put32(file, 0);
+
+        if (t == 0)
+        {
+            for (int bar = 0; bar < NOTES_PER_TRACK / 16; bar++)
+            {
+                unsigned int barTempo = tempo + (bar % 8) * (tempo / 64);
+                length += put_vlq(file, bar ? DIVISION * 4 : 0);
+                fputc(0xFF, file); fputc(0x51, file); fputc(3, file);
+                fputc(barTempo >> 16, file); fputc(barTempo >> 8, file); fputc(barTempo, file);
+                length += 6;
+            }
+        }
+        else
+        {
+            fputc(0, file);
+            fputc(0x90 | (t - 1), file);
+            fputc(36 + t, file);
+            fputc(100, file);
+            length += 4;
+
+            for (int n = 0; n < NOTES_PER_TRACK; n++)
+            {
+                // Off (as velocity 0) after half a sixteenth, then the next on, in running status
+                length += put_vlq(file, SIXTEENTH / 2);
+                fputc(36 + t + (n % 12), file);
+                fputc(0, file);
+                length += put_vlq(file, SIXTEENTH / 2);
+                fputc(36 + t + ((n + 1) % 12), file);
+                fputc(100, file);
+                length += 4;
+            }
+        }
+
+        fputc(0, file); fputc(0xFF, file); fputc(0x2F, file); fputc(0, file);
+        length += 4;
+
+        long end = ftell(file);
+        fseek(file, lengthPos, SEEK_SET);
+        put32(file, length);
+        fseek(file, end, SEEK_SET);
+    }
+
+    fclose(file);
+}
+
+int main(int argc, char** argv)
+{
+    const char *backends[] = { "NULL", NULL };
+    struct platform_midi_options options = { 0 };
+    struct platform_midi_player player;
+
+    options.backends = backends;
+    struct platform_midi_driver *driver = platform_midi_init_ex("play_bench", &options);
+    if (!driver)
+    {
+        return 1;
+    }
+
+    // At 1 microsecond per quarter note everything is due at once, which measures decoding alone
+    write_file("play_bench_fast.mid", 1);
+    write_file("play_bench.mid", 500000);
+
+    unsigned long long start = now_ns();
+    if (!platform_midi_player_open(&player, driver, "play_bench_fast.mid"))
+    {
+        return 1;
+    }
+    double openUs = (now_ns() - start) / 1e3;
+
+    start = now_ns();
+    while (!platform_midi_player_done(&player))
+    {
+        if (platform_midi_player_poll(&player) < 0)
+        {
+            return 1;
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    printf("%.1f MB, %d tracks: open %.1f us, played %llu events in %.3f s, %.2f M events/s\n",
+           player.file.size / 1e6, player.track_count, openUs, player.events, seconds, player.events / seconds / 1e6);
+    platform_midi_player_close(&player);
+
+    // Real time, for the first few seconds, sleeping right up to each deadline and then waking early to spin
+    for (int spin = 0; spin < 2; spin++)
+    {
+        if (!platform_midi_player_open(&player, driver, "play_bench.mid"))
+        {
+            return 1;
+        }
+
+        player.spin = spin ? SPIN_NS : 0;
+        unsigned long long end = player.origin + REALTIME_SECONDS * 1000000000ull;
+        while (platform_midi_player_next(&player) < end)
+        {
+            if (platform_midi_player_wait(&player) < 0)
+            {
+                return 1;
+            }
+        }
+
+        printf("real time, %d s, spin %4llu us: %llu events in %llu writes, lateness mean %6.1f us  stddev %6.1f us  max %7.1f us\n",
+               REALTIME_SECONDS, player.spin / 1000, player.events, player.lateness.count,
+               player.lateness.mean, platform_midi_clock_stddev(&player.lateness), player.lateness.max);
+        platform_midi_player_close(&player);
+    }
+
+    remove("play_bench_fast.mid");
+    remove("play_bench.mid");
+    platform_midi_deinit(driver);
+    return 0;
+}
@@ -0,0 +1,247 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * queue_bench.c
+ *
+ * Pushes messages into a backend's input queue and pops them out again, in
+ * bursts that half fill it, as a backend's callback and platform_midi_read()
+ * would. Once with the queue as it is, short messages packed into one word each,
+ * and once with the layout it replaced (an offset and length per packet, and
+ * every message's bytes in the arena), copied in below. Both have the same
+ * number of packets and arena bytes. Run with three byte messages only, and with
+ * a 64 byte SysEx among every 32. Every popped message is checked. Timestamping
+ * each packet costs the same either way and is shown taken off as well
+ *
+ */
+
+#define MESSAGES 5000000
+#define ROUNDS 9
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// The previous layout
+struct old_packet_info
+{
+    unsigned int offset;
+    unsigned int length;
+    unsigned int timestamp;
+};
+
+struct old_ringbuf
+{
+    unsigned char buffer[PLATFORM_MIDI_EVENT_BUFFER_SIZE];
+    struct old_packet_info packets[PLATFORM_MIDI_EVENT_BUFFER_ITEMS];
+    unsigned int read_pos;
+    unsigned int write_pos;
+    unsigned int buffer_offset;
+    unsigned int buffer_end;
+    struct platform_midi_realtime_lane realtime;
+};
+
+static void old_push_packet(struct old_ringbuf *buf, unsigned char *data, unsigned int length)
+{
+    unsigned int timestamp = platform_midi_event_time();
+
+    if (length == 1 && data[0] >= 0xF8)
+    {
+        platform_midi_realtime_push(&buf->realtime, data[0], timestamp);
+        return;
+    }
+
+    if ((buf->write_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS == buf->read_pos)
+    {
+        buf->buffer_offset = (buf->buffer_offset + buf->packets[buf->read_pos].length) % PLATFORM_MIDI_EVENT_BUFFER_SIZE;
+        buf->read_pos = (buf->read_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS;
+    }
+
+    buf->packets[buf->write_pos].offset = buf->buffer_end;
+    buf->packets[buf->write_pos].length = length;
+    buf->packets[buf->write_pos].timestamp = timestamp;
+
+    if (buf->buffer_end + length <= PLATFORM_MIDI_EVENT_BUFFER_SIZE)
+    {
+        memcpy(&buf->buffer[buf->buffer_end], data, length);
+    }
+    else
+    {
+        unsigned int startLen = PLATFORM_MIDI_EVENT_BUFFER_SIZE - buf->buffer_end;
+        memcpy(&buf->buffer[buf->buffer_end], data, startLen);
+        memcpy(buf->buffer, data + startLen, length - startLen);
+    }
+
+    buf->buffer_end = (buf->buffer_end + length) % PLATFORM_MIDI_EVENT_BUFFER_SIZE;
+    buf->write_pos = (buf->write_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS;
+}
+
+static int old_pop_packet(struct old_ringbuf *buf, unsigned char *out, unsigned int size)
+{
+    struct platform_midi_realtime_msg realtime;
+
+    if (size > 0 && platform_midi_realtime_pop(&buf->realtime, &realtime))
+    {
+        out[0] = realtime.status;
+        return 1;
+    }
+
+    if (buf->read_pos == buf->write_pos)
+    {
+        return 0;
+    }
+
+    struct old_packet_info *packet = &buf->packets[buf->read_pos];
+    int toCopy = (size < packet->length) ? size : packet->length;
+
+    if (packet->offset + packet->length > PLATFORM_MIDI_EVENT_BUFFER_SIZE)
+    {
+        int endCopy = (packet->offset + toCopy <= PLATFORM_MIDI_EVENT_BUFFER_SIZE) ? toCopy : PLATFORM_MIDI_EVENT_BUFFER_SIZE - packet->offset;
+        int startCopy = packet->length - endCopy;
+
+        memcpy(out, &buf->buffer[packet->offset], endCopy);
+        memcpy(out + endCopy, buf->buffer, startCopy);
+    }
+    else
+    {
+        memcpy(out, &buf->buffer[packet->offset], toCopy);
+    }
+
+    buf->buffer_offset = (buf->buffer_offset + packet->length) % PLATFORM_MIDI_EVENT_BUFFER_SIZE;
+    buf->read_pos = (buf->read_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS;
+
+    return toCopy;
+}
+
+static int make_message(unsigned int seq, int sysex, unsigned char *msg)
+{
+    if (sysex && seq % 32 == 31)
+    {
+        msg[0] = 0xF0;
+        memset(msg + 1, seq & 0x7F, 62);
+        msg[63] = 0xF7;
+        return 64;
+    }
+
+    msg[0] = 0x90 | (seq & 0x0F);
+    msg[1] = (seq >> 4) & 0x7F;
+    msg[2] = (seq >> 11) & 0x7F;
+    return 3;
+}
+
+// Returns nanoseconds per message pushed and popped, or 0 if a message came out wrong
+static double run(int old, int sysex)
+{
+    static struct old_ringbuf oldBuf;
+    static struct platform_midi_ringbuf buf;
+    static unsigned char messages[64][64];
+    static int sizes[64];
+    const int burst = PLATFORM_MIDI_EVENT_BUFFER_ITEMS / 2;
+    unsigned char out[256];
+    unsigned long long checksum = 0;
+    unsigned long long expected = 0;
+
+    memset(&oldBuf, 0, sizeof(oldBuf));
+    platform_midi_realtime_init(&oldBuf.realtime);
+    platform_midi_buffer_init(&buf);
+
+    for (int i = 0; i < 64; i++)
+    {
+        sizes[i] = make_message(i * 977, sysex, messages[i]);
+    }
+
+    unsigned long long start = now_ns();
+    for (unsigned int seq = 0; seq < MESSAGES; seq += burst)
+    {
+        for (int i = 0; i < burst; i++)
+        {
+            int m = (seq + i) & 63;
+
+            if (old)
+            {
+                old_push_packet(&oldBuf, messages[m], sizes[m]);
+            }
+            else
+            {
+                platform_midi_push_packet(&buf, messages[m], sizes[m]);
+            }
+        }
+
+        for (int i = 0; i < burst; i++)
+        {
+            int m = (seq + i) & 63;
+            int size = old ? old_pop_packet(&oldBuf, out, sizeof(out)) : platform_midi_pop_packet(&buf, out, sizeof(out));
+
+            checksum += size + out[0] + out[size - 1];
+            expected += sizes[m] + messages[m][0] + messages[m][sizes[m] - 1];
+        }
+    }
+    unsigned long long elapsed = now_ns() - start;
+
+    return checksum == expected ? (double)elapsed / MESSAGES : 0;
+}
+
+// What taking each packet's timestamp costs, which both pay
+static double timestamp_ns(void)
+{
+    volatile unsigned int sink = 0;
+
+    unsigned long long start = now_ns();
+    for (int i = 0; i < MESSAGES; i++)
+    {
+        sink += platform_midi_event_time();
+    }
+    return (double)(now_ns() - start) / MESSAGES;
+}
+
+int main(int argc, char** argv)
+{
+    printf("%d packets, %d arena bytes: old queue %zu bytes, packed queue %zu bytes\n",
+           PLATFORM_MIDI_EVENT_BUFFER_ITEMS, PLATFORM_MIDI_EVENT_BUFFER_SIZE,
+           sizeof(struct old_ringbuf), sizeof(struct platform_midi_ringbuf));
+    printf("per 3 byte message: old %zu bytes, packed %zu bytes\n",
+           sizeof(struct old_packet_info) + 3, sizeof(struct platform_midi_packet_info));
+
+    for (int sysex = 0; sysex < 2; sysex++)
+    {
+        double best[2] = { 0, 0 };
+        double timestamp = 0;
+
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            double ns = timestamp_ns();
+            if (r == 0 || ns < timestamp)
+            {
+                timestamp = ns;
+            }
+
+            for (int old = 0; old < 2; old++)
+            {
+                double ns = run(old, sysex);
+
+                if (ns == 0)
+                {
+                    printf("%s queue returned the wrong messages\n", old ? "old" : "packed");
+                    return 1;
+                }
+                if (r == 0 || ns < best[old])
+                {
+                    best[old] = ns;
+                }
+            }
+        }
+
+        printf("%-22s old %5.2f ns per message (%6.1f M/s)   packed %5.2f ns (%6.1f M/s)   less the timestamp: %5.2f vs %5.2f ns\n",
+               sysex ? "with 1 in 32 SysEx:" : "3 byte messages:", best[1], 1e3 / best[1], best[0], 1e3 / best[0],
+               best[1] - timestamp, best[0] - timestamp);
+    }
+
+    return 0;
+}
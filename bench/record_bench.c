@@ -0,0 +1,168 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * record_bench.c
+ *
+ * Streams notes through the NULL backend at a steady rate and times every
+ * platform_midi_read() while they're recorded: not at all, by writing each
+ * message to a file from the tap as it's read (what piping mididump amounts to),
+ * and with platform_midi_recorder, whose file is locked for a while halfway
+ * through to stand in for a disk stall
+ *
+ */
+
+#define SECONDS 3
+#define BATCH 20
+#define BATCH_INTERVAL_NS 1000000ull
+#define STALL_MS 1000
+#define SAMPLES (SECONDS * 1000 * BATCH)
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long*)a;
+    unsigned long long y = *(const unsigned long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Writes each message as text and flushes it, from the reading thread
+static void direct_tap_fn(void *ctx, int direction, const unsigned char *buf, int size)
+{
+    FILE *file = (FILE*)ctx;
+
+    fprintf(file, "%u", platform_midi_event_time());
+    for (int i = 0; i < size; i++)
+    {
+        fprintf(file, " %02X", buf[i]);
+    }
+    fprintf(file, "\n");
+    fflush(file);
+}
+
+static unsigned long long samples[SAMPLES];
+
+// mode 0: nothing attached, 1: direct writes, 2: recorder
+static void bench_record(int mode)
+{
+    static const char *names[] = { "none", "direct", "recorder" };
+    const char *backends[] = { "NULL", NULL };
+    struct platform_midi_options options = { 0 };
+    static struct platform_midi_recorder recorder;
+    struct platform_midi_recorder_stats stats;
+    struct platform_midi_tap direct;
+    FILE *file = NULL;
+    unsigned char buf[16];
+    int count = 0;
+    int stalled = 0;
+    unsigned long long worstInStall = 0;
+
+    options.backends = backends;
+    struct platform_midi_driver *driver = platform_midi_init_ex("record_bench", &options);
+    if (!driver)
+    {
+        exit(1);
+    }
+
+    if (mode == 1)
+    {
+        file = fopen("record_bench.txt", "w");
+        if (!file)
+        {
+            exit(1);
+        }
+
+        direct.fn = direct_tap_fn;
+        direct.ctx = file;
+        direct.directions = PLATFORM_MIDI_TAP_INPUT;
+        platform_midi_add_tap(driver, &direct);
+    }
+    else if (mode == 2)
+    {
+        if (!platform_midi_recorder_open(&recorder, "record_bench.mid", 1))
+        {
+            exit(1);
+        }
+        platform_midi_recorder_attach(&recorder, driver);
+    }
+
+    unsigned long long start = now_ns();
+    unsigned long long deadline = start;
+
+    for (int batch = 0; batch < SECONDS * 1000; batch++)
+    {
+        unsigned long long elapsed = now_ns() - start;
+
+        // Hold the recorder's file for a while, so its writer can't get anything out
+        if (mode == 2 && !stalled && elapsed > SECONDS * 1000000000ull / 3)
+        {
+            flockfile(recorder.file);
+            stalled = 1;
+        }
+        else if (mode == 2 && stalled == 1 && elapsed > SECONDS * 1000000000ull / 3 + STALL_MS * 1000000ull)
+        {
+            funlockfile(recorder.file);
+            stalled = 2;
+        }
+
+        for (int i = 0; i < BATCH; i++)
+        {
+            platform_midi_write_msg(driver, platform_midi_note_on(0, (batch + i) & 0x7F, 100));
+
+            unsigned long long before = now_ns();
+            platform_midi_read(driver, buf, sizeof(buf));
+            samples[count] = now_ns() - before;
+
+            if (stalled == 1 && samples[count] > worstInStall)
+            {
+                worstInStall = samples[count];
+            }
+            count++;
+        }
+
+        deadline += BATCH_INTERVAL_NS;
+        struct timespec ts = { (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+
+    qsort(samples, count, sizeof(samples[0]), compare);
+    printf("%-8s %d reads at %d/s: p50 %6.2f us  p99 %6.2f us  p99.9 %7.2f us  max %8.2f us\n",
+           names[mode], count, BATCH * 1000,
+           samples[count / 2] / 1e3, samples[count * 99 / 100] / 1e3, samples[count * 999 / 1000] / 1e3, samples[count - 1] / 1e3);
+
+    if (mode == 1)
+    {
+        platform_midi_remove_tap(driver, &direct);
+        fclose(file);
+        remove("record_bench.txt");
+    }
+    else if (mode == 2)
+    {
+        platform_midi_recorder_detach(&recorder, driver);
+        platform_midi_recorder_get_stats(&recorder, &stats);
+        printf("         during the %d ms stall: worst read %.2f us, queue peaked at %u of %u bytes; %llu recorded, %llu dropped\n",
+               STALL_MS, worstInStall / 1e3, stats.queue_max_depth, stats.queue_size, stats.messages, stats.dropped);
+        platform_midi_recorder_close(&recorder);
+        remove("record_bench.mid");
+    }
+
+    platform_midi_deinit(driver);
+}
+
+int main(int argc, char** argv)
+{
+    bench_record(0);
+    bench_record(1);
+    bench_record(2);
+    return 0;
+}
@@ -0,0 +1,227 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_route.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * route_bench.c
+ *
+ * Routes a stream of notes, controllers and pitch bend from two inputs to four
+ * NULL backend outputs: a keyboard split (transposed low half, velocity scaled
+ * upper half), controllers to a third output, everything from the second input
+ * merged into the first output, and everything to a monitor. Once with the
+ * compiled router, and once the usual way, branching on each message and writing
+ * it straight out. The outputs are drained after every batch either way
+ *
+ */
+
+#define BATCH 256
+#define BATCHES 20000
+#define ROUNDS 5
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct platform_midi_driver *outputs[4];
+
+static void drain(void)
+{
+    unsigned char buf[4096];
+
+    for (int o = 0; o < 4; o++)
+    {
+        while (platform_midi_avail(outputs[o]))
+        {
+            platform_midi_read(outputs[o], buf, sizeof(buf));
+        }
+    }
+}
+
+static void send3(int output, unsigned char status, unsigned char data1, unsigned char data2)
+{
+    unsigned char msg[3] = { status, data1, data2 };
+    platform_midi_write(outputs[output], msg, 3);
+}
+
+// The same routes, written out by hand
+static int route_by_hand(int input, const unsigned char *buf, int size)
+{
+    int sent = 0;
+
+    for (int i = 0; i < size; i += 3)
+    {
+        unsigned char status = buf[i];
+        unsigned char type = status & 0xF0;
+        unsigned char channel = status & 0x0F;
+        unsigned char note = buf[i + 1];
+        unsigned char velocity = buf[i + 2];
+
+        if (input == 0)
+        {
+            if ((type == 0x80 || type == 0x90) && channel == 0)
+            {
+                if (note < 60)
+                {
+                    if (note >= 12)
+                    {
+                        send3(0, type | 1, note - 12, velocity);
+                        sent++;
+                    }
+                }
+                else
+                {
+                    if (type == 0x90 && velocity)
+                    {
+                        int scaled = (int)(velocity * 0.8f + 10 + 0.5f);
+                        velocity = scaled > 127 ? 127 : scaled;
+                    }
+                    send3(1, status, note, velocity);
+                    sent++;
+                }
+            }
+            else if (type == 0xB0 || type == 0xE0)
+            {
+                send3(2, status, note, velocity);
+                sent++;
+            }
+        }
+        else
+        {
+            send3(0, status, note, velocity);
+            sent++;
+        }
+
+        send3(3, status, note, velocity);
+        sent++;
+    }
+
+    return sent;
+}
+
+int main(int argc, char** argv)
+{
+    const char *backends[] = { "NULL", NULL };
+    struct platform_midi_options options = { 0 };
+    static struct platform_midi_router router;
+    static unsigned char input[2][BATCH * 3];
+    unsigned long long routed = 0;
+    unsigned long long byHand = 0;
+    double best = 0;
+    double bestByHand = 0;
+
+    options.backends = backends;
+    platform_midi_router_init(&router);
+
+    for (int i = 0; i < 2; i++)
+    {
+        platform_midi_router_add_input(&router, platform_midi_init_ex("route_bench_in", &options));
+    }
+    for (int o = 0; o < 4; o++)
+    {
+        outputs[o] = platform_midi_init_ex("route_bench_out", &options);
+        if (!outputs[o])
+        {
+            return 1;
+        }
+        platform_midi_router_add_output(&router, outputs[o]);
+    }
+
+    struct platform_midi_route routes[5] = { 0 };
+    // Lower half of channel 1 an octave down, on channel 2
+    routes[0].output = 0;
+    routes[0].channels = 1 << 0;
+    routes[0].types = PLATFORM_MIDI_ROUTE_NOTES;
+    routes[0].note_max = 59;
+    routes[0].transpose = -12;
+    routes[0].channel = 2;
+    // Upper half with a softer velocity curve
+    routes[1].output = 1;
+    routes[1].channels = 1 << 0;
+    routes[1].types = PLATFORM_MIDI_ROUTE_NOTES;
+    routes[1].note_min = 60;
+    routes[1].note_max = 127;
+    routes[1].velocity_scale = 0.8f;
+    routes[1].velocity_offset = 10;
+    routes[2].output = 2;
+    routes[2].types = PLATFORM_MIDI_ROUTE_CONTROL_CHANGE | PLATFORM_MIDI_ROUTE_PITCH_BEND;
+    // The second input merged in
+    routes[3].input = 1;
+    routes[3].output = 0;
+    routes[4].input = PLATFORM_MIDI_ROUTE_ANY;
+    routes[4].output = 3;
+
+    unsigned long long start = now_ns();
+    if (!platform_midi_router_compile(&router, routes, 5))
+    {
+        return 1;
+    }
+    double compileUs = (now_ns() - start) / 1e3;
+
+    srand(1);
+    for (int i = 0; i < 2; i++)
+    {
+        for (int m = 0; m < BATCH; m++)
+        {
+            static const unsigned char types[] = { 0x90, 0x80, 0x90, 0x80, 0xB0, 0xE0 };
+            unsigned char *msg = input[i] + m * 3;
+
+            msg[0] = types[rand() % 6] | (rand() % 3);
+            msg[1] = 24 + rand() % 80;
+            msg[2] = 1 + rand() % 127;
+        }
+    }
+
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        routed = 0;
+        start = now_ns();
+        for (int b = 0; b < BATCHES; b++)
+        {
+            routed += platform_midi_router_process(&router, 0, input[0], sizeof(input[0]));
+            routed += platform_midi_router_process(&router, 1, input[1], sizeof(input[1]));
+            platform_midi_router_flush(&router);
+            drain();
+        }
+        double elapsed = (now_ns() - start) / 1e9;
+        if (r == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+
+        byHand = 0;
+        start = now_ns();
+        for (int b = 0; b < BATCHES; b++)
+        {
+            byHand += route_by_hand(0, input[0], sizeof(input[0]));
+            byHand += route_by_hand(1, input[1], sizeof(input[1]));
+            drain();
+        }
+        elapsed = (now_ns() - start) / 1e9;
+        if (r == 0 || elapsed < bestByHand)
+        {
+            bestByHand = elapsed;
+        }
+    }
+
+    double messages = 2.0 * BATCH * BATCHES;
+    printf("compiled %d routes into %d actions in %.1f us\n", 5, router.action_count, compileUs);
+    printf("router:  %5.2f M messages/s in, %5.2f M/s out (%llu sent)\n", messages / best / 1e6, routed / best / 1e6, routed);
+    printf("by hand: %5.2f M messages/s in, %5.2f M/s out (%llu sent)\n", messages / bestByHand / 1e6, byHand / bestByHand / 1e6, byHand);
+
+    for (int i = 0; i < router.input_count; i++)
+    {
+        platform_midi_deinit(router.inputs[i]);
+    }
+    for (int o = 0; o < 4; o++)
+    {
+        platform_midi_deinit(outputs[o]);
+    }
+    platform_midi_router_deinit(&router);
+    return 0;
+}
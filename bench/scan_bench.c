@@ -0,0 +1,155 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * scan_bench.c
+ *
+ * Measures status-byte scanning and framing throughput in GB/s,
+ * comparing the vectorized scanners to the plain byte loop
+ *
+ */
+
+#define BUFFER_SIZE (64 * 1024 * 1024)
+#define ROUNDS 8
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills buf with SysEx dumps of the given payload length, back to back
+static void fill_sysex(unsigned char *buf, size_t len, size_t payload)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        buf[i++] = 0xF0;
+        for (size_t j = 0; j < payload && i < len; j++)
+        {
+            buf[i++] = (unsigned char)(rand() & 0x7F);
+        }
+        if (i < len)
+        {
+            buf[i++] = 0xF7;
+        }
+    }
+}
+
+typedef size_t (*find_fn)(const unsigned char*, size_t);
+
+static void bench_find(const char *name, find_fn fn, const unsigned char *buf, size_t len)
+{
+    size_t found = 0;
+    double start = now_sec();
+
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        size_t i = 0;
+        while (i < len)
+        {
+            i += fn(buf + i, len - i);
+            if (i < len)
+            {
+                found++;
+                i++;
+            }
+        }
+    }
+
+    double elapsed = now_sec() - start;
+    printf("  find     %-8s %8.2f GB/s  (%zu status bytes)\n", name, (double)len * ROUNDS / elapsed / 1e9, found / ROUNDS);
+}
+
+typedef size_t (*find_all_fn)(const unsigned char*, size_t, unsigned int*, size_t);
+
+static void bench_find_all(const char *name, find_all_fn fn, const unsigned char *buf, size_t len, unsigned int *positions)
+{
+    size_t found = 0;
+    double start = now_sec();
+
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        found = fn(buf, len, positions, len);
+    }
+
+    double elapsed = now_sec() - start;
+    printf("  find_all %-8s %8.2f GB/s  (%zu status bytes)\n", name, (double)len * ROUNDS / elapsed / 1e9, found);
+}
+
+static int count_frame(void *ctx, const unsigned char *msg, unsigned int len)
+{
+    (*(size_t*)ctx)++;
+    return 0;
+}
+
+static void bench_framer(const unsigned char *buf, size_t len)
+{
+    struct platform_midi_framer framer;
+    size_t messages = 0;
+    double start = now_sec();
+
+    platform_midi_framer_init(&framer);
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        // Feed in kernel-read sized pieces, as the RawMIDI driver does
+        for (size_t i = 0; i < len; i += 4096)
+        {
+            platform_midi_framer_feed(&framer, buf + i, (len - i < 4096) ? len - i : 4096, count_frame, &messages);
+        }
+    }
+
+    double elapsed = now_sec() - start;
+    printf("  framer   %-8s %8.2f GB/s  (%zu messages)\n", platform_midi_scan_impl(), (double)len * ROUNDS / elapsed / 1e9, messages / ROUNDS);
+}
+
+static void run(const char *label, const unsigned char *buf, size_t len, unsigned int *positions)
+{
+    printf("%s\n", label);
+    bench_find("scalar", platform_midi_scan_status_scalar, buf, len);
+#ifdef PLATFORM_MIDI_SCAN_X86
+    bench_find("sse2", platform_midi_scan_status_sse2, buf, len);
+    if (__builtin_cpu_supports("avx2"))
+    {
+        bench_find("avx2", platform_midi_scan_status_avx2, buf, len);
+    }
+#endif
+    bench_find_all("scalar", platform_midi_scan_status_all_scalar, buf, len, positions);
+#ifdef PLATFORM_MIDI_SCAN_X86
+    bench_find_all("sse2", platform_midi_scan_status_all_sse2, buf, len, positions);
+    if (__builtin_cpu_supports("avx2"))
+    {
+        bench_find_all("avx2", platform_midi_scan_status_all_avx2, buf, len, positions);
+    }
+#endif
+    bench_framer(buf, len);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned char *buf = malloc(BUFFER_SIZE);
+    unsigned int *positions = malloc(sizeof(unsigned int) * BUFFER_SIZE);
+
+    if (!buf || !positions)
+    {
+        printf("Failed to allocate buffers\n");
+        return 1;
+    }
+
+    printf("Selected scanner: %s\n", platform_midi_scan_impl());
+
+    fill_sysex(buf, BUFFER_SIZE, 4096);
+    run("4 KiB SysEx dumps:", buf, BUFFER_SIZE, positions);
+
+    fill_sysex(buf, BUFFER_SIZE, 64);
+    run("64 byte SysEx messages:", buf, BUFFER_SIZE, positions);
+
+    free(positions);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,223 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * shm_bench.c
+ *
+ * Measures one-way hop latency and throughput of the shared-memory backend
+ * between two processes, by bouncing messages off a forked echo process
+ *
+ */
+
+#define ROUND_TRIPS 200000
+#define STREAM_MESSAGES 10000000
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long*)a;
+    unsigned long long y = *(const unsigned long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Echoes every message from ping back on pong until it sees a stop byte
+static void run_echo(int blocking)
+{
+    struct platform_midi_shm_options shmOptions = { "bench-ping", "bench-pong", 0 };
+    struct platform_midi_options options = { 0 };
+    options.shm = &shmOptions;
+    struct platform_midi_driver *driver = platform_midi_init_shm("shm_bench-echo", &options);
+    unsigned char buf[256];
+
+    if (!driver)
+    {
+        exit(1);
+    }
+
+    while (1)
+    {
+        int read = platform_midi_read(driver, buf, sizeof(buf));
+        if (read > 0)
+        {
+            if (buf[0] == 0xFF)
+            {
+                break;
+            }
+
+            platform_midi_write(driver, buf, read);
+        }
+        else if (blocking)
+        {
+            platform_midi_shm_wait(driver, -1);
+        }
+    }
+
+    platform_midi_deinit(driver);
+    exit(0);
+}
+
+static void bench_latency(int blocking)
+{
+    static unsigned long long samples[ROUND_TRIPS];
+    struct platform_midi_shm_options shmOptions = { "bench-pong", "bench-ping", 0 };
+    struct platform_midi_options options = { 0 };
+    options.shm = &shmOptions;
+    struct platform_midi_driver *driver = platform_midi_init_shm("shm_bench", &options);
+    unsigned char msg[3] = { 0x90, 0x3C, 0x7F };
+    unsigned char buf[256];
+
+    if (!driver)
+    {
+        exit(1);
+    }
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        run_echo(blocking);
+    }
+
+    // Let the echo process attach before anything is sent
+    usleep(100000);
+
+    for (int i = 0; i < ROUND_TRIPS; i++)
+    {
+        unsigned long long start = now_ns();
+        platform_midi_write(driver, msg, sizeof(msg));
+
+        while (platform_midi_read(driver, buf, sizeof(buf)) <= 0)
+        {
+            if (blocking)
+            {
+                platform_midi_shm_wait(driver, -1);
+            }
+        }
+
+        samples[i] = now_ns() - start;
+    }
+
+    buf[0] = 0xFF;
+    platform_midi_write(driver, buf, 1);
+    waitpid(child, NULL, 0);
+    platform_midi_deinit(driver);
+
+    qsort(samples, ROUND_TRIPS, sizeof(samples[0]), compare_ull);
+    printf("%-8s one-way hop: p50 %6.0f ns  p99 %6.0f ns  max %8.0f ns\n",
+           blocking ? "futex" : "spin",
+           samples[ROUND_TRIPS / 2] / 2.0,
+           samples[ROUND_TRIPS * 99 / 100] / 2.0,
+           samples[ROUND_TRIPS - 1] / 2.0);
+}
+
+static void bench_throughput(void)
+{
+    struct platform_midi_shm_options writerShm = { NULL, "bench-stream", 0 };
+    struct platform_midi_shm_options readerShm = { "bench-stream", NULL, 0 };
+    struct platform_midi_options writerOptions = { 0 };
+    struct platform_midi_options readerOptions = { 0 };
+    writerOptions.shm = &writerShm;
+    writerOptions.queue_size = 1 << 20;
+    readerOptions.shm = &readerShm;
+    readerOptions.queue_size = 1 << 20;
+    unsigned char msg[3] = { 0x90, 0x3C, 0x7F };
+    unsigned char buf[256];
+    int pipefd[2];
+
+    if (0 != pipe(pipefd))
+    {
+        exit(1);
+    }
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        struct platform_midi_driver *reader = platform_midi_init_shm("shm_bench-reader", &readerOptions);
+        unsigned long long received = 0;
+        unsigned long long lost = 0;
+
+        if (!reader)
+        {
+            exit(1);
+        }
+
+        // Tell the writer we're attached
+        write(pipefd[1], "", 1);
+
+        while (1)
+        {
+            int read = platform_midi_read(reader, buf, sizeof(buf));
+            if (read > 0)
+            {
+                if (buf[0] == 0xFF)
+                {
+                    break;
+                }
+                received++;
+            }
+            else if (read < 0)
+            {
+                lost++;
+            }
+        }
+
+        printf("stream   received %llu of %d messages, %llu overruns\n", received, STREAM_MESSAGES, lost);
+        platform_midi_deinit(reader);
+        exit(0);
+    }
+
+    struct platform_midi_driver *writer = platform_midi_init_shm("shm_bench-writer", &writerOptions);
+    if (!writer)
+    {
+        exit(1);
+    }
+
+    read(pipefd[0], buf, 1);
+
+    unsigned long long start = now_ns();
+    for (int i = 0; i < STREAM_MESSAGES; i++)
+    {
+        platform_midi_write(writer, msg, sizeof(msg));
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    buf[0] = 0xFF;
+    platform_midi_write(writer, buf, 1);
+    waitpid(child, NULL, 0);
+    platform_midi_deinit(writer);
+
+    printf("stream   writer: %.1f M msg/s\n", STREAM_MESSAGES / elapsed / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    // Spinning against a process that can't run at the same time just burns timeslices
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 1)
+    {
+        bench_latency(0);
+    }
+    else
+    {
+        printf("spin     skipped, needs more than one CPU\n");
+    }
+    bench_latency(1);
+    bench_throughput();
+
+    platform_midi_shm_unlink("bench-ping");
+    platform_midi_shm_unlink("bench-pong");
+    platform_midi_shm_unlink("bench-stream");
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * udp_bench.c
+ *
+ * Measures the UDP backend over 127.0.0.1: one-way latency by ping-pong with a
+ * forked echo process, and streaming throughput and loss with and without batching
+ *
+ */
+
+#define PING_PORT 5104
+#define PONG_PORT 5105
+#define ROUND_TRIPS 20000
+#define STREAM_MESSAGES 2000000
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long*)a;
+    unsigned long long y = *(const unsigned long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Waits for input on the driver for up to timeoutMs
+static void wait_input(struct platform_midi_driver *driver, int timeoutMs)
+{
+    int fds[4];
+    struct pollfd pfds[4];
+    int count = platform_midi_fds(driver, fds, 4);
+
+    for (int i = 0; i < count; i++)
+    {
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+    }
+
+    poll(pfds, count, timeoutMs);
+}
+
+static struct platform_midi_driver *open_udp(unsigned short bindPort, unsigned short peerPort, unsigned int latencyUs)
+{
+    struct platform_midi_udp_options udpOptions = { "127.0.0.1", bindPort, "127.0.0.1", peerPort, latencyUs, 0 };
+    struct platform_midi_options options = { 0 };
+    options.udp = &udpOptions;
+    struct platform_midi_driver *driver = platform_midi_init_udp("udp_bench", &options);
+
+    if (!driver)
+    {
+        exit(1);
+    }
+
+    return driver;
+}
+
+static void bench_latency(void)
+{
+    static unsigned long long samples[ROUND_TRIPS];
+    unsigned char msg[3] = { 0x90, 0x3C, 0x7F };
+    unsigned char buf[256];
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        struct platform_midi_driver *echo = open_udp(PONG_PORT, PING_PORT, 0);
+        while (1)
+        {
+            int read = platform_midi_read(echo, buf, sizeof(buf));
+            if (read > 0)
+            {
+                if (buf[0] == 0xFF)
+                {
+                    break;
+                }
+                platform_midi_write(echo, buf, read);
+            }
+            else
+            {
+                wait_input(echo, -1);
+            }
+        }
+
+        platform_midi_deinit(echo);
+        exit(0);
+    }
+
+    struct platform_midi_driver *driver = open_udp(PING_PORT, PONG_PORT, 0);
+    usleep(100000);
+
+    int done = 0;
+    for (int i = 0; i < ROUND_TRIPS; i++)
+    {
+        unsigned long long start = now_ns();
+        platform_midi_write(driver, msg, sizeof(msg));
+
+        while (platform_midi_read(driver, buf, sizeof(buf)) <= 0)
+        {
+            wait_input(driver, 100);
+            if (now_ns() - start > 1000000000ull)
+            {
+                break;
+            }
+        }
+
+        samples[done++] = now_ns() - start;
+    }
+
+    buf[0] = 0xFF;
+    platform_midi_write(driver, buf, 1);
+    waitpid(child, NULL, 0);
+    platform_midi_deinit(driver);
+
+    qsort(samples, done, sizeof(samples[0]), compare_ull);
+    printf("one-way latency:  p50 %6.1f us  p99 %6.1f us  max %8.1f us\n",
+           samples[done / 2] / 2e3, samples[done * 99 / 100] / 2e3, samples[done - 1] / 2e3);
+}
+
+static void bench_throughput(unsigned int latencyUs)
+{
+    unsigned char msg[3] = { 0x90, 0x3C, 0x7F };
+    unsigned char buf[256];
+    int pipefd[2];
+
+    if (0 != pipe(pipefd))
+    {
+        exit(1);
+    }
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        struct platform_midi_driver *receiver = open_udp(PONG_PORT, PING_PORT, 0);
+        struct platform_midi_udp_stats stats;
+        unsigned long long received = 0;
+        unsigned long long first = 0;
+        unsigned long long last = 0;
+
+        write(pipefd[1], "", 1);
+
+        while (1)
+        {
+            int read = platform_midi_read(receiver, buf, sizeof(buf));
+            if (read > 0)
+            {
+                last = now_ns();
+                if (!first)
+                {
+                    first = last;
+                }
+                received++;
+            }
+            else if (received && now_ns() - last > 500000000ull)
+            {
+                break;
+            }
+            else
+            {
+                wait_input(receiver, 100);
+            }
+        }
+
+        platform_midi_udp_get_stats(receiver, &stats);
+        printf("batch %5u us:   received %.1f M msg/s, %llu of %d messages in %llu datagrams, %llu datagrams lost\n",
+               latencyUs, received / ((last - first) / 1e9) / 1e6, received, STREAM_MESSAGES,
+               stats.received_datagrams, stats.lost);
+
+        platform_midi_deinit(receiver);
+        exit(0);
+    }
+
+    struct platform_midi_driver *sender = open_udp(PING_PORT, PONG_PORT, latencyUs);
+    read(pipefd[0], buf, 1);
+
+    for (int i = 0; i < STREAM_MESSAGES; i++)
+    {
+        platform_midi_write(sender, msg, sizeof(msg));
+    }
+    platform_midi_udp_flush(sender);
+
+    waitpid(child, NULL, 0);
+    platform_midi_deinit(sender);
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
+
+int main(int argc, char** argv)
+{
+    bench_latency();
+    bench_throughput(0);
+    bench_throughput(1000);
+
+    return 0;
+}
@@ -2,17 +2,152 @@
 #include "platform_midi.h"
 #include <stdio.h>
 #include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+
+#if defined(WINDOWS) || defined(__WINDOWS__) || defined(_WINDOWS) \
+                     || defined(_WIN32)      || defined(_WIN64) \
+                     || defined(WIN32)       || defined(WIN64) \
+                     || defined(__WIN32__)   || defined(__CYGWIN__) \
+                     || defined(__MINGW32__) || defined(__MINGW64__) \
+                     || defined(__TOS_WIN__)
+#include <windows.h>
+#include <io.h>
+#define MIDIDUMP_WINDOWS 1
+#else
+#include <unistd.h>
+#include <poll.h>
+#endif
 
 /*
  * mididump.c
  *
  * Listens for and prints out MIDI messages
  *
+ * Usage: mididump [--text|--binary|--json|--stats] [--output <file>] [limit]
+ *
+ * Output is collected in a large buffer by hand-rolled formatters and written out
+ * with a single write() whenever the buffer fills up or the input goes idle, so the
+ * dump keeps up with a busy bus.
+ *
+ * --binary writes an 8-byte "PMDUMP01" header followed by one record per message:
+ *   8 bytes  timestamp in nanoseconds (CLOCK_MONOTONIC), little-endian
+ *   2 bytes  message length, little-endian
+ *   n bytes  message data
+ * which midireplay plays back through platform_midi_write()
+ *
+ * --json writes one JSON object per line
+ *
+ * --stats prints message counts per type and channel once a second instead of each message
+ *
  */
 
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+// Flush once this much is buffered, leaving room for the largest single record
+#define OUTPUT_FLUSH_SIZE (OUTPUT_BUFFER_SIZE - 16 * 1024)
+#define PACKET_SIZE 4096
+#define MAX_FDS 8
+
+#define BINARY_MAGIC "PMDUMP01"
+
+enum output_mode
+{
+    MODE_TEXT,
+    MODE_BINARY,
+    MODE_JSON,
+    MODE_STATS,
+};
+
+static char out_buf[OUTPUT_BUFFER_SIZE];
+static size_t out_len = 0;
+static int out_fd = 1;
+
+static void out_flush(void)
+{
+    size_t written = 0;
+
+    while (written < out_len)
+    {
+        int result = write(out_fd, out_buf + written, out_len - written);
+        if (result <= 0)
+        {
+            break;
+        }
+        written += result;
+    }
+
+    out_len = 0;
+}
+
+static void out_char(char c)
+{
+    out_buf[out_len++] = c;
+}
+
+static void out_str(const char *str)
+{
+    while (*str)
+    {
+        out_buf[out_len++] = *str++;
+    }
+}
+
+static void out_bytes(const void *data, size_t len)
+{
+    memcpy(out_buf + out_len, data, len);
+    out_len += len;
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void out_hex2(unsigned char value)
+{
+    out_buf[out_len++] = hex_digits[value >> 4];
+    out_buf[out_len++] = hex_digits[value & 0x0F];
+}
+
+// Writes value padded to at least width characters with pad
+static void out_uint(unsigned long long value, int width, char pad)
+{
+    char digits[24];
+    int count = 0;
+
+    do
+    {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+
+    for (int i = count; i < width; i++)
+    {
+        out_buf[out_len++] = pad;
+    }
+
+    while (count)
+    {
+        out_buf[out_len++] = digits[--count];
+    }
+}
+
+static unsigned long long now_ns(void)
+{
+#ifdef MIDIDUMP_WINDOWS
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (unsigned long long)(count.QuadPart / freq.QuadPart) * 1000000000ull
+        + (unsigned long long)(count.QuadPart % freq.QuadPart) * 1000000000ull / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
 unsigned char get_running_status(unsigned char status, unsigned char *running_status)
 {
-    if (0 != (status & 0xF0))
+    if (0 != (status & 0x80))
     {
         if (status > 0xF7)
         {
@@ -62,12 +197,74 @@ static const char *note_names[] = {
     "B",
 };
 
-void write_note_name(char *out, unsigned char note)
+static const char *system_names[] = {
+    "SysEx Start",
+    "Quarter Frame",
+    "Song Position Pointer",
+    "Song Select",
+    "Reserved",
+    "Reserved",
+    "Tune Request",
+    "SysEx End",
+    "Clock",
+    "Tick",
+    "Start",
+    "Continue",
+    "Stop",
+    "Reserved",
+    "Active Sense",
+    "Reset",
+};
+
+void write_note_name(unsigned char note)
 {
     const char *note_name = note_names[note % 12];
     int octave = (note / 12) - 2;
 
-    sprintf(out, "%2s%d%s", note_name, octave, ((octave < 0) ? "" : " "));
+    if (!note_name[1])
+    {
+        out_char(' ');
+    }
+    out_str(note_name);
+
+    if (octave < 0)
+    {
+        out_char('-');
+        out_uint(-octave, 0, ' ');
+    }
+    else
+    {
+        out_uint(octave, 0, ' ');
+        out_char(' ');
+    }
+}
+
+// Writes the status and data bytes as hex, e.g. ">90 3c 7f"
+static void write_hex_prefix(unsigned char rsc, unsigned char status, const unsigned char *data, int dataLen)
+{
+    out_char(rsc);
+    out_hex2(status);
+
+    for (int i = 0; i < 2; i++)
+    {
+        out_char(' ');
+        if (i < dataLen)
+        {
+            out_hex2(data[i]);
+        }
+        else
+        {
+            out_str("  ");
+        }
+    }
+
+    out_str("  ");
+}
+
+static void write_channel(unsigned char status)
+{
+    out_str(" Chan ");
+    out_uint((status & 0x0F) + 1, 2, ' ');
 }
 
 void print_midi_packet(unsigned char *packet, unsigned int size)
@@ -75,12 +272,11 @@ void print_midi_packet(unsigned char *packet, unsigned int size)
     static unsigned char running_status = 0;
     unsigned char status;
     unsigned char *data;
-    char note_name[16];
     const char *status_name;
 
     if (!size)
     {
-        printf("<Empty Packet>\n");
+        out_str("<Empty Packet>\n");
         return;
     }
 
@@ -89,7 +285,9 @@ void print_midi_packet(unsigned char *packet, unsigned int size)
     if (!status)
     {
         // Error
-        printf("Invalid status byte: %02hhx\n", packet[0]);
+        out_str("Invalid status byte: ");
+        out_hex2(packet[0]);
+        out_char('\n');
         return;
     }
     if (status != packet[0])
@@ -104,15 +302,12 @@ void print_midi_packet(unsigned char *packet, unsigned int size)
     }
 
 #define RSC ((status == packet[0]) ? ' ' : '>')
-#define CH (status & 0x0F)
     switch (status & 0xF0)
     {
         case 0x80: // Note Off
         case 0x90: // Note On
         case 0xA0: // After-Touch
         {
-            write_note_name(note_name, data[0]);
-
             if (0x80 == (status & 0xF0))
             {
                 status_name = "Note OFF";
@@ -121,194 +316,477 @@ void print_midi_packet(unsigned char *packet, unsigned int size)
             {
                 status_name = "Note ON ";
             }
-            else if( 0xA0 == (status  &0xF0))
+            else
             {
                 status_name = "AfterTouch";
             }
 
-            printf("%c%02hhx %02hhx %02hhx  %s Chan %2hhd  Note %s  Velocity %03u\n", RSC, status, data[0], data[1], status_name, (status & 0x0F) + 1, note_name, data[1]);
+            write_hex_prefix(RSC, status, data, 2);
+            out_str(status_name);
+            write_channel(status);
+            out_str("  Note ");
+            write_note_name(data[0]);
+            out_str("  Velocity ");
+            out_uint(data[1], 3, '0');
             break;
         }
 
         case 0xB0: // Controller
         {
-            printf("%c%02hhx %02hhx %02hhx  Controller Chan %2hhd  %hhu = %hhu\n", RSC, status, data[0], data[1], (status & 0x0F) + 1, data[0], data[1]);
+            write_hex_prefix(RSC, status, data, 2);
+            out_str("Controller");
+            write_channel(status);
+            out_str("  ");
+            out_uint(data[0], 0, ' ');
+            out_str(" = ");
+            out_uint(data[1], 0, ' ');
             break;
         }
 
         case 0xC0: // Program Select
         {
-            printf("%c%02hhx %02hhx     Program Select Chan %2hhd  Program %hhu\n", RSC, status, data[0], (status & 0x0F) + 1, data[0]);
+            write_hex_prefix(RSC, status, data, 1);
+            out_str("Program Select");
+            write_channel(status);
+            out_str("  Program ");
+            out_uint(data[0], 0, ' ');
             break;
         }
 
         case 0xD0: // Channel Pressure
         {
-            printf("%c%02hhx %02hhx     Channel Pressure Chan %2hhd  Pressure %03hhu\n", RSC, status, data[0], (status & 0x0F) + 1, data[0]);
+            write_hex_prefix(RSC, status, data, 1);
+            out_str("Channel Pressure");
+            write_channel(status);
+            out_str("  Pressure ");
+            out_uint(data[0], 3, '0');
             break;
         }
 
         case 0xE0: // Pitch wheel
         {
-            printf("%c%02hhx %02hhx %02hhx  Pitch Wheel Chan %2hhd  Pitch %+03dc\n", RSC, status, data[0], data[1], (status & 0x0F) + 1, (-0x2000 + (((data[1] & 0x7F) << 7) | (data[0] & 0x7F))) * 100 / 0x1FFF);
+            int cents = (-0x2000 + (((data[1] & 0x7F) << 7) | (data[0] & 0x7F))) * 100 / 0x1FFF;
+
+            write_hex_prefix(RSC, status, data, 2);
+            out_str("Pitch Wheel");
+            write_channel(status);
+            out_str("  Pitch ");
+            out_char((cents < 0) ? '-' : '+');
+            out_uint((cents < 0) ? -cents : cents, 2, '0');
+            out_char('c');
             break;
         }
 
         case 0xF0: // System
         {
+            unsigned int dataLen = platform_midi_msg_length(status);
+            dataLen = dataLen ? dataLen - 1 : 0;
+
+            write_hex_prefix(' ', status, data, dataLen);
+            out_str(system_names[status & 0x0F]);
+
             switch (status & 0x0F)
             {
-                case 0x0: // SysEx Start
-                {
-                    printf(" %02hhx        SysEx Start\n", status);
-                    break;
-                }
-
                 case 0x1: // MTC Quarter Frame
-                {
-                    printf(" %02hhx %02hhx     Quarter Frame %03hhu\n", status, data[0], data[0]);
+                    out_char(' ');
+                    out_uint(data[0], 3, '0');
                     break;
-                }
 
                 case 0x2: // Song Position Pointer
-                {
-                    printf(" %02hhx %02hhx %02hhx  Song Position Pointer Beat %03d\n", status, data[0], data[1], ((data[1] & 0x7F) << 7) | (data[0] & 0x7F));
+                    out_str(" Beat ");
+                    out_uint(((data[1] & 0x7F) << 7) | (data[0] & 0x7F), 3, '0');
                     break;
-                }
 
                 case 0x3: // Song Select
-                {
-                    printf(" %02hhx %02hhx     Song Select Song %03u\n", status, data[0], data[0]);
+                    out_str(" Song ");
+                    out_uint(data[0], 3, '0');
                     break;
-                }
 
-                case 0x4: // RESERVED
-                {
-                    printf(" %02hhx        Reserved\n", status);
+                default:
                     break;
-                }
+            }
+            break;
+        }
+    }
+#undef RSC
 
-                case 0x5: // RESERVED
-                {
-                    printf(" %02hhx        Reserved\n", status);
-                    break;
-                }
+    out_char('\n');
+}
 
-                case 0x6: // Tune Request
-                {
-                    printf(" %02hhx        Tune Request\n", status);
-                    break;
-                }
+static void write_binary_record(unsigned long long timestamp, const unsigned char *packet, unsigned int size)
+{
+    unsigned char header[10];
 
-                case 0x7: // SysEx End
-                {
-                    printf(" %02hhx        SysEx End\n", status);
-                    break;
-                }
+    for (int i = 0; i < 8; i++)
+    {
+        header[i] = (timestamp >> (i * 8)) & 0xFF;
+    }
+    header[8] = size & 0xFF;
+    header[9] = (size >> 8) & 0xFF;
 
-                case 0x8: // Clock
-                {
-                    printf(" %02hhx        Clock\n", status);
-                    break;
-                }
+    out_bytes(header, sizeof(header));
+    out_bytes(packet, size);
+}
 
-                case 0x9: // Tick
-                {
-                    printf(" %02hhx        Tick\n", status);
-                    break;
-                }
+static const char *json_type_names[] = {
+    "note_off",
+    "note_on",
+    "poly_pressure",
+    "control_change",
+    "program_change",
+    "channel_pressure",
+    "pitch_bend",
+    "system",
+};
 
-                case 0xA: // Start
-                {
-                    printf(" %02hhx        Start\n", status);
-                    break;
-                }
+static void write_json_record(unsigned long long timestamp, const unsigned char *packet, unsigned int size)
+{
+    out_str("{\"t\":");
+    out_uint(timestamp, 0, ' ');
 
-                case 0xB: // Continue
-                {
-                    printf(" %02hhx        Continue\n", status);
-                    break;
-                }
+    if (size && (packet[0] & 0x80))
+    {
+        out_str(",\"type\":\"");
+        if (packet[0] == 0xF0)
+        {
+            out_str("sysex");
+        }
+        else if (packet[0] >= 0xF8)
+        {
+            out_str("realtime");
+        }
+        else
+        {
+            out_str(json_type_names[(packet[0] >> 4) & 0x07]);
+        }
+        out_char('"');
 
-                case 0xC: // Stop
-                {
-                    printf(" %02hhx        Stop\n", status);
-                    break;
-                }
+        if (packet[0] < 0xF0)
+        {
+            out_str(",\"ch\":");
+            out_uint((packet[0] & 0x0F) + 1, 0, ' ');
+        }
+    }
 
-                case 0xD: // RESERVED
-                {
-                    printf(" %02hhx        Reserved\n", status);
-                    break;
-                }
+    out_str(",\"data\":\"");
+    for (unsigned int i = 0; i < size; i++)
+    {
+        out_hex2(packet[i]);
+    }
+    out_str("\"}\n");
+}
 
-                case 0xE: // Active Sense
-                {
-                    printf(" %02hhx        Active Sense\n", status);
-                    break;
-                }
+enum stats_type
+{
+    STATS_NOTE_OFF,
+    STATS_NOTE_ON,
+    STATS_POLY_PRESSURE,
+    STATS_CONTROLLER,
+    STATS_PROGRAM,
+    STATS_CHANNEL_PRESSURE,
+    STATS_PITCH_BEND,
+    STATS_SYSEX,
+    STATS_SYSTEM_COMMON,
+    STATS_REALTIME,
+    STATS_TYPE_COUNT,
+};
 
-                case 0xF: // Reset
-                {
-                    printf(" %02hhx        Reset\n", status);
-                    break;
-                }
+static const char *stats_type_names[] = {
+    "noteoff",
+    "noteon",
+    "polyat",
+    "cc",
+    "program",
+    "chanat",
+    "bend",
+    "sysex",
+    "common",
+    "realtime",
+};
+
+struct stats
+{
+    unsigned long long types[STATS_TYPE_COUNT];
+    unsigned long long channels[16];
+    unsigned long long bytes;
+    unsigned long long total;
+};
+
+static void count_stats(struct stats *stats, const unsigned char *packet, unsigned int size)
+{
+    static unsigned char running_status = 0;
+    unsigned char status = size ? get_running_status(packet[0], &running_status) : 0;
+
+    stats->total++;
+    stats->bytes += size;
+
+    if (status >= 0xF8)
+    {
+        stats->types[STATS_REALTIME]++;
+    }
+    else if (status == 0xF0)
+    {
+        stats->types[STATS_SYSEX]++;
+    }
+    else if (status >= 0xF1)
+    {
+        stats->types[STATS_SYSTEM_COMMON]++;
+    }
+    else if (status >= 0x80)
+    {
+        stats->types[(status >> 4) & 0x07]++;
+        stats->channels[status & 0x0F]++;
+    }
+}
+
+static void print_stats(struct stats *stats, unsigned long long seconds)
+{
+    out_char('[');
+    out_uint(seconds, 0, ' ');
+    out_str("s] msgs ");
+    out_uint(stats->total, 0, ' ');
+    out_str(" bytes ");
+    out_uint(stats->bytes, 0, ' ');
+
+    for (int i = 0; i < STATS_TYPE_COUNT; i++)
+    {
+        if (stats->types[i])
+        {
+            out_char(' ');
+            out_str(stats_type_names[i]);
+            out_char(' ');
+            out_uint(stats->types[i], 0, ' ');
+        }
+    }
+
+    out_str(" |");
+    for (int i = 0; i < 16; i++)
+    {
+        if (stats->channels[i])
+        {
+            out_str(" ch");
+            out_uint(i + 1, 0, ' ');
+            out_char(' ');
+            out_uint(stats->channels[i], 0, ' ');
+        }
+    }
+
+    out_char('\n');
+    memset(stats, 0, sizeof(*stats));
+}
+
+// Blocks until the driver has input or timeout_ms passes (-1 waits forever). Returns -1 if
+// one of its descriptors is in error or hung up, which won't clear by polling again
+static int wait_for_input(struct platform_midi_driver *driver, const int *fds, int fdCount, int timeout_ms)
+{
+#ifndef MIDIDUMP_WINDOWS
+    if (fdCount > 0)
+    {
+        struct pollfd pfds[MAX_FDS];
+
+        for (int i = 0; i < fdCount; i++)
+        {
+            pfds[i].fd = fds[i];
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+
+        poll(pfds, fdCount, timeout_ms);
+
+        for (int i = 0; i < fdCount; i++)
+        {
+            if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+            {
+                fprintf(stderr, "Error waiting for input: the device went away\n");
+                return -1;
             }
-            break;
+        }
+        return 0;
+    }
+#endif
+
+    // No descriptors to block on, so check back shortly
+    while (!platform_midi_avail(driver) && timeout_ms != 0)
+    {
+#ifdef MIDIDUMP_WINDOWS
+        Sleep(1);
+#else
+        usleep(1000);
+#endif
+        if (timeout_ms > 0)
+        {
+            timeout_ms--;
         }
     }
+    return 0;
 }
 
 int main(int argc, char** argv)
 {
-    unsigned char packet[16];
+    unsigned char packet[PACKET_SIZE];
     char* end;
     int read = 0;
+    int failed = 0;
     int limit = 0;
     int packets = 0;
+    int fds[MAX_FDS];
+    int fdCount = 0;
+    enum output_mode mode = MODE_TEXT;
+    const char *output = NULL;
+    struct stats stats;
     struct platform_midi_driver *driver = NULL;
 
-    if (argc > 1)
+    for (int i = 1; i < argc; i++)
     {
-        limit = strtol(argv[1], &end, 10);
-        if (end == argv[1])
+        if (!strcmp(argv[i], "--text"))
         {
-            printf("Invalid arg for limit: %s\n", argv[1]);
-            return 1;
+            mode = MODE_TEXT;
+        }
+        else if (!strcmp(argv[i], "--binary"))
+        {
+            mode = MODE_BINARY;
         }
+        else if (!strcmp(argv[i], "--json"))
+        {
+            mode = MODE_JSON;
+        }
+        else if (!strcmp(argv[i], "--stats"))
+        {
+            mode = MODE_STATS;
+        }
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            limit = strtol(argv[i], &end, 10);
+            if (end == argv[i])
+            {
+                printf("Usage: %s [--text|--binary|--json|--stats] [--output <file>] [limit]\n", argv[0]);
+                return 1;
+            }
 
-	printf("Reading %d MIDI packets...\n", limit);
+            fprintf(stderr, "Reading %d MIDI packets...\n", limit);
+        }
+    }
+
+    if (output)
+    {
+        out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0)
+        {
+            fprintf(stderr, "Could not open %s for writing\n", output);
+            return 1;
+        }
     }
 
+#ifdef MIDIDUMP_WINDOWS
+    _setmode(out_fd, _O_BINARY);
+#endif
+
     if (!(driver = platform_midi_init("mididump")))
     {
-	printf("Initialization failed!\n");
-	return 1;
+        fprintf(stderr, "Initialization failed!\n");
+        return 1;
+    }
+
+    // The library prints through stdio, make sure that's out before our own writes
+    fflush(stdout);
+
+    fdCount = platform_midi_fds(driver, fds, MAX_FDS);
+    memset(&stats, 0, sizeof(stats));
+
+    if (mode == MODE_BINARY)
+    {
+        out_str(BINARY_MAGIC);
     }
 
-    while (1)
+    unsigned long long start = now_ns();
+    unsigned long long seconds = 0;
+
+    while (!failed && (limit == 0 || packets < limit))
     {
-        while (platform_midi_avail(driver))
+        while ((limit == 0 || packets < limit) && (read = platform_midi_read(driver, packet, sizeof(packet))) != 0)
         {
-            read = platform_midi_read(driver, packet, sizeof(packet));
-            if (read > 0)
+            if (read < 0)
             {
-                print_midi_packet(packet, read);
-                packets++;
+                fprintf(stderr, "Error reading: %d\n", read);
+                failed = 1;
+                break;
             }
-            else if (read < 0)
+
+            unsigned long long timestamp = now_ns();
+
+            switch (mode)
             {
-                printf("Error reading: %d\n", read);
-                break;
+                case MODE_TEXT:
+                    print_midi_packet(packet, read);
+                    break;
+
+                case MODE_BINARY:
+                    write_binary_record(timestamp, packet, read);
+                    break;
+
+                case MODE_JSON:
+                    write_json_record(timestamp, packet, read);
+                    break;
+
+                case MODE_STATS:
+                    count_stats(&stats, packet, read);
+
+                    // Busy input may never leave this loop, so the interval is checked here too
+                    if ((timestamp - start) / 1000000000ull > seconds)
+                    {
+                        seconds = (timestamp - start) / 1000000000ull;
+                        print_stats(&stats, seconds);
+                        out_flush();
+                    }
+                    break;
             }
 
-            if (limit != 0 && packets > limit)
+            packets++;
+
+            if (out_len >= OUTPUT_FLUSH_SIZE)
             {
-                break;
+                out_flush();
+            }
+        }
+
+        int timeout_ms = -1;
+        if (mode == MODE_STATS)
+        {
+            unsigned long long elapsed = now_ns() - start;
+
+            if (elapsed / 1000000000ull > seconds)
+            {
+                seconds = elapsed / 1000000000ull;
+                print_stats(&stats, seconds);
             }
+
+            timeout_ms = (int)(((seconds + 1) * 1000000000ull - elapsed) / 1000000ull) + 1;
+        }
+
+        // Input is idle, so this is the time to write everything out
+        out_flush();
+
+        if (!failed && (limit == 0 || packets < limit) && wait_for_input(driver, fds, fdCount, timeout_ms) < 0)
+        {
+            failed = 1;
         }
     }
 
+    if (mode == MODE_STATS)
+    {
+        print_stats(&stats, (now_ns() - start) / 1000000000ull);
+    }
+    out_flush();
+
+    if (output)
+    {
+        close(out_fd);
+    }
+
     platform_midi_deinit(driver);
-    return 0;
+    return failed;
 }
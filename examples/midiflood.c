@@ -0,0 +1,756 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * midiflood.c
+ *
+ * Load generator and matching receive-side verifier
+ *
+ * Usage:
+ *   midiflood send [--rate <msgs/s>] [--count <n>] [--duration <s>]
+ *                  [--mix notes=70,cc=20,clock=5,sysex=5] [--sysex-size <min>[-<max>]]
+ *                  [--probe-ms <ms>]
+ *   midiflood recv [--idle <s>]
+ *
+ * Run the receiver and sender as separate processes and connect them
+ * (e.g. `aconnect midiflood-send midiflood-recv` on ALSA). A rate of 0 sends flat out.
+ *
+ * Every message except clock carries a sequence number so the receiver can count
+ * loss and reordering:
+ *   Note On / CC  sequence bits 0-13 in the data bytes, bits 14-17 in the channel
+ *   SysEx         F0 7D 46 <kind> <seq: 5 x 7 bits> <send time ns: 10 x 7 bits> <filler...> F7
+ *
+ * SysEx kinds are 'D' (data), 'P' (latency probe), 'S' (start of run) and 'E' (end of run).
+ * The end marker carries the sender's totals per message type.
+ * Latency is measured from the send timestamps in SysEx messages, so probes are
+ * sent every --probe-ms even if the mix contains no SysEx.
+ *
+ */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+
+#define SEQ_SHORT_BITS 18
+#define SEQ_SHORT_MASK ((1u << SEQ_SHORT_BITS) - 1)
+
+#define SYSEX_MANUFACTURER 0x7D
+#define SYSEX_TAG 0x46
+#define SYSEX_HEADER_SIZE 4
+#define SYSEX_SEQ_BYTES 5
+#define SYSEX_TIME_BYTES 10
+#define SYSEX_MIN_SIZE (SYSEX_HEADER_SIZE + SYSEX_SEQ_BYTES + SYSEX_TIME_BYTES + 1)
+#define SYSEX_MAX_SIZE 65536
+
+#define MAX_LATENCY_SAMPLES (1 << 20)
+#define MAX_FDS 8
+
+enum flood_type
+{
+    FLOOD_NOTE,
+    FLOOD_CC,
+    FLOOD_CLOCK,
+    FLOOD_SYSEX,
+    FLOOD_PROBE,
+    FLOOD_TYPE_COUNT,
+};
+
+static const char *flood_type_names[] = {
+    "notes",
+    "cc",
+    "clock",
+    "sysex",
+    "probe",
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(unsigned long long deadline)
+{
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL));
+#else
+    unsigned long long now = now_ns();
+    if (deadline > now)
+    {
+        struct timespec ts;
+        ts.tv_sec = (deadline - now) / 1000000000ull;
+        ts.tv_nsec = (deadline - now) % 1000000000ull;
+        nanosleep(&ts, NULL);
+    }
+#endif
+}
+
+static unsigned int xorshift_state = 0x12345678;
+
+static unsigned int random_next(void)
+{
+    xorshift_state ^= xorshift_state << 13;
+    xorshift_state ^= xorshift_state >> 17;
+    xorshift_state ^= xorshift_state << 5;
+    return xorshift_state;
+}
+
+static void put_7bit(unsigned char *out, unsigned long long value, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = (value >> (i * 7)) & 0x7F;
+    }
+}
+
+static unsigned long long get_7bit(const unsigned char *in, int count)
+{
+    unsigned long long value = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        value |= (unsigned long long)(in[i] & 0x7F) << (i * 7);
+    }
+
+    return value;
+}
+
+// Builds a flood SysEx of the given total size and returns its length
+static int build_sysex(unsigned char *out, int size, unsigned char kind, unsigned long long seq, const unsigned long long *extra, int extraCount)
+{
+    int pos = 0;
+
+    out[pos++] = 0xF0;
+    out[pos++] = SYSEX_MANUFACTURER;
+    out[pos++] = SYSEX_TAG;
+    out[pos++] = kind;
+    put_7bit(out + pos, seq, SYSEX_SEQ_BYTES);
+    pos += SYSEX_SEQ_BYTES;
+
+    // The timestamp goes last so that it's as close to the actual send as possible
+    int timePos = pos;
+    pos += SYSEX_TIME_BYTES;
+
+    for (int i = 0; i < extraCount; i++)
+    {
+        put_7bit(out + pos, extra[i], SYSEX_TIME_BYTES);
+        pos += SYSEX_TIME_BYTES;
+    }
+
+    while (pos < size - 1)
+    {
+        out[pos] = pos & 0x7F;
+        pos++;
+    }
+
+    out[pos++] = 0xF7;
+    put_7bit(out + timePos, now_ns(), SYSEX_TIME_BYTES);
+
+    return pos;
+}
+
+struct send_options
+{
+    double rate;
+    unsigned long long count;
+    double duration;
+    unsigned int mix[FLOOD_TYPE_COUNT];
+    int sysexMin;
+    int sysexMax;
+    double probeMs;
+};
+
+static int parse_mix(const char *arg, unsigned int *mix)
+{
+    char name[16];
+    unsigned int weight;
+    int used;
+
+    memset(mix, 0, sizeof(unsigned int) * FLOOD_TYPE_COUNT);
+
+    while (2 == sscanf(arg, "%15[a-z]=%u%n", name, &weight, &used))
+    {
+        int found = 0;
+        for (int i = 0; i < FLOOD_PROBE; i++)
+        {
+            if (!strcmp(name, flood_type_names[i]))
+            {
+                mix[i] = weight;
+                found = 1;
+            }
+        }
+
+        if (!found)
+        {
+            printf("Unknown message type in mix: %s\n", name);
+            return 0;
+        }
+
+        arg += used;
+        if (*arg == ',')
+        {
+            arg++;
+        }
+    }
+
+    return *arg == '\0';
+}
+
+static int run_send(struct send_options *opts)
+{
+    static unsigned char sysex[SYSEX_MAX_SIZE];
+    unsigned long long sent[FLOOD_TYPE_COUNT] = { 0 };
+    unsigned long long seq = 0;
+    unsigned long long errors = 0;
+    unsigned long long bytes = 0;
+    unsigned long long total = 0;
+    unsigned int mixTotal = 0;
+
+    for (int i = 0; i < FLOOD_PROBE; i++)
+    {
+        mixTotal += opts->mix[i];
+    }
+
+    if (!mixTotal)
+    {
+        printf("The message mix is empty\n");
+        return 1;
+    }
+
+    struct platform_midi_driver *driver = platform_midi_init("midiflood-send");
+    if (!driver)
+    {
+        printf("ERROR! Could not initialize platform_midi\n");
+        return 1;
+    }
+
+    // Give the user a moment to connect us
+    printf("Sending in 2 seconds...\n");
+    sleep(2);
+
+    int len = build_sysex(sysex, SYSEX_MIN_SIZE, 'S', 0, NULL, 0);
+    platform_midi_write(driver, sysex, len);
+
+    unsigned long long period = (opts->rate > 0) ? (unsigned long long)(1e9 / opts->rate) : 0;
+    unsigned long long probePeriod = (unsigned long long)(opts->probeMs * 1e6);
+    unsigned long long start = now_ns();
+    unsigned long long end = (opts->duration > 0) ? start + (unsigned long long)(opts->duration * 1e9) : 0;
+    unsigned long long nextProbe = start + probePeriod;
+
+    while ((opts->count == 0 || total < opts->count) && (end == 0 || now_ns() < end))
+    {
+        unsigned char packet[3];
+        const unsigned char *data = packet;
+        int type = FLOOD_PROBE;
+        unsigned int pick;
+
+        if (period)
+        {
+            // Pace against absolute deadlines so timing errors don't accumulate
+            unsigned long long deadline = start + total * period;
+            if (deadline > now_ns() + 50000)
+            {
+                sleep_until(deadline);
+            }
+        }
+
+        if (probePeriod && now_ns() >= nextProbe)
+        {
+            nextProbe += probePeriod;
+            len = build_sysex(sysex, SYSEX_MIN_SIZE, 'P', seq++, NULL, 0);
+            data = sysex;
+        }
+        else
+        {
+            pick = random_next() % mixTotal;
+            for (type = 0; type < FLOOD_PROBE && pick >= opts->mix[type]; type++)
+            {
+                pick -= opts->mix[type];
+            }
+
+            switch (type)
+            {
+                case FLOOD_NOTE:
+                case FLOOD_CC:
+                    packet[0] = ((type == FLOOD_NOTE) ? 0x90 : 0xB0) | ((seq >> 14) & 0x0F);
+                    packet[1] = (seq >> 7) & 0x7F;
+                    packet[2] = seq & 0x7F;
+                    seq++;
+                    len = 3;
+                    break;
+
+                case FLOOD_CLOCK:
+                    packet[0] = 0xF8;
+                    len = 1;
+                    break;
+
+                case FLOOD_SYSEX:
+                default:
+                {
+                    int size = opts->sysexMin;
+                    if (opts->sysexMax > opts->sysexMin)
+                    {
+                        size += random_next() % (opts->sysexMax - opts->sysexMin + 1);
+                    }
+
+                    len = build_sysex(sysex, size, 'D', seq++, NULL, 0);
+                    data = sysex;
+                    break;
+                }
+            }
+        }
+
+        if (platform_midi_write(driver, data, len) > 0)
+        {
+            sent[type]++;
+            bytes += len;
+        }
+        else
+        {
+            errors++;
+        }
+
+        total++;
+    }
+
+    double elapsed = (now_ns() - start) / 1e9;
+
+    unsigned long long totals[FLOOD_TYPE_COUNT + 1];
+    totals[0] = seq;
+    memcpy(&totals[1], sent, sizeof(sent));
+    len = build_sysex(sysex, SYSEX_MIN_SIZE + SYSEX_TIME_BYTES * (FLOOD_TYPE_COUNT + 1), 'E', seq, totals, FLOOD_TYPE_COUNT + 1);
+    platform_midi_write(driver, sysex, len);
+
+    printf("Sent %llu messages (%llu bytes) in %.3f s: %.0f msg/s, %.0f bytes/s, %llu write errors\n",
+           total - errors, bytes, elapsed, (total - errors) / elapsed, bytes / elapsed, errors);
+    for (int i = 0; i < FLOOD_TYPE_COUNT; i++)
+    {
+        printf("  %-6s %llu\n", flood_type_names[i], sent[i]);
+    }
+
+    platform_midi_deinit(driver);
+    return 0;
+}
+
+struct recv_stats
+{
+    int running;
+    unsigned long long received[FLOOD_TYPE_COUNT];
+    unsigned long long bytes;
+    unsigned long long sequenced;
+    unsigned long long reordered;
+    unsigned long long highest;
+    int haveHighest;
+    unsigned long long first;
+    unsigned long long last;
+    unsigned int latencyCount;
+    unsigned int latencies[MAX_LATENCY_SAMPLES];
+};
+
+static struct recv_stats stats;
+
+static void note_sequence(unsigned long long seq)
+{
+    stats.sequenced++;
+
+    if (!stats.haveHighest || seq > stats.highest)
+    {
+        stats.highest = seq;
+        stats.haveHighest = 1;
+    }
+    else
+    {
+        stats.reordered++;
+    }
+}
+
+// Expands an 18-bit sequence number to the value closest to the next one expected
+static unsigned long long expand_short_seq(unsigned int seq)
+{
+    unsigned long long expected = stats.haveHighest ? stats.highest + 1 : 0;
+    unsigned int delta = (seq - (unsigned int)expected) & SEQ_SHORT_MASK;
+
+    if (delta >= (1u << (SEQ_SHORT_BITS - 1)) && expected >= (1u << SEQ_SHORT_BITS))
+    {
+        return expected + delta - (1u << SEQ_SHORT_BITS);
+    }
+
+    return expected + delta;
+}
+
+static int compare_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int*)a;
+    unsigned int y = *(const unsigned int*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_report(const unsigned long long *totals)
+{
+    double elapsed = (stats.last - stats.first) / 1e9;
+    unsigned long long received = 0;
+
+    for (int i = 0; i < FLOOD_TYPE_COUNT; i++)
+    {
+        received += stats.received[i];
+    }
+
+    printf("Received %llu messages (%llu bytes) in %.3f s: %.0f msg/s, %.0f bytes/s\n",
+           received, stats.bytes, elapsed, elapsed > 0 ? received / elapsed : 0.0, elapsed > 0 ? stats.bytes / elapsed : 0.0);
+
+    unsigned long long expected = totals ? totals[0] : (stats.haveHighest ? stats.highest + 1 : 0);
+    unsigned long long lost = (expected > stats.sequenced) ? expected - stats.sequenced : 0;
+    printf("Sequenced: %llu of %llu received, %llu lost (%.3f%%), %llu reordered\n",
+           stats.sequenced, expected, lost, expected ? 100.0 * lost / expected : 0.0, stats.reordered);
+
+    for (int i = 0; i < FLOOD_TYPE_COUNT; i++)
+    {
+        if (totals)
+        {
+            printf("  %-6s %llu of %llu\n", flood_type_names[i], stats.received[i], totals[i + 1]);
+        }
+        else
+        {
+            printf("  %-6s %llu\n", flood_type_names[i], stats.received[i]);
+        }
+    }
+
+    if (stats.latencyCount)
+    {
+        unsigned long long sum = 0;
+
+        qsort(stats.latencies, stats.latencyCount, sizeof(unsigned int), compare_uint);
+        for (unsigned int i = 0; i < stats.latencyCount; i++)
+        {
+            sum += stats.latencies[i];
+        }
+
+        printf("Latency over %u SysEx (us): min %.1f  avg %.1f  p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+               stats.latencyCount,
+               stats.latencies[0] / 1e3,
+               (double)sum / stats.latencyCount / 1e3,
+               stats.latencies[stats.latencyCount / 2] / 1e3,
+               stats.latencies[(unsigned long long)stats.latencyCount * 99 / 100] / 1e3,
+               stats.latencies[(unsigned long long)stats.latencyCount * 999 / 1000] / 1e3,
+               stats.latencies[stats.latencyCount - 1] / 1e3);
+    }
+    else
+    {
+        printf("Latency: no SysEx received\n");
+    }
+
+    fflush(stdout);
+}
+
+static void handle_message(const unsigned char *packet, int size, unsigned long long timestamp)
+{
+    if (!stats.running && !(size > SYSEX_HEADER_SIZE && packet[0] == 0xF0 && packet[3] == 'S'))
+    {
+        return;
+    }
+
+    switch (packet[0] & 0xF0)
+    {
+        case 0x90:
+        case 0xB0:
+            if (size >= 3)
+            {
+                stats.received[((packet[0] & 0xF0) == 0x90) ? FLOOD_NOTE : FLOOD_CC]++;
+                note_sequence(expand_short_seq(((packet[0] & 0x0F) << 14) | (packet[1] << 7) | packet[2]));
+            }
+            break;
+
+        case 0xF0:
+        {
+            if (packet[0] == 0xF8)
+            {
+                stats.received[FLOOD_CLOCK]++;
+                break;
+            }
+
+            if (packet[0] != 0xF0 || size < SYSEX_MIN_SIZE || packet[1] != SYSEX_MANUFACTURER || packet[2] != SYSEX_TAG)
+            {
+                break;
+            }
+
+            unsigned long long seq = get_7bit(packet + SYSEX_HEADER_SIZE, SYSEX_SEQ_BYTES);
+            unsigned long long sentAt = get_7bit(packet + SYSEX_HEADER_SIZE + SYSEX_SEQ_BYTES, SYSEX_TIME_BYTES) & ((1ull << 63) - 1);
+            unsigned char kind = packet[3];
+
+            if (kind == 'S')
+            {
+                memset(&stats, 0, sizeof(stats));
+                stats.running = 1;
+                stats.first = timestamp;
+                printf("Run started\n");
+                fflush(stdout);
+                break;
+            }
+
+            if (timestamp > sentAt && stats.latencyCount < MAX_LATENCY_SAMPLES)
+            {
+                unsigned long long latency = timestamp - sentAt;
+                stats.latencies[stats.latencyCount++] = (latency > 0xFFFFFFFFull) ? 0xFFFFFFFFu : (unsigned int)latency;
+            }
+
+            if (kind == 'E')
+            {
+                unsigned long long totals[FLOOD_TYPE_COUNT + 1];
+                const unsigned char *extra = packet + SYSEX_HEADER_SIZE + SYSEX_SEQ_BYTES + SYSEX_TIME_BYTES;
+
+                if (size < SYSEX_MIN_SIZE + SYSEX_TIME_BYTES * (FLOOD_TYPE_COUNT + 1))
+                {
+                    break;
+                }
+
+                for (int i = 0; i < FLOOD_TYPE_COUNT + 1; i++)
+                {
+                    totals[i] = get_7bit(extra + i * SYSEX_TIME_BYTES, SYSEX_TIME_BYTES);
+                }
+
+                print_report(totals);
+                stats.running = 0;
+                break;
+            }
+
+            stats.received[(kind == 'P') ? FLOOD_PROBE : FLOOD_SYSEX]++;
+            note_sequence(seq);
+            break;
+        }
+
+        default:
+            return;
+    }
+
+    stats.bytes += size;
+    stats.last = timestamp;
+}
+
+static unsigned char sysexBuf[SYSEX_MAX_SIZE];
+static int sysexLen;
+
+// Backends may hand a long SysEx over in pieces, so it's put back together before it's checked
+static void receive_packet(const unsigned char *packet, int size, unsigned long long timestamp)
+{
+    int continued = sysexLen > 0 && !(packet[0] & 0x80);
+
+    if (packet[0] >= 0xF8)
+    {
+        // Real-time messages can arrive between the pieces
+        handle_message(packet, size, timestamp);
+        return;
+    }
+
+    if (!continued && (packet[0] != 0xF0 || packet[size - 1] == 0xF7))
+    {
+        // Anything else ends an unfinished SysEx
+        sysexLen = 0;
+        handle_message(packet, size, timestamp);
+        return;
+    }
+
+    if (!continued)
+    {
+        sysexLen = 0;
+    }
+
+    if (sysexLen + size > SYSEX_MAX_SIZE)
+    {
+        sysexLen = 0;
+        return;
+    }
+
+    memcpy(sysexBuf + sysexLen, packet, size);
+    sysexLen += size;
+
+    if (sysexBuf[sysexLen - 1] == 0xF7)
+    {
+        handle_message(sysexBuf, sysexLen, timestamp);
+        sysexLen = 0;
+    }
+}
+
+static int run_recv(double idle)
+{
+    static unsigned char packet[SYSEX_MAX_SIZE];
+    int fds[MAX_FDS];
+    struct pollfd pfds[MAX_FDS];
+
+    struct platform_midi_driver *driver = platform_midi_init("midiflood-recv");
+    if (!driver)
+    {
+        printf("ERROR! Could not initialize platform_midi\n");
+        return 1;
+    }
+
+    int fdCount = platform_midi_fds(driver, fds, MAX_FDS);
+    for (int i = 0; i < fdCount; i++)
+    {
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+    }
+
+    printf("Waiting for a run to start...\n");
+    fflush(stdout);
+
+    unsigned long long lastInput = now_ns();
+
+    while (1)
+    {
+        int read;
+
+        while ((read = platform_midi_read(driver, packet, sizeof(packet))) != 0)
+        {
+            if (read < 0)
+            {
+                // Usually an input overrun, which the loss numbers will show
+                break;
+            }
+
+            lastInput = now_ns();
+            receive_packet(packet, read, lastInput);
+        }
+
+        if (stats.running && idle > 0 && now_ns() - lastInput > (unsigned long long)(idle * 1e9))
+        {
+            printf("No input for %.1f s, the end marker was lost\n", idle);
+            print_report(NULL);
+            stats.running = 0;
+        }
+
+        if (fdCount > 0)
+        {
+            poll(pfds, fdCount, 100);
+        }
+        else
+        {
+            usleep(100);
+        }
+    }
+
+    platform_midi_deinit(driver);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    struct send_options opts;
+    double idle = 5.0;
+    char *end;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.count = 100000;
+    opts.mix[FLOOD_NOTE] = 70;
+    opts.mix[FLOOD_CC] = 20;
+    opts.mix[FLOOD_CLOCK] = 5;
+    opts.mix[FLOOD_SYSEX] = 5;
+    opts.sysexMin = 64;
+    opts.sysexMax = 64;
+    opts.probeMs = 10;
+
+    if (argc < 2 || (strcmp(argv[1], "send") && strcmp(argv[1], "recv")))
+    {
+        printf("Usage: %s send [--rate <msgs/s>] [--count <n>] [--duration <s>] [--mix notes=70,cc=20,clock=5,sysex=5] [--sysex-size <min>[-<max>]] [--probe-ms <ms>]\n", argv[0]);
+        printf("       %s recv [--idle <s>]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (!value)
+        {
+            printf("Missing value for %s\n", arg);
+            return 1;
+        }
+        i++;
+
+        if (!strcmp(arg, "--rate"))
+        {
+            opts.rate = strtod(value, &end);
+        }
+        else if (!strcmp(arg, "--count"))
+        {
+            opts.count = strtoull(value, &end, 10);
+        }
+        else if (!strcmp(arg, "--duration"))
+        {
+            opts.duration = strtod(value, &end);
+            opts.count = 0;
+        }
+        else if (!strcmp(arg, "--mix"))
+        {
+            if (!parse_mix(value, opts.mix))
+            {
+                printf("Invalid mix: %s\n", value);
+                return 1;
+            }
+            end = "";
+        }
+        else if (!strcmp(arg, "--sysex-size"))
+        {
+            opts.sysexMin = opts.sysexMax = strtol(value, &end, 10);
+            if (*end == '-')
+            {
+                opts.sysexMax = strtol(end + 1, &end, 10);
+            }
+        }
+        else if (!strcmp(arg, "--probe-ms"))
+        {
+            opts.probeMs = strtod(value, &end);
+        }
+        else if (!strcmp(arg, "--idle"))
+        {
+            idle = strtod(value, &end);
+        }
+        else
+        {
+            printf("Unknown option: %s\n", arg);
+            return 1;
+        }
+
+        if (*end != '\0')
+        {
+            printf("Invalid value for %s: %s\n", arg, value);
+            return 1;
+        }
+    }
+
+    if (opts.sysexMin < SYSEX_MIN_SIZE)
+    {
+        opts.sysexMin = SYSEX_MIN_SIZE;
+    }
+    if (opts.sysexMax < opts.sysexMin)
+    {
+        opts.sysexMax = opts.sysexMin;
+    }
+    if (opts.sysexMax > SYSEX_MAX_SIZE)
+    {
+        opts.sysexMax = SYSEX_MAX_SIZE;
+    }
+
+    return (!strcmp(argv[1], "send")) ? run_send(&opts) : run_recv(idle);
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+    printf("midiflood is only supported on Linux and macOS\n");
+    return 1;
+}
+
+#endif
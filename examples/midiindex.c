@@ -0,0 +1,122 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * midiindex.c
+ *
+ * Converts a Standard MIDI File or a `mididump --binary` capture to the seekable
+ * index format, or plays an index file from any point
+ *
+ * Usage: midiindex <input.mid|capture> <output>
+ *        midiindex --play <file> [start seconds]
+ *
+ * Playing seeks straight to the start time, sends the held notes, programs and
+ * controllers in effect there, then plays on from it
+ *
+ */
+
+static int play(const char *path, double startSeconds)
+{
+    static struct platform_midi_index index;
+    unsigned long long time;
+    const unsigned char *data;
+    int size;
+
+    if (!platform_midi_index_open(&index, path))
+    {
+        return 1;
+    }
+
+    struct platform_midi_driver *driver = platform_midi_init("midiindex");
+    if (!driver)
+    {
+        platform_midi_index_close(&index);
+        return 1;
+    }
+
+    unsigned long long start = startSeconds > 0 ? (unsigned long long)(startSeconds * 1e6) : 0;
+    if (platform_midi_index_seek(&index, start, driver) < 0)
+    {
+        platform_midi_deinit(driver);
+        platform_midi_index_close(&index);
+        return 1;
+    }
+
+    printf("Playing %s from %.1f of %.1f seconds\n", path, start / 1e6, index.duration / 1e6);
+
+    unsigned long long origin = platform_midi_clock_now();
+    while ((size = platform_midi_index_next(&index, &time, &data)) > 0)
+    {
+        platform_midi_clock_sleep_until(origin + (time - start) * 1000);
+
+        if (platform_midi_write(driver, data, size) < 0)
+        {
+            break;
+        }
+    }
+
+    if (size < 0)
+    {
+        printf("Stopped at a damaged event\n");
+    }
+
+    platform_midi_state_all_notes_off(&index.state, driver);
+    platform_midi_deinit(driver);
+    platform_midi_index_close(&index);
+    return size < 0;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned char magic[8] = { 0 };
+    int ok;
+
+    if (argc >= 3 && !strcmp(argv[1], "--play"))
+    {
+        return play(argv[2], argc > 3 ? atof(argv[3]) : 0);
+    }
+
+    if (argc != 3)
+    {
+        printf("Usage: %s <input.mid|capture> <output>\n", argv[0]);
+        printf("       %s --play <file> [start seconds]\n", argv[0]);
+        return 0;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (!file)
+    {
+        printf("Failed to open %s\n", argv[1]);
+        return 1;
+    }
+    fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+
+    if (!memcmp(magic, "MThd", 4))
+    {
+        ok = platform_midi_index_from_smf(argv[1], argv[2]);
+    }
+    else
+    {
+        ok = platform_midi_index_from_dump(argv[1], argv[2]);
+    }
+
+    if (!ok)
+    {
+        return 1;
+    }
+
+    struct platform_midi_index *index = (struct platform_midi_index*)malloc(sizeof(struct platform_midi_index));
+    if (index && platform_midi_index_open(index, argv[2]))
+    {
+        printf("%s: %llu events, %.1f seconds, %u checkpoints\n", argv[2], index->event_count, index->duration / 1e6, index->entry_count);
+        platform_midi_index_close(index);
+    }
+    free(index);
+
+    return 0;
+}
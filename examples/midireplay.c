@@ -0,0 +1,209 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_play.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * midireplay.c
+ *
+ * Replays a capture made with `mididump --binary`, writing each record as it was
+ * read, in the same order and split the same way
+ *
+ * Usage: midireplay [--speed <n>|--max] [--loop <n>] [--backend <name>] <capture>
+ *
+ * --speed plays the capture n times as fast (1 by default), on absolute deadlines
+ *   from the first record so lateness doesn't pile up; --max writes back to back
+ *
+ * --loop plays it n times over
+ *
+ * --backend picks the backend to write to, e.g. NULL to measure the library alone
+ *
+ * At the end it prints how many records went out, how fast, how long each
+ * platform_midi_write() took, and when timed, how late writes were
+ *
+ */
+
+#define CAPTURE_MAGIC "PMDUMP01"
+#define RECORD_HEADER_SIZE 10
+
+static unsigned long long get64(const unsigned char *buf)
+{
+    unsigned long long value = 0;
+
+    for (int i = 7; i >= 0; i--)
+    {
+        value = (value << 8) | buf[i];
+    }
+
+    return value;
+}
+
+// Checks every record is whole before anything is sent, returning how many there are
+static unsigned long long count_records(const struct platform_midi_file_map *map, const char *path)
+{
+    const unsigned char *pos = map->data + 8;
+    const unsigned char *end = map->data + map->size;
+    unsigned long long count = 0;
+
+    while (end - pos >= RECORD_HEADER_SIZE)
+    {
+        unsigned int size = pos[8] | (pos[9] << 8);
+
+        if (size > end - pos - RECORD_HEADER_SIZE)
+        {
+            break;
+        }
+
+        pos += RECORD_HEADER_SIZE + size;
+        count++;
+    }
+
+    if (pos != end)
+    {
+        printf("Warn: %s is truncated, replaying the first %llu records\n", path, count);
+    }
+
+    return count;
+}
+
+int main(int argc, char** argv)
+{
+    struct platform_midi_file_map map = { 0 };
+    struct platform_midi_options options = { 0 };
+    struct platform_midi_clock_stats lateness;
+    struct platform_midi_clock_stats writeTime;
+    const char *backends[] = { NULL, NULL };
+    const char *path = NULL;
+    double speed = 1;
+    int loops = 1;
+    unsigned long long bytes = 0;
+    unsigned long long errors = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+        {
+            speed = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--max"))
+        {
+            speed = 0;
+        }
+        else if (!strcmp(argv[i], "--loop") && i + 1 < argc)
+        {
+            loops = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--backend") && i + 1 < argc)
+        {
+            backends[0] = argv[++i];
+            options.backends = backends;
+        }
+        else if (!path && argv[i][0] != '-')
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+
+    if (!path || speed < 0 || loops < 1)
+    {
+        printf("Usage: %s [--speed <n>|--max] [--loop <n>] [--backend <name>] <capture>\n", argv[0]);
+        return 1;
+    }
+
+    if (!platform_midi_file_map_open(&map, path, 1))
+    {
+        return 1;
+    }
+
+    if (map.size < 8 || memcmp(map.data, CAPTURE_MAGIC, 8))
+    {
+        printf("Error: %s is not a mididump --binary capture\n", path);
+        platform_midi_file_map_close(&map);
+        return 1;
+    }
+
+    unsigned long long records = count_records(&map, path);
+    if (!records)
+    {
+        printf("%s has nothing in it\n", path);
+        platform_midi_file_map_close(&map);
+        return 0;
+    }
+
+    struct platform_midi_driver *driver = platform_midi_init_ex("midireplay", &options);
+    if (!driver)
+    {
+        platform_midi_file_map_close(&map);
+        return 1;
+    }
+
+    const unsigned char *first = map.data + 8;
+    unsigned long long firstTime = get64(first);
+
+    platform_midi_clock_stats_reset(&lateness);
+    platform_midi_clock_stats_reset(&writeTime);
+
+    unsigned long long start = platform_midi_clock_now();
+    unsigned long long origin = start;
+
+    for (int loop = 0; loop < loops; loop++)
+    {
+        const unsigned char *pos = first;
+        unsigned long long lastTime = firstTime;
+
+        for (unsigned long long r = 0; r < records; r++)
+        {
+            unsigned long long timestamp = get64(pos);
+            unsigned int size = pos[8] | (pos[9] << 8);
+
+            if (speed > 0)
+            {
+                // A capture's clock only goes forwards, but one pieced together might not
+                unsigned long long offset = timestamp > firstTime ? timestamp - firstTime : 0;
+                unsigned long long deadline = origin + (unsigned long long)(offset / speed);
+
+                platform_midi_clock_sleep_until(deadline);
+
+                unsigned long long now = platform_midi_clock_now();
+                platform_midi_clock_stats_add(&lateness, now > deadline ? (now - deadline) / 1000.0 : 0);
+            }
+
+            unsigned long long before = platform_midi_clock_now();
+            if (size && platform_midi_write(driver, pos + RECORD_HEADER_SIZE, size) < 0)
+            {
+                errors++;
+            }
+            platform_midi_clock_stats_add(&writeTime, (platform_midi_clock_now() - before) / 1000.0);
+
+            bytes += size;
+            lastTime = timestamp;
+            pos += RECORD_HEADER_SIZE + size;
+        }
+
+        // The next loop starts where this one ended
+        origin += (unsigned long long)((lastTime > firstTime ? lastTime - firstTime : 0) / (speed > 0 ? speed : 1));
+    }
+
+    double seconds = (platform_midi_clock_now() - start) / 1e9;
+
+    printf("%llu records (%llu bytes) in %.3f s: %.0f records/s, %.2f MB/s, %llu write errors\n",
+           writeTime.count, bytes, seconds, writeTime.count / seconds, bytes / seconds / 1e6, errors);
+    printf("write:    mean %8.2f us  stddev %8.2f us  max %9.2f us\n",
+           writeTime.mean, platform_midi_clock_stddev(&writeTime), writeTime.max);
+    if (speed > 0)
+    {
+        printf("lateness: mean %8.2f us  stddev %8.2f us  max %9.2f us  at %gx\n",
+               lateness.mean, platform_midi_clock_stddev(&lateness), lateness.max, speed);
+    }
+
+    platform_midi_deinit(driver);
+    platform_midi_file_map_close(&map);
+    return errors ? 1 : 0;
+}
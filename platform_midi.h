@@ -2,91 +2,628 @@
 #define _PLATFORM_MIDI_H_
 
 struct platform_midi_driver;
+struct platform_midi_event;
+struct platform_midi_dest;
+struct platform_midi_options;
+struct platform_midi_alsa_options;
+struct platform_midi_alsa_rawmidi_options;
+struct platform_midi_shm_options;
+struct platform_midi_udp_options;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef struct platform_midi_driver* (*platform_midi_init_fn)(const char *, void*);
+typedef struct platform_midi_driver* (*platform_midi_init_fn)(const char *, const struct platform_midi_options*);
 typedef void  (*platform_midi_deinit_fn)(struct platform_midi_driver*);
 typedef int   (*platform_midi_read_fn)(struct platform_midi_driver*, unsigned char*, int);
 typedef int   (*platform_midi_write_fn)(struct platform_midi_driver*, const unsigned char*, int);
 typedef int   (*platform_midi_avail_fn)(struct platform_midi_driver*);
+typedef int   (*platform_midi_fds_fn)(struct platform_midi_driver*, int*, int);
+typedef int   (*platform_midi_read_events_fn)(struct platform_midi_driver*, struct platform_midi_event*, int, unsigned char*, int);
+typedef int   (*platform_midi_write_events_fn)(struct platform_midi_driver*, const struct platform_midi_event*, int);
+typedef int   (*platform_midi_read_ump_fn)(struct platform_midi_driver*, unsigned int*, int, int);
+typedef int   (*platform_midi_write_ump_fn)(struct platform_midi_driver*, const unsigned int*, int);
+typedef int   (*platform_midi_write_multi_fn)(struct platform_midi_driver*, const unsigned char*, int, const struct platform_midi_dest*, int);
+
+// Taps observe every message passing through platform_midi_read() / platform_midi_write()
+#define PLATFORM_MIDI_TAP_INPUT  1
+#define PLATFORM_MIDI_TAP_OUTPUT 2
+
+typedef void  (*platform_midi_tap_fn)(void *ctx, int direction, const unsigned char *buf, int size);
+
+struct platform_midi_tap
+{
+    platform_midi_tap_fn fn;
+    void *ctx;
+    // Bitmask of PLATFORM_MIDI_TAP_INPUT / PLATFORM_MIDI_TAP_OUTPUT
+    int directions;
+    struct platform_midi_tap *next;
+};
+
+struct platform_midi_options
+{
+    // Backend names to try in order, ending with NULL, e.g. { "JACK", "ALSA-Sequencer", NULL }.
+    // NULL tries every backend that can be picked automatically, highest priority first
+    const char *const *backends;
+
+    // Non-zero makes platform_midi_read(), platform_midi_read_events() and platform_midi_read_ump()
+    // wait for input instead of returning 0
+    int blocking;
+
+    // ALSA sequencer client pools in events, and its input buffer in bytes. 0 keeps ALSA's defaults
+    int seq_output_pool;
+    int seq_input_pool;
+    int seq_input_buffer;
+
+    // Size in bytes of the queues backends allocate at runtime: JACK's rings, new shared memory rings,
+    // RawMIDI kernel buffers and the UDP socket buffer. 0 keeps each backend's default
+    unsigned int queue_size;
+
+    // Real-time priority for the thread calling platform_midi_init_ex(), which does the reading and
+    // writing for most backends. 1-99 for SCHED_FIFO, or 0 to leave it alone
+    int rt_priority;
+
+    // Stored as the driver's data
+    void *user_data;
+
+    // Options only read by one backend, NULL for its defaults
+    const struct platform_midi_alsa_options *alsa;
+    const struct platform_midi_alsa_rawmidi_options *alsa_rawmidi;
+    const struct platform_midi_shm_options *shm;
+    const struct platform_midi_udp_options *udp;
+};
 
 struct platform_midi_driver* platform_midi_init(const char *name);
+
+// Like platform_midi_init(), but if a backend fails to start the next one is tried. options may be NULL
+struct platform_midi_driver* platform_midi_init_ex(const char *name, const struct platform_midi_options *options);
 void platform_midi_deinit(struct platform_midi_driver *driver);
 int platform_midi_read(struct platform_midi_driver *driver, unsigned char *out, int size);
 int platform_midi_avail(struct platform_midi_driver *driver);
 int platform_midi_write(struct platform_midi_driver *driver, const unsigned char *buf, int size);
 
-#if defined(__linux) || defined(__linux__) || defined(linux) || defined(__LINUX__)
+// Sends a real-time message (0xF8-0xFF) ahead of anything else. If another thread is inside a write,
+// it's queued and goes out as soon as that write reaches the end of a message or SysEx piece.
+// Only one thread at a time may call this. Returns 1 if the message was sent or queued, -1 if the queue is full
+int platform_midi_write_realtime(struct platform_midi_driver *driver, unsigned char status);
+
+// Delivers to the port's subscribers, like platform_midi_write()
+#define PLATFORM_MIDI_DEST_SUBSCRIBERS -1
+
+// A destination addressed directly by a backend that can do so, e.g. an ALSA sequencer client and port
+struct platform_midi_dest
+{
+    int client;
+    int port;
+};
+
+// Sends the same messages to each of count destinations, encoding them once and flushing once.
+// Returns the number of bytes written, or -1 on error or if the backend can't address destinations
+int platform_midi_write_multi(struct platform_midi_driver *driver, const unsigned char *buf, int size, const struct platform_midi_dest *dests, int count);
+
+// A channel message made by one of the builders below, ready to write. cc14 makes two messages
+struct platform_midi_msg
+{
+    unsigned char data[6];
+    unsigned char length;
+};
+
+static inline struct platform_midi_msg platform_midi_msg_2(unsigned char status, unsigned char data1)
+{
+    struct platform_midi_msg msg = { { status, data1 }, 2 };
+    return msg;
+}
+
+static inline struct platform_midi_msg platform_midi_msg_3(unsigned char status, unsigned char data1, unsigned char data2)
+{
+    struct platform_midi_msg msg = { { status, data1, data2 }, 3 };
+    return msg;
+}
+
+static inline struct platform_midi_msg platform_midi_msg_cc14(int channel, int controller, int value)
+{
+    struct platform_midi_msg msg = { {
+        (unsigned char)(0xB0 | (channel & 0x0F)), (unsigned char)(controller & 0x1F), (unsigned char)((value >> 7) & 0x7F),
+        (unsigned char)(0xB0 | (channel & 0x0F)), (unsigned char)((controller & 0x1F) + 32), (unsigned char)(value & 0x7F),
+    }, 6 };
+    return msg;
+}
+
+static inline int platform_midi_write_msg(struct platform_midi_driver *driver, struct platform_midi_msg msg)
+{
+    return platform_midi_write(driver, msg.data, msg.length);
+}
+
+// With GCC and clang, an argument that's a compile-time constant out of its range stops the build.
+// Anything else is masked into range, so a bad value can never turn into a status byte
+#if defined(__GNUC__)
+void platform_midi_value_out_of_range(void) __attribute__((error("MIDI message value out of range")));
+#define platform_midi_check(value, max) \
+    (__builtin_constant_p(value) && ((value) < 0 || (value) > (max)) ? platform_midi_value_out_of_range() : (void)0)
+#else
+#define platform_midi_check(value, max) ((void)0)
+#endif
+
+// Channels are 0-15, other values 0-127 unless noted
+#define platform_midi_note_on(channel, note, velocity) \
+    (platform_midi_check(channel, 15), platform_midi_check(note, 127), platform_midi_check(velocity, 127), \
+     platform_midi_msg_3((unsigned char)(0x90 | ((channel) & 0x0F)), (unsigned char)((note) & 0x7F), (unsigned char)((velocity) & 0x7F)))
+
+#define platform_midi_note_off(channel, note, velocity) \
+    (platform_midi_check(channel, 15), platform_midi_check(note, 127), platform_midi_check(velocity, 127), \
+     platform_midi_msg_3((unsigned char)(0x80 | ((channel) & 0x0F)), (unsigned char)((note) & 0x7F), (unsigned char)((velocity) & 0x7F)))
+
+#define platform_midi_cc(channel, controller, value) \
+    (platform_midi_check(channel, 15), platform_midi_check(controller, 127), platform_midi_check(value, 127), \
+     platform_midi_msg_3((unsigned char)(0xB0 | ((channel) & 0x0F)), (unsigned char)((controller) & 0x7F), (unsigned char)((value) & 0x7F)))
+
+#define platform_midi_program(channel, program) \
+    (platform_midi_check(channel, 15), platform_midi_check(program, 127), \
+     platform_midi_msg_2((unsigned char)(0xC0 | ((channel) & 0x0F)), (unsigned char)((program) & 0x7F)))
+
+// Channel pressure
+#define platform_midi_pressure(channel, pressure) \
+    (platform_midi_check(channel, 15), platform_midi_check(pressure, 127), \
+     platform_midi_msg_2((unsigned char)(0xD0 | ((channel) & 0x0F)), (unsigned char)((pressure) & 0x7F)))
+
+// value is 0-16383, centred on 8192
+#define platform_midi_pitch_bend(channel, value) \
+    (platform_midi_check(channel, 15), platform_midi_check(value, 16383), \
+     platform_midi_msg_3((unsigned char)(0xE0 | ((channel) & 0x0F)), (unsigned char)((value) & 0x7F), (unsigned char)(((value) >> 7) & 0x7F)))
+
+// A 14-bit controller: controller 0-31 carries the MSB and controller + 32 the LSB. value is 0-16383
+#define platform_midi_cc14(channel, controller, value) \
+    (platform_midi_check(channel, 15), platform_midi_check(controller, 31), platform_midi_check(value, 16383), \
+     platform_midi_msg_cc14(channel, controller, value))
+
+// Stores up to max file descriptors which become readable (POLLIN) when input arrives.
+// Returns the number of descriptors, or 0 if the backend can't be waited on this way
+int platform_midi_fds(struct platform_midi_driver *driver, int *fds, int max);
+
+// The tap is owned by the caller and must stay valid until it is removed
+void platform_midi_add_tap(struct platform_midi_driver *driver, struct platform_midi_tap *tap);
+void platform_midi_remove_tap(struct platform_midi_driver *driver, struct platform_midi_tap *tap);
+
+// platform_midi_event_time() when the input last read arrived, e.g. for an input tap to timestamp
+// what it's given. Backends that queue input give the time it was queued, others the time it was read
+unsigned int platform_midi_read_time(struct platform_midi_driver *driver);
+
+// A single parsed message, 16 bytes on 64-bit platforms
+struct platform_midi_event
+{
+    // Microseconds on a monotonic clock when the event was read. Wraps about every 71 minutes,
+    // so compare timestamps by subtracting them
+    unsigned int timestamp;
+    // Status byte including the channel, or 0xF0 for SysEx
+    unsigned char status;
+    // UMP group, 0 unless the backend speaks UMP
+    unsigned char group;
+    union
+    {
+        // The data bytes of any message that isn't SysEx, unused ones are 0
+        unsigned char data[2];
+        // The number of bytes at sysex, for SysEx
+        unsigned short sysex_len;
+    };
+    // Raw SysEx bytes. Long messages may be split over several events, in which case
+    // only the first starts with F0 and only the last ends with F7
+    const unsigned char *sysex;
+};
+
+// Reads up to max events without going through the byte stream where the backend allows it.
+// SysEx data is copied into sysexBuf, so it stays valid for as long as the caller keeps that around;
+// a SysEx bigger than the space left in it may be truncated. Returns the number of events read
+int platform_midi_read_events(struct platform_midi_driver *driver, struct platform_midi_event *events, int max, unsigned char *sysexBuf, int sysexSize);
+
+// Writes count events. Returns the number written, or -1 on error
+int platform_midi_write_events(struct platform_midi_driver *driver, const struct platform_midi_event *events, int count);
+
+// Parses the message at the start of buf. A SysEx event points into buf, and bytes that don't start
+// with a status byte are taken as the continuation of a SysEx. Returns the bytes used, or 0 if incomplete
+int platform_midi_event_from_bytes(struct platform_midi_event *event, const unsigned char *buf, int size);
+
+// Serializes an event. Returns the number of bytes written, or 0 if it doesn't fit
+int platform_midi_event_to_bytes(const struct platform_midi_event *event, unsigned char *out, int size);
+
+// Converts an event to MIDI 1.0 UMP packets, SysEx becoming SysEx7 packets.
+// Returns the number of 32-bit words written, or 0 if they don't fit
+int platform_midi_event_to_ump(const struct platform_midi_event *event, unsigned int *words, int max);
+
+// Converts one UMP packet from words. Returns the number of words in the packet, or 0 if count is too
+// short. Packets with no MIDI 1.0 equivalent, and SysEx7 which needs reassembly, give a status of 0
+int platform_midi_event_from_ump(struct platform_midi_event *event, const unsigned int *words, int count);
+
+// UMP protocols. MIDI 1.0 carries channel voice messages as type 2 packets, MIDI 2.0 as type 4
+#define PLATFORM_MIDI_PROTOCOL_1 1
+#define PLATFORM_MIDI_PROTOCOL_2 2
+
+// Reads whole UMP packets, translating channel voice messages to the requested protocol if the
+// endpoint speaks the other one. As with platform_midi_read_events(), a SysEx bigger than the words
+// left may be truncated. Returns the number of 32-bit words read, or -1 on error
+int platform_midi_read_ump(struct platform_midi_driver *driver, unsigned int *words, int max, int protocol);
+
+// Writes count words of whole UMP packets in either protocol. Returns the number of words written, or -1 on error
+int platform_midi_write_ump(struct platform_midi_driver *driver, const unsigned int *words, int count);
+
+// Translates MIDI 1.0 channel voice packets to MIDI 2.0, copying everything else. out needs room
+// for twice count words. Returns the number of words written
+int platform_midi_ump_to_midi2(const unsigned int *words, int count, unsigned int *out, int max);
+
+// Translates MIDI 2.0 channel voice packets to MIDI 1.0, dropping the ones with no equivalent and
+// copying everything else. out needs room for twice count words. Returns the number of words written
+int platform_midi_ump_to_midi1(const unsigned int *words, int count, unsigned int *out, int max);
+
+#define PLATFORM_MIDI_CONCAT_(a, b) a##b
+#define PLATFORM_MIDI_CONCAT(a, b) PLATFORM_MIDI_CONCAT_(a, b)
+
+// Defining PLATFORM_MIDI_STATIC_BACKEND as one of null, alsa, alsa_rawmidi, shm, udp, coremidi, winmm
+// or jack builds only that backend (and NULL), and platform_midi_read(), platform_midi_write() and
+// platform_midi_avail() call it directly instead of through the driver, so it can be inlined
+#ifdef PLATFORM_MIDI_STATIC_BACKEND
+#define PLATFORM_MIDI_STATIC_ID_null 1
+#define PLATFORM_MIDI_STATIC_ID_alsa 2
+#define PLATFORM_MIDI_STATIC_ID_alsa_rawmidi 3
+#define PLATFORM_MIDI_STATIC_ID_shm 4
+#define PLATFORM_MIDI_STATIC_ID_udp 5
+#define PLATFORM_MIDI_STATIC_ID_coremidi 6
+#define PLATFORM_MIDI_STATIC_ID_winmm 7
+#define PLATFORM_MIDI_STATIC_ID_jack 8
+#define PLATFORM_MIDI_STATIC_ID PLATFORM_MIDI_CONCAT(PLATFORM_MIDI_STATIC_ID_, PLATFORM_MIDI_STATIC_BACKEND)
+
+// e.g. PLATFORM_MIDI_STATIC_FN(read) is platform_midi_read_alsa
+#define PLATFORM_MIDI_STATIC_FN(fn) PLATFORM_MIDI_CONCAT(platform_midi_##fn##_, PLATFORM_MIDI_STATIC_BACKEND)
+
+#if PLATFORM_MIDI_STATIC_ID == 2
+#define PLATFORM_MIDI_ALSA 1
+#elif PLATFORM_MIDI_STATIC_ID == 3
+#define PLATFORM_MIDI_ALSA_RAWMIDI 1
+#elif PLATFORM_MIDI_STATIC_ID == 4
+#define PLATFORM_MIDI_SHM 1
+#elif PLATFORM_MIDI_STATIC_ID == 5
+#define PLATFORM_MIDI_UDP 1
+#elif PLATFORM_MIDI_STATIC_ID == 6
+#define PLATFORM_MIDI_COREMIDI 1
+#elif PLATFORM_MIDI_STATIC_ID == 7
+#define PLATFORM_MIDI_WINMM 1
+#elif PLATFORM_MIDI_STATIC_ID == 8
+#ifndef PLATFORM_MIDI_JACK
+#define PLATFORM_MIDI_JACK 1
+#endif
+#elif PLATFORM_MIDI_STATIC_ID != 1
+#error "PLATFORM_MIDI_STATIC_BACKEND must be one of null, alsa, alsa_rawmidi, shm, udp, coremidi, winmm or jack"
+#endif
+#elif defined(__linux) || defined(__linux__) || defined(linux) || defined(__LINUX__)
 #define PLATFORM_MIDI_ALSA_RAWMIDI 1
 #define PLATFORM_MIDI_ALSA 1
+#define PLATFORM_MIDI_SHM 1
+#define PLATFORM_MIDI_UDP 1
 #elif defined(__APPLE__)
 #define PLATFORM_MIDI_COREMIDI 1
 #else
 #define PLATFORM_MIDI_WINMM 1
 #endif
 
+#define PLATFORM_MIDI_NULL 1
+
+// Messages queued per input
 #ifndef PLATFORM_MIDI_EVENT_BUFFER_ITEMS
 #define PLATFORM_MIDI_EVENT_BUFFER_ITEMS 32
 #endif
 
+// Bytes of queued SysEx per input; shorter messages don't use any
 #ifndef PLATFORM_MIDI_EVENT_BUFFER_SIZE
 #define PLATFORM_MIDI_EVENT_BUFFER_SIZE 1024
 #endif
 
+// Real-time messages (0xF8-0xFF) queued separately from everything else, per direction
+#ifndef PLATFORM_MIDI_REALTIME_ITEMS
+#define PLATFORM_MIDI_REALTIME_ITEMS 64
+#endif
+
+// Writes of longer SysEx messages to byte-stream backends (RawMIDI, the ALSA sequencer, UDP) are split,
+// so real-time messages can be sent between the pieces
+#ifndef PLATFORM_MIDI_SYSEX_CHUNK_SIZE
+#define PLATFORM_MIDI_SYSEX_CHUNK_SIZE 256
+#endif
+
 #ifdef PLATFORM_MIDI_IMPLEMENTATION
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Monotonic microseconds for event timestamps
+static unsigned int platform_midi_event_time(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER count;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned int)(count.QuadPart / (frequency.QuadPart / 1000000));
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned int)((unsigned long long)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000);
+#endif
+}
+
+// Returns the total length of a message beginning with the given status byte, or 0 for SysEx
+static unsigned int platform_midi_msg_length(unsigned char status)
+{
+    switch (status & 0xF0)
+    {
+        case 0xC0:
+        case 0xD0:
+            return 2;
+
+        case 0xF0:
+        {
+            switch (status)
+            {
+                case 0xF0:
+                    return 0;
+
+                case 0xF1:
+                case 0xF3:
+                    return 2;
+
+                case 0xF2:
+                    return 3;
+
+                default:
+                    return 1;
+            }
+        }
+
+        default:
+            return 3;
+    }
+}
+
+// Returns the length of the first message in buf, or all of it if the message is incomplete
+static unsigned int platform_midi_next_message(const unsigned char *buf, unsigned int size)
+{
+    unsigned int length = platform_midi_msg_length(buf[0]);
+
+    if (!(buf[0] & 0x80))
+    {
+        // Running status or stray data, pass it along as-is
+        return size;
+    }
+
+    if (length == 0)
+    {
+        const unsigned char *end = (const unsigned char*)memchr(buf, 0xF7, size);
+        return end ? (unsigned int)(end - buf) + 1 : size;
+    }
+
+    return (length < size) ? length : size;
+}
+
+struct platform_midi_realtime_msg
+{
+    // platform_midi_event_time() when the message was queued
+    unsigned int timestamp;
+    unsigned char status;
+};
+
+// Single-producer single-consumer queue of real-time messages, so a clock never waits behind a SysEx
+struct platform_midi_realtime_lane
+{
+    struct platform_midi_realtime_msg items[PLATFORM_MIDI_REALTIME_ITEMS];
+    unsigned int read_pos;
+    unsigned int write_pos;
+    // Output only: non-zero while a thread is writing to the driver
+    int busy;
+    // Output only: set by the first platform_midi_write_realtime(), writes don't lock until then
+    int active;
+    // Output only: non-zero while a write runs without the lock
+    int unlocked;
+};
+
+static void platform_midi_realtime_init(struct platform_midi_realtime_lane *lane)
+{
+    lane->read_pos = 0;
+    lane->write_pos = 0;
+    lane->busy = 0;
+    lane->active = 0;
+    lane->unlocked = 0;
+}
+
+static int platform_midi_realtime_empty(struct platform_midi_realtime_lane *lane)
+{
+    return __atomic_load_n(&lane->read_pos, __ATOMIC_RELAXED) == __atomic_load_n(&lane->write_pos, __ATOMIC_ACQUIRE);
+}
+
+static int platform_midi_realtime_count(struct platform_midi_realtime_lane *lane)
+{
+    return (__atomic_load_n(&lane->write_pos, __ATOMIC_ACQUIRE) + PLATFORM_MIDI_REALTIME_ITEMS - lane->read_pos) % PLATFORM_MIDI_REALTIME_ITEMS;
+}
+
+// Returns 0 if the lane is full
+static int platform_midi_realtime_push(struct platform_midi_realtime_lane *lane, unsigned char status, unsigned int timestamp)
+{
+    unsigned int pos = lane->write_pos;
+    unsigned int next = (pos + 1) % PLATFORM_MIDI_REALTIME_ITEMS;
+
+    if (next == __atomic_load_n(&lane->read_pos, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+
+    lane->items[pos].timestamp = timestamp;
+    lane->items[pos].status = status;
+    __atomic_store_n(&lane->write_pos, next, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Returns 0 if the lane is empty
+static int platform_midi_realtime_pop(struct platform_midi_realtime_lane *lane, struct platform_midi_realtime_msg *out)
+{
+    unsigned int pos = lane->read_pos;
+
+    if (pos == __atomic_load_n(&lane->write_pos, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+
+    *out = lane->items[pos];
+    __atomic_store_n(&lane->read_pos, (pos + 1) % PLATFORM_MIDI_REALTIME_ITEMS, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Packets of up to 3 bytes (every message but SysEx) are stored whole in the word: the bytes
+// from the bottom up, and the length in bits 24-30. Longer ones set the top bit, keep their
+// length in the rest, and their bytes in the ring's arena, in the same order as the packets
+#define PLATFORM_MIDI_PACKET_LONG 0x80000000u
+
 struct platform_midi_packet_info
 {
-    unsigned int offset;
-    unsigned int length;
+    unsigned int word;
+    // platform_midi_event_time() when the packet was queued
+    unsigned int timestamp;
 };
 
 struct platform_midi_ringbuf
 {
-    unsigned char buffer[PLATFORM_MIDI_EVENT_BUFFER_SIZE];
     struct platform_midi_packet_info packets[PLATFORM_MIDI_EVENT_BUFFER_ITEMS];
+    // The reader owns read_pos and buffer_offset, the backend's callback write_pos and buffer_end.
+    // Each side publishes its own with a release store, so they can run on different threads
     unsigned int read_pos;
     unsigned int write_pos;
+    // Long packets' bytes, from buffer_offset to buffer_end. Both count modulo twice the arena's
+    // size, so a full arena can be told from an empty one without a count both sides update
     unsigned int buffer_offset;
     unsigned int buffer_end;
+    unsigned char buffer[PLATFORM_MIDI_EVENT_BUFFER_SIZE];
+    // Real-time messages skip the queue and are read before any packet
+    struct platform_midi_realtime_lane realtime;
+    // Messages dropped because the queue or the real-time lane was full, or they were too long
+    // for it. Counted rather than reported, since messages are pushed from a backend's callback
+    unsigned int dropped;
 };
 
-#define platform_midi_buffer_empty(buf) (buf->read_pos == buf->write_pos)
+#define platform_midi_buffer_empty(buf) (__atomic_load_n(&(buf)->read_pos, __ATOMIC_ACQUIRE) == __atomic_load_n(&(buf)->write_pos, __ATOMIC_ACQUIRE) && \
+                                         platform_midi_realtime_empty(&(buf)->realtime))
+
+// Bytes of the arena holding queued long packets
+static unsigned int platform_midi_buffer_used(struct platform_midi_ringbuf *buf)
+{
+    unsigned int offset = __atomic_load_n(&buf->buffer_offset, __ATOMIC_ACQUIRE);
+    unsigned int end = __atomic_load_n(&buf->buffer_end, __ATOMIC_ACQUIRE);
+
+    return (end + 2 * PLATFORM_MIDI_EVENT_BUFFER_SIZE - offset) % (2 * PLATFORM_MIDI_EVENT_BUFFER_SIZE);
+}
+
+static unsigned int platform_midi_packet_length(unsigned int word)
+{
+    return (word & PLATFORM_MIDI_PACKET_LONG) ? word & ~PLATFORM_MIDI_PACKET_LONG : (word >> 24) & 0x7F;
+}
+
+// Drops the oldest packet to make room
+static void platform_midi_drop_packet(struct platform_midi_ringbuf *buf)
+{
+    unsigned int readPos = __atomic_load_n(&buf->read_pos, __ATOMIC_ACQUIRE);
+    unsigned int word = buf->packets[readPos].word;
+
+    if (word & PLATFORM_MIDI_PACKET_LONG)
+    {
+        unsigned int length = word & ~PLATFORM_MIDI_PACKET_LONG;
+        unsigned int offset = __atomic_load_n(&buf->buffer_offset, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&buf->buffer_offset, (offset + length) % (2 * PLATFORM_MIDI_EVENT_BUFFER_SIZE), __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&buf->read_pos, (readPos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS, __ATOMIC_RELEASE);
+}
 
 static void platform_midi_push_packet(struct platform_midi_ringbuf *buf, unsigned char *data, unsigned int length)
 {
-    if ((buf->write_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS == buf->read_pos)
+    unsigned int timestamp = platform_midi_event_time();
+
+    if (length == 1 && data[0] >= 0xF8)
+    {
+        if (!platform_midi_realtime_push(&buf->realtime, data[0], timestamp))
+        {
+            __atomic_fetch_add(&buf->dropped, 1, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+
+    if (length > PLATFORM_MIDI_EVENT_BUFFER_SIZE)
+    {
+        __atomic_fetch_add(&buf->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    unsigned int writePos = buf->write_pos;
+
+    if ((writePos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS == __atomic_load_n(&buf->read_pos, __ATOMIC_ACQUIRE) ||
+        (length > 3 && platform_midi_buffer_used(buf) + length > PLATFORM_MIDI_EVENT_BUFFER_SIZE))
     {
-        printf("Warn: MIDI packet buffer is full, dropping an event\n");
-        // The buffer is full... gotta drop a packet
-        buf->buffer_offset = (buf->buffer_offset + buf->packets[buf->read_pos].length) % PLATFORM_MIDI_EVENT_BUFFER_SIZE;
-        buf->read_pos = (buf->read_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS;
+        // The buffer is full... gotta drop packets
+        unsigned int count = 1;
+
+        platform_midi_drop_packet(buf);
+        while (length > 3 && platform_midi_buffer_used(buf) + length > PLATFORM_MIDI_EVENT_BUFFER_SIZE)
+        {
+            platform_midi_drop_packet(buf);
+            count++;
+        }
+        __atomic_fetch_add(&buf->dropped, count, __ATOMIC_RELAXED);
     }
 
-    buf->packets[buf->write_pos].offset = buf->buffer_end;
-    buf->packets[buf->write_pos].length = length;
+    struct platform_midi_packet_info *packet = &buf->packets[writePos];
+    packet->timestamp = timestamp;
 
-    if (buf->buffer_end + length <= PLATFORM_MIDI_EVENT_BUFFER_SIZE)
+    if (length <= 3)
     {
-        memcpy(&buf->buffer[buf->buffer_end], data, length);
+        unsigned int word = length << 24;
+
+        switch (length)
+        {
+            case 3: word |= (unsigned int)data[2] << 16; // fallthrough
+            case 2: word |= (unsigned int)data[1] << 8; // fallthrough
+            case 1: word |= data[0];
+        }
+        packet->word = word;
     }
     else
     {
-        unsigned int startLen = PLATFORM_MIDI_EVENT_BUFFER_SIZE - buf->buffer_end;
-        memcpy(&buf->buffer[buf->buffer_end], data, startLen);
-        memcpy(buf->buffer, data + startLen, length - startLen);
+        unsigned int end = buf->buffer_end;
+        unsigned int pos = end % PLATFORM_MIDI_EVENT_BUFFER_SIZE;
+
+        packet->word = PLATFORM_MIDI_PACKET_LONG | length;
+
+        if (pos + length <= PLATFORM_MIDI_EVENT_BUFFER_SIZE)
+        {
+            memcpy(&buf->buffer[pos], data, length);
+        }
+        else
+        {
+            unsigned int startLen = PLATFORM_MIDI_EVENT_BUFFER_SIZE - pos;
+            memcpy(&buf->buffer[pos], data, startLen);
+            memcpy(buf->buffer, data + startLen, length - startLen);
+        }
+
+        __atomic_store_n(&buf->buffer_end, (end + length) % (2 * PLATFORM_MIDI_EVENT_BUFFER_SIZE), __ATOMIC_RELEASE);
     }
 
-    buf->buffer_end = (buf->buffer_end + length) % PLATFORM_MIDI_EVENT_BUFFER_SIZE;
-    buf->write_pos = (buf->write_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS;
+    __atomic_store_n(&buf->write_pos, (writePos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS, __ATOMIC_RELEASE);
 }
 
+// Packet size in words for each UMP message type
+static const unsigned char PLATFORM_MIDI_UMP_WORDS[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+
 static int platform_midi_convert_from_ump(unsigned char *out, unsigned int maxlen, const unsigned int *umpWords, unsigned int wordCount)
 {
     unsigned int written = 0;
@@ -98,7 +635,7 @@ static int platform_midi_convert_from_ump(unsigned char *out, unsigned int maxle
         case 0x01:
         {
             // System real-time / system common
-            unsigned char status = (umpWords[0] & 0x00FF0000) >> 20;
+            unsigned char status = (umpWords[0] & 0x00FF0000) >> 16;
             unsigned int packetLen = 1;
             switch (status)
             {
@@ -172,8 +709,58 @@ static int platform_midi_convert_from_ump(unsigned char *out, unsigned int maxle
 
         case 0x03:
         {
-            // Data (SysEx)
-            // TODO
+            // Data (SysEx7), each packet becomes a piece of the SysEx with F0 and F7 only at the ends
+            unsigned char packetStatus = (umpWords[0] >> 20) & 0x0F;
+            unsigned int bytes = (umpWords[0] >> 16) & 0x0F;
+            int start = (packetStatus == 0x0 || packetStatus == 0x1);
+            int end = (packetStatus == 0x0 || packetStatus == 0x3);
+
+            if (wordCount < 2 || bytes > 6)
+            {
+                return 0;
+            }
+
+            if (written + start + bytes + end > maxlen)
+            {
+                return written;
+            }
+
+            unsigned char payload[6] = {
+                (unsigned char)((umpWords[0] >> 8) & 0x7F), (unsigned char)(umpWords[0] & 0x7F),
+                (unsigned char)((umpWords[1] >> 24) & 0x7F), (unsigned char)((umpWords[1] >> 16) & 0x7F),
+                (unsigned char)((umpWords[1] >> 8) & 0x7F), (unsigned char)(umpWords[1] & 0x7F),
+            };
+
+            if (start)
+            {
+                out[written++] = 0xF0;
+            }
+
+            memcpy(out + written, payload, bytes);
+            written += bytes;
+
+            if (end)
+            {
+                out[written++] = 0xF7;
+            }
+            break;
+        }
+
+        case 0x04:
+        {
+            // MIDI 2.0 channel voice, which may become up to four MIDI 1.0 messages
+            unsigned int midi1[8];
+            int midi1Words = platform_midi_ump_to_midi1(umpWords, wordCount < 2 ? wordCount : 2, midi1, 8);
+
+            for (int i = 0; i < midi1Words; i++)
+            {
+                int length = platform_midi_convert_from_ump(out + written, maxlen - written, &midi1[i], 1);
+                if (length == 0)
+                {
+                    break;
+                }
+                written += length;
+            }
             break;
         }
     }
@@ -221,63 +808,111 @@ static int platform_midi_convert_to_ump(unsigned int *out, unsigned int maxWords
 
 static int platform_midi_packet_count(struct platform_midi_ringbuf *buf)
 {
-    if (buf->read_pos == buf->write_pos)
-    {
-        return 0;
-    }
-    else if (buf->read_pos < buf->write_pos)
-    {
-        return buf->write_pos - buf->read_pos;
-    }
-    else
+    int realtime = platform_midi_realtime_count(&buf->realtime);
+    unsigned int readPos = __atomic_load_n(&buf->read_pos, __ATOMIC_ACQUIRE);
+    unsigned int writePos = __atomic_load_n(&buf->write_pos, __ATOMIC_ACQUIRE);
+
+    return realtime + (writePos + PLATFORM_MIDI_EVENT_BUFFER_ITEMS - readPos) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS;
+}
+
+// Returns non-zero if a packet of the given length might not fit without dropping one
+static int platform_midi_buffer_full(struct platform_midi_ringbuf *buf, unsigned int length)
+{
+    if ((buf->write_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS == __atomic_load_n(&buf->read_pos, __ATOMIC_ACQUIRE))
     {
-        return PLATFORM_MIDI_EVENT_BUFFER_ITEMS - buf->read_pos - buf->write_pos;
+        return 1;
     }
+
+    return length > 3 && platform_midi_buffer_used(buf) + length > PLATFORM_MIDI_EVENT_BUFFER_SIZE;
 }
 
-static int platform_midi_pop_packet(struct platform_midi_ringbuf *buf, unsigned char *out, unsigned int size)
+// Pops the next packet, real-time messages first. If timestamp isn't NULL it gets the time the
+// packet was queued, which puts real-time messages back in order with the rest if that matters
+static int platform_midi_pop_packet_timed(struct platform_midi_ringbuf *buf, unsigned char *out, unsigned int size, unsigned int *timestamp)
 {
-    if (buf->read_pos == buf->write_pos)
+    struct platform_midi_realtime_msg realtime;
+
+    if (size > 0 && platform_midi_realtime_pop(&buf->realtime, &realtime))
+    {
+        out[0] = realtime.status;
+        if (timestamp)
+        {
+            *timestamp = realtime.timestamp;
+        }
+        return 1;
+    }
+
+    unsigned int readPos = buf->read_pos;
+
+    if (readPos == __atomic_load_n(&buf->write_pos, __ATOMIC_ACQUIRE))
     {
         return 0;
     }
 
-    struct platform_midi_packet_info *packet = &buf->packets[buf->read_pos];
-    int toCopy = (size < packet->length) ? size : packet->length;
+    struct platform_midi_packet_info *packet = &buf->packets[readPos];
+    unsigned int word = packet->word;
+    unsigned int length = platform_midi_packet_length(word);
+    unsigned int toCopy = (size < length) ? size : length;
+
+    if (timestamp)
+    {
+        *timestamp = packet->timestamp;
+    }
 
-    // TODO detect large events overrunning the buffer
+    if (!(word & PLATFORM_MIDI_PACKET_LONG))
+    {
+        switch (toCopy)
+        {
+            case 3: out[2] = (unsigned char)(word >> 16); // fallthrough
+            case 2: out[1] = (unsigned char)(word >> 8); // fallthrough
+            case 1: out[0] = (unsigned char)word;
+        }
+        __atomic_store_n(&buf->read_pos, (readPos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS, __ATOMIC_RELEASE);
+        return toCopy;
+    }
 
-    if (packet->offset + packet->length > PLATFORM_MIDI_EVENT_BUFFER_SIZE)
+    unsigned int pos = buf->buffer_offset % PLATFORM_MIDI_EVENT_BUFFER_SIZE;
+    if (pos + toCopy > PLATFORM_MIDI_EVENT_BUFFER_SIZE)
     {
         // event is split across the end and beginning of the buffer
-        int endCopy = (packet->offset + toCopy <= PLATFORM_MIDI_EVENT_BUFFER_SIZE) ? toCopy : PLATFORM_MIDI_EVENT_BUFFER_SIZE - packet->offset;
-        int startCopy = packet->length - endCopy;
+        unsigned int endCopy = PLATFORM_MIDI_EVENT_BUFFER_SIZE - pos;
 
-        memcpy(out, &buf->buffer[packet->offset], endCopy);
-        memcpy(out + endCopy, buf->buffer, startCopy);
+        memcpy(out, &buf->buffer[pos], endCopy);
+        memcpy(out + endCopy, buf->buffer, toCopy - endCopy);
     }
     else
     {
-        memcpy(out, &buf->buffer[packet->offset], toCopy);
+        memcpy(out, &buf->buffer[pos], toCopy);
     }
 
-    buf->buffer_offset = (buf->buffer_offset + packet->length) % PLATFORM_MIDI_EVENT_BUFFER_SIZE;
-    buf->read_pos = (buf->read_pos + 1) % PLATFORM_MIDI_EVENT_BUFFER_ITEMS;
-
+    platform_midi_drop_packet(buf);
     return toCopy;
 }
 
+static int platform_midi_pop_packet(struct platform_midi_ringbuf *buf, unsigned char *out, unsigned int size)
+{
+    return platform_midi_pop_packet_timed(buf, out, size, NULL);
+}
+
 static int platform_midi_buffer_init(struct platform_midi_ringbuf *buf)
 {
     buf->read_pos = 0;
     buf->write_pos = 0;
     buf->buffer_offset = 0;
     buf->buffer_end = 0;
+    buf->dropped = 0;
     memset(buf->buffer, 0, PLATFORM_MIDI_EVENT_BUFFER_SIZE);
+    platform_midi_realtime_init(&buf->realtime);
 
     return 1;
 }
 
+// Returns how many messages the queue has dropped. Safe to call while a callback pushes
+static unsigned int platform_midi_buffer_dropped(struct platform_midi_ringbuf *buf)
+{
+    return __atomic_load_n(&buf->dropped, __ATOMIC_RELAXED);
+}
+
 static void platform_midi_buffer_deinit(struct platform_midi_ringbuf *buf)
 {
     platform_midi_buffer_init(buf);
@@ -289,13 +924,48 @@ struct platform_midi_driver
     platform_midi_avail_fn availFn;
     platform_midi_read_fn readFn;
     platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
     void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    // Non-zero if the backend takes output as a byte stream, so a long SysEx can be written in
+    // pieces. Backends that send each message whole as one event or record must get it in one go
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    // A message platform_midi_read_events() read but had no room for, kept for its next call. Only
+    // the generic code touches it, and platform_midi_deinit() frees it
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    // See platform_midi_read_time()
+    unsigned int read_time;
 };
+
+static void platform_midi_run_taps(struct platform_midi_driver *driver, int direction, const unsigned char *buf, int size)
+{
+    for (struct platform_midi_tap *tap = driver->taps; tap; tap = tap->next)
+    {
+        if (tap->directions & direction)
+        {
+            tap->fn(tap->ctx, direction, buf, size);
+        }
+    }
+}
 #endif
 
-//#define PLATFORM_MIDI_DRIVER_NULL { 1, "NULL", platform_midi_init_null }
-//#include "platform_midi_null.h"
+// Only used when asked for, since it doesn't talk to anything
+#ifdef PLATFORM_MIDI_NULL
+#define PLATFORM_MIDI_DRIVER_NULL { 0, "NULL", platform_midi_init_null }
+#include "platform_midi_null.h"
+#else
 #define PLATFORM_MIDI_DRIVER_NULL { 0, 0, 0 }
+#endif
 
 #ifdef PLATFORM_MIDI_ALSA
 #define PLATFORM_MIDI_DRIVER_ALSA { 2, "ALSA-Sequencer", platform_midi_init_alsa }
@@ -304,6 +974,22 @@ struct platform_midi_driver
 #define PLATFORM_MIDI_DRIVER_ALSA { 0, 0, 0 }
 #endif
 
+// Never picked automatically, since it only talks to other platform_midi processes
+#ifdef PLATFORM_MIDI_SHM
+#define PLATFORM_MIDI_DRIVER_SHM { 0, "SharedMemory", platform_midi_init_shm }
+#include "platform_midi_shm.h"
+#else
+#define PLATFORM_MIDI_DRIVER_SHM { 0, 0, 0 }
+#endif
+
+// Also only used when asked for, since it needs to be told where the other end is
+#ifdef PLATFORM_MIDI_UDP
+#define PLATFORM_MIDI_DRIVER_UDP { 0, "UDP", platform_midi_init_udp }
+#include "platform_midi_udp.h"
+#else
+#define PLATFORM_MIDI_DRIVER_UDP { 0, 0, 0 }
+#endif
+
 #ifdef PLATFORM_MIDI_ALSA_RAWMIDI
 #define PLATFORM_MIDI_DRIVER_ALSA_RAWMIDI { 1, "ALSA-RawMIDI", platform_midi_init_alsa_rawmidi }
 #include "platform_midi_alsa_rawmidi.h"
@@ -342,54 +1028,1307 @@ struct platform_midi_driver_def
 static const struct platform_midi_driver_def PLATFORM_MIDI_DRIVERS[] = {
     PLATFORM_MIDI_DRIVER_NULL,
     PLATFORM_MIDI_DRIVER_ALSA,
+    PLATFORM_MIDI_DRIVER_SHM,
+    PLATFORM_MIDI_DRIVER_UDP,
     PLATFORM_MIDI_DRIVER_ALSA_RAWMIDI,
     PLATFORM_MIDI_DRIVER_COREMIDI,
     PLATFORM_MIDI_DRIVER_WINMM,
     PLATFORM_MIDI_DRIVER_JACK,
 };
 
-struct platform_midi_driver* platform_midi_init(const char* name)
+#ifdef PLATFORM_MIDI_STATIC_BACKEND
+#define platform_midi_call_read(driver, out, size) PLATFORM_MIDI_STATIC_FN(read)(driver, out, size)
+#define platform_midi_call_write(driver, buf, size) PLATFORM_MIDI_STATIC_FN(write)(driver, buf, size)
+#define platform_midi_call_avail(driver) PLATFORM_MIDI_STATIC_FN(avail)(driver)
+#else
+#define platform_midi_call_read(driver, out, size) (driver)->readFn(driver, out, size)
+#define platform_midi_call_write(driver, buf, size) (driver)->writeFn(driver, buf, size)
+#define platform_midi_call_avail(driver) (driver)->availFn(driver)
+#endif
+
+// Whether a backend can be started, and if automatic, whether it's picked without being asked for.
+// A static build can only start the backend the API is bound to, which it always picks
+static int platform_midi_driver_usable(const struct platform_midi_driver_def *def, int automatic)
 {
-    const struct platform_midi_driver_def *driver = &PLATFORM_MIDI_DRIVERS[0];
+#ifdef PLATFORM_MIDI_STATIC_BACKEND
+    return def->initFn == PLATFORM_MIDI_STATIC_FN(init);
+#else
+    return def->initFn && (!automatic || def->priority > 0);
+#endif
+}
 
-    for (int i = 0; i < sizeof(PLATFORM_MIDI_DRIVERS) / sizeof(PLATFORM_MIDI_DRIVERS[0]); i++)
+static void platform_midi_set_rt_priority(int priority)
+{
+#if defined(_WIN32)
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
     {
-        if (PLATFORM_MIDI_DRIVERS[i].priority > driver->priority && PLATFORM_MIDI_DRIVERS[i].initFn)
-        {
-            driver = &PLATFORM_MIDI_DRIVERS[i];
-        }
+        printf("Warn: couldn't raise the thread priority\n");
     }
+#else
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
 
-    if (!driver->initFn)
+    int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (0 != result)
+    {
+        printf("Warn: couldn't set SCHED_FIFO priority %d: %s\n", priority, strerror(result));
+    }
+#endif
+}
+
+static int platform_midi_name_equal(const char *a, const char *b)
+{
+    for (; *a && *b; a++, b++)
+    {
+        char x = (*a >= 'A' && *a <= 'Z') ? *a - 'A' + 'a' : *a;
+        char y = (*b >= 'A' && *b <= 'Z') ? *b - 'A' + 'a' : *b;
+        if (x != y)
+        {
+            return 0;
+        }
+    }
+
+    return *a == *b;
+}
+
+struct platform_midi_driver* platform_midi_init(const char* name)
+{
+    return platform_midi_init_ex(name, NULL);
+}
+
+struct platform_midi_driver* platform_midi_init_ex(const char* name, const struct platform_midi_options* options)
+{
+    const int driverCount = sizeof(PLATFORM_MIDI_DRIVERS) / sizeof(PLATFORM_MIDI_DRIVERS[0]);
+    const struct platform_midi_driver_def *order[sizeof(PLATFORM_MIDI_DRIVERS) / sizeof(PLATFORM_MIDI_DRIVERS[0])];
+    int orderCount = 0;
+
+    if (options && options->backends)
+    {
+        for (int i = 0; options->backends[i] && orderCount < driverCount; i++)
+        {
+            int found = 0;
+
+            for (int j = 0; j < driverCount; j++)
+            {
+                if (platform_midi_driver_usable(&PLATFORM_MIDI_DRIVERS[j], 0) && platform_midi_name_equal(PLATFORM_MIDI_DRIVERS[j].name, options->backends[i]))
+                {
+                    order[orderCount++] = &PLATFORM_MIDI_DRIVERS[j];
+                    found = 1;
+                    break;
+                }
+            }
+
+            if (!found)
+            {
+                printf("Warn: MIDI backend %s isn't available\n", options->backends[i]);
+            }
+        }
+    }
+    else
+    {
+        // Highest priority first, leaving out the ones that are only used when asked for
+        for (int i = 0; i < driverCount; i++)
+        {
+            const struct platform_midi_driver_def *def = &PLATFORM_MIDI_DRIVERS[i];
+            int pos = orderCount;
+
+            if (!platform_midi_driver_usable(def, 1))
+            {
+                continue;
+            }
+
+            while (pos > 0 && order[pos - 1]->priority < def->priority)
+            {
+                order[pos] = order[pos - 1];
+                pos--;
+            }
+
+            order[pos] = def;
+            orderCount++;
+        }
+    }
+
+    if (orderCount == 0)
     {
         printf("ERR: No suitable MIDI backends found.\n");
         return NULL;
     }
 
-    return driver->initFn(name, NULL);
+    if (options && options->rt_priority > 0)
+    {
+        platform_midi_set_rt_priority(options->rt_priority);
+    }
+
+    for (int i = 0; i < orderCount; i++)
+    {
+        struct platform_midi_driver *driver = order[i]->initFn(name, options);
+        if (driver)
+        {
+            return driver;
+        }
+
+        if (i + 1 < orderCount)
+        {
+            printf("MIDI backend %s failed, trying %s\n", order[i]->name, order[i + 1]->name);
+        }
+    }
+
+    printf("ERR: No MIDI backend could be started.\n");
+    return NULL;
 }
 
 void platform_midi_deinit(struct platform_midi_driver* driver)
 {
+    if (driver)
+    {
+        free(driver->read_held);
+        driver->read_held = NULL;
+    }
+
     if (driver && driver->deinitFn)
     {
         driver->deinitFn(driver);
     }
 }
 
+// Waits for input on a blocking driver, by polling its descriptors or else by sleeping a little
+static void platform_midi_wait_input(struct platform_midi_driver* driver)
+{
+#if defined(_WIN32)
+    Sleep(1);
+#else
+    int fds[8];
+    struct pollfd pfds[8];
+    int count = platform_midi_fds(driver, fds, 8);
+
+    if (count <= 0)
+    {
+        struct timespec ts = { 0, 1000000 };
+        nanosleep(&ts, NULL);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+
+    poll(pfds, count, -1);
+#endif
+}
+
 int platform_midi_read(struct platform_midi_driver* driver, unsigned char * out, int size)
 {
-    return driver->readFn(driver, out, size);
+    int result;
+
+    if (driver->read_held_len > 0)
+    {
+        // A SysEx platform_midi_read_events() had no room for comes first
+        result = (size < driver->read_held_len) ? size : driver->read_held_len;
+        memcpy(out, driver->read_held, result);
+        driver->read_held_len = 0;
+        driver->read_time = driver->read_held_time;
+    }
+    else
+    {
+        driver->read_time = platform_midi_event_time();
+        result = platform_midi_call_read(driver, out, size);
+    }
+
+    while (result == 0 && driver->blocking)
+    {
+        platform_midi_wait_input(driver);
+        driver->read_time = platform_midi_event_time();
+        result = platform_midi_call_read(driver, out, size);
+    }
+
+    if (result > 0 && driver->taps)
+    {
+        platform_midi_run_taps(driver, PLATFORM_MIDI_TAP_INPUT, out, result);
+    }
+
+    return result;
 }
 
 int platform_midi_avail(struct platform_midi_driver* driver)
 {
-    return driver->availFn(driver);
+    int result = platform_midi_call_avail(driver);
+
+    if (driver->read_held_len > 0)
+    {
+        return (result > 0) ? result + 1 : 1;
+    }
+
+    return result;
+}
+
+static int platform_midi_write_now(struct platform_midi_driver* driver, const unsigned char* buf, int size)
+{
+    int result = platform_midi_call_write(driver, buf, size);
+
+    if (result > 0 && driver->taps)
+    {
+        platform_midi_run_taps(driver, PLATFORM_MIDI_TAP_OUTPUT, buf, result);
+    }
+
+    return result;
+}
+
+// Sends the queued real-time messages. Only called by the thread holding the output
+static void platform_midi_flush_realtime(struct platform_midi_driver* driver)
+{
+    struct platform_midi_realtime_msg msg;
+
+    while (platform_midi_realtime_pop(&driver->realtime_out, &msg))
+    {
+        if (platform_midi_write_now(driver, &msg.status, 1) <= 0)
+        {
+            printf("Error sending real-time message 0x%02X\n", msg.status);
+        }
+    }
+}
+
+static int platform_midi_output_trylock(struct platform_midi_driver* driver)
+{
+    return !__atomic_exchange_n(&driver->realtime_out.busy, 1, __ATOMIC_SEQ_CST);
+}
+
+static void platform_midi_output_lock(struct platform_midi_driver* driver)
+{
+    // Real-time writers only ever hold the output for a few bytes
+    while (!platform_midi_output_trylock(driver))
+    {
+#if defined(_WIN32)
+        SwitchToThread();
+#else
+        sched_yield();
+#endif
+    }
+
+    platform_midi_flush_realtime(driver);
+}
+
+static void platform_midi_output_unlock(struct platform_midi_driver* driver)
+{
+    __atomic_store_n(&driver->realtime_out.busy, 0, __ATOMIC_SEQ_CST);
+
+    // A message queued after the last flush would otherwise wait for the next write
+    while (!platform_midi_realtime_empty(&driver->realtime_out) && platform_midi_output_trylock(driver))
+    {
+        platform_midi_flush_realtime(driver);
+        __atomic_store_n(&driver->realtime_out.busy, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+// Returns non-zero if the write took the lock. Until platform_midi_write_realtime() is first
+// used there's nothing to keep apart, so a write only marks itself as running
+static int platform_midi_output_enter(struct platform_midi_driver* driver)
+{
+    __atomic_store_n(&driver->realtime_out.unlocked, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&driver->realtime_out.active, __ATOMIC_SEQ_CST))
+    {
+        return 0;
+    }
+
+    __atomic_store_n(&driver->realtime_out.unlocked, 0, __ATOMIC_RELEASE);
+    platform_midi_output_lock(driver);
+    return 1;
+}
+
+static void platform_midi_output_leave(struct platform_midi_driver* driver, int locked)
+{
+    if (locked)
+    {
+        platform_midi_output_unlock(driver);
+    }
+    else
+    {
+        __atomic_store_n(&driver->realtime_out.unlocked, 0, __ATOMIC_RELEASE);
+    }
 }
 
 int platform_midi_write(struct platform_midi_driver* driver, const unsigned char* buf, int size)
 {
-    return driver->writeFn(driver, buf, size);
+    int written = 0;
+    int result = 0;
+    int inSysex = 0;
+
+    if (!platform_midi_output_enter(driver))
+    {
+        // No real-time messages to fit in, so the buffer goes out as it is
+        result = platform_midi_write_now(driver, buf, size);
+        platform_midi_output_leave(driver, 0);
+        return result;
+    }
+
+    while (written < size)
+    {
+        int end = size;
+
+        if (driver->stream_out && size - written > PLATFORM_MIDI_SYSEX_CHUNK_SIZE)
+        {
+            if (buf[written] == 0xF0 || inSysex)
+            {
+                // Long SysEx goes out in pieces, with any real-time messages sent in between
+                end = written + 1;
+                while (end < size && !(buf[end] & 0x80))
+                {
+                    end++;
+                }
+                if (end < size && buf[end] == 0xF7)
+                {
+                    end++;
+                }
+
+                inSysex = end - written > PLATFORM_MIDI_SYSEX_CHUNK_SIZE;
+                if (inSysex)
+                {
+                    end = written + PLATFORM_MIDI_SYSEX_CHUNK_SIZE;
+                }
+            }
+            else
+            {
+                // Everything up to the next SysEx can go in one write
+                const unsigned char *sysex = (const unsigned char*)memchr(buf + written, 0xF0, size - written);
+                end = sysex ? (int)(sysex - buf) : size;
+            }
+        }
+
+        result = platform_midi_write_now(driver, buf + written, end - written);
+        if (result <= 0)
+        {
+            break;
+        }
+
+        written += result;
+        if (written < end)
+        {
+            // Short write, the backend can't take any more right now
+            break;
+        }
+
+        platform_midi_flush_realtime(driver);
+    }
+
+    platform_midi_output_unlock(driver);
+    return written ? written : result;
+}
+
+int platform_midi_write_realtime(struct platform_midi_driver* driver, unsigned char status)
+{
+    if (status < 0xF8)
+    {
+        printf("Error: 0x%02X is not a real-time message\n", status);
+        return -1;
+    }
+
+    if (!__atomic_load_n(&driver->realtime_out.active, __ATOMIC_ACQUIRE))
+    {
+        // Writes lock from now on; wait out one that started before it could see that
+        __atomic_store_n(&driver->realtime_out.active, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&driver->realtime_out.unlocked, __ATOMIC_SEQ_CST))
+        {
+#if defined(_WIN32)
+            SwitchToThread();
+#else
+            sched_yield();
+#endif
+        }
+    }
+
+    if (!platform_midi_realtime_push(&driver->realtime_out, status, platform_midi_event_time()))
+    {
+        printf("Warn: MIDI real-time output queue is full, dropping an event\n");
+        return -1;
+    }
+
+    // If another thread holds the output, it sends the message when it's between writes
+    if (platform_midi_output_trylock(driver))
+    {
+        platform_midi_flush_realtime(driver);
+        platform_midi_output_unlock(driver);
+    }
+
+    return 1;
+}
+
+int platform_midi_write_multi(struct platform_midi_driver* driver, const unsigned char* buf, int size, const struct platform_midi_dest* dests, int count)
+{
+    if (!driver->writeMultiFn)
+    {
+        printf("Error: this backend can't address destinations\n");
+        return -1;
+    }
+
+    int locked = platform_midi_output_enter(driver);
+    int result = driver->writeMultiFn(driver, buf, size, dests, count);
+    platform_midi_output_leave(driver, locked);
+
+    if (result > 0 && driver->taps)
+    {
+        platform_midi_run_taps(driver, PLATFORM_MIDI_TAP_OUTPUT, buf, result);
+    }
+
+    return result;
+}
+
+int platform_midi_fds(struct platform_midi_driver* driver, int* fds, int max)
+{
+    if (!driver->fdsFn)
+    {
+        return 0;
+    }
+
+    return driver->fdsFn(driver, fds, max);
+}
+
+int platform_midi_event_from_bytes(struct platform_midi_event* event, const unsigned char* buf, int size)
+{
+    memset(event, 0, sizeof(*event));
+
+    if (size <= 0)
+    {
+        return 0;
+    }
+
+    if (buf[0] == 0xF0 || !(buf[0] & 0x80))
+    {
+        const unsigned char *end = (const unsigned char*)memchr(buf, 0xF7, size);
+        int length = end ? (int)(end - buf) + 1 : size;
+
+        event->status = 0xF0;
+        event->sysex = buf;
+        event->sysex_len = (length > 0xFFFF) ? 0xFFFF : length;
+        return event->sysex_len;
+    }
+
+    int length = platform_midi_msg_length(buf[0]);
+    if (length > size)
+    {
+        return 0;
+    }
+
+    event->status = buf[0];
+    if (length > 1)
+    {
+        event->data[0] = buf[1];
+    }
+    if (length > 2)
+    {
+        event->data[1] = buf[2];
+    }
+
+    return length;
+}
+
+int platform_midi_event_to_bytes(const struct platform_midi_event* event, unsigned char* out, int size)
+{
+    if (event->status == 0xF0)
+    {
+        if (event->sysex_len > size)
+        {
+            return 0;
+        }
+
+        memcpy(out, event->sysex, event->sysex_len);
+        return event->sysex_len;
+    }
+
+    int length = platform_midi_msg_length(event->status);
+    if (length > size)
+    {
+        return 0;
+    }
+
+    out[0] = event->status;
+    if (length > 1)
+    {
+        out[1] = event->data[0];
+    }
+    if (length > 2)
+    {
+        out[2] = event->data[1];
+    }
+
+    return length;
+}
+
+int platform_midi_event_to_ump(const struct platform_midi_event* event, unsigned int* words, int max)
+{
+    unsigned int group = (event->group & 0x0F) << 24;
+
+    if (event->status != 0xF0)
+    {
+        if (max < 1)
+        {
+            return 0;
+        }
+
+        // Type 1 for system messages, 2 for MIDI 1.0 channel voice
+        unsigned int type = (event->status >= 0xF0) ? 0x1 : 0x2;
+        words[0] = (type << 28) | group | (event->status << 16) | (event->data[0] << 8) | event->data[1];
+        return 1;
+    }
+
+    // SysEx7 packets carry up to 6 bytes without the F0 and F7
+    const unsigned char *data = event->sysex;
+    int length = event->sysex_len;
+    int start = (length > 0 && data[0] == 0xF0);
+    int end = (length > 0 && data[length - 1] == 0xF7);
+
+    data += start;
+    length -= start + end;
+    if (length < 0)
+    {
+        length = 0;
+    }
+
+    int packets = (length + 5) / 6;
+    if (packets == 0)
+    {
+        packets = 1;
+    }
+
+    if (max < packets * 2)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < packets; i++)
+    {
+        int first = (i == 0 && start);
+        int last = (i == packets - 1 && end);
+        int bytes = (length - i * 6 > 6) ? 6 : length - i * 6;
+        unsigned char payload[6] = { 0 };
+        unsigned int packetStatus;
+
+        if (first && last)
+        {
+            packetStatus = 0x0;
+        }
+        else if (first)
+        {
+            packetStatus = 0x1;
+        }
+        else if (last)
+        {
+            packetStatus = 0x3;
+        }
+        else
+        {
+            packetStatus = 0x2;
+        }
+
+        memcpy(payload, data + i * 6, bytes);
+        words[i * 2] = (0x3u << 28) | group | (packetStatus << 20) | (bytes << 16) | (payload[0] << 8) | payload[1];
+        words[i * 2 + 1] = (payload[2] << 24) | (payload[3] << 16) | (payload[4] << 8) | payload[5];
+    }
+
+    return packets * 2;
+}
+
+int platform_midi_event_from_ump(struct platform_midi_event* event, const unsigned int* words, int count)
+{
+    if (count < 1)
+    {
+        return 0;
+    }
+
+    unsigned int type = words[0] >> 28;
+    if (count < PLATFORM_MIDI_UMP_WORDS[type])
+    {
+        return 0;
+    }
+
+    memset(event, 0, sizeof(*event));
+    event->group = (words[0] >> 24) & 0x0F;
+
+    if (type == 0x1 || type == 0x2)
+    {
+        event->status = (words[0] >> 16) & 0xFF;
+        event->data[0] = (words[0] >> 8) & 0x7F;
+        event->data[1] = words[0] & 0x7F;
+    }
+
+    return PLATFORM_MIDI_UMP_WORDS[type];
+}
+
+// Fills events from the byte stream for backends without a native event path. The first message
+// is read straight into sysexBuf, later ones into the driver's read_held buffer, which can hold
+// as much as sysexBuf. A SysEx that doesn't fit in what's left of sysexBuf stays there for the
+// next call, since the byte stream can't be peeked at
+static int platform_midi_read_events_bytes(struct platform_midi_driver* driver, struct platform_midi_event* events, int max, unsigned char* sysexBuf, int sysexSize)
+{
+    unsigned char small[3];
+    unsigned int timestamp = platform_midi_event_time();
+    int used = 0;
+    int count = 0;
+
+    driver->read_time = timestamp;
+
+    while (count < max)
+    {
+        unsigned char *dest;
+        int read = driver->read_held_len;
+
+        if (read > 0)
+        {
+            dest = driver->read_held;
+            driver->read_held_len = 0;
+            driver->read_time = driver->read_held_time;
+        }
+        else
+        {
+            int space = sysexSize;
+
+            if (!sysexBuf || sysexSize < (int)sizeof(small))
+            {
+                dest = small;
+                space = sizeof(small);
+            }
+            else if (used == 0)
+            {
+                dest = sysexBuf;
+            }
+            else
+            {
+                if (driver->read_held_capacity < sysexSize)
+                {
+                    unsigned char *grown = (unsigned char*)realloc(driver->read_held, sysexSize);
+                    if (!grown)
+                    {
+                        printf("Err: couldn't allocate %d bytes to read into\n", sysexSize);
+                        break;
+                    }
+                    driver->read_held = grown;
+                    driver->read_held_capacity = sysexSize;
+                }
+                dest = driver->read_held;
+            }
+
+            driver->read_time = timestamp;
+            read = platform_midi_call_read(driver, dest, space);
+            if (read < 0)
+            {
+                return count ? count : read;
+            }
+            else if (read == 0)
+            {
+                break;
+            }
+        }
+
+        if (!platform_midi_event_from_bytes(&events[count], dest, read))
+        {
+            continue;
+        }
+
+        if (events[count].status == 0xF0)
+        {
+            int length = events[count].sysex_len;
+
+            if (dest == small)
+            {
+                // Nowhere to keep it
+                continue;
+            }
+
+            if (dest != sysexBuf + used)
+            {
+                if (length > sysexSize - used)
+                {
+                    if (used > 0)
+                    {
+                        // Leave it for the next call, when the whole buffer is free again
+                        driver->read_held_len = read;
+                        driver->read_held_time = driver->read_time;
+                        break;
+                    }
+
+                    printf("Warn: dropping a %d byte SysEx that can't fit in %d bytes\n", length, sysexSize);
+                    continue;
+                }
+
+                memcpy(sysexBuf + used, dest, length);
+                events[count].sysex = sysexBuf + used;
+            }
+
+            used += length;
+        }
+
+        events[count++].timestamp = driver->read_time;
+    }
+
+    return count;
+}
+
+// platform_midi_read_events() without the waiting
+static int platform_midi_read_events_now(struct platform_midi_driver* driver, struct platform_midi_event* events, int max, unsigned char* sysexBuf, int sysexSize)
+{
+    int count;
+
+    if (driver->readEventsFn)
+    {
+        count = driver->readEventsFn(driver, events, max, sysexBuf, sysexSize);
+    }
+    else
+    {
+        count = platform_midi_read_events_bytes(driver, events, max, sysexBuf, sysexSize);
+    }
+
+    // Taps only see bytes, so only serialize if someone is listening
+    for (int i = 0; i < count && driver->taps; i++)
+    {
+        unsigned char bytes[3];
+
+        driver->read_time = events[i].timestamp;
+        if (events[i].status == 0xF0)
+        {
+            platform_midi_run_taps(driver, PLATFORM_MIDI_TAP_INPUT, events[i].sysex, events[i].sysex_len);
+        }
+        else
+        {
+            platform_midi_run_taps(driver, PLATFORM_MIDI_TAP_INPUT, bytes, platform_midi_event_to_bytes(&events[i], bytes, sizeof(bytes)));
+        }
+    }
+
+    return count;
+}
+
+int platform_midi_read_events(struct platform_midi_driver* driver, struct platform_midi_event* events, int max, unsigned char* sysexBuf, int sysexSize)
+{
+    int count = platform_midi_read_events_now(driver, events, max, sysexBuf, sysexSize);
+
+    while (count == 0 && max > 0 && driver->blocking)
+    {
+        platform_midi_wait_input(driver);
+        count = platform_midi_read_events_now(driver, events, max, sysexBuf, sysexSize);
+    }
+
+    return count;
+}
+
+int platform_midi_write_events(struct platform_midi_driver* driver, const struct platform_midi_event* events, int count)
+{
+    int written = 0;
+    int locked = platform_midi_output_enter(driver);
+
+    if (driver->writeEventsFn)
+    {
+        written = driver->writeEventsFn(driver, events, count);
+    }
+    else
+    {
+        unsigned char bytes[3];
+
+        for (; written < count; written++)
+        {
+            const unsigned char *buf = bytes;
+            int size;
+
+            if (events[written].status == 0xF0)
+            {
+                buf = events[written].sysex;
+                size = events[written].sysex_len;
+            }
+            else
+            {
+                size = platform_midi_event_to_bytes(&events[written], bytes, sizeof(bytes));
+            }
+
+            // Skip the taps here, they're run below
+            if (size > 0 && platform_midi_call_write(driver, buf, size) < 0)
+            {
+                break;
+            }
+
+            if (locked)
+            {
+                platform_midi_flush_realtime(driver);
+            }
+        }
+
+        if (written == 0 && count > 0)
+        {
+            platform_midi_output_leave(driver, locked);
+            return -1;
+        }
+    }
+
+    platform_midi_output_leave(driver, locked);
+
+    for (int i = 0; i < written && driver->taps; i++)
+    {
+        unsigned char bytes[3];
+
+        if (events[i].status == 0xF0)
+        {
+            platform_midi_run_taps(driver, PLATFORM_MIDI_TAP_OUTPUT, events[i].sysex, events[i].sysex_len);
+        }
+        else
+        {
+            platform_midi_run_taps(driver, PLATFORM_MIDI_TAP_OUTPUT, bytes, platform_midi_event_to_bytes(&events[i], bytes, sizeof(bytes)));
+        }
+    }
+
+    return written;
+}
+
+// Scales a value up to more bits so that the minimum, center and maximum map onto the same points,
+// as the UMP spec translation rules require
+static unsigned int platform_midi_ump_scale_up(unsigned int value, int srcBits, int dstBits)
+{
+    int scaleBits = dstBits - srcBits;
+    unsigned int shifted = value << scaleBits;
+    unsigned int center = 1u << (srcBits - 1);
+
+    if (value <= center)
+    {
+        return shifted;
+    }
+
+    // Above the center, fill the new low bits by repeating the bits below the top one
+    int repeatBits = srcBits - 1;
+    unsigned int repeat = value & ((1u << repeatBits) - 1);
+
+    if (scaleBits > repeatBits)
+    {
+        repeat <<= scaleBits - repeatBits;
+    }
+    else
+    {
+        repeat >>= repeatBits - scaleBits;
+    }
+
+    while (repeat)
+    {
+        shifted |= repeat;
+        repeat >>= repeatBits;
+    }
+
+    return shifted;
+}
+
+int platform_midi_ump_to_midi2(const unsigned int* words, int count, unsigned int* out, int max)
+{
+    int read = 0;
+    int written = 0;
+
+    while (read < count)
+    {
+        unsigned int type = words[read] >> 28;
+        int size = PLATFORM_MIDI_UMP_WORDS[type];
+
+        if (read + size > count)
+        {
+            break;
+        }
+
+        if (type != 0x2)
+        {
+            if (written + size > max)
+            {
+                break;
+            }
+
+            memcpy(out + written, words + read, size * sizeof(unsigned int));
+            written += size;
+            read += size;
+            continue;
+        }
+
+        if (written + 2 > max)
+        {
+            break;
+        }
+
+        unsigned int word = words[read];
+        unsigned int head = (0x4u << 28) | (word & 0x0FFF0000);
+        unsigned int data0 = (word >> 8) & 0x7F;
+        unsigned int data1 = word & 0x7F;
+        unsigned int value = 0;
+
+        switch ((word >> 20) & 0x0F)
+        {
+            case 0x9:
+                if (data1 == 0)
+                {
+                    // Note on with velocity 0 is a note off with the default velocity of 64
+                    head = (head & 0xFF0FFFFF) | (0x8 << 20);
+                    data1 = 64;
+                }
+                // Fall through
+            case 0x8:
+                head |= data0 << 8;
+                value = platform_midi_ump_scale_up(data1, 7, 16) << 16;
+                break;
+
+            case 0xA:
+            case 0xB:
+                head |= data0 << 8;
+                value = platform_midi_ump_scale_up(data1, 7, 32);
+                break;
+
+            case 0xC:
+                // No bank select, that would need state from earlier CCs
+                value = data0 << 24;
+                break;
+
+            case 0xD:
+                value = platform_midi_ump_scale_up(data0, 7, 32);
+                break;
+
+            case 0xE:
+                value = platform_midi_ump_scale_up((data1 << 7) | data0, 14, 32);
+                break;
+        }
+
+        out[written++] = head;
+        out[written++] = value;
+        read += 1;
+    }
+
+    return written;
+}
+
+int platform_midi_ump_to_midi1(const unsigned int* words, int count, unsigned int* out, int max)
+{
+    int read = 0;
+    int written = 0;
+
+    while (read < count)
+    {
+        unsigned int type = words[read] >> 28;
+        int size = PLATFORM_MIDI_UMP_WORDS[type];
+
+        if (read + size > count)
+        {
+            break;
+        }
+
+        if (type != 0x4)
+        {
+            if (written + size > max)
+            {
+                break;
+            }
+
+            memcpy(out + written, words + read, size * sizeof(unsigned int));
+            written += size;
+            read += size;
+            continue;
+        }
+
+        unsigned int word = words[read];
+        unsigned int value = words[read + 1];
+        unsigned int head = (0x2u << 28) | (word & 0x0F0F0000);
+        unsigned int index = (word >> 8) & 0x7F;
+        unsigned int midi1[4];
+        int produced = 0;
+
+        switch ((word >> 20) & 0x0F)
+        {
+            case 0x8:
+                midi1[produced++] = head | (0x8 << 20) | (index << 8) | (value >> 25);
+                break;
+
+            case 0x9:
+            {
+                unsigned int velocity = value >> 25;
+                // Velocity 0 would turn it into a note off
+                midi1[produced++] = head | (0x9 << 20) | (index << 8) | (velocity ? velocity : 1);
+                break;
+            }
+
+            case 0xA:
+            case 0xB:
+                midi1[produced++] = head | (word & 0x00F00000) | (index << 8) | (value >> 25);
+                break;
+
+            case 0xC:
+                if (word & 0x1)
+                {
+                    // Bank valid, so select it first
+                    midi1[produced++] = head | (0xB << 20) | (0 << 8) | ((value >> 8) & 0x7F);
+                    midi1[produced++] = head | (0xB << 20) | (32 << 8) | (value & 0x7F);
+                }
+                midi1[produced++] = head | (0xC << 20) | (((value >> 24) & 0x7F) << 8);
+                break;
+
+            case 0xD:
+                midi1[produced++] = head | (0xD << 20) | ((value >> 25) << 8);
+                break;
+
+            case 0xE:
+                midi1[produced++] = head | (0xE << 20) | (((value >> 18) & 0x7F) << 8) | (value >> 25);
+                break;
+
+            case 0x2:
+            case 0x3:
+            {
+                // Registered / assignable controllers become the RPN / NRPN CC sequence
+                int registered = (((word >> 20) & 0x0F) == 0x2);
+                unsigned int cc = head | (0xB << 20);
+                midi1[produced++] = cc | ((registered ? 101 : 99) << 8) | index;
+                midi1[produced++] = cc | ((registered ? 100 : 98) << 8) | (word & 0x7F);
+                midi1[produced++] = cc | (6 << 8) | (value >> 25);
+                midi1[produced++] = cc | (38 << 8) | ((value >> 18) & 0x7F);
+                break;
+            }
+
+            default:
+                // Per-note and relative messages have no MIDI 1.0 equivalent
+                break;
+        }
+
+        if (written + produced > max)
+        {
+            break;
+        }
+
+        memcpy(out + written, midi1, produced * sizeof(unsigned int));
+        written += produced;
+        read += size;
+    }
+
+    return written;
+}
+
+// Runs the taps on the bytes for each UMP packet, so they see the same thing as with platform_midi_read()
+static void platform_midi_run_taps_ump(struct platform_midi_driver *driver, int direction, const unsigned int *words, int count)
+{
+    int pos = 0;
+
+    while (pos < count)
+    {
+        unsigned char bytes[16];
+        int size = PLATFORM_MIDI_UMP_WORDS[words[pos] >> 28];
+
+        if (pos + size > count)
+        {
+            break;
+        }
+
+        int length = platform_midi_convert_from_ump(bytes, sizeof(bytes), words + pos, size);
+        if (length > 0)
+        {
+            platform_midi_run_taps(driver, direction, bytes, length);
+        }
+
+        pos += size;
+    }
+}
+
+// platform_midi_read_ump() without the waiting
+static int platform_midi_read_ump_now(struct platform_midi_driver* driver, unsigned int* words, int max, int protocol)
+{
+    if (driver->readUmpFn)
+    {
+        driver->read_time = platform_midi_event_time();
+        int count = driver->readUmpFn(driver, words, max, protocol);
+
+        if (count > 0 && driver->taps)
+        {
+            platform_midi_run_taps_ump(driver, PLATFORM_MIDI_TAP_INPUT, words, count);
+        }
+
+        return count;
+    }
+
+    // MIDI 1.0 backends, one event at a time so a SysEx is never read into more space than the words left
+    unsigned char sysexBuf[192];
+    int written = 0;
+
+    while (max - written >= 2)
+    {
+        struct platform_midi_event event;
+        int sysexSize = (max - written) / 2 * 6;
+
+        if (sysexSize > (int)sizeof(sysexBuf))
+        {
+            sysexSize = sizeof(sysexBuf);
+        }
+
+        int read = platform_midi_read_events_now(driver, &event, 1, sysexBuf, sysexSize);
+        if (read < 0)
+        {
+            return written ? written : -1;
+        }
+        else if (read == 0)
+        {
+            break;
+        }
+
+        unsigned int midi1[64];
+        int count = platform_midi_event_to_ump(&event, midi1, 64);
+
+        if (protocol == PLATFORM_MIDI_PROTOCOL_2)
+        {
+            written += platform_midi_ump_to_midi2(midi1, count, words + written, max - written);
+        }
+        else
+        {
+            written += platform_midi_ump_to_midi1(midi1, count, words + written, max - written);
+        }
+    }
+
+    return written;
+}
+
+int platform_midi_read_ump(struct platform_midi_driver* driver, unsigned int* words, int max, int protocol)
+{
+    int count = platform_midi_read_ump_now(driver, words, max, protocol);
+
+    while (count == 0 && max > 0 && driver->blocking)
+    {
+        platform_midi_wait_input(driver);
+        count = platform_midi_read_ump_now(driver, words, max, protocol);
+    }
+
+    return count;
+}
+
+int platform_midi_write_ump(struct platform_midi_driver* driver, const unsigned int* words, int count)
+{
+    if (driver->writeUmpFn)
+    {
+        int locked = platform_midi_output_enter(driver);
+        int written = driver->writeUmpFn(driver, words, count);
+        platform_midi_output_leave(driver, locked);
+
+        if (written > 0 && driver->taps)
+        {
+            platform_midi_run_taps_ump(driver, PLATFORM_MIDI_TAP_OUTPUT, words, written);
+        }
+
+        return written;
+    }
+
+    // MIDI 1.0 backends get events, with SysEx7 packets joined back together where they fit
+    struct platform_midi_event events[16];
+    unsigned char sysexBuf[256];
+    int eventCount = 0;
+    int sysexLen = 0;
+    int pos = 0;
+
+    while (pos < count)
+    {
+        unsigned int type = words[pos] >> 28;
+        int size = PLATFORM_MIDI_UMP_WORDS[type];
+
+        if (pos + size > count)
+        {
+            break;
+        }
+
+        if (type == 0x3)
+        {
+            if (sysexLen + 8 > (int)sizeof(sysexBuf))
+            {
+                // Send what we have as a piece of the SysEx
+                struct platform_midi_event piece = { 0 };
+                piece.status = 0xF0;
+                piece.sysex = sysexBuf;
+                piece.sysex_len = sysexLen;
+
+                if (eventCount > 0 && platform_midi_write_events(driver, events, eventCount) < 0)
+                {
+                    return -1;
+                }
+                eventCount = 0;
+
+                if (platform_midi_write_events(driver, &piece, 1) < 0)
+                {
+                    return -1;
+                }
+                sysexLen = 0;
+            }
+
+            sysexLen += platform_midi_convert_from_ump(sysexBuf + sysexLen, sizeof(sysexBuf) - sysexLen, words + pos, size);
+
+            unsigned char packetStatus = (words[pos] >> 20) & 0x0F;
+            if (packetStatus == 0x0 || packetStatus == 0x3)
+            {
+                struct platform_midi_event *event = &events[eventCount++];
+                memset(event, 0, sizeof(*event));
+                event->status = 0xF0;
+                event->group = (words[pos] >> 24) & 0x0F;
+                event->sysex = sysexBuf;
+                event->sysex_len = sysexLen;
+            }
+        }
+        else
+        {
+            unsigned int midi1[4];
+            int midi1Words = platform_midi_ump_to_midi1(words + pos, size, midi1, 4);
+
+            for (int i = 0; i < midi1Words; i++)
+            {
+                platform_midi_event_from_ump(&events[eventCount], &midi1[i], 1);
+                if (events[eventCount].status)
+                {
+                    eventCount++;
+                }
+            }
+        }
+
+        pos += size;
+
+        // A finished SysEx points into sysexBuf, so it has to go out before that's reused
+        int finishedSysex = (eventCount > 0 && events[eventCount - 1].status == 0xF0);
+
+        if (finishedSysex || eventCount > (int)(sizeof(events) / sizeof(events[0])) - 4)
+        {
+            if (platform_midi_write_events(driver, events, eventCount) < 0)
+            {
+                return -1;
+            }
+            eventCount = 0;
+
+            if (finishedSysex)
+            {
+                sysexLen = 0;
+            }
+        }
+    }
+
+    if (eventCount > 0 && platform_midi_write_events(driver, events, eventCount) < 0)
+    {
+        return -1;
+    }
+
+    return pos;
+}
+
+unsigned int platform_midi_read_time(struct platform_midi_driver* driver)
+{
+    return driver->read_time;
+}
+
+void platform_midi_add_tap(struct platform_midi_driver* driver, struct platform_midi_tap* tap)
+{
+    tap->next = driver->taps;
+    driver->taps = tap;
+}
+
+void platform_midi_remove_tap(struct platform_midi_driver* driver, struct platform_midi_tap* tap)
+{
+    struct platform_midi_tap **cur = &driver->taps;
+
+    while (*cur)
+    {
+        if (*cur == tap)
+        {
+            *cur = tap->next;
+            tap->next = NULL;
+            return;
+        }
+
+        cur = &(*cur)->next;
+    }
 }
 
 #ifdef __cplusplus
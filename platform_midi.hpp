@@ -0,0 +1,603 @@
+#ifndef _PLATFORM_MIDI_HPP_
+#define _PLATFORM_MIDI_HPP_
+
+#include "platform_midi.h"
+
+#include <coroutine>
+#include <cstdio>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <poll.h>
+#endif
+
+/*
+ * platform_midi.hpp
+ *
+ * Optional C++20 front-end: an RAII driver whose reads and writes can be awaited
+ * from coroutines, e.g.
+ *
+ *     platform_midi::poll_reactor reactor;
+ *     platform_midi::driver midi(reactor, "myapp");
+ *     std::span<const unsigned char> msg = co_await midi.next_message();
+ *     co_await midi.write(msg);
+ *
+ * A waiting coroutine is parked on the driver's poll descriptor in a reactor and
+ * resumed by it once input arrives. To run on your own event loop, implement
+ * platform_midi::reactor for it; poll_reactor is a small one for everything else.
+ * Nothing here allocates per message: messages are views into the driver's buffer.
+ *
+ * The C implementation still has to be compiled into one translation unit by
+ * defining PLATFORM_MIDI_IMPLEMENTATION before including this header.
+ */
+
+#ifndef PLATFORM_MIDI_HPP_BUFFER_SIZE
+#define PLATFORM_MIDI_HPP_BUFFER_SIZE 1024
+#endif
+
+#ifndef PLATFORM_MIDI_HPP_MAX_WAITERS
+#define PLATFORM_MIDI_HPP_MAX_WAITERS 64
+#endif
+
+namespace platform_midi
+{
+
+// Something parked in a reactor, waiting for input
+class waiter
+{
+public:
+    virtual void ready() = 0;
+
+protected:
+    ~waiter() = default;
+};
+
+// Parks waiters until their descriptor is readable. Call w->ready() once, from the thread that
+// runs the coroutines, when fd becomes readable; it may park itself again from inside ready().
+// fd is -1 for backends that have no poll descriptors, which should be called back after a short delay.
+// Returns false if w can't be parked, and its awaiter then resumes at once with an error
+class reactor
+{
+public:
+    virtual bool wait_readable(int fd, waiter *w) = 0;
+    virtual void cancel(waiter *w) = 0;
+
+protected:
+    ~reactor() = default;
+};
+
+// A reactor on poll(), with a fixed number of slots
+class poll_reactor final : public reactor
+{
+public:
+    bool wait_readable(int fd, waiter *w) override
+    {
+        if (count == PLATFORM_MIDI_HPP_MAX_WAITERS)
+        {
+            printf("Error: too many coroutines waiting on MIDI input\n");
+            return false;
+        }
+
+        entries[count].fd = fd;
+        entries[count].w = w;
+        count++;
+        return true;
+    }
+
+    void cancel(waiter *w) override
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (entries[i].w == w)
+            {
+                entries[i] = entries[--count];
+                return;
+            }
+        }
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    // Waits up to timeoutMs, or forever if it's negative, and wakes everything that's ready.
+    // Returns the number of waiters woken
+    int run_once(int timeoutMs)
+    {
+        entry woken[PLATFORM_MIDI_HPP_MAX_WAITERS];
+        int wokenCount = 0;
+        int polled = 0;
+        bool deferred = false;
+
+#if defined(_WIN32)
+        // No descriptors to wait on here, everything is deferred
+        (void)polled;
+        Sleep(1);
+        deferred = true;
+#else
+        struct pollfd pfds[PLATFORM_MIDI_HPP_MAX_WAITERS];
+        int slots[PLATFORM_MIDI_HPP_MAX_WAITERS];
+
+        for (int i = 0; i < count; i++)
+        {
+            if (entries[i].fd < 0)
+            {
+                deferred = true;
+                continue;
+            }
+
+            pfds[polled].fd = entries[i].fd;
+            pfds[polled].events = POLLIN;
+            pfds[polled].revents = 0;
+            slots[polled++] = i;
+        }
+
+        if (deferred && (timeoutMs < 0 || timeoutMs > 1))
+        {
+            timeoutMs = 1;
+        }
+
+        if (poll(pfds, polled, timeoutMs) < 0)
+        {
+            return 0;
+        }
+
+        // Take the ready ones out first, since waking them may park them again
+        for (int i = polled - 1; i >= 0; i--)
+        {
+            if (pfds[i].revents)
+            {
+                woken[wokenCount++] = entries[slots[i]];
+                entries[slots[i]] = entries[--count];
+            }
+        }
+#endif
+
+        for (int i = count - 1; deferred && i >= 0; i--)
+        {
+            if (entries[i].fd < 0)
+            {
+                woken[wokenCount++] = entries[i];
+                entries[i] = entries[--count];
+            }
+        }
+
+        for (int i = 0; i < wokenCount; i++)
+        {
+            woken[i].w->ready();
+        }
+
+        return wokenCount;
+    }
+
+private:
+    struct entry
+    {
+        int fd;
+        waiter *w;
+    };
+
+    entry entries[PLATFORM_MIDI_HPP_MAX_WAITERS];
+    int count = 0;
+};
+
+// A channel message from one of the builders below. cc14 makes two messages
+struct message
+{
+    unsigned char data[6] = {};
+    unsigned char length = 0;
+
+    constexpr std::span<const unsigned char> bytes() const
+    {
+        return std::span<const unsigned char>(data, length);
+    }
+};
+
+namespace detail
+{
+
+// Deliberately not constexpr: reaching it while a message is built at compile time stops the build
+inline void value_out_of_range()
+{
+}
+
+// Out-of-range values are masked at runtime, so they can never turn into a status byte
+constexpr int checked(int value, int max)
+{
+    if (value < 0 || value > max)
+    {
+        if (std::is_constant_evaluated())
+        {
+            value_out_of_range();
+        }
+    }
+
+    return value & max;
+}
+
+constexpr message make(unsigned char status, unsigned char data1)
+{
+    message msg;
+    msg.data[0] = status;
+    msg.data[1] = data1;
+    msg.length = 2;
+    return msg;
+}
+
+constexpr message make(unsigned char status, unsigned char data1, unsigned char data2)
+{
+    message msg = make(status, data1);
+    msg.data[2] = data2;
+    msg.length = 3;
+    return msg;
+}
+
+}
+
+// Channels are 0-15, other values 0-127 unless noted. Out-of-range values are a compile error
+// where the message is a constant expression, e.g. constexpr auto msg = note_on(0, 60, 100)
+constexpr message note_on(int channel, int note, int velocity)
+{
+    return detail::make(0x90 | detail::checked(channel, 15), detail::checked(note, 127), detail::checked(velocity, 127));
+}
+
+constexpr message note_off(int channel, int note, int velocity)
+{
+    return detail::make(0x80 | detail::checked(channel, 15), detail::checked(note, 127), detail::checked(velocity, 127));
+}
+
+constexpr message cc(int channel, int controller, int value)
+{
+    return detail::make(0xB0 | detail::checked(channel, 15), detail::checked(controller, 127), detail::checked(value, 127));
+}
+
+constexpr message program(int channel, int program)
+{
+    return detail::make(0xC0 | detail::checked(channel, 15), detail::checked(program, 127));
+}
+
+// Channel pressure
+constexpr message pressure(int channel, int pressure)
+{
+    return detail::make(0xD0 | detail::checked(channel, 15), detail::checked(pressure, 127));
+}
+
+// value is 0-16383, centred on 8192
+constexpr message pitch_bend(int channel, int value)
+{
+    int bend = detail::checked(value, 16383);
+    return detail::make(0xE0 | detail::checked(channel, 15), bend & 0x7F, bend >> 7);
+}
+
+// A 14-bit controller: controller 0-31 carries the MSB and controller + 32 the LSB. value is 0-16383
+constexpr message cc14(int channel, int controller, int value)
+{
+    int number = detail::checked(controller, 31);
+    int bits = detail::checked(value, 16383);
+    message msg = cc(channel, number, bits >> 7);
+    message lsb = cc(channel, number + 32, bits & 0x7F);
+
+    for (int i = 0; i < 3; i++)
+    {
+        msg.data[3 + i] = lsb.data[i];
+    }
+    msg.length = 6;
+    return msg;
+}
+
+class driver;
+
+namespace detail
+{
+
+// Shared suspend/resume logic of the input awaitables. Derived::poll() tries one read into result
+// and returns non-zero once there's something (or an error) to resume with
+template <typename Derived>
+class input_awaitable : public waiter
+{
+public:
+    explicit input_awaitable(driver &d) : owner(d) {}
+    input_awaitable(const input_awaitable&) = delete;
+    input_awaitable& operator=(const input_awaitable&) = delete;
+
+    ~input_awaitable();
+
+    bool await_ready()
+    {
+        return static_cast<Derived*>(this)->poll();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle);
+
+    void ready() override;
+
+protected:
+    driver &owner;
+    std::coroutine_handle<> continuation;
+    int result = 0;
+    bool parked = false;
+};
+
+}
+
+class message_awaitable;
+class event_awaitable;
+class write_awaitable;
+
+class driver
+{
+public:
+    // options may be NULL. Its blocking flag is ignored, since waiting is the reactor's job
+    driver(reactor &r, const char *name, const struct platform_midi_options *options = nullptr)
+        : owner(&r)
+    {
+        struct platform_midi_options nonBlocking = {};
+
+        if (options)
+        {
+            nonBlocking = *options;
+        }
+        nonBlocking.blocking = 0;
+
+        handle = platform_midi_init_ex(name, &nonBlocking);
+
+        int fds[1];
+        if (handle && platform_midi_fds(handle, fds, 1) == 1)
+        {
+            fd = fds[0];
+        }
+    }
+
+    ~driver()
+    {
+        if (handle)
+        {
+            platform_midi_deinit(handle);
+        }
+    }
+
+    driver(const driver&) = delete;
+    driver& operator=(const driver&) = delete;
+
+    driver(driver &&other) noexcept
+        : owner(other.owner), handle(std::exchange(other.handle, nullptr)), fd(other.fd)
+    {
+    }
+
+    driver& operator=(driver &&other) noexcept
+    {
+        std::swap(owner, other.owner);
+        std::swap(handle, other.handle);
+        std::swap(fd, other.fd);
+        return *this;
+    }
+
+    explicit operator bool() const
+    {
+        return handle != nullptr;
+    }
+
+    struct platform_midi_driver *get() const
+    {
+        return handle;
+    }
+
+    // The next complete message, as a view into the driver that's valid until the next read.
+    // An empty view means the backend reported an error
+    message_awaitable next_message();
+
+    // The next event, with SysEx data in the driver's buffer until the next read.
+    // A status of 0 means the backend reported an error
+    event_awaitable next_event();
+
+    // Writes all of buf, waiting for the backend to make room if it has to.
+    // Resumes with the number of bytes written, or -1 on error
+    write_awaitable write(std::span<const unsigned char> buf);
+
+    // Reads without waiting. Returns an empty view if there's nothing to read
+    std::span<const unsigned char> try_read()
+    {
+        int result = platform_midi_read(handle, buffer, sizeof(buffer));
+        return std::span<const unsigned char>(buffer, result > 0 ? result : 0);
+    }
+
+    int try_write(std::span<const unsigned char> buf)
+    {
+        return platform_midi_write(handle, buf.data(), (int)buf.size());
+    }
+
+private:
+    template <typename Derived> friend class detail::input_awaitable;
+    friend class message_awaitable;
+    friend class event_awaitable;
+    friend class write_awaitable;
+
+    reactor *owner;
+    struct platform_midi_driver *handle = nullptr;
+    int fd = -1;
+    unsigned char buffer[PLATFORM_MIDI_HPP_BUFFER_SIZE];
+};
+
+namespace detail
+{
+
+template <typename Derived>
+input_awaitable<Derived>::~input_awaitable()
+{
+    // The coroutine was destroyed while it was waiting
+    if (parked)
+    {
+        owner.owner->cancel(this);
+    }
+}
+
+template <typename Derived>
+bool input_awaitable<Derived>::await_suspend(std::coroutine_handle<> handle)
+{
+    continuation = handle;
+    parked = owner.owner->wait_readable(owner.fd, this);
+    if (!parked)
+    {
+        result = -1;
+    }
+    return parked;
+}
+
+template <typename Derived>
+void input_awaitable<Derived>::ready()
+{
+    // Readable doesn't always mean a whole message, e.g. ALSA announcements are read and dropped
+    if (!static_cast<Derived*>(this)->poll())
+    {
+        if (owner.owner->wait_readable(owner.fd, this))
+        {
+            return;
+        }
+        result = -1;
+    }
+
+    parked = false;
+    continuation.resume();
+}
+
+}
+
+class message_awaitable : public detail::input_awaitable<message_awaitable>
+{
+public:
+    using detail::input_awaitable<message_awaitable>::input_awaitable;
+
+    bool poll()
+    {
+        result = platform_midi_read(owner.handle, owner.buffer, sizeof(owner.buffer));
+        return result != 0;
+    }
+
+    std::span<const unsigned char> await_resume() const
+    {
+        return std::span<const unsigned char>(owner.buffer, result > 0 ? result : 0);
+    }
+};
+
+class event_awaitable : public detail::input_awaitable<event_awaitable>
+{
+public:
+    using detail::input_awaitable<event_awaitable>::input_awaitable;
+
+    bool poll()
+    {
+        result = platform_midi_read_events(owner.handle, &event, 1, owner.buffer, sizeof(owner.buffer));
+        return result != 0;
+    }
+
+    struct platform_midi_event await_resume() const
+    {
+        if (result < 0)
+        {
+            struct platform_midi_event error = {};
+            return error;
+        }
+
+        return event;
+    }
+
+private:
+    struct platform_midi_event event;
+};
+
+class write_awaitable : public waiter
+{
+public:
+    write_awaitable(driver &d, std::span<const unsigned char> buf) : owner(d), data(buf) {}
+    write_awaitable(const write_awaitable&) = delete;
+    write_awaitable& operator=(const write_awaitable&) = delete;
+
+    ~write_awaitable()
+    {
+        if (parked)
+        {
+            owner.owner->cancel(this);
+        }
+    }
+
+    bool await_ready()
+    {
+        return poll();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        continuation = handle;
+        // There's no descriptor for output space, so just try again shortly
+        parked = owner.owner->wait_readable(-1, this);
+        failed = !parked;
+        return parked;
+    }
+
+    int await_resume() const
+    {
+        return (written == 0 && failed) ? -1 : written;
+    }
+
+    void ready() override
+    {
+        if (!poll())
+        {
+            if (owner.owner->wait_readable(-1, this))
+            {
+                return;
+            }
+            failed = true;
+        }
+
+        parked = false;
+        continuation.resume();
+    }
+
+private:
+    // Writes what it can, returning true once everything's gone or the backend failed
+    bool poll()
+    {
+        int result = platform_midi_write(owner.handle, data.data() + written, (int)data.size() - written);
+
+        if (result < 0)
+        {
+            failed = true;
+            return true;
+        }
+
+        written += result;
+        return written == (int)data.size();
+    }
+
+    driver &owner;
+    std::span<const unsigned char> data;
+    std::coroutine_handle<> continuation;
+    int written = 0;
+    bool failed = false;
+    bool parked = false;
+};
+
+inline message_awaitable driver::next_message()
+{
+    return message_awaitable(*this);
+}
+
+inline event_awaitable driver::next_event()
+{
+    return event_awaitable(*this);
+}
+
+inline write_awaitable driver::write(std::span<const unsigned char> buf)
+{
+    return write_awaitable(*this, buf);
+}
+
+}
+
+#endif
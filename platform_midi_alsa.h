@@ -2,37 +2,148 @@
 #define _PLATFORM_MIDI_ALSA_H_
 
 #include <alsa/asoundlib.h>
+#include <fnmatch.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-struct platform_midi_driver *platform_midi_init_alsa(const char *name, void *data);
+// UMP sequencer clients need alsa-lib 1.2.10, and a 6.5 kernel at runtime
+#if !defined(PLATFORM_MIDI_ALSA_UMP) && defined(SND_LIB_VERSION) && SND_LIB_VERSION >= 0x01020a
+#define PLATFORM_MIDI_ALSA_UMP 1
+#endif
+
+struct platform_midi_alsa_options
+{
+    // 0 for a MIDI 1.0 client, or PLATFORM_MIDI_PROTOCOL_1 / PLATFORM_MIDI_PROTOCOL_2 to exchange UMP
+    // packets with the sequencer. Falls back to 0 if the system can't do UMP
+    int protocol;
+
+    // Glob patterns matched against "client:port" names, e.g. "*Keystation*:*", ending with NULL.
+    // Sources matching connect_inputs are connected to our input and destinations matching
+    // connect_outputs to our output, as soon as they appear
+    const char *const *connect_inputs;
+    const char *const *connect_outputs;
+};
+
+// A port in the cached snapshot of the sequencer
+struct platform_midi_alsa_port
+{
+    int client;
+    int port;
+    // SND_SEQ_PORT_CAP_* and SND_SEQ_PORT_TYPE_* bits
+    unsigned int capability;
+    unsigned int type;
+    char client_name[64];
+    char port_name[64];
+};
+
+// Set options->alsa to a struct platform_midi_alsa_options, or leave it NULL for a MIDI 1.0 client
+struct platform_midi_driver *platform_midi_init_alsa(const char *name, const struct platform_midi_options *options);
 void platform_midi_deinit_alsa(struct platform_midi_driver *driver);
 int platform_midi_read_alsa(struct platform_midi_driver *driver, unsigned char *out, int size);
 int platform_midi_avail_alsa(struct platform_midi_driver *driver);
 int platform_midi_write_alsa(struct platform_midi_driver *driver, const unsigned char *buf, int size);
+int platform_midi_write_multi_alsa(struct platform_midi_driver *driver, const unsigned char *buf, int size, const struct platform_midi_dest *dests, int count);
+int platform_midi_fds_alsa(struct platform_midi_driver *driver, int *fds, int max);
+int platform_midi_read_events_alsa(struct platform_midi_driver *driver, struct platform_midi_event *events, int max, unsigned char *sysexBuf, int sysexSize);
+int platform_midi_write_events_alsa(struct platform_midi_driver *driver, const struct platform_midi_event *events, int count);
+int platform_midi_read_ump_alsa(struct platform_midi_driver *driver, unsigned int *words, int max, int protocol);
+int platform_midi_write_ump_alsa(struct platform_midi_driver *driver, const unsigned int *words, int count);
+
+// Returns the protocol the client ended up with, 0 if it's a MIDI 1.0 client
+int platform_midi_alsa_protocol(struct platform_midi_driver *driver);
+
+// Stores up to max ports from the snapshot, which announcements from the sequencer keep up to date as
+// they're read along with the MIDI. Returns how many ports there are, which may be more than max
+int platform_midi_alsa_ports(struct platform_midi_driver *driver, struct platform_midi_alsa_port *ports, int max);
+
+// Subscribes our input to a source, or a destination to our output. Returns 1 on success
+int platform_midi_alsa_connect_input(struct platform_midi_driver *driver, int client, int port);
+int platform_midi_alsa_connect_output(struct platform_midi_driver *driver, int client, int port);
+
+// Adds an auto-connect pattern like the ones in the options, connecting any ports that already match.
+// Returns 1 on success
+int platform_midi_alsa_auto_connect(struct platform_midi_driver *driver, const char *pattern, int input);
 
 #ifdef PLATFORM_MIDI_IMPLEMENTATION
 
+#ifndef PLATFORM_MIDI_ALSA_MAX_RULES
+#define PLATFORM_MIDI_ALSA_MAX_RULES 16
+#endif
+
+struct platform_midi_alsa_rule
+{
+    char *pattern;
+    int input;
+};
+
 struct platform_midi_alsa_driver
 {
     platform_midi_deinit_fn deinitFn;
     platform_midi_avail_fn availFn;
     platform_midi_read_fn readFn;
     platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
     void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    unsigned int read_time;
 
     snd_seq_t *seq_handle;
     snd_midi_event_t *event_parser;
     int in_port;
     int out_port;
+
+    // An input event that didn't fit in the last read, or NULL. It points at held_event, a copy
+    // with its SysEx bytes in held_sysex, since alsa-lib reuses its input buffer on the next
+    // snd_seq_event_input() or snd_seq_event_input_pending()
+    snd_seq_event_t *held;
+    snd_seq_event_t held_event;
+    unsigned char *held_sysex;
+    unsigned int held_sysex_capacity;
+    // Events left over from one ALSA event that expands to several MIDI messages
+    struct platform_midi_event pending[4];
+    int pending_count;
+    int pending_pos;
+
+    int protocol;
+#ifdef PLATFORM_MIDI_ALSA_UMP
+    // Like held, for a UMP client. UMP events carry their packet inline, so a plain copy will do
+    snd_seq_ump_event_t *held_ump;
+    snd_seq_ump_event_t held_ump_event;
+#endif
+
+    int client_id;
+    // Snapshot of every port, kept current by the system announce port
+    struct platform_midi_alsa_port *ports;
+    int port_count;
+    int port_capacity;
+    struct platform_midi_alsa_rule rules[PLATFORM_MIDI_ALSA_MAX_RULES];
+    int rule_count;
 };
 
-struct platform_midi_driver *platform_midi_init_alsa(const char* name, void *data)
+static void platform_midi_alsa_scan_ports(struct platform_midi_alsa_driver *alsa_driver);
+static int platform_midi_alsa_system_event(struct platform_midi_alsa_driver *alsa_driver, const snd_seq_event_t *ev);
+
+struct platform_midi_driver *platform_midi_init_alsa(const char* name, const struct platform_midi_options *options)
 {
+    const struct platform_midi_alsa_options defaults = { 0 };
+    const struct platform_midi_alsa_options *alsaOptions = (options && options->alsa) ? options->alsa : &defaults;
     snd_seq_t *seq_handle;
     snd_midi_event_t *event_parser;
     int in_port = 0;
     int out_port = 0;
+    int protocol = 0;
 
     if (0 != snd_seq_open(&seq_handle, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK))
     {
@@ -43,6 +154,24 @@ struct platform_midi_driver *platform_midi_init_alsa(const char* name, void *dat
 
     printf("Sequncer initialized\n");
 
+    if (alsaOptions->protocol)
+    {
+#ifdef PLATFORM_MIDI_ALSA_UMP
+        int version = (alsaOptions->protocol == PLATFORM_MIDI_PROTOCOL_2) ? SND_SEQ_CLIENT_UMP_MIDI_2_0 : SND_SEQ_CLIENT_UMP_MIDI_1_0;
+
+        if (0 != snd_seq_set_client_midi_version(seq_handle, version))
+        {
+            printf("Warn: the sequencer can't do UMP, using MIDI 1.0 events\n");
+        }
+        else
+        {
+            protocol = (alsaOptions->protocol == PLATFORM_MIDI_PROTOCOL_2) ? PLATFORM_MIDI_PROTOCOL_2 : PLATFORM_MIDI_PROTOCOL_1;
+        }
+#else
+        printf("Warn: built against an alsa-lib without UMP, using MIDI 1.0 events\n");
+#endif
+    }
+
     if (0 != snd_seq_set_client_name(seq_handle, name))
     {
         printf("Failed to set client name\n");
@@ -50,12 +179,28 @@ struct platform_midi_driver *platform_midi_init_alsa(const char* name, void *dat
 
     printf("Client name set to %s\n", name);
 
+    // Bigger pools let bursts through without the kernel dropping events
+    if (options && options->seq_output_pool > 0 && 0 != snd_seq_set_client_pool_output(seq_handle, options->seq_output_pool))
+    {
+        printf("Failed to set the output pool to %d events\n", options->seq_output_pool);
+    }
+
+    if (options && options->seq_input_pool > 0 && 0 != snd_seq_set_client_pool_input(seq_handle, options->seq_input_pool))
+    {
+        printf("Failed to set the input pool to %d events\n", options->seq_input_pool);
+    }
+
+    if (options && options->seq_input_buffer > 0 && 0 != snd_seq_set_input_buffer_size(seq_handle, options->seq_input_buffer))
+    {
+        printf("Failed to set the input buffer to %d bytes\n", options->seq_input_buffer);
+    }
+
     in_port = snd_seq_create_simple_port(seq_handle, "listen:in",
                       SND_SEQ_PORT_CAP_WRITE|SND_SEQ_PORT_CAP_SUBS_WRITE,
                       SND_SEQ_PORT_TYPE_APPLICATION);
 
     out_port = snd_seq_create_simple_port(seq_handle, "output",
-                                          SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                          SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_READ,
                                           SND_SEQ_PORT_TYPE_APPLICATION|SND_SEQ_PORT_TYPE_PORT|SND_SEQ_PORT_TYPE_SOFTWARE);
 
     if (0 != snd_midi_event_new(64, &event_parser))
@@ -63,6 +208,9 @@ struct platform_midi_driver *platform_midi_init_alsa(const char* name, void *dat
         printf("Failed to create MIDI parser\n");
     }
 
+    // Always decode full messages, never with running status
+    snd_midi_event_no_status(event_parser, 1);
+
     void* alloc = malloc(sizeof(struct platform_midi_alsa_driver));
 
     if (!alloc)
@@ -76,12 +224,77 @@ struct platform_midi_driver *platform_midi_init_alsa(const char* name, void *dat
     alsa_driver->availFn = platform_midi_avail_alsa;
     alsa_driver->readFn = platform_midi_read_alsa;
     alsa_driver->writeFn = platform_midi_write_alsa;
-    alsa_driver->data = data;
+    alsa_driver->fdsFn = platform_midi_fds_alsa;
+    alsa_driver->readEventsFn = platform_midi_read_events_alsa;
+    alsa_driver->writeEventsFn = platform_midi_write_events_alsa;
+    alsa_driver->readUmpFn = NULL;
+    alsa_driver->writeUmpFn = NULL;
+    alsa_driver->writeMultiFn = platform_midi_write_multi_alsa;
+    alsa_driver->data = options ? options->user_data : NULL;
+    alsa_driver->taps = NULL;
+    alsa_driver->blocking = options ? options->blocking : 0;
+    alsa_driver->stream_out = 1;
+    platform_midi_realtime_init(&alsa_driver->realtime_out);
+    alsa_driver->read_held = NULL;
+    alsa_driver->read_held_len = 0;
+    alsa_driver->read_held_capacity = 0;
+    alsa_driver->read_held_time = 0;
+    alsa_driver->read_time = 0;
 
     alsa_driver->seq_handle = seq_handle;
     alsa_driver->event_parser = event_parser;
     alsa_driver->in_port = in_port;
     alsa_driver->out_port = out_port;
+    alsa_driver->held = NULL;
+    alsa_driver->held_sysex = NULL;
+    alsa_driver->held_sysex_capacity = 0;
+    alsa_driver->pending_count = 0;
+    alsa_driver->pending_pos = 0;
+    alsa_driver->protocol = protocol;
+
+#ifdef PLATFORM_MIDI_ALSA_UMP
+    alsa_driver->held_ump = NULL;
+
+    if (protocol)
+    {
+        // Everything arrives as UMP now, so structured events go through the byte path instead
+        alsa_driver->readEventsFn = NULL;
+        alsa_driver->readUmpFn = platform_midi_read_ump_alsa;
+        alsa_driver->writeUmpFn = platform_midi_write_ump_alsa;
+    }
+#endif
+
+    alsa_driver->client_id = snd_seq_client_id(seq_handle);
+    alsa_driver->ports = NULL;
+    alsa_driver->port_count = 0;
+    alsa_driver->port_capacity = 0;
+    alsa_driver->rule_count = 0;
+
+    for (int input = 1; input >= 0; input--)
+    {
+        const char *const *patterns = input ? alsaOptions->connect_inputs : alsaOptions->connect_outputs;
+
+        for (int i = 0; patterns && patterns[i]; i++)
+        {
+            if (alsa_driver->rule_count == PLATFORM_MIDI_ALSA_MAX_RULES)
+            {
+                printf("Warn: only %d auto-connect patterns are supported\n", PLATFORM_MIDI_ALSA_MAX_RULES);
+                break;
+            }
+
+            alsa_driver->rules[alsa_driver->rule_count].pattern = strdup(patterns[i]);
+            alsa_driver->rules[alsa_driver->rule_count].input = input;
+            alsa_driver->rule_count++;
+        }
+    }
+
+    // Listen for announcements before taking the snapshot, so nothing that appears in between is missed
+    if (0 != snd_seq_connect_from(seq_handle, in_port, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE))
+    {
+        printf("Failed to subscribe to sequencer announcements, ports won't be tracked\n");
+    }
+
+    platform_midi_alsa_scan_ports(alsa_driver);
 
     printf("Done initializing MIDI!\n");
     return (struct platform_midi_driver*)alsa_driver;
@@ -93,19 +306,116 @@ void platform_midi_deinit_alsa(struct platform_midi_driver* driver)
 
     snd_midi_event_free(alsa_driver->event_parser);
     snd_seq_delete_port(alsa_driver->seq_handle, alsa_driver->in_port);
+    snd_seq_delete_port(alsa_driver->seq_handle, alsa_driver->out_port);
     snd_seq_close(alsa_driver->seq_handle);
+    free(alsa_driver->held_sysex);
+
+    for (int i = 0; i < alsa_driver->rule_count; i++)
+    {
+        free(alsa_driver->rules[i].pattern);
+    }
+
+    free(alsa_driver->ports);
     free(alsa_driver);
 }
 
+#ifdef PLATFORM_MIDI_ALSA_UMP
+// Reads the next UMP event for a UMP client, or returns NULL if there isn't one
+static snd_seq_ump_event_t *platform_midi_alsa_next_ump(struct platform_midi_alsa_driver *alsa_driver, int *error)
+{
+    snd_seq_ump_event_t *ev = alsa_driver->held_ump;
+    alsa_driver->held_ump = NULL;
+    *error = 0;
+
+    while (!ev)
+    {
+        int result = snd_seq_ump_event_input(alsa_driver->seq_handle, &ev);
+        if (result == -EAGAIN)
+        {
+            return NULL;
+        }
+        else if (result < 0)
+        {
+            printf("Err: couldn't read ALSA event: %d\n", result);
+            *error = 1;
+            return NULL;
+        }
+
+        // The sequencer converts MIDI for UMP clients, so anything else is a system notification
+        if (!(ev->flags & SND_SEQ_EVENT_UMP))
+        {
+            platform_midi_alsa_system_event(alsa_driver, (const snd_seq_event_t*)ev);
+            ev = NULL;
+        }
+    }
+
+    return ev;
+}
+
+// platform_midi_read() for a UMP client, which gets MIDI 1.0 bytes back out of the packets
+static int platform_midi_read_alsa_ump_bytes(struct platform_midi_alsa_driver *alsa_driver, unsigned char *out, int size)
+{
+    int error;
+    snd_seq_ump_event_t *ev;
+
+    while ((ev = platform_midi_alsa_next_ump(alsa_driver, &error)))
+    {
+        int words = PLATFORM_MIDI_UMP_WORDS[ev->ump[0] >> 28];
+        int length = platform_midi_convert_from_ump(out, size, ev->ump, words);
+
+        // Utility and per-note packets give nothing, so keep going until something does
+        if (length > 0)
+        {
+            return length;
+        }
+    }
+
+    return error ? -1 : 0;
+}
+#endif
+
 int platform_midi_read_alsa(struct platform_midi_driver* driver, unsigned char * out, int size)
 {
     struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
     snd_seq_event_t *ev = NULL;
 
-    int result = snd_seq_event_input(alsa_driver->seq_handle, &ev);
-    if (result == -EAGAIN)
+    // Anything left over from platform_midi_read_events() comes first
+    if (alsa_driver->pending_pos < alsa_driver->pending_count)
     {
-        return 0;
+        return platform_midi_event_to_bytes(&alsa_driver->pending[alsa_driver->pending_pos++], out, size);
+    }
+
+#ifdef PLATFORM_MIDI_ALSA_UMP
+    if (alsa_driver->protocol)
+    {
+        return platform_midi_read_alsa_ump_bytes(alsa_driver, out, size);
+    }
+#endif
+
+    if (alsa_driver->held)
+    {
+        ev = alsa_driver->held;
+        alsa_driver->held = NULL;
+    }
+
+    while (!ev)
+    {
+        int result = snd_seq_event_input(alsa_driver->seq_handle, &ev);
+        if (result == -EAGAIN)
+        {
+            return 0;
+        }
+        else if (result < 0)
+        {
+            // -ENOSPC means the kernel input pool overran and events were lost
+            printf("Err: couldn't read ALSA event: %d\n", result);
+            return -1;
+        }
+
+        if (platform_midi_alsa_system_event(alsa_driver, ev))
+        {
+            ev = NULL;
+        }
     }
 
     long convertResult = snd_midi_event_decode(alsa_driver->event_parser, out, size, ev);
@@ -123,7 +433,20 @@ int platform_midi_read_alsa(struct platform_midi_driver* driver, unsigned char *
 int platform_midi_avail_alsa(struct platform_midi_driver* driver)
 {
     struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
-    return snd_seq_event_input_pending(alsa_driver->seq_handle, 1);
+    // Events already taken from alsa-lib but not yet read won't raise the fd again
+    int count = alsa_driver->pending_count - alsa_driver->pending_pos + (alsa_driver->held != NULL);
+
+#ifdef PLATFORM_MIDI_ALSA_UMP
+    count += alsa_driver->held_ump != NULL;
+#endif
+
+    int pending = snd_seq_event_input_pending(alsa_driver->seq_handle, 1);
+    if (pending < 0)
+    {
+        return count ? count : pending;
+    }
+
+    return count + pending;
 }
 
 int platform_midi_write_alsa(struct platform_midi_driver* driver, const unsigned char* buf, int size)
@@ -132,26 +455,818 @@ int platform_midi_write_alsa(struct platform_midi_driver* driver, const unsigned
 
     snd_seq_event_t ev;
     int total = 0;
+    long result = 0;
 
-    do
+    while (total < size)
     {
-        int result = snd_midi_event_encode(alsa_driver->event_parser, buf + total, size - total, &ev);
+        snd_seq_ev_clear(&ev);
+        result = snd_midi_event_encode(alsa_driver->event_parser, buf + total, size - total, &ev);
 
-        if (result < 0)
+        if (result <= 0)
         {
-            return result;
+            break;
         }
 
         total += result;
-    } while (total < size);
 
-    if (0 >= snd_seq_event_output(alsa_driver->seq_handle, &ev))
+        if (ev.type == SND_SEQ_EVENT_NONE)
+        {
+            // Incomplete message, the rest may come in the next write
+            continue;
+        }
+
+        snd_seq_ev_set_source(&ev, alsa_driver->out_port);
+        snd_seq_ev_set_subs(&ev);
+        snd_seq_ev_set_direct(&ev);
+
+        if (0 > snd_seq_event_output(alsa_driver->seq_handle, &ev))
+        {
+            printf("Error sending event\n");
+            return -1;
+        }
+    }
+
+    snd_seq_drain_output(alsa_driver->seq_handle);
+
+    return (result < 0 && total == 0) ? (int)result : total;
+}
+
+// Queues an event for output, draining the buffer to make room if it's full
+static int platform_midi_alsa_output(struct platform_midi_alsa_driver *alsa_driver, snd_seq_event_t *ev)
+{
+    int result = snd_seq_event_output(alsa_driver->seq_handle, ev);
+
+    if (result == -EAGAIN)
     {
-        printf("Error sending event\n");
-        return -1;
+        snd_seq_drain_output(alsa_driver->seq_handle);
+        result = snd_seq_event_output(alsa_driver->seq_handle, ev);
+    }
+
+    return result;
+}
+
+int platform_midi_write_multi_alsa(struct platform_midi_driver* driver, const unsigned char* buf, int size, const struct platform_midi_dest* dests, int count)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+
+    snd_seq_event_t ev;
+    int total = 0;
+    long result = 0;
+
+    while (total < size)
+    {
+        snd_seq_ev_clear(&ev);
+        result = snd_midi_event_encode(alsa_driver->event_parser, buf + total, size - total, &ev);
+
+        if (result <= 0)
+        {
+            break;
+        }
+
+        total += result;
+
+        if (ev.type == SND_SEQ_EVENT_NONE)
+        {
+            continue;
+        }
+
+        snd_seq_ev_set_source(&ev, alsa_driver->out_port);
+        snd_seq_ev_set_direct(&ev);
+
+        // The encoded event is only re-addressed for each destination
+        for (int i = 0; i < count; i++)
+        {
+            if (dests[i].client == PLATFORM_MIDI_DEST_SUBSCRIBERS)
+            {
+                snd_seq_ev_set_subs(&ev);
+            }
+            else
+            {
+                snd_seq_ev_set_dest(&ev, dests[i].client, dests[i].port);
+            }
+
+            if (0 > platform_midi_alsa_output(alsa_driver, &ev))
+            {
+                printf("Error sending event to %d:%d\n", dests[i].client, dests[i].port);
+                snd_seq_drain_output(alsa_driver->seq_handle);
+                return -1;
+            }
+        }
+    }
+
+    snd_seq_drain_output(alsa_driver->seq_handle);
+
+    return (result < 0 && total == 0) ? (int)result : total;
+}
+
+static void platform_midi_alsa_set_event(struct platform_midi_event *event, unsigned char status, unsigned char data0, unsigned char data1, unsigned int timestamp)
+{
+    event->timestamp = timestamp;
+    event->status = status;
+    event->group = 0;
+    event->data[0] = data0 & 0x7F;
+    event->data[1] = data1 & 0x7F;
+    event->sysex = NULL;
+}
+
+// Maps an ALSA event to the MIDI messages it stands for. Returns how many, which is 0 for non-MIDI events
+static int platform_midi_alsa_map_event(const snd_seq_event_t *ev, struct platform_midi_event *out, unsigned int timestamp)
+{
+    unsigned char channel = ev->data.control.channel & 0x0F;
+    int value = ev->data.control.value;
+    unsigned int param = ev->data.control.param;
+
+    switch (ev->type)
+    {
+        case SND_SEQ_EVENT_NOTEON:
+            platform_midi_alsa_set_event(out, 0x90 | (ev->data.note.channel & 0x0F), ev->data.note.note, ev->data.note.velocity, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_NOTEOFF:
+            platform_midi_alsa_set_event(out, 0x80 | (ev->data.note.channel & 0x0F), ev->data.note.note, ev->data.note.velocity, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_KEYPRESS:
+            platform_midi_alsa_set_event(out, 0xA0 | (ev->data.note.channel & 0x0F), ev->data.note.note, ev->data.note.velocity, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_CONTROLLER:
+            platform_midi_alsa_set_event(out, 0xB0 | channel, param, value, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_PGMCHANGE:
+            platform_midi_alsa_set_event(out, 0xC0 | channel, value, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_CHANPRESS:
+            platform_midi_alsa_set_event(out, 0xD0 | channel, value, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_PITCHBEND:
+            value += 8192;
+            platform_midi_alsa_set_event(out, 0xE0 | channel, value, value >> 7, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_CONTROL14:
+            if (param >= 32)
+            {
+                platform_midi_alsa_set_event(out, 0xB0 | channel, param, value, timestamp);
+                return 1;
+            }
+
+            // MSB on the controller, LSB on the one 32 above it
+            platform_midi_alsa_set_event(&out[0], 0xB0 | channel, param, value >> 7, timestamp);
+            platform_midi_alsa_set_event(&out[1], 0xB0 | channel, param + 32, value, timestamp);
+            return 2;
+
+        case SND_SEQ_EVENT_NONREGPARAM:
+        case SND_SEQ_EVENT_REGPARAM:
+        {
+            int nrpn = (ev->type == SND_SEQ_EVENT_NONREGPARAM);
+            platform_midi_alsa_set_event(&out[0], 0xB0 | channel, nrpn ? 99 : 101, param >> 7, timestamp);
+            platform_midi_alsa_set_event(&out[1], 0xB0 | channel, nrpn ? 98 : 100, param, timestamp);
+            platform_midi_alsa_set_event(&out[2], 0xB0 | channel, 6, value >> 7, timestamp);
+            platform_midi_alsa_set_event(&out[3], 0xB0 | channel, 38, value, timestamp);
+            return 4;
+        }
+
+        case SND_SEQ_EVENT_QFRAME:
+            platform_midi_alsa_set_event(out, 0xF1, value, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_SONGPOS:
+            platform_midi_alsa_set_event(out, 0xF2, value, value >> 7, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_SONGSEL:
+            platform_midi_alsa_set_event(out, 0xF3, value, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_TUNE_REQUEST:
+            platform_midi_alsa_set_event(out, 0xF6, 0, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_CLOCK:
+            platform_midi_alsa_set_event(out, 0xF8, 0, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_START:
+            platform_midi_alsa_set_event(out, 0xFA, 0, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_CONTINUE:
+            platform_midi_alsa_set_event(out, 0xFB, 0, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_STOP:
+            platform_midi_alsa_set_event(out, 0xFC, 0, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_SENSING:
+            platform_midi_alsa_set_event(out, 0xFE, 0, 0, timestamp);
+            return 1;
+
+        case SND_SEQ_EVENT_RESET:
+            platform_midi_alsa_set_event(out, 0xFF, 0, 0, timestamp);
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// Keeps a SysEx event for the next read, copying it out of alsa-lib's input buffer. Returns 0 if
+// there's no memory for the copy, and the event is lost
+static int platform_midi_alsa_hold(struct platform_midi_alsa_driver *alsa_driver, const snd_seq_event_t *ev)
+{
+    unsigned int length = ev->data.ext.len;
+
+    if (ev == &alsa_driver->held_event)
+    {
+        // Already a copy, put back
+        alsa_driver->held = &alsa_driver->held_event;
+        return 1;
+    }
+
+    if (length > alsa_driver->held_sysex_capacity)
+    {
+        unsigned char *grown = (unsigned char*)realloc(alsa_driver->held_sysex, length);
+        if (!grown)
+        {
+            printf("Err: couldn't keep a %u byte SysEx event for the next read\n", length);
+            return 0;
+        }
+        alsa_driver->held_sysex = grown;
+        alsa_driver->held_sysex_capacity = length;
+    }
+
+    memcpy(alsa_driver->held_sysex, ev->data.ext.ptr, length);
+    alsa_driver->held_event = *ev;
+    alsa_driver->held_event.data.ext.ptr = alsa_driver->held_sysex;
+    alsa_driver->held = &alsa_driver->held_event;
+    return 1;
+}
+
+int platform_midi_read_events_alsa(struct platform_midi_driver* driver, struct platform_midi_event* events, int max, unsigned char* sysexBuf, int sysexSize)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+    unsigned int timestamp = platform_midi_event_time();
+    int used = 0;
+    int count = 0;
+
+    while (count < max && alsa_driver->pending_pos < alsa_driver->pending_count)
+    {
+        events[count++] = alsa_driver->pending[alsa_driver->pending_pos++];
+    }
+
+    while (count < max)
+    {
+        snd_seq_event_t *ev = alsa_driver->held;
+        alsa_driver->held = NULL;
+
+        if (!ev)
+        {
+            int result = snd_seq_event_input(alsa_driver->seq_handle, &ev);
+            if (result == -EAGAIN)
+            {
+                break;
+            }
+            else if (result < 0)
+            {
+                printf("Err: couldn't read ALSA event: %d\n", result);
+                return count ? count : -1;
+            }
+
+            if (platform_midi_alsa_system_event(alsa_driver, ev))
+            {
+                continue;
+            }
+        }
+
+        if (ev->type == SND_SEQ_EVENT_SYSEX)
+        {
+            unsigned int length = ev->data.ext.len;
+            unsigned int space = (sysexBuf && sysexSize > used) ? sysexSize - used : 0;
+
+            if (length > space && count > 0)
+            {
+                // Leave it for the next call, when the whole buffer is free again
+                platform_midi_alsa_hold(alsa_driver, ev);
+                break;
+            }
+
+            if (length > space || length > 0xFFFF)
+            {
+                printf("Warn: truncating %u byte SysEx event\n", length);
+                length = (space < 0xFFFF) ? space : 0xFFFF;
+            }
+
+            memcpy(sysexBuf + used, ev->data.ext.ptr, length);
+
+            events[count].timestamp = timestamp;
+            events[count].status = 0xF0;
+            events[count].group = 0;
+            events[count].sysex_len = length;
+            events[count].sysex = sysexBuf + used;
+            used += length;
+            count++;
+            continue;
+        }
+
+        struct platform_midi_event mapped[4];
+        int produced = platform_midi_alsa_map_event(ev, mapped, timestamp);
+        int i = 0;
+
+        for (; i < produced && count < max; i++)
+        {
+            events[count++] = mapped[i];
+        }
+
+        // Keep the rest of an expanded event for next time
+        alsa_driver->pending_count = 0;
+        alsa_driver->pending_pos = 0;
+        for (; i < produced; i++)
+        {
+            alsa_driver->pending[alsa_driver->pending_count++] = mapped[i];
+        }
+    }
+
+    return count;
+}
+
+int platform_midi_write_events_alsa(struct platform_midi_driver* driver, const struct platform_midi_event* events, int count)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+    snd_seq_event_t ev;
+    int written = 0;
+
+    for (; written < count; written++)
+    {
+        const struct platform_midi_event *event = &events[written];
+        unsigned char channel = event->status & 0x0F;
+
+        snd_seq_ev_clear(&ev);
+
+        switch (event->status & 0xF0)
+        {
+            case 0x80:
+                snd_seq_ev_set_noteoff(&ev, channel, event->data[0], event->data[1]);
+                break;
+
+            case 0x90:
+                snd_seq_ev_set_noteon(&ev, channel, event->data[0], event->data[1]);
+                break;
+
+            case 0xA0:
+                snd_seq_ev_set_keypress(&ev, channel, event->data[0], event->data[1]);
+                break;
+
+            case 0xB0:
+                snd_seq_ev_set_controller(&ev, channel, event->data[0], event->data[1]);
+                break;
+
+            case 0xC0:
+                snd_seq_ev_set_pgmchange(&ev, channel, event->data[0]);
+                break;
+
+            case 0xD0:
+                snd_seq_ev_set_chanpress(&ev, channel, event->data[0]);
+                break;
+
+            case 0xE0:
+                snd_seq_ev_set_pitchbend(&ev, channel, ((event->data[1] << 7) | event->data[0]) - 8192);
+                break;
+
+            default:
+            {
+                switch (event->status)
+                {
+                    case 0xF0:
+                        snd_seq_ev_set_sysex(&ev, event->sysex_len, (void*)event->sysex);
+                        break;
+
+                    case 0xF1:
+                        ev.type = SND_SEQ_EVENT_QFRAME;
+                        ev.data.control.value = event->data[0];
+                        break;
+
+                    case 0xF2:
+                        ev.type = SND_SEQ_EVENT_SONGPOS;
+                        ev.data.control.value = (event->data[1] << 7) | event->data[0];
+                        break;
+
+                    case 0xF3:
+                        ev.type = SND_SEQ_EVENT_SONGSEL;
+                        ev.data.control.value = event->data[0];
+                        break;
+
+                    case 0xF6:
+                        ev.type = SND_SEQ_EVENT_TUNE_REQUEST;
+                        break;
+
+                    case 0xF8:
+                        ev.type = SND_SEQ_EVENT_CLOCK;
+                        break;
+
+                    case 0xFA:
+                        ev.type = SND_SEQ_EVENT_START;
+                        break;
+
+                    case 0xFB:
+                        ev.type = SND_SEQ_EVENT_CONTINUE;
+                        break;
+
+                    case 0xFC:
+                        ev.type = SND_SEQ_EVENT_STOP;
+                        break;
+
+                    case 0xFE:
+                        ev.type = SND_SEQ_EVENT_SENSING;
+                        break;
+
+                    case 0xFF:
+                        ev.type = SND_SEQ_EVENT_RESET;
+                        break;
+
+                    default:
+                        // Not a message, nothing to send
+                        continue;
+                }
+                break;
+            }
+        }
+
+        snd_seq_ev_set_source(&ev, alsa_driver->out_port);
+        snd_seq_ev_set_subs(&ev);
+        snd_seq_ev_set_direct(&ev);
+
+        if (0 > snd_seq_event_output(alsa_driver->seq_handle, &ev))
+        {
+            printf("Error sending event\n");
+            break;
+        }
+    }
+
+    snd_seq_drain_output(alsa_driver->seq_handle);
+
+    return (written == 0 && count > 0) ? -1 : written;
+}
+
+static int platform_midi_alsa_find_port(struct platform_midi_alsa_driver *alsa_driver, int client, int port)
+{
+    for (int i = 0; i < alsa_driver->port_count; i++)
+    {
+        if (alsa_driver->ports[i].client == client && alsa_driver->ports[i].port == port)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Whether a port is something our input could read from (input) or our output could write to
+static int platform_midi_alsa_port_usable(const struct platform_midi_alsa_port *port, int input)
+{
+    unsigned int caps = input ? (SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ) : (SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE);
+    return (port->capability & caps) == caps && !(port->capability & SND_SEQ_PORT_CAP_NO_EXPORT);
+}
+
+static int platform_midi_alsa_rule_matches(const struct platform_midi_alsa_rule *rule, const struct platform_midi_alsa_port *port)
+{
+    char fullName[sizeof(port->client_name) + sizeof(port->port_name) + 1];
+
+    if (!platform_midi_alsa_port_usable(port, rule->input))
+    {
+        return 0;
+    }
+
+    snprintf(fullName, sizeof(fullName), "%s:%s", port->client_name, port->port_name);
+    return 0 == fnmatch(rule->pattern, fullName, 0);
+}
+
+static void platform_midi_alsa_apply_rule(struct platform_midi_alsa_driver *alsa_driver, const struct platform_midi_alsa_rule *rule, const struct platform_midi_alsa_port *port)
+{
+    // Never ourselves, or the system timer and announce ports
+    if (port->client == alsa_driver->client_id || port->client == SND_SEQ_CLIENT_SYSTEM || !platform_midi_alsa_rule_matches(rule, port))
+    {
+        return;
+    }
+
+    // -EBUSY just means we're already connected
+    int result = rule->input
+        ? snd_seq_connect_from(alsa_driver->seq_handle, alsa_driver->in_port, port->client, port->port)
+        : snd_seq_connect_to(alsa_driver->seq_handle, alsa_driver->out_port, port->client, port->port);
+
+    if (result == 0)
+    {
+        printf("Connected %s %s:%s\n", rule->input ? "from" : "to", port->client_name, port->port_name);
+    }
+    else if (result != -EBUSY)
+    {
+        printf("Failed to connect %s:%s: %d\n", port->client_name, port->port_name, result);
+    }
+}
+
+// Adds or refreshes a port in the snapshot, then connects it if a rule wants it
+static void platform_midi_alsa_update_port(struct platform_midi_alsa_driver *alsa_driver, int client, int port)
+{
+    snd_seq_client_info_t *clientInfo;
+    snd_seq_port_info_t *portInfo;
+    snd_seq_client_info_alloca(&clientInfo);
+    snd_seq_port_info_alloca(&portInfo);
+
+    if (0 != snd_seq_get_any_port_info(alsa_driver->seq_handle, client, port, portInfo)
+        || 0 != snd_seq_get_any_client_info(alsa_driver->seq_handle, client, clientInfo))
+    {
+        // Gone again already
+        return;
+    }
+
+    int index = platform_midi_alsa_find_port(alsa_driver, client, port);
+    if (index < 0)
+    {
+        if (alsa_driver->port_count == alsa_driver->port_capacity)
+        {
+            int capacity = alsa_driver->port_capacity ? alsa_driver->port_capacity * 2 : 32;
+            void *grown = realloc(alsa_driver->ports, capacity * sizeof(struct platform_midi_alsa_port));
+
+            if (!grown)
+            {
+                printf("Failed to grow the port list\n");
+                return;
+            }
+
+            alsa_driver->ports = (struct platform_midi_alsa_port*)grown;
+            alsa_driver->port_capacity = capacity;
+        }
+
+        index = alsa_driver->port_count++;
+    }
+
+    struct platform_midi_alsa_port *entry = &alsa_driver->ports[index];
+    entry->client = client;
+    entry->port = port;
+    entry->capability = snd_seq_port_info_get_capability(portInfo);
+    entry->type = snd_seq_port_info_get_type(portInfo);
+    snprintf(entry->client_name, sizeof(entry->client_name), "%s", snd_seq_client_info_get_name(clientInfo));
+    snprintf(entry->port_name, sizeof(entry->port_name), "%s", snd_seq_port_info_get_name(portInfo));
+
+    for (int i = 0; i < alsa_driver->rule_count; i++)
+    {
+        platform_midi_alsa_apply_rule(alsa_driver, &alsa_driver->rules[i], entry);
+    }
+}
+
+// Removes one port, or every port of the client if port is -1
+static void platform_midi_alsa_remove_ports(struct platform_midi_alsa_driver *alsa_driver, int client, int port)
+{
+    int kept = 0;
+
+    for (int i = 0; i < alsa_driver->port_count; i++)
+    {
+        const struct platform_midi_alsa_port *entry = &alsa_driver->ports[i];
+
+        if (entry->client == client && (port < 0 || entry->port == port))
+        {
+            continue;
+        }
+
+        alsa_driver->ports[kept++] = *entry;
+    }
+
+    alsa_driver->port_count = kept;
+}
+
+static void platform_midi_alsa_scan_ports(struct platform_midi_alsa_driver *alsa_driver)
+{
+    snd_seq_client_info_t *clientInfo;
+    snd_seq_port_info_t *portInfo;
+    snd_seq_client_info_alloca(&clientInfo);
+    snd_seq_port_info_alloca(&portInfo);
+
+    snd_seq_client_info_set_client(clientInfo, -1);
+    while (0 == snd_seq_query_next_client(alsa_driver->seq_handle, clientInfo))
+    {
+        int client = snd_seq_client_info_get_client(clientInfo);
+
+        snd_seq_port_info_set_client(portInfo, client);
+        snd_seq_port_info_set_port(portInfo, -1);
+        while (0 == snd_seq_query_next_port(alsa_driver->seq_handle, portInfo))
+        {
+            platform_midi_alsa_update_port(alsa_driver, client, snd_seq_port_info_get_port(portInfo));
+        }
+    }
+}
+
+// Keeps the snapshot current. Returns 1 if ev was an announcement rather than MIDI
+static int platform_midi_alsa_system_event(struct platform_midi_alsa_driver *alsa_driver, const snd_seq_event_t *ev)
+{
+    switch (ev->type)
+    {
+        case SND_SEQ_EVENT_PORT_START:
+        case SND_SEQ_EVENT_PORT_CHANGE:
+            platform_midi_alsa_update_port(alsa_driver, ev->data.addr.client, ev->data.addr.port);
+            return 1;
+
+        case SND_SEQ_EVENT_PORT_EXIT:
+            platform_midi_alsa_remove_ports(alsa_driver, ev->data.addr.client, ev->data.addr.port);
+            return 1;
+
+        case SND_SEQ_EVENT_CLIENT_EXIT:
+            platform_midi_alsa_remove_ports(alsa_driver, ev->data.addr.client, -1);
+            return 1;
+
+        case SND_SEQ_EVENT_CLIENT_START:
+        case SND_SEQ_EVENT_CLIENT_CHANGE:
+        case SND_SEQ_EVENT_PORT_SUBSCRIBED:
+        case SND_SEQ_EVENT_PORT_UNSUBSCRIBED:
+            // Ports announce themselves separately, and subscriptions don't change the snapshot
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+int platform_midi_alsa_ports(struct platform_midi_driver* driver, struct platform_midi_alsa_port* ports, int max)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+    int count = (alsa_driver->port_count < max) ? alsa_driver->port_count : max;
+
+    if (count > 0)
+    {
+        memcpy(ports, alsa_driver->ports, count * sizeof(struct platform_midi_alsa_port));
+    }
+
+    return alsa_driver->port_count;
+}
+
+int platform_midi_alsa_connect_input(struct platform_midi_driver* driver, int client, int port)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+    int result = snd_seq_connect_from(alsa_driver->seq_handle, alsa_driver->in_port, client, port);
+
+    if (0 != result && -EBUSY != result)
+    {
+        printf("Failed to connect from %d:%d: %d\n", client, port, result);
+        return 0;
+    }
+
+    return 1;
+}
+
+int platform_midi_alsa_connect_output(struct platform_midi_driver* driver, int client, int port)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+    int result = snd_seq_connect_to(alsa_driver->seq_handle, alsa_driver->out_port, client, port);
+
+    if (0 != result && -EBUSY != result)
+    {
+        printf("Failed to connect to %d:%d: %d\n", client, port, result);
+        return 0;
+    }
+
+    return 1;
+}
+
+int platform_midi_alsa_auto_connect(struct platform_midi_driver* driver, const char* pattern, int input)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+
+    if (alsa_driver->rule_count == PLATFORM_MIDI_ALSA_MAX_RULES)
+    {
+        printf("Warn: only %d auto-connect patterns are supported\n", PLATFORM_MIDI_ALSA_MAX_RULES);
+        return 0;
+    }
+
+    struct platform_midi_alsa_rule *rule = &alsa_driver->rules[alsa_driver->rule_count];
+    rule->pattern = strdup(pattern);
+    rule->input = input ? 1 : 0;
+
+    if (!rule->pattern)
+    {
+        return 0;
+    }
+
+    alsa_driver->rule_count++;
+
+    for (int i = 0; i < alsa_driver->port_count; i++)
+    {
+        platform_midi_alsa_apply_rule(alsa_driver, rule, &alsa_driver->ports[i]);
+    }
+
+    return 1;
+}
+
+int platform_midi_alsa_protocol(struct platform_midi_driver* driver)
+{
+    return ((struct platform_midi_alsa_driver*)driver)->protocol;
+}
+
+#ifdef PLATFORM_MIDI_ALSA_UMP
+int platform_midi_read_ump_alsa(struct platform_midi_driver* driver, unsigned int* words, int max, int protocol)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+    int written = 0;
+    int error = 0;
+    snd_seq_ump_event_t *ev;
+
+    while (written < max && (ev = platform_midi_alsa_next_ump(alsa_driver, &error)))
+    {
+        int size = PLATFORM_MIDI_UMP_WORDS[ev->ump[0] >> 28];
+        unsigned int type = ev->ump[0] >> 28;
+        unsigned int translated[8];
+        int count;
+
+        // Only channel voice packets in the other protocol need translating
+        if (protocol == PLATFORM_MIDI_PROTOCOL_2 && type == 0x2)
+        {
+            count = platform_midi_ump_to_midi2(ev->ump, size, translated, 8);
+        }
+        else if (protocol != PLATFORM_MIDI_PROTOCOL_2 && type == 0x4)
+        {
+            count = platform_midi_ump_to_midi1(ev->ump, size, translated, 8);
+        }
+        else
+        {
+            count = size;
+            memcpy(translated, ev->ump, size * sizeof(unsigned int));
+        }
+
+        if (written + count > max)
+        {
+            if (written == 0)
+            {
+                printf("Warn: dropping a %d word UMP packet that can't fit in %d words\n", count, max);
+                continue;
+            }
+
+            // Leave it for the next call
+            alsa_driver->held_ump_event = *ev;
+            alsa_driver->held_ump = &alsa_driver->held_ump_event;
+            break;
+        }
+
+        memcpy(words + written, translated, count * sizeof(unsigned int));
+        written += count;
+    }
+
+    return (error && written == 0) ? -1 : written;
+}
+
+int platform_midi_write_ump_alsa(struct platform_midi_driver* driver, const unsigned int* words, int count)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+    snd_seq_ump_event_t ev;
+    int pos = 0;
+
+    // The sequencer translates for receivers that speak the other protocol, so send packets as they are
+    while (pos < count)
+    {
+        int size = PLATFORM_MIDI_UMP_WORDS[words[pos] >> 28];
+
+        if (pos + size > count)
+        {
+            break;
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.flags = SND_SEQ_EVENT_UMP;
+        memcpy(ev.ump, words + pos, size * sizeof(unsigned int));
+
+        snd_seq_ev_set_source(&ev, alsa_driver->out_port);
+        snd_seq_ev_set_subs(&ev);
+        snd_seq_ev_set_direct(&ev);
+
+        if (0 > snd_seq_ump_event_output(alsa_driver->seq_handle, &ev))
+        {
+            printf("Error sending event\n");
+            break;
+        }
+
+        pos += size;
+    }
+
+    snd_seq_drain_output(alsa_driver->seq_handle);
+
+    return (pos == 0 && count > 0) ? -1 : pos;
+}
+#endif
+
+int platform_midi_fds_alsa(struct platform_midi_driver* driver, int* fds, int max)
+{
+    struct platform_midi_alsa_driver *alsa_driver = (struct platform_midi_alsa_driver*)driver;
+    int count = snd_seq_poll_descriptors_count(alsa_driver->seq_handle, POLLIN);
+    struct pollfd pfds[count];
+
+    count = snd_seq_poll_descriptors(alsa_driver->seq_handle, pfds, count, POLLIN);
+    for (int i = 0; i < count && i < max; i++)
+    {
+        fds[i] = pfds[i].fd;
     }
 
-    return total;
+    return (count < max) ? count : max;
 }
 #endif
 
@@ -4,11 +4,55 @@
 #include <alsa/asoundlib.h>
 #include <stdio.h>
 
-struct platform_midi_driver *platform_midi_init_alsa_rawmidi(const char *name, void *data);
+#include "platform_midi_scan.h"
+
+// Bytes pulled from the kernel per snd_rawmidi_read() call
+#ifndef PLATFORM_MIDI_RAWMIDI_READ_SIZE
+#define PLATFORM_MIDI_RAWMIDI_READ_SIZE 4096
+#endif
+
+struct platform_midi_alsa_rawmidi_device
+{
+    // What to open it with, e.g. "hw:1,0,0"
+    char id[32];
+    char name[80];
+    int card;
+    int device;
+    int subdevice;
+    // Non-zero if the subdevice has an input / output stream
+    int input;
+    int output;
+};
+
+struct platform_midi_alsa_rawmidi_options
+{
+    // An ALSA device like "hw:1,0,0", a card:device[:subdevice] pair like "1:0", or part of a
+    // hardware device's name. NULL opens "virtual"
+    const char *device;
+    // Kernel buffer size in bytes for each direction, 0 for the common queue_size or else the default of 4096
+    size_t buffer_size;
+    // Bytes needed in the input buffer before poll() wakes up, 0 keeps the default of 1
+    size_t avail_min;
+    // Don't send active sensing (FE) on the output when it's closed
+    int no_active_sensing;
+};
+
+// Stores up to max of the hardware RawMIDI subdevices. Returns how many there are, which may be more than max
+int platform_midi_alsa_rawmidi_list(struct platform_midi_alsa_rawmidi_device *devices, int max);
+
+// Set options->alsa_rawmidi to a struct platform_midi_alsa_rawmidi_options, or leave it NULL to open "virtual"
+struct platform_midi_driver *platform_midi_init_alsa_rawmidi(const char *name, const struct platform_midi_options *options);
 void platform_midi_deinit_alsa_rawmidi(struct platform_midi_driver *driver);
 int platform_midi_read_alsa_rawmidi(struct platform_midi_driver *driver, unsigned char *out, int size);
 int platform_midi_avail_alsa_rawmidi(struct platform_midi_driver *driver);
 int platform_midi_write_alsa_rawmidi(struct platform_midi_driver *driver, const unsigned char *buf, int size);
+int platform_midi_fds_alsa_rawmidi(struct platform_midi_driver *driver, int *fds, int max);
+
+// Returns how many times the kernel input buffer has overflowed, or -1 if there's no input
+int platform_midi_alsa_rawmidi_xruns(struct platform_midi_driver *driver);
+
+// Returns how many received messages were dropped because the input queue was full
+unsigned int platform_midi_alsa_rawmidi_dropped(struct platform_midi_driver *driver);
 
 #ifdef PLATFORM_MIDI_IMPLEMENTATION
 
@@ -18,15 +62,222 @@ struct platform_midi_alsa_rawmidi_driver
     platform_midi_avail_fn availFn;
     platform_midi_read_fn readFn;
     platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
     void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    unsigned int read_time;
 
     snd_rawmidi_t *raw_in_port;
     snd_rawmidi_t *raw_out_port;
     int rawmidi_init;
+
+    // Complete messages waiting to be read
+    struct platform_midi_ringbuf buffer;
+    struct platform_midi_framer framer;
+
+    // Raw bytes read from the device which haven't been framed yet
+    unsigned char raw[PLATFORM_MIDI_RAWMIDI_READ_SIZE];
+    size_t raw_pos;
+    size_t raw_len;
 };
 
-struct platform_midi_driver *platform_midi_init_alsa_rawmidi(const char* name, void *data)
+int platform_midi_alsa_rawmidi_list(struct platform_midi_alsa_rawmidi_device *devices, int max)
+{
+    snd_rawmidi_info_t *info;
+    int card = -1;
+    int found = 0;
+
+    snd_rawmidi_info_alloca(&info);
+
+    while (0 == snd_card_next(&card) && card >= 0)
+    {
+        char ctlName[16];
+        snd_ctl_t *ctl;
+        int device = -1;
+
+        snprintf(ctlName, sizeof(ctlName), "hw:%d", card);
+        if (0 > snd_ctl_open(&ctl, ctlName, 0))
+        {
+            printf("Failed to open sound card %d\n", card);
+            continue;
+        }
+
+        while (0 == snd_ctl_rawmidi_next_device(ctl, &device) && device >= 0)
+        {
+            const int streams[2] = { SND_RAWMIDI_STREAM_INPUT, SND_RAWMIDI_STREAM_OUTPUT };
+            unsigned int subdevices = 0;
+
+            // Either direction may have more subdevices than the other
+            for (int i = 0; i < 2; i++)
+            {
+                snd_rawmidi_info_set_device(info, device);
+                snd_rawmidi_info_set_subdevice(info, 0);
+                snd_rawmidi_info_set_stream(info, streams[i]);
+
+                if (0 == snd_ctl_rawmidi_info(ctl, info) && snd_rawmidi_info_get_subdevices_count(info) > subdevices)
+                {
+                    subdevices = snd_rawmidi_info_get_subdevices_count(info);
+                }
+            }
+
+            for (unsigned int sub = 0; sub < subdevices; sub++, found++)
+            {
+                if (found >= max)
+                {
+                    continue;
+                }
+
+                struct platform_midi_alsa_rawmidi_device *entry = &devices[found];
+                memset(entry, 0, sizeof(*entry));
+                entry->card = card;
+                entry->device = device;
+                entry->subdevice = sub;
+                snprintf(entry->id, sizeof(entry->id), "hw:%d,%d,%u", card, device, sub);
+
+                for (int i = 0; i < 2; i++)
+                {
+                    snd_rawmidi_info_set_device(info, device);
+                    snd_rawmidi_info_set_subdevice(info, sub);
+                    snd_rawmidi_info_set_stream(info, streams[i]);
+
+                    if (0 != snd_ctl_rawmidi_info(ctl, info))
+                    {
+                        continue;
+                    }
+
+                    if (streams[i] == SND_RAWMIDI_STREAM_INPUT)
+                    {
+                        entry->input = 1;
+                    }
+                    else
+                    {
+                        entry->output = 1;
+                    }
+
+                    // Subdevice names are only worth showing when there's more than one
+                    const char *subName = snd_rawmidi_info_get_subdevice_name(info);
+                    const char *devName = snd_rawmidi_info_get_name(info);
+                    snprintf(entry->name, sizeof(entry->name), "%s", (subdevices > 1 && subName && subName[0]) ? subName : (devName ? devName : ""));
+                }
+            }
+        }
+
+        snd_ctl_close(ctl);
+    }
+
+    return found;
+}
+
+// Turns the device option into something snd_rawmidi_open() takes, writing it to out
+static int platform_midi_alsa_rawmidi_resolve(const char *device, char *out, size_t size)
+{
+    int card, dev, sub;
+    char extra;
+
+    if (!device)
+    {
+        snprintf(out, size, "virtual");
+        return 1;
+    }
+
+    if (3 == sscanf(device, "%d:%d:%d%c", &card, &dev, &sub, &extra))
+    {
+        snprintf(out, size, "hw:%d,%d,%d", card, dev, sub);
+        return 1;
+    }
+
+    if (2 == sscanf(device, "%d:%d%c", &card, &dev, &extra))
+    {
+        snprintf(out, size, "hw:%d,%d", card, dev);
+        return 1;
+    }
+
+    // ALSA names like "hw:1,0" or "virtual" go straight through
+    if (strchr(device, ':') || !strcmp(device, "virtual") || !strcmp(device, "default"))
+    {
+        snprintf(out, size, "%s", device);
+        return 1;
+    }
+
+    struct platform_midi_alsa_rawmidi_device devices[64];
+    int count = platform_midi_alsa_rawmidi_list(devices, 64);
+
+    for (int i = 0; i < count && i < 64; i++)
+    {
+        if (strstr(devices[i].name, device))
+        {
+            snprintf(out, size, "%s", devices[i].id);
+            return 1;
+        }
+    }
+
+    printf("No RawMIDI device matching \"%s\"\n", device);
+    return 0;
+}
+
+static void platform_midi_alsa_rawmidi_set_params(snd_rawmidi_t *port, const struct platform_midi_alsa_rawmidi_options *options)
+{
+    snd_rawmidi_params_t *params;
+    snd_rawmidi_params_alloca(&params);
+
+    if (0 != snd_rawmidi_params_current(port, params))
+    {
+        printf("Failed to get RawMIDI parameters\n");
+        return;
+    }
+
+    if (options->buffer_size && 0 != snd_rawmidi_params_set_buffer_size(port, params, options->buffer_size))
+    {
+        printf("Failed to set RawMIDI buffer size to %zu\n", options->buffer_size);
+    }
+
+    if (options->avail_min && 0 != snd_rawmidi_params_set_avail_min(port, params, options->avail_min))
+    {
+        printf("Failed to set RawMIDI avail_min to %zu\n", options->avail_min);
+    }
+
+    snd_rawmidi_params_set_no_active_sensing(port, params, options->no_active_sensing ? 1 : 0);
+
+    if (0 != snd_rawmidi_params(port, params))
+    {
+        printf("Failed to apply RawMIDI parameters\n");
+    }
+}
+
+struct platform_midi_driver *platform_midi_init_alsa_rawmidi(const char* name, const struct platform_midi_options *options)
 {
+    struct platform_midi_alsa_rawmidi_options rawmidiOptions = { NULL, 0, 0, 0 };
+    char device[64];
+
+    (void)name;
+
+    if (options && options->alsa_rawmidi)
+    {
+        rawmidiOptions = *options->alsa_rawmidi;
+    }
+
+    if (!rawmidiOptions.buffer_size && options)
+    {
+        rawmidiOptions.buffer_size = options->queue_size;
+    }
+
+    if (!platform_midi_alsa_rawmidi_resolve(rawmidiOptions.device, device, sizeof(device)))
+    {
+        return NULL;
+    }
+
     void *alloc = malloc(sizeof(struct platform_midi_alsa_rawmidi_driver));
 
     if (!alloc)
@@ -36,17 +287,67 @@ struct platform_midi_driver *platform_midi_init_alsa_rawmidi(const char* name, v
     }
 
     struct platform_midi_alsa_rawmidi_driver *rawmidi_driver = (struct platform_midi_alsa_rawmidi_driver*)alloc;
+    rawmidi_driver->deinitFn = platform_midi_deinit_alsa_rawmidi;
+    rawmidi_driver->availFn = platform_midi_avail_alsa_rawmidi;
+    rawmidi_driver->readFn = platform_midi_read_alsa_rawmidi;
+    rawmidi_driver->writeFn = platform_midi_write_alsa_rawmidi;
+    rawmidi_driver->fdsFn = platform_midi_fds_alsa_rawmidi;
+    rawmidi_driver->readEventsFn = NULL;
+    rawmidi_driver->writeEventsFn = NULL;
+    rawmidi_driver->readUmpFn = NULL;
+    rawmidi_driver->writeUmpFn = NULL;
+    rawmidi_driver->writeMultiFn = NULL;
+    rawmidi_driver->data = options ? options->user_data : NULL;
+    rawmidi_driver->taps = NULL;
+    rawmidi_driver->blocking = options ? options->blocking : 0;
+    rawmidi_driver->stream_out = 1;
+    platform_midi_realtime_init(&rawmidi_driver->realtime_out);
+    rawmidi_driver->read_held = NULL;
+    rawmidi_driver->read_held_len = 0;
+    rawmidi_driver->read_held_capacity = 0;
+    rawmidi_driver->read_held_time = 0;
+    rawmidi_driver->read_time = 0;
+    rawmidi_driver->raw_in_port = NULL;
+    rawmidi_driver->raw_out_port = NULL;
 
-    int result = snd_rawmidi_open(&rawmidi_driver->raw_in_port, &rawmidi_driver->raw_out_port, "virtual", SND_RAWMIDI_NONBLOCK);
+    // Hardware may only go one way, so fall back to opening just one direction
+    int result = snd_rawmidi_open(&rawmidi_driver->raw_in_port, &rawmidi_driver->raw_out_port, device, SND_RAWMIDI_NONBLOCK);
     if (0 != result)
     {
-        const char *error_desc = snd_strerror(result);
-        // Error!
-        printf("Failed to initialize ALSA RawMIDI driver: %d (%s)\n", result, error_desc ? error_desc : "?");
-        return 0;
+        rawmidi_driver->raw_in_port = NULL;
+        rawmidi_driver->raw_out_port = NULL;
+
+        if (0 != snd_rawmidi_open(&rawmidi_driver->raw_in_port, NULL, device, SND_RAWMIDI_NONBLOCK))
+        {
+            rawmidi_driver->raw_in_port = NULL;
+
+            if (0 != snd_rawmidi_open(NULL, &rawmidi_driver->raw_out_port, device, SND_RAWMIDI_NONBLOCK))
+            {
+                const char *error_desc = snd_strerror(result);
+                // Error!
+                printf("Failed to initialize ALSA RawMIDI driver on %s: %d (%s)\n", device, result, error_desc ? error_desc : "?");
+                free(rawmidi_driver);
+                return NULL;
+            }
+        }
     }
 
-    printf("RawMIDI initialized\n");
+    if (rawmidi_driver->raw_in_port)
+    {
+        platform_midi_alsa_rawmidi_set_params(rawmidi_driver->raw_in_port, &rawmidiOptions);
+    }
+
+    if (rawmidi_driver->raw_out_port)
+    {
+        platform_midi_alsa_rawmidi_set_params(rawmidi_driver->raw_out_port, &rawmidiOptions);
+    }
+
+    platform_midi_buffer_init(&rawmidi_driver->buffer);
+    platform_midi_framer_init(&rawmidi_driver->framer);
+    rawmidi_driver->raw_pos = 0;
+    rawmidi_driver->raw_len = 0;
+
+    printf("RawMIDI initialized on %s\n", device);
 
     return (struct platform_midi_driver*)rawmidi_driver;
 }
@@ -54,43 +355,102 @@ struct platform_midi_driver *platform_midi_init_alsa_rawmidi(const char* name, v
 void platform_midi_deinit_alsa_rawmidi(struct platform_midi_driver *driver)
 {
     struct platform_midi_alsa_rawmidi_driver *rawmidi_driver = (struct platform_midi_alsa_rawmidi_driver*)driver;
-    snd_rawmidi_drain(rawmidi_driver->raw_in_port);
-    snd_rawmidi_close(rawmidi_driver->raw_in_port);
-    snd_rawmidi_drain(rawmidi_driver->raw_out_port);
-    snd_rawmidi_close(rawmidi_driver->raw_out_port);
+
+    if (rawmidi_driver->raw_in_port)
+    {
+        snd_rawmidi_drain(rawmidi_driver->raw_in_port);
+        snd_rawmidi_close(rawmidi_driver->raw_in_port);
+    }
+
+    if (rawmidi_driver->raw_out_port)
+    {
+        snd_rawmidi_drain(rawmidi_driver->raw_out_port);
+        snd_rawmidi_close(rawmidi_driver->raw_out_port);
+    }
 
     free(rawmidi_driver);
 }
 
+static int platform_midi_alsa_rawmidi_frame(void *ctx, const unsigned char *msg, unsigned int len)
+{
+    struct platform_midi_ringbuf *buffer = (struct platform_midi_ringbuf*)ctx;
+    platform_midi_push_packet(buffer, (unsigned char*)msg, len);
+
+    // Stop framing before the queue would have to drop a message
+    return platform_midi_buffer_full(buffer, PLATFORM_MIDI_SYSEX_CHUNK_SIZE);
+}
+
+// Reads and frames as much pending input as the message queue can hold
+static int platform_midi_alsa_rawmidi_fill(struct platform_midi_alsa_rawmidi_driver *rawmidi_driver)
+{
+    if (!rawmidi_driver->raw_in_port)
+    {
+        return 0;
+    }
+
+    while (!platform_midi_buffer_full(&rawmidi_driver->buffer, PLATFORM_MIDI_SYSEX_CHUNK_SIZE))
+    {
+        if (rawmidi_driver->raw_pos == rawmidi_driver->raw_len)
+        {
+            ssize_t result = snd_rawmidi_read(rawmidi_driver->raw_in_port, rawmidi_driver->raw, sizeof(rawmidi_driver->raw));
+            if (result == -EAGAIN || result == 0)
+            {
+                break;
+            }
+            else if (result < 0)
+            {
+                printf("Error reading data\n");
+                return -1;
+            }
+
+            rawmidi_driver->raw_pos = 0;
+            rawmidi_driver->raw_len = (size_t)result;
+        }
+
+        rawmidi_driver->raw_pos += platform_midi_framer_feed(&rawmidi_driver->framer,
+                                                             rawmidi_driver->raw + rawmidi_driver->raw_pos,
+                                                             rawmidi_driver->raw_len - rawmidi_driver->raw_pos,
+                                                             platform_midi_alsa_rawmidi_frame, &rawmidi_driver->buffer);
+    }
+
+    return 0;
+}
+
 int platform_midi_read_alsa_rawmidi(struct platform_midi_driver *driver, unsigned char *out, int size)
 {
     struct platform_midi_alsa_rawmidi_driver *rawmidi_driver = (struct platform_midi_alsa_rawmidi_driver*)driver;
-    ssize_t result = snd_rawmidi_read(rawmidi_driver->raw_in_port, (void*)out, (size_t)size);
-    if (result < 1)
+    struct platform_midi_ringbuf *buffer = &rawmidi_driver->buffer;
+
+    if (platform_midi_buffer_empty(buffer) && 0 != platform_midi_alsa_rawmidi_fill(rawmidi_driver))
     {
-        printf("Error reading data\n");
         return -1;
     }
 
-    return (int)result;
+    return platform_midi_pop_packet_timed(buffer, out, size, &rawmidi_driver->read_time);
 }
 
 int platform_midi_avail_alsa_rawmidi(struct platform_midi_driver *driver)
 {
     struct platform_midi_alsa_rawmidi_driver *rawmidi_driver = (struct platform_midi_alsa_rawmidi_driver*)driver;
-    char status_data[snd_rawmidi_status_sizeof()];
-    snd_rawmidi_status_t *status = (snd_rawmidi_status_t*)status_data;
-    if (0 == snd_rawmidi_status(rawmidi_driver->raw_in_port, status))
+
+    if (0 != platform_midi_alsa_rawmidi_fill(rawmidi_driver))
     {
-        return snd_rawmidi_status_get_avail(status);
+        return -1;
     }
 
-    return -1;
+    return platform_midi_packet_count(&rawmidi_driver->buffer);
 }
 
 int platform_midi_write_alsa_rawmidi(struct platform_midi_driver *driver, const unsigned char* buf, int size)
 {
     struct platform_midi_alsa_rawmidi_driver *rawmidi_driver = (struct platform_midi_alsa_rawmidi_driver*)driver;
+
+    if (!rawmidi_driver->raw_out_port)
+    {
+        printf("Error sending data: the device has no output\n");
+        return -1;
+    }
+
     ssize_t result = snd_rawmidi_write(rawmidi_driver->raw_out_port, (const void*)buf, (size_t)size);
 
     if (result < 0)
@@ -101,6 +461,51 @@ int platform_midi_write_alsa_rawmidi(struct platform_midi_driver *driver, const
 
     return (int)result;
 }
+
+int platform_midi_fds_alsa_rawmidi(struct platform_midi_driver *driver, int *fds, int max)
+{
+    struct platform_midi_alsa_rawmidi_driver *rawmidi_driver = (struct platform_midi_alsa_rawmidi_driver*)driver;
+
+    if (!rawmidi_driver->raw_in_port)
+    {
+        return 0;
+    }
+
+    int count = snd_rawmidi_poll_descriptors_count(rawmidi_driver->raw_in_port);
+    struct pollfd pfds[count];
+
+    count = snd_rawmidi_poll_descriptors(rawmidi_driver->raw_in_port, pfds, count);
+    for (int i = 0; i < count && i < max; i++)
+    {
+        fds[i] = pfds[i].fd;
+    }
+
+    return (count < max) ? count : max;
+}
+
+int platform_midi_alsa_rawmidi_xruns(struct platform_midi_driver *driver)
+{
+    struct platform_midi_alsa_rawmidi_driver *rawmidi_driver = (struct platform_midi_alsa_rawmidi_driver*)driver;
+    snd_rawmidi_status_t *status;
+
+    if (!rawmidi_driver->raw_in_port)
+    {
+        return -1;
+    }
+
+    snd_rawmidi_status_alloca(&status);
+    if (0 != snd_rawmidi_status(rawmidi_driver->raw_in_port, status))
+    {
+        return -1;
+    }
+
+    return (int)snd_rawmidi_status_get_xruns(status);
+}
+
+unsigned int platform_midi_alsa_rawmidi_dropped(struct platform_midi_driver *driver)
+{
+    return platform_midi_buffer_dropped(&((struct platform_midi_alsa_rawmidi_driver*)driver)->buffer);
+}
 #endif
 
 #endif
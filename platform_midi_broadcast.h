@@ -0,0 +1,339 @@
+#ifndef _PLATFORM_MIDI_BROADCAST_H_
+#define _PLATFORM_MIDI_BROADCAST_H_
+
+#include "platform_midi.h"
+
+/*
+ * platform_midi_broadcast.h
+ *
+ * Hands every message a driver reads to any number of consumers, each reading at
+ * its own pace on its own thread, from one ring written once.
+ *
+ * The ring is made of fixed-size slots, each stamped with the sequence number it
+ * was written at. A consumer owns a cursor, and reads the slot at it if the stamp
+ * matches; nothing else is shared, so reads are wait-free. Messages that don't
+ * fit a slot (SysEx) take several in a row.
+ *
+ * The producer never waits either. It keeps clear of the slowest consumer that
+ * isn't lossy, and drops (and counts) the message if that would mean overwriting
+ * something it hasn't read. A lossy consumer holds nobody up: it's overwritten
+ * like anything else, notices from the stamps when it has been lapped and skips
+ * ahead to the newest message, counting what it missed.
+ *
+ * There is one producer, the thread reading the driver (the ring is fed by an
+ * input tap), and each consumer must only be read from one thread at a time.
+ */
+
+// Consumers per ring
+#ifndef PLATFORM_MIDI_BROADCAST_MAX_CONSUMERS
+#define PLATFORM_MIDI_BROADCAST_MAX_CONSUMERS 16
+#endif
+
+// Bytes of message per slot. A slot is this plus 10, so 22 makes it 32
+#ifndef PLATFORM_MIDI_BROADCAST_SLOT_DATA
+#define PLATFORM_MIDI_BROADCAST_SLOT_DATA 22
+#endif
+
+#define PLATFORM_MIDI_BROADCAST_FIRST 1
+#define PLATFORM_MIDI_BROADCAST_MORE 2
+
+struct platform_midi_broadcast_slot
+{
+    // Sequence number + 1 once written, 0 while being written
+    unsigned long long stamp;
+    unsigned char length;
+    // PLATFORM_MIDI_BROADCAST_FIRST on a message's first slot, _MORE on all but its last
+    unsigned char flags;
+    unsigned char data[PLATFORM_MIDI_BROADCAST_SLOT_DATA];
+};
+
+struct platform_midi_broadcast_consumer
+{
+    // The next slot to read, written only by the consumer; alone on its cache line, since the producer polls it
+    unsigned long long cursor __attribute__((aligned(64)));
+    int lossy;
+    int active;
+
+    // Slots a lossy consumer skipped after being lapped, or cut-off messages discarded
+    unsigned long long lost;
+    unsigned long long messages;
+};
+
+struct platform_midi_broadcast
+{
+    struct platform_midi_broadcast_slot *slots;
+    unsigned long long mask;
+
+    // The producer's side: the next slot to write, and the slowest lossless cursor as last seen
+    unsigned long long head __attribute__((aligned(64)));
+    unsigned long long gate;
+    unsigned int gate_changes;
+    unsigned long long published;
+    unsigned long long dropped;
+
+    struct platform_midi_broadcast_consumer *consumers[PLATFORM_MIDI_BROADCAST_MAX_CONSUMERS];
+    int consumer_count;
+    // Bumped on every subscribe, so the producer knows to look at the cursors again
+    unsigned int changes;
+
+    struct platform_midi_tap tap;
+};
+
+// slots is rounded up to a power of two. Returns 1 on success, 0 on failure
+int platform_midi_broadcast_init(struct platform_midi_broadcast *broadcast, unsigned int slots);
+void platform_midi_broadcast_deinit(struct platform_midi_broadcast *broadcast);
+
+// Starts the consumer at the newest message. Anything published while this runs may be counted as lost
+// rather than read. Subscribe from one thread at a time. Returns 1, or 0 if there are too many consumers
+int platform_midi_broadcast_subscribe(struct platform_midi_broadcast *broadcast, struct platform_midi_broadcast_consumer *consumer, int lossy);
+// The producer stops waiting for the consumer at once; it may be subscribed again later
+void platform_midi_broadcast_unsubscribe(struct platform_midi_broadcast *broadcast, struct platform_midi_broadcast_consumer *consumer);
+
+// Publishes what the driver reads, from the thread that reads it
+void platform_midi_broadcast_attach(struct platform_midi_broadcast *broadcast, struct platform_midi_driver *driver);
+void platform_midi_broadcast_detach(struct platform_midi_broadcast *broadcast, struct platform_midi_driver *driver);
+
+// Publishes one message. Returns 1, or 0 if a lossless consumer is too far behind and it was dropped
+int platform_midi_broadcast_publish(struct platform_midi_broadcast *broadcast, const unsigned char *buf, int size);
+
+// Reads the consumer's next message, cut short to size if it doesn't fit. Returns its size, or 0 if there's nothing new
+int platform_midi_broadcast_read(struct platform_midi_broadcast *broadcast, struct platform_midi_broadcast_consumer *consumer, unsigned char *buf, int size);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+int platform_midi_broadcast_init(struct platform_midi_broadcast *broadcast, unsigned int slots)
+{
+    unsigned long long capacity = 16;
+
+    memset(broadcast, 0, sizeof(*broadcast));
+    while (capacity < slots)
+    {
+        capacity *= 2;
+    }
+
+    broadcast->slots = (struct platform_midi_broadcast_slot*)calloc(capacity, sizeof(struct platform_midi_broadcast_slot));
+    if (!broadcast->slots)
+    {
+        printf("Failed to allocate MIDI broadcast ring\n");
+        return 0;
+    }
+
+    broadcast->mask = capacity - 1;
+    return 1;
+}
+
+void platform_midi_broadcast_deinit(struct platform_midi_broadcast *broadcast)
+{
+    free(broadcast->slots);
+    broadcast->slots = NULL;
+}
+
+int platform_midi_broadcast_subscribe(struct platform_midi_broadcast *broadcast, struct platform_midi_broadcast_consumer *consumer, int lossy)
+{
+    int index = -1;
+
+    for (int i = 0; i < PLATFORM_MIDI_BROADCAST_MAX_CONSUMERS; i++)
+    {
+        struct platform_midi_broadcast_consumer *current = __atomic_load_n(&broadcast->consumers[i], __ATOMIC_ACQUIRE);
+
+        if (current == consumer || (!current && index < 0))
+        {
+            index = i;
+        }
+    }
+
+    if (index < 0)
+    {
+        printf("Error: a MIDI broadcast takes at most %d consumers\n", PLATFORM_MIDI_BROADCAST_MAX_CONSUMERS);
+        return 0;
+    }
+
+    consumer->lossy = lossy;
+    consumer->lost = 0;
+    consumer->messages = 0;
+    __atomic_store_n(&consumer->cursor, __atomic_load_n(&broadcast->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    __atomic_store_n(&consumer->active, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&broadcast->consumers[index], consumer, __ATOMIC_RELEASE);
+
+    if (index >= broadcast->consumer_count)
+    {
+        __atomic_store_n(&broadcast->consumer_count, index + 1, __ATOMIC_RELEASE);
+    }
+
+    // The producer's gate may already be past the new cursor
+    __atomic_add_fetch(&broadcast->changes, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+void platform_midi_broadcast_unsubscribe(struct platform_midi_broadcast *broadcast, struct platform_midi_broadcast_consumer *consumer)
+{
+    __atomic_store_n(&consumer->active, 0, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < PLATFORM_MIDI_BROADCAST_MAX_CONSUMERS; i++)
+    {
+        if (broadcast->consumers[i] == consumer)
+        {
+            __atomic_store_n(&broadcast->consumers[i], NULL, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// The oldest slot a lossless consumer still has to read, or head if none
+static unsigned long long platform_midi_broadcast_slowest(struct platform_midi_broadcast *broadcast, unsigned long long head)
+{
+    unsigned long long slowest = head;
+    int count = __atomic_load_n(&broadcast->consumer_count, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < count; i++)
+    {
+        struct platform_midi_broadcast_consumer *consumer = __atomic_load_n(&broadcast->consumers[i], __ATOMIC_ACQUIRE);
+
+        if (consumer && !consumer->lossy && __atomic_load_n(&consumer->active, __ATOMIC_ACQUIRE))
+        {
+            unsigned long long cursor = __atomic_load_n(&consumer->cursor, __ATOMIC_ACQUIRE);
+            if (cursor < slowest)
+            {
+                slowest = cursor;
+            }
+        }
+    }
+
+    return slowest;
+}
+
+int platform_midi_broadcast_publish(struct platform_midi_broadcast *broadcast, const unsigned char *buf, int size)
+{
+    unsigned long long head = broadcast->head;
+    unsigned long long capacity = broadcast->mask + 1;
+    unsigned long long needed = size > 0 ? (size + PLATFORM_MIDI_BROADCAST_SLOT_DATA - 1) / PLATFORM_MIDI_BROADCAST_SLOT_DATA : 1;
+
+    if (needed > capacity)
+    {
+        broadcast->dropped++;
+        return 0;
+    }
+
+    // Only look at the consumers again when the last look says there isn't room, or someone new has subscribed
+    unsigned int changes = __atomic_load_n(&broadcast->changes, __ATOMIC_ACQUIRE);
+    if (head + needed - broadcast->gate > capacity || changes != broadcast->gate_changes)
+    {
+        broadcast->gate = platform_midi_broadcast_slowest(broadcast, head);
+        broadcast->gate_changes = changes;
+
+        if (head + needed - broadcast->gate > capacity)
+        {
+            broadcast->dropped++;
+            return 0;
+        }
+    }
+
+    for (unsigned long long i = 0; i < needed; i++)
+    {
+        struct platform_midi_broadcast_slot *slot = &broadcast->slots[(head + i) & broadcast->mask];
+        int length = size > PLATFORM_MIDI_BROADCAST_SLOT_DATA ? PLATFORM_MIDI_BROADCAST_SLOT_DATA : size;
+
+        // A lossy consumer still reading the old contents will see the stamp change and discard them
+        __atomic_store_n(&slot->stamp, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        slot->length = length;
+        slot->flags = (i == 0 ? PLATFORM_MIDI_BROADCAST_FIRST : 0) | (i + 1 < needed ? PLATFORM_MIDI_BROADCAST_MORE : 0);
+        memcpy(slot->data, buf, length);
+
+        __atomic_store_n(&slot->stamp, head + i + 1, __ATOMIC_RELEASE);
+        buf += length;
+        size -= length;
+    }
+
+    __atomic_store_n(&broadcast->head, head + needed, __ATOMIC_RELEASE);
+    broadcast->published++;
+    return 1;
+}
+
+static void platform_midi_broadcast_tap_fn(void *ctx, int direction, const unsigned char *buf, int size)
+{
+    (void)direction;
+    platform_midi_broadcast_publish((struct platform_midi_broadcast*)ctx, buf, size);
+}
+
+void platform_midi_broadcast_attach(struct platform_midi_broadcast *broadcast, struct platform_midi_driver *driver)
+{
+    broadcast->tap.fn = platform_midi_broadcast_tap_fn;
+    broadcast->tap.ctx = broadcast;
+    broadcast->tap.directions = PLATFORM_MIDI_TAP_INPUT;
+    platform_midi_add_tap(driver, &broadcast->tap);
+}
+
+void platform_midi_broadcast_detach(struct platform_midi_broadcast *broadcast, struct platform_midi_driver *driver)
+{
+    platform_midi_remove_tap(driver, &broadcast->tap);
+}
+
+int platform_midi_broadcast_read(struct platform_midi_broadcast *broadcast, struct platform_midi_broadcast_consumer *consumer, unsigned char *buf, int size)
+{
+    unsigned long long cursor = consumer->cursor;
+    int copied = 0;
+
+    while (1)
+    {
+        const struct platform_midi_broadcast_slot *slot = &broadcast->slots[cursor & broadcast->mask];
+        unsigned long long stamp = __atomic_load_n(&slot->stamp, __ATOMIC_ACQUIRE);
+        unsigned char header[2];
+        unsigned char data[PLATFORM_MIDI_BROADCAST_SLOT_DATA];
+
+        if (stamp == cursor + 1)
+        {
+            header[0] = slot->length;
+            header[1] = slot->flags;
+            memcpy(data, slot->data, sizeof(data));
+
+            // Overwritten while copying: the copy can't be trusted
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->stamp, __ATOMIC_RELAXED) == stamp)
+            {
+                if (header[1] & PLATFORM_MIDI_BROADCAST_FIRST)
+                {
+                    copied = 0;
+                }
+
+                int length = header[0] < size - copied ? header[0] : size - copied;
+                memcpy(buf + copied, data, length);
+                copied += length;
+                cursor++;
+
+                if (!(header[1] & PLATFORM_MIDI_BROADCAST_MORE))
+                {
+                    __atomic_store_n(&consumer->cursor, cursor, __ATOMIC_RELEASE);
+                    consumer->messages++;
+                    return copied;
+                }
+                continue;
+            }
+        }
+        else if (stamp != 0 && stamp <= cursor)
+        {
+            // Not written yet; a message partly read is read again from the start next time
+            return 0;
+        }
+
+        // Lapped: the producer has moved on past this slot. Skip to the newest message
+        unsigned long long head = __atomic_load_n(&broadcast->head, __ATOMIC_ACQUIRE);
+
+        if (head <= cursor)
+        {
+            // Being written right now
+            return 0;
+        }
+
+        consumer->lost += head - cursor;
+        __atomic_store_n(&consumer->cursor, head, __ATOMIC_RELEASE);
+        return 0;
+    }
+}
+
+#endif
+
+#endif
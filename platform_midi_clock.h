@@ -0,0 +1,508 @@
+#ifndef _PLATFORM_MIDI_CLOCK_H_
+#define _PLATFORM_MIDI_CLOCK_H_
+
+#include "platform_midi.h"
+
+/*
+ * platform_midi_clock.h
+ *
+ * MIDI beat clock (24 clocks per quarter note) generation and following.
+ *
+ * The generator sends 0xF8 on absolute deadlines computed from a fixed origin, so
+ * wakeup latency never accumulates into drift. Run platform_midi_clock_gen_wait()
+ * in a loop on a dedicated (ideally real-time) thread, or call
+ * platform_midi_clock_gen_poll() from an existing loop.
+ *
+ * The follower estimates tempo and phase from incoming clock timestamps with a
+ * second-order PLL, and tracks transport and song position from Start, Continue,
+ * Stop and Song Position Pointer.
+ *
+ * Neither side is synchronized; use each from a single thread.
+ */
+
+#define PLATFORM_MIDI_CLOCK_PPQN 24
+
+// Clocks per MIDI beat (a sixteenth note), the unit of Song Position Pointer
+#define PLATFORM_MIDI_CLOCK_PER_BEAT 6
+
+// Running statistics of a timing error
+struct platform_midi_clock_stats
+{
+    unsigned long long count;
+    double mean;
+    // Sum of squared differences from the mean, see platform_midi_clock_stddev()
+    double m2;
+    double min;
+    double max;
+};
+
+struct platform_midi_clock_gen
+{
+    struct platform_midi_driver *driver;
+
+    // Clock period in nanoseconds
+    double period;
+    // Clock number n is due at origin + n * period
+    unsigned long long origin;
+    unsigned long long ticks;
+
+    // Song position of the next clock, advanced only while running
+    unsigned int song_clocks;
+    int running;
+
+    // How late each clock was sent relative to its deadline, in microseconds
+    struct platform_midi_clock_stats lateness;
+};
+
+struct platform_midi_clock_follower
+{
+    // Filtered clock period in microseconds
+    double period;
+    // Timestamp of the most recent clock, and the filtered clock time relative to it
+    unsigned int last_time;
+    double offset;
+
+    // Loop gains, see platform_midi_clock_follower_set_gain()
+    double alpha;
+    double beta;
+
+    // Clocks since the loop was (re)acquired, and consecutive clocks within tolerance
+    unsigned int clocks;
+    unsigned int steady;
+    int locked;
+
+    // Song position of the next clock, and whether one has arrived since the transport moved
+    unsigned int song_clocks;
+    unsigned char clocked;
+    int running;
+
+    // Difference between each clock and the time the loop predicted for it, in microseconds
+    struct platform_midi_clock_stats jitter;
+
+    // Song Position Pointer parser
+    unsigned char spp[2];
+    unsigned char spp_count;
+    unsigned char in_spp;
+
+    struct platform_midi_tap tap;
+    // The driver the tap is on, whose platform_midi_read_time() stamps each clock
+    struct platform_midi_driver *driver;
+};
+
+void platform_midi_clock_stats_reset(struct platform_midi_clock_stats *stats);
+void platform_midi_clock_stats_add(struct platform_midi_clock_stats *stats, double value);
+double platform_midi_clock_stddev(const struct platform_midi_clock_stats *stats);
+
+// Monotonic nanoseconds, the time base of the generator
+unsigned long long platform_midi_clock_now(void);
+
+void platform_midi_clock_gen_init(struct platform_midi_clock_gen *gen, struct platform_midi_driver *driver, double bpm);
+void platform_midi_clock_gen_set_bpm(struct platform_midi_clock_gen *gen, double bpm);
+int platform_midi_clock_gen_start(struct platform_midi_clock_gen *gen);
+int platform_midi_clock_gen_continue(struct platform_midi_clock_gen *gen);
+int platform_midi_clock_gen_stop(struct platform_midi_clock_gen *gen);
+int platform_midi_clock_gen_locate(struct platform_midi_clock_gen *gen, unsigned int beats);
+int platform_midi_clock_gen_wait(struct platform_midi_clock_gen *gen);
+int platform_midi_clock_gen_poll(struct platform_midi_clock_gen *gen);
+
+void platform_midi_clock_follower_init(struct platform_midi_clock_follower *follower);
+void platform_midi_clock_follower_set_gain(struct platform_midi_clock_follower *follower, double alpha);
+void platform_midi_clock_follower_feed(struct platform_midi_clock_follower *follower, const unsigned char *buf, int size, unsigned int timestamp);
+void platform_midi_clock_follower_attach(struct platform_midi_clock_follower *follower, struct platform_midi_driver *driver);
+void platform_midi_clock_follower_detach(struct platform_midi_clock_follower *follower, struct platform_midi_driver *driver);
+double platform_midi_clock_follower_position(const struct platform_midi_clock_follower *follower, unsigned int now);
+
+// Deadline of the next clock, in platform_midi_clock_now() nanoseconds
+static inline unsigned long long platform_midi_clock_gen_next(const struct platform_midi_clock_gen *gen)
+{
+    return gen->origin + (unsigned long long)(gen->ticks * gen->period);
+}
+
+static inline double platform_midi_clock_follower_bpm(const struct platform_midi_clock_follower *follower)
+{
+    return follower->period > 0 ? 60000000.0 / (follower->period * PLATFORM_MIDI_CLOCK_PPQN) : 0;
+}
+
+// Song position in MIDI beats (sixteenth notes), as a Song Position Pointer would carry it
+static inline unsigned int platform_midi_clock_follower_song_position(const struct platform_midi_clock_follower *follower)
+{
+    return follower->song_clocks / PLATFORM_MIDI_CLOCK_PER_BEAT;
+}
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <math.h>
+#include <errno.h>
+
+// A gap this many periods long means the clock stopped, and the loop starts over
+#define PLATFORM_MIDI_CLOCK_GAP 4
+// Clocks within this fraction of a period of the prediction count towards lock
+#define PLATFORM_MIDI_CLOCK_TOLERANCE 0.25
+// Clocks within tolerance needed to declare lock
+#define PLATFORM_MIDI_CLOCK_LOCK_CLOCKS PLATFORM_MIDI_CLOCK_PPQN
+
+void platform_midi_clock_stats_reset(struct platform_midi_clock_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void platform_midi_clock_stats_add(struct platform_midi_clock_stats *stats, double value)
+{
+    stats->count++;
+
+    if (stats->count == 1)
+    {
+        stats->min = value;
+        stats->max = value;
+    }
+    else
+    {
+        if (value < stats->min) stats->min = value;
+        if (value > stats->max) stats->max = value;
+    }
+
+    // Welford's update, so long runs don't lose precision
+    double delta = value - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (value - stats->mean);
+}
+
+double platform_midi_clock_stddev(const struct platform_midi_clock_stats *stats)
+{
+    return stats->count > 1 ? sqrt(stats->m2 / (stats->count - 1)) : 0;
+}
+
+unsigned long long platform_midi_clock_now(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER count;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long)((double)count.QuadPart * 1000000000.0 / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Sleeps until the given platform_midi_clock_now() time
+static void platform_midi_clock_sleep_until(unsigned long long deadline)
+{
+#if defined(_WIN32)
+    // Sleep() is only good to a millisecond or so, so spin out the remainder
+    unsigned long long now = platform_midi_clock_now();
+    if (deadline > now + 2000000ull)
+    {
+        Sleep((DWORD)((deadline - now) / 1000000ull) - 1);
+    }
+    while (platform_midi_clock_now() < deadline)
+    {
+    }
+#elif defined(__APPLE__)
+    // No clock_nanosleep(), but the deadline is still absolute so errors don't accumulate
+    unsigned long long now = platform_midi_clock_now();
+    if (deadline > now)
+    {
+        struct timespec ts;
+        ts.tv_sec = (deadline - now) / 1000000000ull;
+        ts.tv_nsec = (deadline - now) % 1000000000ull;
+        nanosleep(&ts, NULL);
+    }
+#else
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+    {
+    }
+#endif
+}
+
+static int platform_midi_clock_send(struct platform_midi_clock_gen *gen, unsigned char byte)
+{
+    // Jumps ahead of any SysEx another thread is in the middle of sending
+    return platform_midi_write_realtime(gen->driver, byte);
+}
+
+void platform_midi_clock_gen_init(struct platform_midi_clock_gen *gen, struct platform_midi_driver *driver, double bpm)
+{
+    memset(gen, 0, sizeof(*gen));
+    gen->driver = driver;
+    gen->period = 60000000000.0 / (bpm * PLATFORM_MIDI_CLOCK_PPQN);
+    gen->origin = platform_midi_clock_now();
+}
+
+void platform_midi_clock_gen_set_bpm(struct platform_midi_clock_gen *gen, double bpm)
+{
+    // Re-anchor on the next deadline so the clock already scheduled keeps its time
+    gen->origin = platform_midi_clock_gen_next(gen);
+    gen->ticks = 0;
+    gen->period = 60000000000.0 / (bpm * PLATFORM_MIDI_CLOCK_PPQN);
+}
+
+int platform_midi_clock_gen_start(struct platform_midi_clock_gen *gen)
+{
+    // The first clock after Start marks the downbeat, so send it right away
+    gen->origin = platform_midi_clock_now();
+    gen->ticks = 0;
+    gen->song_clocks = 0;
+    gen->running = 1;
+    return platform_midi_clock_send(gen, 0xFA);
+}
+
+int platform_midi_clock_gen_continue(struct platform_midi_clock_gen *gen)
+{
+    gen->running = 1;
+    return platform_midi_clock_send(gen, 0xFB);
+}
+
+int platform_midi_clock_gen_stop(struct platform_midi_clock_gen *gen)
+{
+    gen->running = 0;
+    return platform_midi_clock_send(gen, 0xFC);
+}
+
+int platform_midi_clock_gen_locate(struct platform_midi_clock_gen *gen, unsigned int beats)
+{
+    unsigned char msg[3] = { 0xF2, (unsigned char)(beats & 0x7F), (unsigned char)((beats >> 7) & 0x7F) };
+
+    if (gen->running)
+    {
+        printf("Warn: relocating the clock while running, receivers may ignore it\n");
+    }
+
+    gen->song_clocks = (beats & 0x3FFF) * PLATFORM_MIDI_CLOCK_PER_BEAT;
+    return platform_midi_write(gen->driver, msg, sizeof(msg));
+}
+
+// Sends the clock that is due, timing how late it went out
+static int platform_midi_clock_gen_tick(struct platform_midi_clock_gen *gen, unsigned long long deadline)
+{
+    int result = platform_midi_clock_send(gen, 0xF8);
+    unsigned long long now = platform_midi_clock_now();
+
+    platform_midi_clock_stats_add(&gen->lateness, now > deadline ? (now - deadline) / 1000.0 : 0);
+    gen->ticks++;
+
+    if (gen->running)
+    {
+        gen->song_clocks++;
+    }
+
+    return result;
+}
+
+int platform_midi_clock_gen_wait(struct platform_midi_clock_gen *gen)
+{
+    unsigned long long deadline = platform_midi_clock_gen_next(gen);
+
+    platform_midi_clock_sleep_until(deadline);
+    return platform_midi_clock_gen_tick(gen, deadline);
+}
+
+int platform_midi_clock_gen_poll(struct platform_midi_clock_gen *gen)
+{
+    unsigned long long now = platform_midi_clock_now();
+    int sent = 0;
+
+    // Missed clocks are all sent, late, so receivers keep the right song position
+    while (platform_midi_clock_gen_next(gen) <= now)
+    {
+        if (platform_midi_clock_gen_tick(gen, platform_midi_clock_gen_next(gen)) <= 0)
+        {
+            return -1;
+        }
+        sent++;
+    }
+
+    return sent;
+}
+
+void platform_midi_clock_follower_init(struct platform_midi_clock_follower *follower)
+{
+    memset(follower, 0, sizeof(*follower));
+    platform_midi_clock_follower_set_gain(follower, 0.05);
+}
+
+void platform_midi_clock_follower_set_gain(struct platform_midi_clock_follower *follower, double alpha)
+{
+    // Critically damped: lower alpha rejects more jitter but follows tempo changes more slowly
+    follower->alpha = alpha;
+    follower->beta = alpha * alpha / (2.0 - alpha);
+}
+
+static void platform_midi_clock_follower_clock(struct platform_midi_clock_follower *follower, unsigned int timestamp)
+{
+    double elapsed = (double)(int)(timestamp - follower->last_time);
+
+    if (follower->running)
+    {
+        follower->song_clocks++;
+        follower->clocked = 1;
+    }
+
+    if (follower->clocks > 1 && elapsed > follower->period * PLATFORM_MIDI_CLOCK_GAP)
+    {
+        follower->clocks = 0;
+        follower->steady = 0;
+        follower->locked = 0;
+    }
+
+    if (follower->clocks == 0)
+    {
+        // Keep the old period as a guess until the next clock measures one
+        follower->offset = 0;
+    }
+    else if (follower->clocks == 1)
+    {
+        follower->period = elapsed;
+        follower->offset = 0;
+    }
+    else
+    {
+        double error = elapsed - (follower->offset + follower->period);
+
+        if (fabs(error) < follower->period * PLATFORM_MIDI_CLOCK_TOLERANCE)
+        {
+            if (follower->steady < PLATFORM_MIDI_CLOCK_LOCK_CLOCKS)
+            {
+                follower->steady++;
+            }
+        }
+        else
+        {
+            // A lone late clock from a scheduling hiccup shouldn't drop lock, a run of them should
+            follower->steady = follower->steady > PLATFORM_MIDI_CLOCK_PER_BEAT ? follower->steady - PLATFORM_MIDI_CLOCK_PER_BEAT : 0;
+        }
+
+        if (follower->locked)
+        {
+            follower->locked = (follower->steady > 0);
+        }
+        else
+        {
+            follower->locked = (follower->steady >= PLATFORM_MIDI_CLOCK_LOCK_CLOCKS);
+        }
+
+        if (follower->locked)
+        {
+            platform_midi_clock_stats_add(&follower->jitter, error);
+        }
+
+        // The filtered time of this clock is the prediction plus alpha of the error;
+        // store it relative to the raw timestamp
+        follower->offset = -(1.0 - follower->alpha) * error;
+        follower->period += follower->beta * error;
+    }
+
+    follower->last_time = timestamp;
+    follower->clocks++;
+}
+
+void platform_midi_clock_follower_feed(struct platform_midi_clock_follower *follower, const unsigned char *buf, int size, unsigned int timestamp)
+{
+    for (int i = 0; i < size; i++)
+    {
+        unsigned char byte = buf[i];
+
+        switch (byte)
+        {
+            case 0xF8:
+                platform_midi_clock_follower_clock(follower, timestamp);
+                continue;
+
+            case 0xFA:
+                follower->song_clocks = 0;
+                follower->clocked = 0;
+                follower->running = 1;
+                continue;
+
+            case 0xFB:
+                follower->clocked = 0;
+                follower->running = 1;
+                continue;
+
+            case 0xFC:
+                follower->running = 0;
+                continue;
+
+            case 0xF2:
+                follower->in_spp = 1;
+                follower->spp_count = 0;
+                continue;
+        }
+
+        if (byte >= 0xF8)
+        {
+            // Other real-time bytes may interleave with a Song Position Pointer
+            continue;
+        }
+
+        if (byte & 0x80)
+        {
+            follower->in_spp = 0;
+        }
+        else if (follower->in_spp)
+        {
+            follower->spp[follower->spp_count++] = byte;
+
+            if (follower->spp_count == 2)
+            {
+                follower->song_clocks = (follower->spp[0] | (follower->spp[1] << 7)) * PLATFORM_MIDI_CLOCK_PER_BEAT;
+                follower->clocked = 0;
+                follower->in_spp = 0;
+            }
+        }
+    }
+}
+
+static void platform_midi_clock_follower_tap_fn(void *ctx, int direction, const unsigned char *buf, int size)
+{
+    struct platform_midi_clock_follower *follower = (struct platform_midi_clock_follower*)ctx;
+
+    (void)direction;
+    // When the clock arrived, not when the app got round to reading it
+    platform_midi_clock_follower_feed(follower, buf, size, platform_midi_read_time(follower->driver));
+}
+
+void platform_midi_clock_follower_attach(struct platform_midi_clock_follower *follower, struct platform_midi_driver *driver)
+{
+    follower->tap.fn = platform_midi_clock_follower_tap_fn;
+    follower->tap.ctx = follower;
+    follower->tap.directions = PLATFORM_MIDI_TAP_INPUT;
+    follower->driver = driver;
+    platform_midi_add_tap(driver, &follower->tap);
+}
+
+void platform_midi_clock_follower_detach(struct platform_midi_clock_follower *follower, struct platform_midi_driver *driver)
+{
+    platform_midi_remove_tap(driver, &follower->tap);
+}
+
+double platform_midi_clock_follower_position(const struct platform_midi_clock_follower *follower, unsigned int now)
+{
+    double position = (double)follower->song_clocks;
+
+    // Until the first clock after Start or Continue, the position is that of the next clock
+    if (follower->running && follower->clocked && follower->clocks > 1 && follower->period > 0)
+    {
+        position -= 1;
+
+        // Interpolate between clocks, but never past the next one
+        double phase = ((double)(int)(now - follower->last_time) - follower->offset) / follower->period;
+
+        if (phase > 0)
+        {
+            position += phase < 1 ? phase : 1;
+        }
+    }
+
+    return position / PLATFORM_MIDI_CLOCK_PPQN;
+}
+
+#endif
+
+#endif
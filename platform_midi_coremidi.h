@@ -1,12 +1,15 @@
 #ifndef _PLATFORM_MIDI_COREMIDI_H_
 #define _PLATFORM_MIDI_COREMIDI_H_
 
-struct platform_midi_driver *platform_midi_init_coremidi(const char *name, void *data);
+struct platform_midi_driver *platform_midi_init_coremidi(const char *name, const struct platform_midi_options *options);
 void platform_midi_deinit_coremidi(struct platform_midi_driver *driver);
 int platform_midi_read_coremidi(struct platform_midi_driver *driver, unsigned char *out, int size);
 int platform_midi_avail_coremidi(struct platform_midi_driver *driver);
 int platform_midi_write_coremidi(struct platform_midi_driver *driver, const unsigned char *buf, int size);
 
+// Returns how many received messages were dropped because the input queue was full
+unsigned int platform_midi_coremidi_dropped(struct platform_midi_driver *driver);
+
 #define PLATFORM_MIDI_IMPLEMENTATION
 #ifdef PLATFORM_MIDI_IMPLEMENTATION
 
@@ -25,7 +28,22 @@ struct platform_midi_coremidi_driver
     platform_midi_avail_fn availFn;
     platform_midi_read_fn readFn;
     platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
     void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    unsigned int read_time;
 
     struct platform_midi_ringbuf buffer;
     MIDIClientRef coremidi_client;
@@ -98,7 +116,7 @@ void platform_midi_notify_callback(const MIDINotification* message, void* refcon
     }
 }
 
-struct platform_midi_driver *platform_midi_init_coremidi(const char* name, void *data)
+struct platform_midi_driver *platform_midi_init_coremidi(const char* name, const struct platform_midi_options *options)
 {
     void *alloc = malloc(sizeof(struct platform_midi_coremidi_driver));
 
@@ -113,7 +131,22 @@ struct platform_midi_driver *platform_midi_init_coremidi(const char* name, void
     driver->availFn = platform_midi_avail_coremidi;
     driver->readFn = platform_midi_read_coremidi;
     driver->writeFn = platform_midi_write_coremidi;
-    driver->data = data;
+    driver->fdsFn = NULL;
+    driver->readEventsFn = NULL;
+    driver->writeEventsFn = NULL;
+    driver->readUmpFn = NULL;
+    driver->writeUmpFn = NULL;
+    driver->writeMultiFn = NULL;
+    driver->data = options ? options->user_data : NULL;
+    driver->taps = NULL;
+    driver->blocking = options ? options->blocking : 0;
+    driver->stream_out = 0;
+    platform_midi_realtime_init(&driver->realtime_out);
+    driver->read_held = NULL;
+    driver->read_held_len = 0;
+    driver->read_held_capacity = 0;
+    driver->read_held_time = 0;
+    driver->read_time = 0;
 
     driver->in_endpoint = 0;
     driver->out_endpoint = 0;
@@ -265,7 +298,7 @@ void platform_midi_deinit_coremidi(struct platform_midi_driver *driver)
 int platform_midi_read_coremidi(struct platform_midi_driver *driver, unsigned char * out, int size)
 {
     struct platform_midi_coremidi_driver *coremidi_driver = (struct platform_midi_coremidi_driver*)driver;
-    return platform_midi_pop_packet(&coremidi_driver->buffer, out, size);
+    return platform_midi_pop_packet_timed(&coremidi_driver->buffer, out, size, &coremidi_driver->read_time);
 }
 
 int platform_midi_avail_coremidi(struct platform_midi_driver *driver)
@@ -295,6 +328,11 @@ int platform_midi_write_coremidi(struct platform_midi_driver *driver, const unsi
     return size;
 }
 
+unsigned int platform_midi_coremidi_dropped(struct platform_midi_driver *driver)
+{
+    return platform_midi_buffer_dropped(&((struct platform_midi_coremidi_driver*)driver)->buffer);
+}
+
 #endif
 
 #endif
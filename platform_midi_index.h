@@ -0,0 +1,818 @@
+#ifndef _PLATFORM_MIDI_INDEX_H_
+#define _PLATFORM_MIDI_INDEX_H_
+
+#include "platform_midi.h"
+#include "platform_midi_play.h"
+#include "platform_midi_state.h"
+#include <stdio.h>
+
+/*
+ * platform_midi_index.h
+ *
+ * A binary capture format that can be seeked in O(log n), for long recordings
+ * where replaying from the start to rebuild controller and program state would
+ * take too long.
+ *
+ * All numbers are little-endian. A 64-byte header:
+ *   0   "PMIDX001"
+ *   8   u64 number of events
+ *   16  u64 time of the last event, in microseconds
+ *   24  u64 offset and 32 u64 size of the events
+ *   40  u64 offset of the index, 48 u32 number of index entries
+ *   52  u32 events per index entry, 56 u32 size of a checkpoint
+ *
+ * Each event is the microseconds since the previous one as an unsigned LEB128
+ * varint, then the message as-is if its status byte gives its length, or else
+ * (SysEx, continuations, running status) 0xF4, a varint length and the bytes.
+ * Either way the message can be handed out straight from the map.
+ *
+ * Every PLATFORM_MIDI_INDEX_INTERVAL events there is an index entry (u64 time of
+ * the event before, u64 offset into the events) and a checkpoint of the channel
+ * state up to there. The entries follow the events, then the checkpoints.
+ *
+ * Seeking binary searches the entries, restores one checkpoint and applies at
+ * most an interval's worth of events on top. With a driver, the messages that
+ * take it from the state before the seek to the state after are then written.
+ */
+
+// Events between checkpoints. A checkpoint is PLATFORM_MIDI_INDEX_CHECKPOINT_SIZE bytes
+#ifndef PLATFORM_MIDI_INDEX_INTERVAL
+#define PLATFORM_MIDI_INDEX_INTERVAL 4096
+#endif
+
+#define PLATFORM_MIDI_INDEX_MAGIC "PMIDX001"
+#define PLATFORM_MIDI_INDEX_HEADER_SIZE 64
+#define PLATFORM_MIDI_INDEX_ENTRY_SIZE 16
+#define PLATFORM_MIDI_INDEX_CHECKPOINT_SIZE (PLATFORM_MIDI_STATE_CHANNELS * (16 + 128 + 2 * (4 + PLATFORM_MIDI_STATE_RPNS) + 3))
+
+// Room for the state messages written by a seek; the most a full diff can need
+#define PLATFORM_MIDI_INDEX_SEEK_BUFFER_SIZE (16 * 1024)
+
+struct platform_midi_index_writer
+{
+    FILE *file;
+    int error;
+    unsigned int interval;
+
+    unsigned long long count;
+    unsigned long long time;
+    unsigned long long events_size;
+
+    // What the messages so far have done, checkpointed every interval
+    struct platform_midi_state state;
+
+    // Index entries and checkpoints, kept until the events are all written
+    unsigned char *index;
+    size_t index_size;
+    size_t index_capacity;
+    unsigned char *checkpoints;
+    size_t checkpoints_size;
+    size_t checkpoints_capacity;
+};
+
+struct platform_midi_index
+{
+    struct platform_midi_file_map file;
+
+    unsigned long long event_count;
+    unsigned long long duration;
+    const unsigned char *events;
+    const unsigned char *events_end;
+    const unsigned char *entries;
+    unsigned int entry_count;
+    unsigned int interval;
+    const unsigned char *checkpoints;
+
+    // Where reading is up to: the next event, its number, and the time of the one before
+    const unsigned char *pos;
+    unsigned long long event;
+    unsigned long long time;
+
+    // The state after every event read so far
+    struct platform_midi_state state;
+
+    unsigned char out[PLATFORM_MIDI_INDEX_SEEK_BUFFER_SIZE];
+};
+
+// Creates path. Returns 1 on success, 0 on failure
+int platform_midi_index_writer_open(struct platform_midi_index_writer *writer, const char *path);
+
+// Adds the messages in buf at time_us, which may not go backwards. Returns 1 on success, 0 on failure
+int platform_midi_index_writer_add(struct platform_midi_index_writer *writer, unsigned long long time_us, const unsigned char *buf, int size);
+
+// Writes the index and checkpoints and closes the file. Returns 1 if everything was written, 0 otherwise
+int platform_midi_index_writer_close(struct platform_midi_index_writer *writer);
+
+// Maps path. Returns 1 on success, 0 if it can't be opened or isn't an index file
+int platform_midi_index_open(struct platform_midi_index *index, const char *path);
+void platform_midi_index_close(struct platform_midi_index *index);
+
+// Moves reading to the first event at or after time_us. If driver isn't NULL, writes it the
+// messages that bring the state read so far up to date (held notes, programs, controllers,
+// RPN/NRPN, pressure, pitch bend). Returns the bytes written, or -1 on error
+int platform_midi_index_seek(struct platform_midi_index *index, unsigned long long time_us, struct platform_midi_driver *driver);
+
+// Reads the next event, pointing data at it in the map. Returns its size, 0 at the end, or -1 if the file is damaged
+int platform_midi_index_next(struct platform_midi_index *index, unsigned long long *time_us, const unsigned char **data);
+
+// Converts a Standard MIDI File, at the tempos in its tempo map. Returns 1 on success, 0 on failure
+int platform_midi_index_from_smf(const char *path, const char *out_path);
+
+// Converts a `mididump --binary` capture, with times relative to its first message. Returns 1 on success, 0 on failure
+int platform_midi_index_from_dump(const char *path, const char *out_path);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+static void platform_midi_index_put16(unsigned char *buf, unsigned int value)
+{
+    buf[0] = value & 0xFF;
+    buf[1] = (value >> 8) & 0xFF;
+}
+
+static void platform_midi_index_put32(unsigned char *buf, unsigned int value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        buf[i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+static void platform_midi_index_put64(unsigned char *buf, unsigned long long value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        buf[i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+static unsigned int platform_midi_index_get16(const unsigned char *buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+static unsigned int platform_midi_index_get32(const unsigned char *buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+}
+
+static unsigned long long platform_midi_index_get64(const unsigned char *buf)
+{
+    return platform_midi_index_get32(buf) | ((unsigned long long)platform_midi_index_get32(buf + 4) << 32);
+}
+
+static int platform_midi_index_put_varint(unsigned char *buf, unsigned long long value)
+{
+    int count = 0;
+
+    while (value >= 0x80)
+    {
+        buf[count++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buf[count++] = value;
+
+    return count;
+}
+
+// Reads a varint. Returns 0 if it runs past end
+static int platform_midi_index_get_varint(const unsigned char **pos, const unsigned char *end, unsigned long long *value)
+{
+    unsigned long long result = 0;
+
+    for (int shift = 0; shift < 64 && *pos < end; shift += 7)
+    {
+        unsigned char byte = *(*pos)++;
+        result |= (unsigned long long)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Field by field, so that the file doesn't depend on the struct's layout
+static void platform_midi_index_save_state(const struct platform_midi_state *state, unsigned char *out)
+{
+    for (int ch = 0; ch < PLATFORM_MIDI_STATE_CHANNELS; ch++)
+    {
+        for (int word = 0; word < 4; word++)
+        {
+            platform_midi_index_put32(out, state->notes[ch][word]);
+            out += 4;
+        }
+
+        memcpy(out, state->cc[ch], 128);
+        out += 128;
+
+        platform_midi_index_put16(out, state->pitch_bend[ch]);
+        platform_midi_index_put16(out + 2, state->rpn[ch]);
+        platform_midi_index_put16(out + 4, state->nrpn[ch]);
+        platform_midi_index_put16(out + 6, state->nrpn_value[ch]);
+        out += 8;
+
+        for (int rpn = 0; rpn < PLATFORM_MIDI_STATE_RPNS; rpn++)
+        {
+            platform_midi_index_put16(out, state->rpn_values[ch][rpn]);
+            out += 2;
+        }
+
+        *out++ = state->program[ch];
+        *out++ = state->pressure[ch];
+        *out++ = state->nrpn_active[ch];
+    }
+}
+
+static void platform_midi_index_load_state(struct platform_midi_state *state, const unsigned char *in)
+{
+    for (int ch = 0; ch < PLATFORM_MIDI_STATE_CHANNELS; ch++)
+    {
+        for (int word = 0; word < 4; word++)
+        {
+            state->notes[ch][word] = platform_midi_index_get32(in);
+            in += 4;
+        }
+
+        memcpy(state->cc[ch], in, 128);
+        in += 128;
+
+        state->pitch_bend[ch] = platform_midi_index_get16(in);
+        state->rpn[ch] = platform_midi_index_get16(in + 2);
+        state->nrpn[ch] = platform_midi_index_get16(in + 4);
+        state->nrpn_value[ch] = platform_midi_index_get16(in + 6);
+        in += 8;
+
+        for (int rpn = 0; rpn < PLATFORM_MIDI_STATE_RPNS; rpn++)
+        {
+            state->rpn_values[ch][rpn] = platform_midi_index_get16(in);
+            in += 2;
+        }
+
+        state->program[ch] = *in++;
+        state->pressure[ch] = *in++;
+        state->nrpn_active[ch] = *in++;
+    }
+
+    // Running status doesn't carry over a checkpoint, neither when writing nor when reading
+    memset(state->parsers, 0, sizeof(state->parsers));
+    state->changed = 0;
+}
+
+// Makes room for size more bytes at the end of a growable buffer, or returns NULL
+static unsigned char *platform_midi_index_grow(unsigned char **buf, size_t *used, size_t *capacity, size_t size)
+{
+    if (*used + size > *capacity)
+    {
+        size_t grown = *capacity ? *capacity * 2 : 64 * 1024;
+        while (grown < *used + size)
+        {
+            grown *= 2;
+        }
+
+        unsigned char *bigger = (unsigned char*)realloc(*buf, grown);
+        if (!bigger)
+        {
+            return NULL;
+        }
+        *buf = bigger;
+        *capacity = grown;
+    }
+
+    unsigned char *result = *buf + *used;
+    *used += size;
+    return result;
+}
+
+int platform_midi_index_writer_open(struct platform_midi_index_writer *writer, const char *path)
+{
+    unsigned char header[PLATFORM_MIDI_INDEX_HEADER_SIZE] = { 0 };
+
+    memset(writer, 0, sizeof(*writer));
+    writer->interval = PLATFORM_MIDI_INDEX_INTERVAL;
+    platform_midi_state_init(&writer->state);
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file)
+    {
+        printf("Failed to create %s\n", path);
+        return 0;
+    }
+
+    // Filled in on close
+    if (fwrite(header, 1, sizeof(header), writer->file) != sizeof(header))
+    {
+        printf("Failed to write %s\n", path);
+        fclose(writer->file);
+        writer->file = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+// Checkpoints the state before event number writer->count
+static int platform_midi_index_writer_checkpoint(struct platform_midi_index_writer *writer)
+{
+    unsigned char *entry = platform_midi_index_grow(&writer->index, &writer->index_size, &writer->index_capacity, PLATFORM_MIDI_INDEX_ENTRY_SIZE);
+    unsigned char *checkpoint = entry ? platform_midi_index_grow(&writer->checkpoints, &writer->checkpoints_size, &writer->checkpoints_capacity, PLATFORM_MIDI_INDEX_CHECKPOINT_SIZE) : NULL;
+
+    if (!checkpoint)
+    {
+        printf("Failed to allocate MIDI index\n");
+        return 0;
+    }
+
+    platform_midi_index_put64(entry, writer->time);
+    platform_midi_index_put64(entry + 8, writer->events_size);
+    platform_midi_index_save_state(&writer->state, checkpoint);
+    memset(writer->state.parsers, 0, sizeof(writer->state.parsers));
+    return 1;
+}
+
+int platform_midi_index_writer_add(struct platform_midi_index_writer *writer, unsigned long long time_us, const unsigned char *buf, int size)
+{
+    unsigned char head[24];
+
+    if (!writer->file || writer->error)
+    {
+        return 0;
+    }
+
+    if (time_us < writer->time)
+    {
+        time_us = writer->time;
+    }
+
+    while (size > 0)
+    {
+        int length = platform_midi_next_message(buf, size);
+        int used;
+
+        if (writer->count % writer->interval == 0 && !platform_midi_index_writer_checkpoint(writer))
+        {
+            writer->error = 1;
+            return 0;
+        }
+
+        used = platform_midi_index_put_varint(head, time_us - writer->time);
+
+        if (buf[0] & 0x80 && buf[0] != 0xF0 && buf[0] != 0xF4 && buf[0] != 0xF7 && length == (int)platform_midi_msg_length(buf[0]))
+        {
+            memcpy(head + used, buf, length);
+            used += length;
+        }
+        else
+        {
+            head[used++] = 0xF4;
+            used += platform_midi_index_put_varint(head + used, length);
+
+            // Too big to go in one write with the header
+            if (used + length > (int)sizeof(head))
+            {
+                if (fwrite(head, 1, used, writer->file) != (size_t)used)
+                {
+                    writer->error = 1;
+                    return 0;
+                }
+                writer->events_size += used;
+                used = 0;
+            }
+
+            if (used)
+            {
+                memcpy(head + used, buf, length);
+                used += length;
+            }
+            else if (fwrite(buf, 1, length, writer->file) != (size_t)length)
+            {
+                writer->error = 1;
+                return 0;
+            }
+            else
+            {
+                writer->events_size += length;
+            }
+        }
+
+        if (used && fwrite(head, 1, used, writer->file) != (size_t)used)
+        {
+            writer->error = 1;
+            return 0;
+        }
+
+        writer->events_size += used;
+        writer->time = time_us;
+        writer->count++;
+        platform_midi_state_update(&writer->state, buf, length);
+
+        buf += length;
+        size -= length;
+    }
+
+    return 1;
+}
+
+int platform_midi_index_writer_close(struct platform_midi_index_writer *writer)
+{
+    unsigned char header[PLATFORM_MIDI_INDEX_HEADER_SIZE] = { 0 };
+    static const unsigned char padding[8] = { 0 };
+    int ok = 0;
+
+    if (!writer->file)
+    {
+        return 0;
+    }
+
+    // The index starts 8-byte aligned
+    unsigned long long indexOffset = (PLATFORM_MIDI_INDEX_HEADER_SIZE + writer->events_size + 7) & ~7ull;
+    size_t pad = indexOffset - PLATFORM_MIDI_INDEX_HEADER_SIZE - writer->events_size;
+
+    memcpy(header, PLATFORM_MIDI_INDEX_MAGIC, 8);
+    platform_midi_index_put64(header + 8, writer->count);
+    platform_midi_index_put64(header + 16, writer->time);
+    platform_midi_index_put64(header + 24, PLATFORM_MIDI_INDEX_HEADER_SIZE);
+    platform_midi_index_put64(header + 32, writer->events_size);
+    platform_midi_index_put64(header + 40, indexOffset);
+    platform_midi_index_put32(header + 48, (unsigned int)(writer->index_size / PLATFORM_MIDI_INDEX_ENTRY_SIZE));
+    platform_midi_index_put32(header + 52, writer->interval);
+    platform_midi_index_put32(header + 56, PLATFORM_MIDI_INDEX_CHECKPOINT_SIZE);
+
+    if (!writer->error
+        && fwrite(padding, 1, pad, writer->file) == pad
+        && fwrite(writer->index, 1, writer->index_size, writer->file) == writer->index_size
+        && fwrite(writer->checkpoints, 1, writer->checkpoints_size, writer->file) == writer->checkpoints_size
+        && 0 == fseek(writer->file, 0, SEEK_SET)
+        && fwrite(header, 1, sizeof(header), writer->file) == sizeof(header))
+    {
+        ok = 1;
+    }
+
+    if (0 != fclose(writer->file))
+    {
+        ok = 0;
+    }
+
+    if (!ok)
+    {
+        printf("Error writing MIDI index file\n");
+    }
+
+    free(writer->index);
+    free(writer->checkpoints);
+    writer->index = NULL;
+    writer->checkpoints = NULL;
+    writer->file = NULL;
+    return ok;
+}
+
+int platform_midi_index_open(struct platform_midi_index *index, const char *path)
+{
+    memset(&index->file, 0, sizeof(index->file));
+
+    // Seeks jump about, so don't read ahead
+    if (!platform_midi_file_map_open(&index->file, path, 0))
+    {
+        return 0;
+    }
+
+    const unsigned char *data = index->file.data;
+    unsigned long long size = index->file.size;
+
+    if (size < PLATFORM_MIDI_INDEX_HEADER_SIZE || memcmp(data, PLATFORM_MIDI_INDEX_MAGIC, 8))
+    {
+        printf("Error: %s is not a MIDI index file\n", path);
+        platform_midi_file_map_close(&index->file);
+        return 0;
+    }
+
+    unsigned long long eventsOffset = platform_midi_index_get64(data + 24);
+    unsigned long long eventsSize = platform_midi_index_get64(data + 32);
+    unsigned long long indexOffset = platform_midi_index_get64(data + 40);
+
+    index->event_count = platform_midi_index_get64(data + 8);
+    index->duration = platform_midi_index_get64(data + 16);
+    index->entry_count = platform_midi_index_get32(data + 48);
+    index->interval = platform_midi_index_get32(data + 52);
+
+    unsigned long long tablesSize = (unsigned long long)index->entry_count * (PLATFORM_MIDI_INDEX_ENTRY_SIZE + PLATFORM_MIDI_INDEX_CHECKPOINT_SIZE);
+
+    if (eventsOffset > size || eventsSize > size - eventsOffset || indexOffset > size || tablesSize > size - indexOffset
+        || platform_midi_index_get32(data + 56) != PLATFORM_MIDI_INDEX_CHECKPOINT_SIZE || index->interval == 0
+        || index->entry_count != (index->event_count + index->interval - 1) / index->interval)
+    {
+        printf("Error: %s is damaged\n", path);
+        platform_midi_file_map_close(&index->file);
+        return 0;
+    }
+
+    index->events = data + eventsOffset;
+    index->events_end = index->events + eventsSize;
+    index->entries = data + indexOffset;
+    index->checkpoints = index->entries + (size_t)index->entry_count * PLATFORM_MIDI_INDEX_ENTRY_SIZE;
+
+    index->pos = index->events;
+    index->event = 0;
+    index->time = 0;
+    platform_midi_state_init(&index->state);
+    return 1;
+}
+
+void platform_midi_index_close(struct platform_midi_index *index)
+{
+    platform_midi_file_map_close(&index->file);
+    index->pos = NULL;
+    index->events_end = NULL;
+}
+
+// Decodes the event at the read position without moving it. Returns its size, 0 at the end, or -1 if damaged
+static int platform_midi_index_decode(const struct platform_midi_index *index, unsigned long long *time, const unsigned char **data, const unsigned char **next)
+{
+    const unsigned char *pos = index->pos;
+    unsigned long long delta;
+    unsigned long long length;
+
+    if (index->event >= index->event_count || pos >= index->events_end)
+    {
+        return 0;
+    }
+
+    if (!platform_midi_index_get_varint(&pos, index->events_end, &delta) || pos >= index->events_end)
+    {
+        return -1;
+    }
+
+    if (*pos == 0xF4)
+    {
+        pos++;
+        if (!platform_midi_index_get_varint(&pos, index->events_end, &length) || length == 0 || length > (unsigned long long)(index->events_end - pos))
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        length = platform_midi_msg_length(*pos);
+        if (!(*pos & 0x80) || length > (unsigned long long)(index->events_end - pos))
+        {
+            return -1;
+        }
+    }
+
+    *time = index->time + delta;
+    *data = pos;
+    *next = pos + length;
+    return (int)length;
+}
+
+int platform_midi_index_next(struct platform_midi_index *index, unsigned long long *time_us, const unsigned char **data)
+{
+    const unsigned char *next;
+    int size = platform_midi_index_decode(index, time_us, data, &next);
+
+    if (size <= 0)
+    {
+        return size;
+    }
+
+    // Keep in step with the writer, which restarts parsing at each checkpoint
+    if (index->event % index->interval == 0)
+    {
+        memset(index->state.parsers, 0, sizeof(index->state.parsers));
+    }
+
+    platform_midi_state_update(&index->state, *data, size);
+    index->pos = next;
+    index->time = *time_us;
+    index->event++;
+    return size;
+}
+
+int platform_midi_index_seek(struct platform_midi_index *index, unsigned long long time_us, struct platform_midi_driver *driver)
+{
+    struct platform_midi_state before;
+    unsigned int entry = 0;
+
+    if (driver)
+    {
+        memcpy(&before, &index->state, sizeof(before));
+    }
+
+    // The last checkpoint with everything before it earlier than time_us; the first has nothing before it
+    if (index->entry_count)
+    {
+        unsigned int low = 1;
+        unsigned int high = index->entry_count;
+
+        while (low < high)
+        {
+            unsigned int mid = low + (high - low) / 2;
+
+            if (platform_midi_index_get64(index->entries + (size_t)mid * PLATFORM_MIDI_INDEX_ENTRY_SIZE) < time_us)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+        entry = low - 1;
+
+        const unsigned char *found = index->entries + (size_t)entry * PLATFORM_MIDI_INDEX_ENTRY_SIZE;
+        unsigned long long offset = platform_midi_index_get64(found + 8);
+
+        if (offset > (unsigned long long)(index->events_end - index->events))
+        {
+            printf("Error: MIDI index entry %u is damaged\n", entry);
+            return -1;
+        }
+
+        index->pos = index->events + offset;
+        index->time = platform_midi_index_get64(found);
+        index->event = (unsigned long long)entry * index->interval;
+        platform_midi_index_load_state(&index->state, index->checkpoints + (size_t)entry * PLATFORM_MIDI_INDEX_CHECKPOINT_SIZE);
+    }
+    else
+    {
+        index->pos = index->events;
+        index->time = 0;
+        index->event = 0;
+        platform_midi_state_init(&index->state);
+    }
+
+    // Then the events up to time_us
+    while (1)
+    {
+        unsigned long long time;
+        const unsigned char *data;
+        const unsigned char *next;
+        int size = platform_midi_index_decode(index, &time, &data, &next);
+
+        if (size < 0)
+        {
+            printf("Error: MIDI index event %llu is damaged\n", index->event);
+            return -1;
+        }
+
+        if (size == 0 || time >= time_us)
+        {
+            break;
+        }
+
+        platform_midi_index_next(index, &time, &data);
+    }
+
+    if (!driver)
+    {
+        return 0;
+    }
+
+    int size = platform_midi_state_diff(&before, &index->state, index->out, sizeof(index->out));
+    if (size && platform_midi_write(driver, index->out, size) < 0)
+    {
+        printf("Error writing MIDI state\n");
+        return -1;
+    }
+
+    return size;
+}
+
+int platform_midi_index_from_smf(const char *path, const char *out_path)
+{
+    struct platform_midi_player *player = (struct platform_midi_player*)malloc(sizeof(struct platform_midi_player));
+    struct platform_midi_index_writer writer;
+    unsigned char *sysex = NULL;
+    unsigned int sysexSize = 0;
+    int ok = 1;
+
+    if (!player)
+    {
+        printf("Failed to allocate MIDI file player\n");
+        return 0;
+    }
+
+    // Nothing is played, the player just merges the tracks and keeps the tempo map
+    if (!platform_midi_player_open(player, NULL, path))
+    {
+        free(player);
+        return 0;
+    }
+
+    if (!platform_midi_index_writer_open(&writer, out_path))
+    {
+        platform_midi_player_close(player);
+        free(player);
+        return 0;
+    }
+
+    while (ok && player->heap_count)
+    {
+        struct platform_midi_player_track *track = &player->tracks[player->heap[0]];
+        unsigned long long time = (unsigned long long)(platform_midi_player_time(player, track->tick) + 0.5);
+
+        if (track->kind == PLATFORM_MIDI_PLAY_MESSAGE)
+        {
+            ok = platform_midi_index_writer_add(&writer, time, track->msg, track->size);
+        }
+        else if (track->kind == PLATFORM_MIDI_PLAY_SYSEX)
+        {
+            // The F0 isn't in the file's copy of the message
+            if (track->size + 1 > sysexSize)
+            {
+                unsigned char *bigger = (unsigned char*)realloc(sysex, track->size + 1);
+                if (!bigger)
+                {
+                    printf("Failed to allocate SysEx buffer\n");
+                    ok = 0;
+                    break;
+                }
+                sysex = bigger;
+                sysexSize = track->size + 1;
+            }
+
+            sysex[0] = 0xF0;
+            memcpy(sysex + 1, track->data, track->size);
+            ok = platform_midi_index_writer_add(&writer, time, sysex, track->size + 1);
+        }
+        else if (track->size)
+        {
+            ok = platform_midi_index_writer_add(&writer, time, track->data, track->size);
+        }
+
+        platform_midi_player_next_event(player);
+        platform_midi_player_skip_meta(player);
+    }
+
+    free(sysex);
+    platform_midi_player_close(player);
+    free(player);
+
+    // Close regardless, so the file isn't left open
+    return platform_midi_index_writer_close(&writer) && ok;
+}
+
+int platform_midi_index_from_dump(const char *path, const char *out_path)
+{
+    struct platform_midi_file_map map = { 0 };
+    struct platform_midi_index_writer writer;
+    int ok = 1;
+
+    if (!platform_midi_file_map_open(&map, path, 1))
+    {
+        return 0;
+    }
+
+    if (map.size < 8 || memcmp(map.data, "PMDUMP01", 8))
+    {
+        printf("Error: %s is not a mididump --binary capture\n", path);
+        platform_midi_file_map_close(&map);
+        return 0;
+    }
+
+    if (!platform_midi_index_writer_open(&writer, out_path))
+    {
+        platform_midi_file_map_close(&map);
+        return 0;
+    }
+
+    const unsigned char *pos = map.data + 8;
+    const unsigned char *end = map.data + map.size;
+    unsigned long long first = 0;
+    int records = 0;
+
+    while (ok && pos < end)
+    {
+        if (end - pos < 10 || platform_midi_index_get16(pos + 8) > (size_t)(end - pos - 10))
+        {
+            printf("Warn: %s is truncated\n", path);
+            break;
+        }
+
+        unsigned long long timestamp = platform_midi_index_get64(pos);
+        unsigned int size = platform_midi_index_get16(pos + 8);
+
+        if (!records++)
+        {
+            first = timestamp;
+        }
+
+        if (size)
+        {
+            ok = platform_midi_index_writer_add(&writer, timestamp > first ? (timestamp - first) / 1000 : 0, pos + 10, size);
+        }
+        pos += 10 + size;
+    }
+
+    platform_midi_file_map_close(&map);
+    return platform_midi_index_writer_close(&writer) && ok;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,464 @@
+#ifndef _PLATFORM_MIDI_JACK_H_
+#define _PLATFORM_MIDI_JACK_H_
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <jack/ringbuffer.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * JACK backend, enabled by defining PLATFORM_MIDI_JACK and linking with -ljack
+ *
+ * Registers one MIDI input port "in" and one output port "out". The process callback
+ * runs on JACK's real-time thread and only ever touches the lock-free ringbuffers, so
+ * it never blocks on the application:
+ *   - input events are copied from the port buffer into the input ring along with
+ *     their frame offset inside the period
+ *   - messages written by the application are copied from the output ring into the
+ *     port buffer at the start of the next period
+ *
+ * platform_midi_fds() gives an eventfd that the process callback signals whenever it
+ * queues input, so the driver can be waited on with poll() or epoll.
+ *
+ * Test without audio hardware with `jackd -d dummy`.
+ */
+
+// Size in bytes of each direction's ringbuffer
+#ifndef PLATFORM_MIDI_JACK_RING_SIZE
+#define PLATFORM_MIDI_JACK_RING_SIZE 65536
+#endif
+
+// Where and when the process callback received an input event
+struct platform_midi_jack_event_info
+{
+    // Frame offset of the event inside its period
+    jack_nframes_t offset;
+    // Frame time of the first frame of the period
+    jack_nframes_t period_start;
+    // CLOCK_MONOTONIC time in ns at which the process callback copied the event
+    unsigned long long received_ns;
+};
+
+struct platform_midi_driver *platform_midi_init_jack(const char *name, const struct platform_midi_options *options);
+void platform_midi_deinit_jack(struct platform_midi_driver *driver);
+int platform_midi_read_jack(struct platform_midi_driver *driver, unsigned char *out, int size);
+int platform_midi_avail_jack(struct platform_midi_driver *driver);
+int platform_midi_write_jack(struct platform_midi_driver *driver, const unsigned char *buf, int size);
+
+// Reads like platform_midi_read_jack(), also storing the event's timing into info if it isn't NULL
+int platform_midi_read_jack_info(struct platform_midi_driver *driver, unsigned char *out, int size, struct platform_midi_jack_event_info *info);
+
+// Returns the JACK client, e.g. for connecting ports
+jack_client_t *platform_midi_jack_client(struct platform_midi_driver *driver);
+
+int platform_midi_fds_jack(struct platform_midi_driver *driver, int *fds, int max);
+
+// Returns how many events were dropped: input because the input ring was full, and output
+// too large for a JACK port buffer
+unsigned int platform_midi_jack_dropped(struct platform_midi_driver *driver);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+struct platform_midi_jack_record
+{
+    jack_nframes_t offset;
+    jack_nframes_t period_start;
+    unsigned long long received_ns;
+    unsigned int size;
+};
+
+struct platform_midi_jack_driver
+{
+    platform_midi_deinit_fn deinitFn;
+    platform_midi_avail_fn availFn;
+    platform_midi_read_fn readFn;
+    platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
+    void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    unsigned int read_time;
+
+    jack_client_t *client;
+    jack_port_t *in_port;
+    jack_port_t *out_port;
+
+    // Process callback -> application
+    jack_ringbuffer_t *in_ring;
+    // Application -> process callback
+    jack_ringbuffer_t *out_ring;
+
+    // Signalled by the process callback when it queues input
+    int event_fd;
+    // The largest event a port buffer can hold
+    size_t max_event_size;
+
+    unsigned int dropped;
+};
+
+static unsigned long long platform_midi_jack_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Runs on JACK's real-time thread, so no locks, allocation or printing in here
+static int platform_midi_jack_process(jack_nframes_t nframes, void *arg)
+{
+    struct platform_midi_jack_driver *jack_driver = (struct platform_midi_jack_driver*)arg;
+    void *inBuf = jack_port_get_buffer(jack_driver->in_port, nframes);
+    void *outBuf = jack_port_get_buffer(jack_driver->out_port, nframes);
+    jack_nframes_t periodStart = jack_last_frame_time(jack_driver->client);
+    unsigned long long now = platform_midi_jack_now_ns();
+    int queued = 0;
+
+    uint32_t count = jack_midi_get_event_count(inBuf);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        jack_midi_event_t event;
+        struct platform_midi_jack_record record;
+
+        if (0 != jack_midi_event_get(&event, inBuf, i))
+        {
+            continue;
+        }
+
+        if (jack_ringbuffer_write_space(jack_driver->in_ring) < sizeof(record) + event.size)
+        {
+            __atomic_fetch_add(&jack_driver->dropped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        record.offset = event.time;
+        record.period_start = periodStart;
+        record.received_ns = now;
+        record.size = event.size;
+
+        jack_ringbuffer_write(jack_driver->in_ring, (const char*)&record, sizeof(record));
+        jack_ringbuffer_write(jack_driver->in_ring, (const char*)event.buffer, event.size);
+        queued = 1;
+    }
+
+    // One eventfd write per period, which doesn't block
+    if (queued)
+    {
+        uint64_t one = 1;
+        if (write(jack_driver->event_fd, &one, sizeof(one)) < 0)
+        {
+            // Only fails if the counter is saturated, which is still readable
+        }
+    }
+
+    jack_midi_clear_buffer(outBuf);
+
+    while (jack_ringbuffer_read_space(jack_driver->out_ring) >= sizeof(unsigned int))
+    {
+        unsigned int size;
+        jack_ringbuffer_peek(jack_driver->out_ring, (char*)&size, sizeof(size));
+
+        // The writer may not have finished copying the message in yet
+        if (jack_ringbuffer_read_space(jack_driver->out_ring) < sizeof(size) + size)
+        {
+            break;
+        }
+
+        if (size > jack_midi_max_event_size(outBuf))
+        {
+            // Anything that doesn't fit in this period goes out in the next one, unless it
+            // doesn't fit in an empty buffer either, when it would hold up everything behind it
+            if (jack_midi_get_event_count(outBuf) == 0)
+            {
+                jack_ringbuffer_read_advance(jack_driver->out_ring, sizeof(size) + size);
+                __atomic_fetch_add(&jack_driver->dropped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            break;
+        }
+
+        jack_midi_data_t *dest = jack_midi_event_reserve(outBuf, 0, size);
+        if (!dest)
+        {
+            break;
+        }
+
+        jack_ringbuffer_read_advance(jack_driver->out_ring, sizeof(size));
+        jack_ringbuffer_read(jack_driver->out_ring, (char*)dest, size);
+    }
+
+    return 0;
+}
+
+struct platform_midi_driver *platform_midi_init_jack(const char *name, const struct platform_midi_options *options)
+{
+    jack_status_t status;
+
+    void *alloc = malloc(sizeof(struct platform_midi_jack_driver));
+
+    if (!alloc)
+    {
+        printf("Failed to allocate driver struct\n");
+        return NULL;
+    }
+
+    struct platform_midi_jack_driver *jack_driver = (struct platform_midi_jack_driver*)alloc;
+    memset(jack_driver, 0, sizeof(*jack_driver));
+
+    jack_driver->deinitFn = platform_midi_deinit_jack;
+    jack_driver->availFn = platform_midi_avail_jack;
+    jack_driver->readFn = platform_midi_read_jack;
+    jack_driver->writeFn = platform_midi_write_jack;
+    jack_driver->fdsFn = platform_midi_fds_jack;
+    jack_driver->readEventsFn = NULL;
+    jack_driver->writeEventsFn = NULL;
+    jack_driver->readUmpFn = NULL;
+    jack_driver->writeUmpFn = NULL;
+    jack_driver->writeMultiFn = NULL;
+    jack_driver->data = options ? options->user_data : NULL;
+    jack_driver->taps = NULL;
+    jack_driver->blocking = options ? options->blocking : 0;
+    jack_driver->stream_out = 0;
+    platform_midi_realtime_init(&jack_driver->realtime_out);
+    jack_driver->read_held = NULL;
+    jack_driver->read_held_len = 0;
+    jack_driver->read_held_capacity = 0;
+    jack_driver->read_held_time = 0;
+    jack_driver->read_time = 0;
+
+    jack_driver->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (jack_driver->event_fd < 0)
+    {
+        printf("Failed to create JACK eventfd: %s\n", strerror(errno));
+        free(jack_driver);
+        return NULL;
+    }
+
+    jack_driver->client = jack_client_open(name, JackNoStartServer, &status);
+    if (!jack_driver->client)
+    {
+        printf("Failed to open JACK client: status 0x%x\n", (unsigned int)status);
+        platform_midi_deinit_jack((struct platform_midi_driver*)jack_driver);
+        return NULL;
+    }
+
+    jack_driver->max_event_size = jack_port_type_get_buffer_size(jack_driver->client, JACK_DEFAULT_MIDI_TYPE);
+
+    size_t ringSize = (options && options->queue_size) ? options->queue_size : PLATFORM_MIDI_JACK_RING_SIZE;
+    jack_driver->in_ring = jack_ringbuffer_create(ringSize);
+    jack_driver->out_ring = jack_ringbuffer_create(ringSize);
+    if (!jack_driver->in_ring || !jack_driver->out_ring)
+    {
+        printf("Failed to create JACK ringbuffers\n");
+        platform_midi_deinit_jack((struct platform_midi_driver*)jack_driver);
+        return NULL;
+    }
+
+    // Keep the real-time thread from page faulting on them
+    jack_ringbuffer_mlock(jack_driver->in_ring);
+    jack_ringbuffer_mlock(jack_driver->out_ring);
+
+    jack_driver->in_port = jack_port_register(jack_driver->client, "in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+    jack_driver->out_port = jack_port_register(jack_driver->client, "out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+    if (!jack_driver->in_port || !jack_driver->out_port)
+    {
+        printf("Failed to register JACK MIDI ports\n");
+        platform_midi_deinit_jack((struct platform_midi_driver*)jack_driver);
+        return NULL;
+    }
+
+    if (0 != jack_set_process_callback(jack_driver->client, platform_midi_jack_process, jack_driver)
+        || 0 != jack_activate(jack_driver->client))
+    {
+        printf("Failed to activate JACK client\n");
+        platform_midi_deinit_jack((struct platform_midi_driver*)jack_driver);
+        return NULL;
+    }
+
+    printf("JACK client %s initialized\n", jack_get_client_name(jack_driver->client));
+
+    return (struct platform_midi_driver*)jack_driver;
+}
+
+void platform_midi_deinit_jack(struct platform_midi_driver *driver)
+{
+    struct platform_midi_jack_driver *jack_driver = (struct platform_midi_jack_driver*)driver;
+
+    if (jack_driver->client)
+    {
+        // Stops the process callback before the rings go away
+        jack_deactivate(jack_driver->client);
+        jack_client_close(jack_driver->client);
+    }
+
+    if (jack_driver->in_ring)
+    {
+        jack_ringbuffer_free(jack_driver->in_ring);
+    }
+
+    if (jack_driver->out_ring)
+    {
+        jack_ringbuffer_free(jack_driver->out_ring);
+    }
+
+    if (jack_driver->event_fd >= 0)
+    {
+        close(jack_driver->event_fd);
+    }
+
+    free(jack_driver);
+}
+
+int platform_midi_read_jack_info(struct platform_midi_driver *driver, unsigned char *out, int size, struct platform_midi_jack_event_info *info)
+{
+    struct platform_midi_jack_driver *jack_driver = (struct platform_midi_jack_driver*)driver;
+    struct platform_midi_jack_record record;
+
+    size_t space = jack_ringbuffer_read_space(jack_driver->in_ring);
+    if (space < sizeof(record))
+    {
+        // Clear the eventfd before looking again, so input queued after that look signals it afresh
+        uint64_t count;
+        if (read(jack_driver->event_fd, &count, sizeof(count)) <= 0)
+        {
+            return 0;
+        }
+
+        space = jack_ringbuffer_read_space(jack_driver->in_ring);
+        if (space < sizeof(record))
+        {
+            return 0;
+        }
+    }
+
+    // The header is written first, so wait until the whole event is there
+    jack_ringbuffer_peek(jack_driver->in_ring, (char*)&record, sizeof(record));
+    if (space < sizeof(record) + record.size)
+    {
+        return 0;
+    }
+
+    jack_ringbuffer_read_advance(jack_driver->in_ring, sizeof(record));
+
+    unsigned int toCopy = ((unsigned int)size < record.size) ? (unsigned int)size : record.size;
+    jack_ringbuffer_read(jack_driver->in_ring, (char*)out, toCopy);
+    jack_ringbuffer_read_advance(jack_driver->in_ring, record.size - toCopy);
+    // The same clock as platform_midi_event_time(), in microseconds
+    jack_driver->read_time = (unsigned int)(record.received_ns / 1000);
+
+    if (info)
+    {
+        info->offset = record.offset;
+        info->period_start = record.period_start;
+        info->received_ns = record.received_ns;
+    }
+
+    return toCopy;
+}
+
+int platform_midi_read_jack(struct platform_midi_driver *driver, unsigned char *out, int size)
+{
+    return platform_midi_read_jack_info(driver, out, size, NULL);
+}
+
+int platform_midi_avail_jack(struct platform_midi_driver *driver)
+{
+    struct platform_midi_jack_driver *jack_driver = (struct platform_midi_jack_driver*)driver;
+    jack_ringbuffer_data_t vec[2];
+    struct platform_midi_jack_record record;
+    size_t pos = 0;
+    int count = 0;
+
+    jack_ringbuffer_get_read_vector(jack_driver->in_ring, vec);
+    size_t total = vec[0].len + vec[1].len;
+
+    // Walk the record headers without consuming anything
+    while (pos + sizeof(record) <= total)
+    {
+        for (size_t i = 0; i < sizeof(record); i++)
+        {
+            size_t at = pos + i;
+            ((char*)&record)[i] = (at < vec[0].len) ? vec[0].buf[at] : vec[1].buf[at - vec[0].len];
+        }
+
+        pos += sizeof(record) + record.size;
+        if (pos > total)
+        {
+            break;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+int platform_midi_write_jack(struct platform_midi_driver *driver, const unsigned char *buf, int size)
+{
+    struct platform_midi_jack_driver *jack_driver = (struct platform_midi_jack_driver*)driver;
+    int written = 0;
+
+    // JACK events are single messages, so split the buffer up
+    while (written < size)
+    {
+        unsigned int length = platform_midi_next_message(buf + written, size - written);
+
+        if (length > jack_driver->max_event_size)
+        {
+            printf("Err: %u byte message is too large for a JACK port buffer\n", length);
+            break;
+        }
+
+        if (jack_ringbuffer_write_space(jack_driver->out_ring) < sizeof(length) + length)
+        {
+            printf("Warn: JACK output ring is full, dropping %d bytes\n", size - written);
+            break;
+        }
+
+        jack_ringbuffer_write(jack_driver->out_ring, (const char*)&length, sizeof(length));
+        jack_ringbuffer_write(jack_driver->out_ring, (const char*)buf + written, length);
+        written += length;
+    }
+
+    return (written > 0) ? written : -1;
+}
+
+jack_client_t *platform_midi_jack_client(struct platform_midi_driver *driver)
+{
+    return ((struct platform_midi_jack_driver*)driver)->client;
+}
+
+int platform_midi_fds_jack(struct platform_midi_driver *driver, int *fds, int max)
+{
+    if (max < 1)
+    {
+        return 0;
+    }
+
+    fds[0] = ((struct platform_midi_jack_driver*)driver)->event_fd;
+    return 1;
+}
+
+unsigned int platform_midi_jack_dropped(struct platform_midi_driver *driver)
+{
+    return __atomic_load_n(&((struct platform_midi_jack_driver*)driver)->dropped, __ATOMIC_RELAXED);
+}
+#endif
+
+#endif
@@ -0,0 +1,521 @@
+#ifndef _PLATFORM_MIDI_MUX_H_
+#define _PLATFORM_MIDI_MUX_H_
+
+#include "platform_midi.h"
+#include <pthread.h>
+
+/*
+ * platform_midi_mux.h
+ *
+ * Serves many drivers from a few threads (Linux only). Every driver's fds go
+ * into one epoll set, watched by one thread that never reads anything itself:
+ * it hands each ready driver to a small pool of workers, which drain it in
+ * batches and call back with each message. Idle ports cost nothing, so CPU per
+ * message stays the same however many ports there are.
+ *
+ * Each port goes to its own worker's queue (port number modulo the pool size),
+ * and a worker with nothing queued steals from the others. A port is in at most
+ * one queue and drained by at most one worker at a time, so its messages are
+ * handled in order, though messages from different ports may be handled at once.
+ *
+ * The fds are edge-triggered. Each edge bumps the port's count of wakeups, and
+ * only the first one queues it. A worker drains the port until it has nothing,
+ * then clears the count only if no edge came in meanwhile, or else goes again,
+ * so input that arrives as it finishes isn't stranded.
+ * Only drivers with fds can be added (ALSA, ALSA rawmidi, UDP).
+ */
+
+#ifndef PLATFORM_MIDI_MUX_MAX_PORTS
+#define PLATFORM_MIDI_MUX_MAX_PORTS 1024
+#endif
+
+#ifndef PLATFORM_MIDI_MUX_MAX_WORKERS
+#define PLATFORM_MIDI_MUX_MAX_WORKERS 16
+#endif
+
+// Messages read from a port before it goes to the back of the queue, so a busy port can't hog a worker
+#ifndef PLATFORM_MIDI_MUX_BATCH
+#define PLATFORM_MIDI_MUX_BATCH 64
+#endif
+
+#ifndef PLATFORM_MIDI_MUX_READ_SIZE
+#define PLATFORM_MIDI_MUX_READ_SIZE 4096
+#endif
+
+// Called on a worker thread for every message read from a port
+typedef void (*platform_midi_mux_fn)(void *ctx, int port, const unsigned char *buf, int size);
+
+struct platform_midi_mux_port
+{
+    struct platform_midi_driver *driver;
+    // Edges since the port was last found empty. Non-zero while it's queued or being drained
+    unsigned int pending;
+    unsigned long long messages;
+};
+
+// A queue of ports, which never holds more than all of them
+struct platform_midi_mux_queue
+{
+    pthread_mutex_t lock;
+    int *ports;
+    unsigned int head;
+    unsigned int tail;
+};
+
+struct platform_midi_mux_worker
+{
+    struct platform_midi_mux *mux;
+    int index;
+    pthread_t thread;
+    struct platform_midi_mux_queue queue;
+
+    unsigned long long messages;
+    unsigned long long drains;
+    unsigned long long steals;
+
+    unsigned char buf[PLATFORM_MIDI_MUX_READ_SIZE];
+};
+
+struct platform_midi_mux
+{
+    int epoll_fd;
+    // Wakes the epoll thread to stop
+    int stop_fd;
+    int stop;
+
+    struct platform_midi_mux_port *ports;
+    int port_count;
+
+    platform_midi_mux_fn fn;
+    void *ctx;
+
+    pthread_t thread;
+    int started;
+    struct platform_midi_mux_worker *workers;
+    int worker_count;
+
+    // Workers sleep here when every queue is empty
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int sleeping;
+    int queued;
+
+    unsigned long long wakeups;
+};
+
+struct platform_midi_mux_stats
+{
+    unsigned long long messages;
+    // Times the epoll thread woke up, and times a worker drained a port
+    unsigned long long wakeups;
+    unsigned long long drains;
+    // Ports a worker took from another worker's queue
+    unsigned long long steals;
+};
+
+// Returns 1 on success, 0 on failure. workers is clamped to 1 - PLATFORM_MIDI_MUX_MAX_WORKERS
+int platform_midi_mux_init(struct platform_midi_mux *mux, int workers, platform_midi_mux_fn fn, void *ctx);
+void platform_midi_mux_deinit(struct platform_midi_mux *mux);
+
+// Adds a driver, before or after starting. Returns its port number, or -1 if it has no fds or there's no room
+int platform_midi_mux_add(struct platform_midi_mux *mux, struct platform_midi_driver *driver);
+
+// Starts the epoll thread and workers. Returns 1 on success, 0 on failure
+int platform_midi_mux_start(struct platform_midi_mux *mux);
+
+// Stops and joins the threads. Messages still unread stay in their drivers
+void platform_midi_mux_stop(struct platform_midi_mux *mux);
+
+// Read while running, the counts may be slightly behind
+void platform_midi_mux_get_stats(struct platform_midi_mux *mux, struct platform_midi_mux_stats *stats);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// The epoll_event.data of the stop eventfd, where a port number would be
+#define PLATFORM_MIDI_MUX_STOP_EVENT 0xFFFFFFFFu
+
+static void platform_midi_mux_push(struct platform_midi_mux_queue *queue, int port)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->ports[queue->tail++ % PLATFORM_MIDI_MUX_MAX_PORTS] = port;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Returns a port, or -1 if the queue is empty
+static int platform_midi_mux_pop(struct platform_midi_mux_queue *queue, int wait)
+{
+    int port = -1;
+
+    if (wait)
+    {
+        pthread_mutex_lock(&queue->lock);
+    }
+    else if (0 != pthread_mutex_trylock(&queue->lock))
+    {
+        return -1;
+    }
+
+    if (queue->head != queue->tail)
+    {
+        port = queue->ports[queue->head++ % PLATFORM_MIDI_MUX_MAX_PORTS];
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return port;
+}
+
+// Counts an edge, queueing the port if it isn't already. Returns 1 if it did
+static int platform_midi_mux_schedule(struct platform_midi_mux *mux, int port, int worker)
+{
+    if (__atomic_fetch_add(&mux->ports[port].pending, 1, __ATOMIC_ACQ_REL))
+    {
+        return 0;
+    }
+
+    __atomic_add_fetch(&mux->queued, 1, __ATOMIC_RELEASE);
+    platform_midi_mux_push(&mux->workers[worker].queue, port);
+    return 1;
+}
+
+static void platform_midi_mux_wake(struct platform_midi_mux *mux)
+{
+    pthread_mutex_lock(&mux->lock);
+    if (mux->sleeping)
+    {
+        pthread_cond_broadcast(&mux->wake);
+    }
+    pthread_mutex_unlock(&mux->lock);
+}
+
+static void *platform_midi_mux_thread(void *arg)
+{
+    struct platform_midi_mux *mux = (struct platform_midi_mux*)arg;
+    struct epoll_event events[64];
+
+    while (!__atomic_load_n(&mux->stop, __ATOMIC_ACQUIRE))
+    {
+        int count = epoll_wait(mux->epoll_fd, events, 64, -1);
+        int scheduled = 0;
+
+        mux->wakeups++;
+
+        for (int i = 0; i < count; i++)
+        {
+            unsigned int port = events[i].data.u32;
+
+            if (port != PLATFORM_MIDI_MUX_STOP_EVENT)
+            {
+                scheduled += platform_midi_mux_schedule(mux, port, port % mux->worker_count);
+            }
+        }
+
+        if (scheduled)
+        {
+            platform_midi_mux_wake(mux);
+        }
+    }
+
+    return NULL;
+}
+
+// Reads up to a batch from a port. Returns 1 if it may have more
+static int platform_midi_mux_drain(struct platform_midi_mux_worker *worker, int port)
+{
+    struct platform_midi_mux *mux = worker->mux;
+    struct platform_midi_driver *driver = mux->ports[port].driver;
+    int messages = 0;
+
+    while (messages < PLATFORM_MIDI_MUX_BATCH && platform_midi_avail(driver))
+    {
+        int read = platform_midi_read(driver, worker->buf, sizeof(worker->buf));
+        if (read <= 0)
+        {
+            break;
+        }
+
+        mux->fn(mux->ctx, port, worker->buf, read);
+        messages++;
+    }
+
+    mux->ports[port].messages += messages;
+    worker->messages += messages;
+    worker->drains++;
+    return messages == PLATFORM_MIDI_MUX_BATCH;
+}
+
+static void *platform_midi_mux_worker_thread(void *arg)
+{
+    struct platform_midi_mux_worker *worker = (struct platform_midi_mux_worker*)arg;
+    struct platform_midi_mux *mux = worker->mux;
+
+    // Checked before every pop, a port that never goes quiet keeps the queue from emptying
+    while (!__atomic_load_n(&mux->stop, __ATOMIC_ACQUIRE))
+    {
+        int port = platform_midi_mux_pop(&worker->queue, 1);
+
+        for (int i = 1; port < 0 && i < mux->worker_count; i++)
+        {
+            port = platform_midi_mux_pop(&mux->workers[(worker->index + i) % mux->worker_count].queue, 0);
+            if (port >= 0)
+            {
+                worker->steals++;
+            }
+        }
+
+        if (port >= 0)
+        {
+            unsigned int *pending = &mux->ports[port].pending;
+            __atomic_sub_fetch(&mux->queued, 1, __ATOMIC_ACQ_REL);
+
+            while (1)
+            {
+                unsigned int seen = __atomic_load_n(pending, __ATOMIC_ACQUIRE);
+
+                if (platform_midi_mux_drain(worker, port) || __atomic_load_n(&mux->stop, __ATOMIC_ACQUIRE))
+                {
+                    // Still busy, let the other ports have a turn first. When stopping, it stays
+                    // queued for the next start
+                    __atomic_add_fetch(&mux->queued, 1, __ATOMIC_RELEASE);
+                    platform_midi_mux_push(&worker->queue, port);
+                    break;
+                }
+
+                // Another edge while draining might have been for input after the last read
+                if (__atomic_compare_exchange_n(pending, &seen, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&mux->lock);
+        while (!__atomic_load_n(&mux->queued, __ATOMIC_ACQUIRE) && !__atomic_load_n(&mux->stop, __ATOMIC_ACQUIRE))
+        {
+            mux->sleeping++;
+            pthread_cond_wait(&mux->wake, &mux->lock);
+            mux->sleeping--;
+        }
+        pthread_mutex_unlock(&mux->lock);
+    }
+
+    return NULL;
+}
+
+int platform_midi_mux_init(struct platform_midi_mux *mux, int workers, platform_midi_mux_fn fn, void *ctx)
+{
+    struct epoll_event event;
+
+    memset(mux, 0, sizeof(*mux));
+    mux->fn = fn;
+    mux->ctx = ctx;
+    mux->worker_count = workers < 1 ? 1 : workers > PLATFORM_MIDI_MUX_MAX_WORKERS ? PLATFORM_MIDI_MUX_MAX_WORKERS : workers;
+    mux->stop_fd = -1;
+
+    mux->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    mux->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    mux->ports = (struct platform_midi_mux_port*)calloc(PLATFORM_MIDI_MUX_MAX_PORTS, sizeof(struct platform_midi_mux_port));
+    mux->workers = (struct platform_midi_mux_worker*)calloc(mux->worker_count, sizeof(struct platform_midi_mux_worker));
+
+    if (mux->epoll_fd < 0 || mux->stop_fd < 0 || !mux->ports || !mux->workers)
+    {
+        printf("Failed to create MIDI multiplexer\n");
+        goto fail;
+    }
+
+    event.events = EPOLLIN;
+    event.data.u64 = 0;
+    event.data.u32 = PLATFORM_MIDI_MUX_STOP_EVENT;
+    if (0 != epoll_ctl(mux->epoll_fd, EPOLL_CTL_ADD, mux->stop_fd, &event))
+    {
+        printf("Failed to create MIDI multiplexer\n");
+        goto fail;
+    }
+
+    for (int i = 0; i < mux->worker_count; i++)
+    {
+        struct platform_midi_mux_worker *worker = &mux->workers[i];
+
+        worker->mux = mux;
+        worker->index = i;
+        worker->queue.ports = (int*)malloc(PLATFORM_MIDI_MUX_MAX_PORTS * sizeof(int));
+        if (!worker->queue.ports)
+        {
+            printf("Failed to allocate MIDI multiplexer queues\n");
+            goto fail;
+        }
+        pthread_mutex_init(&worker->queue.lock, NULL);
+    }
+
+    pthread_mutex_init(&mux->lock, NULL);
+    pthread_cond_init(&mux->wake, NULL);
+    return 1;
+
+fail:
+    if (mux->epoll_fd >= 0)
+    {
+        close(mux->epoll_fd);
+    }
+    if (mux->stop_fd >= 0)
+    {
+        close(mux->stop_fd);
+    }
+    for (int i = 0; mux->workers && i < mux->worker_count; i++)
+    {
+        free(mux->workers[i].queue.ports);
+    }
+    free(mux->workers);
+    free(mux->ports);
+    mux->workers = NULL;
+    mux->ports = NULL;
+    return 0;
+}
+
+int platform_midi_mux_add(struct platform_midi_mux *mux, struct platform_midi_driver *driver)
+{
+    struct epoll_event event;
+    int fds[8];
+    int count = platform_midi_fds(driver, fds, 8);
+    int port = mux->port_count;
+
+    if (count <= 0)
+    {
+        printf("Error: the driver has no fds to wait on, so it can't be multiplexed\n");
+        return -1;
+    }
+
+    if (port >= PLATFORM_MIDI_MUX_MAX_PORTS)
+    {
+        printf("Error: a multiplexer takes at most %d ports\n", PLATFORM_MIDI_MUX_MAX_PORTS);
+        return -1;
+    }
+
+    mux->ports[port].driver = driver;
+    mux->ports[port].pending = 0;
+    mux->ports[port].messages = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        event.events = EPOLLIN | EPOLLET;
+        event.data.u64 = 0;
+        event.data.u32 = port;
+
+        if (0 != epoll_ctl(mux->epoll_fd, EPOLL_CTL_ADD, fds[i], &event))
+        {
+            printf("Failed to add MIDI driver fd %d to the multiplexer\n", fds[i]);
+            while (--i >= 0)
+            {
+                epoll_ctl(mux->epoll_fd, EPOLL_CTL_DEL, fds[i], &event);
+            }
+            return -1;
+        }
+    }
+
+    // An fd that's already readable when added comes up in the next epoll_wait(), so nothing is missed
+    mux->port_count++;
+    return port;
+}
+
+int platform_midi_mux_start(struct platform_midi_mux *mux)
+{
+    int started = 0;
+
+    __atomic_store_n(&mux->stop, 0, __ATOMIC_RELEASE);
+
+    for (; started < mux->worker_count; started++)
+    {
+        if (0 != pthread_create(&mux->workers[started].thread, NULL, platform_midi_mux_worker_thread, &mux->workers[started]))
+        {
+            break;
+        }
+    }
+
+    if (started < mux->worker_count || 0 != pthread_create(&mux->thread, NULL, platform_midi_mux_thread, mux))
+    {
+        printf("Failed to start the MIDI multiplexer threads\n");
+        __atomic_store_n(&mux->stop, 1, __ATOMIC_RELEASE);
+        platform_midi_mux_wake(mux);
+        while (--started >= 0)
+        {
+            pthread_join(mux->workers[started].thread, NULL);
+        }
+        return 0;
+    }
+
+    mux->started = 1;
+    return 1;
+}
+
+void platform_midi_mux_stop(struct platform_midi_mux *mux)
+{
+    unsigned long long one = 1;
+
+    if (!mux->started)
+    {
+        return;
+    }
+
+    __atomic_store_n(&mux->stop, 1, __ATOMIC_RELEASE);
+    if (write(mux->stop_fd, &one, sizeof(one)) != sizeof(one))
+    {
+        printf("Warn: failed to wake the MIDI multiplexer\n");
+    }
+    pthread_join(mux->thread, NULL);
+
+    platform_midi_mux_wake(mux);
+    for (int i = 0; i < mux->worker_count; i++)
+    {
+        pthread_join(mux->workers[i].thread, NULL);
+    }
+
+    mux->started = 0;
+}
+
+void platform_midi_mux_deinit(struct platform_midi_mux *mux)
+{
+    if (!mux->ports)
+    {
+        return;
+    }
+
+    platform_midi_mux_stop(mux);
+
+    close(mux->epoll_fd);
+    close(mux->stop_fd);
+
+    for (int i = 0; i < mux->worker_count; i++)
+    {
+        pthread_mutex_destroy(&mux->workers[i].queue.lock);
+        free(mux->workers[i].queue.ports);
+    }
+    pthread_mutex_destroy(&mux->lock);
+    pthread_cond_destroy(&mux->wake);
+
+    free(mux->workers);
+    free(mux->ports);
+    mux->workers = NULL;
+    mux->ports = NULL;
+}
+
+void platform_midi_mux_get_stats(struct platform_midi_mux *mux, struct platform_midi_mux_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->wakeups = mux->wakeups;
+
+    for (int i = 0; i < mux->worker_count; i++)
+    {
+        stats->messages += mux->workers[i].messages;
+        stats->drains += mux->workers[i].drains;
+        stats->steals += mux->workers[i].steals;
+    }
+}
+
+#endif
+
+#endif
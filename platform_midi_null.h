@@ -0,0 +1,141 @@
+#ifndef _PLATFORM_MIDI_NULL_H_
+#define _PLATFORM_MIDI_NULL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Null backend, which talks to no device at all
+ *
+ * Whatever is written comes back out of platform_midi_read(), so it works as a
+ * loopback for tests and for measuring the library itself. Nobody has to read:
+ * once the queue is full, further writes are discarded and counted by
+ * platform_midi_null_dropped().
+ */
+
+struct platform_midi_driver *platform_midi_init_null(const char *name, const struct platform_midi_options *options);
+void platform_midi_deinit_null(struct platform_midi_driver *driver);
+int platform_midi_read_null(struct platform_midi_driver *driver, unsigned char *out, int size);
+int platform_midi_avail_null(struct platform_midi_driver *driver);
+int platform_midi_write_null(struct platform_midi_driver *driver, const unsigned char *buf, int size);
+
+// Returns how many written messages were discarded because the loopback queue was full
+unsigned int platform_midi_null_dropped(struct platform_midi_driver *driver);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+struct platform_midi_null_driver
+{
+    platform_midi_deinit_fn deinitFn;
+    platform_midi_avail_fn availFn;
+    platform_midi_read_fn readFn;
+    platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
+    void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    unsigned int read_time;
+
+    struct platform_midi_ringbuf buffer;
+};
+
+struct platform_midi_driver *platform_midi_init_null(const char *name, const struct platform_midi_options *options)
+{
+    void *alloc = malloc(sizeof(struct platform_midi_null_driver));
+
+    (void)name;
+
+    if (!alloc)
+    {
+        printf("Failed to allocate driver struct\n");
+        return NULL;
+    }
+
+    struct platform_midi_null_driver *null_driver = (struct platform_midi_null_driver*)alloc;
+    null_driver->deinitFn = platform_midi_deinit_null;
+    null_driver->availFn = platform_midi_avail_null;
+    null_driver->readFn = platform_midi_read_null;
+    null_driver->writeFn = platform_midi_write_null;
+    null_driver->fdsFn = NULL;
+    null_driver->readEventsFn = NULL;
+    null_driver->writeEventsFn = NULL;
+    null_driver->readUmpFn = NULL;
+    null_driver->writeUmpFn = NULL;
+    null_driver->writeMultiFn = NULL;
+    null_driver->data = options ? options->user_data : NULL;
+    null_driver->taps = NULL;
+    // Nothing would ever arrive to wake a blocking read that found the loopback empty
+    null_driver->blocking = 0;
+    null_driver->stream_out = 0;
+    platform_midi_realtime_init(&null_driver->realtime_out);
+    null_driver->read_held = NULL;
+    null_driver->read_held_len = 0;
+    null_driver->read_held_capacity = 0;
+    null_driver->read_held_time = 0;
+    null_driver->read_time = 0;
+
+    platform_midi_buffer_init(&null_driver->buffer);
+
+    return (struct platform_midi_driver*)null_driver;
+}
+
+void platform_midi_deinit_null(struct platform_midi_driver *driver)
+{
+    free(driver);
+}
+
+int platform_midi_read_null(struct platform_midi_driver *driver, unsigned char *out, int size)
+{
+    struct platform_midi_null_driver *null_driver = (struct platform_midi_null_driver*)driver;
+    return platform_midi_pop_packet_timed(&null_driver->buffer, out, size, &null_driver->read_time);
+}
+
+int platform_midi_avail_null(struct platform_midi_driver *driver)
+{
+    struct platform_midi_null_driver *null_driver = (struct platform_midi_null_driver*)driver;
+    return platform_midi_packet_count(&null_driver->buffer);
+}
+
+int platform_midi_write_null(struct platform_midi_driver *driver, const unsigned char *buf, int size)
+{
+    struct platform_midi_null_driver *null_driver = (struct platform_midi_null_driver*)driver;
+    int written = 0;
+
+    while (written < size)
+    {
+        unsigned int length = platform_midi_next_message(buf + written, size - written);
+
+        if (!platform_midi_buffer_full(&null_driver->buffer, length))
+        {
+            platform_midi_push_packet(&null_driver->buffer, (unsigned char*)buf + written, length);
+        }
+        else
+        {
+            __atomic_fetch_add(&null_driver->buffer.dropped, 1, __ATOMIC_RELAXED);
+        }
+
+        written += length;
+    }
+
+    return written;
+}
+
+unsigned int platform_midi_null_dropped(struct platform_midi_driver *driver)
+{
+    return platform_midi_buffer_dropped(&((struct platform_midi_null_driver*)driver)->buffer);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,692 @@
+#ifndef _PLATFORM_MIDI_PLAY_H_
+#define _PLATFORM_MIDI_PLAY_H_
+
+#include "platform_midi.h"
+#include "platform_midi_clock.h"
+#include <stddef.h>
+
+/*
+ * platform_midi_play.h
+ *
+ * Plays a Standard MIDI File (format 0, 1 or 2) to a driver.
+ *
+ * The file is memory-mapped and opening it only walks the chunk headers, so
+ * playback starts at once however big it is. Each track then decodes just its
+ * next event, and a min-heap on absolute tick merges the tracks in order, with
+ * tempo changes applied as they come up.
+ *
+ * Events go out on absolute deadlines from platform_midi_clock_now(), like the
+ * clock generator's, so lateness never accumulates. The next events are decoded
+ * before sleeping, and everything due at the same time goes out in one write.
+ * Run platform_midi_player_wait() in a loop on a dedicated (ideally real-time)
+ * thread, or call platform_midi_player_poll() from an existing loop.
+ *
+ * Format 2 tracks are independent sequences, but are played merged all the same.
+ * The player is not synchronized; use it from a single thread.
+ */
+
+// Channel messages due at the same time are collected into writes of up to this many bytes
+#ifndef PLATFORM_MIDI_PLAY_BATCH_SIZE
+#define PLATFORM_MIDI_PLAY_BATCH_SIZE 256
+#endif
+
+// A whole file mapped read-only
+struct platform_midi_file_map
+{
+    const unsigned char *data;
+    size_t size;
+#if defined(_WIN32)
+    void *file_handle;
+    void *map_handle;
+#endif
+};
+
+struct platform_midi_player_track
+{
+    const unsigned char *start;
+    const unsigned char *pos;
+    const unsigned char *end;
+    unsigned char running_status;
+    int done;
+
+    // The next event, decoded
+    unsigned long long tick;
+    // PLATFORM_MIDI_PLAY_MESSAGE, _SYSEX, _ESCAPE or _META
+    unsigned char kind;
+    unsigned char meta_type;
+    unsigned char msg[3];
+    const unsigned char *data;
+    unsigned int size;
+};
+
+struct platform_midi_player
+{
+    struct platform_midi_driver *driver;
+
+    struct platform_midi_file_map file;
+
+    int format;
+    // Ticks per quarter note, or 0 for SMPTE timing, which has ticks_per_second instead
+    unsigned int division;
+    double ticks_per_second;
+
+    struct platform_midi_player_track *tracks;
+    int track_count;
+    // Unfinished tracks by their next event's tick
+    int *heap;
+    int heap_count;
+
+    // The tempo in microseconds per quarter note, in effect since tempo_tick, which fell tempo_time
+    // microseconds into the song
+    unsigned int tempo;
+    unsigned long long tempo_tick;
+    double tempo_time;
+
+    // platform_midi_clock_now() when the song started
+    unsigned long long origin;
+
+    // platform_midi_player_wait() wakes this many nanoseconds early and spins out the rest, trading
+    // CPU for less jitter when the scheduler is slow to wake. 0 by default
+    unsigned long long spin;
+
+    // Messages sent, and how late each write went out in microseconds
+    unsigned long long events;
+    struct platform_midi_clock_stats lateness;
+
+    unsigned char batch[PLATFORM_MIDI_PLAY_BATCH_SIZE];
+};
+
+#define PLATFORM_MIDI_PLAY_MESSAGE 0
+#define PLATFORM_MIDI_PLAY_SYSEX 1
+#define PLATFORM_MIDI_PLAY_ESCAPE 2
+#define PLATFORM_MIDI_PLAY_META 3
+
+// Maps path, hinting the OS to read ahead if sequential is non-zero. Returns 1 on success, 0 on failure
+int platform_midi_file_map_open(struct platform_midi_file_map *map, const char *path, int sequential);
+void platform_midi_file_map_close(struct platform_midi_file_map *map);
+
+// Maps path and finds its tracks. Returns 1 on success, 0 if it can't be opened or isn't a MIDI file
+int platform_midi_player_open(struct platform_midi_player *player, struct platform_midi_driver *driver, const char *path);
+void platform_midi_player_close(struct platform_midi_player *player);
+
+// Starts the song now, from the beginning
+void platform_midi_player_start(struct platform_midi_player *player);
+
+// Sleeps until the next events are due and sends them.
+// Returns the number of messages sent, 0 once the song is over, or -1 on error
+int platform_midi_player_wait(struct platform_midi_player *player);
+
+// Sends whatever is due without waiting. Returns the number of messages sent, or -1 on error
+int platform_midi_player_poll(struct platform_midi_player *player);
+
+// Deadline of the next event, in platform_midi_clock_now() nanoseconds
+unsigned long long platform_midi_player_next(struct platform_midi_player *player);
+
+static inline int platform_midi_player_done(const struct platform_midi_player *player)
+{
+    return player->heap_count == 0;
+}
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static unsigned int platform_midi_player_get32(const unsigned char *buf)
+{
+    return ((unsigned int)buf[0] << 24) | ((unsigned int)buf[1] << 16) | ((unsigned int)buf[2] << 8) | buf[3];
+}
+
+// Reads a variable-length quantity. Returns 0 if it runs past end
+static int platform_midi_player_get_vlq(const unsigned char **pos, const unsigned char *end, unsigned int *value)
+{
+    unsigned int result = 0;
+
+    for (int i = 0; i < 4 && *pos < end; i++)
+    {
+        unsigned char byte = *(*pos)++;
+        result = (result << 7) | (byte & 0x7F);
+
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Decodes the track's next event, or marks it done
+static void platform_midi_player_decode(struct platform_midi_player_track *track)
+{
+    const unsigned char *pos = track->pos;
+    unsigned int delta;
+    unsigned int length;
+
+    if (pos >= track->end || !platform_midi_player_get_vlq(&pos, track->end, &delta) || pos >= track->end)
+    {
+        track->done = 1;
+        return;
+    }
+
+    track->tick += delta;
+    unsigned char byte = *pos;
+
+    if (byte == 0xFF)
+    {
+        pos++;
+        if (pos >= track->end)
+        {
+            track->done = 1;
+            return;
+        }
+
+        track->kind = PLATFORM_MIDI_PLAY_META;
+        track->meta_type = *pos++;
+        track->running_status = 0;
+    }
+    else if (byte == 0xF0 || byte == 0xF7)
+    {
+        pos++;
+        track->kind = byte == 0xF0 ? PLATFORM_MIDI_PLAY_SYSEX : PLATFORM_MIDI_PLAY_ESCAPE;
+        track->running_status = 0;
+    }
+    else
+    {
+        if (byte & 0x80)
+        {
+            track->running_status = byte;
+            pos++;
+        }
+
+        // Running status with nothing to run on, or a system message outside an escape
+        if (!track->running_status || track->running_status >= 0xF0)
+        {
+            printf("Warn: bad event in MIDI file track, skipping the rest of it\n");
+            track->done = 1;
+            return;
+        }
+
+        length = platform_midi_msg_length(track->running_status);
+        if (pos + length - 1 > track->end)
+        {
+            track->done = 1;
+            return;
+        }
+
+        track->kind = PLATFORM_MIDI_PLAY_MESSAGE;
+        track->msg[0] = track->running_status;
+        memcpy(track->msg + 1, pos, length - 1);
+        track->size = length;
+        track->pos = pos + length - 1;
+        return;
+    }
+
+    if (!platform_midi_player_get_vlq(&pos, track->end, &length) || length > (unsigned int)(track->end - pos))
+    {
+        track->done = 1;
+        return;
+    }
+
+    track->data = pos;
+    track->size = length;
+    track->pos = pos + length;
+}
+
+static int platform_midi_player_before(struct platform_midi_player *player, int a, int b)
+{
+    // Ties go to the earlier track, so a format 1 tempo track comes first
+    return player->tracks[a].tick < player->tracks[b].tick || (player->tracks[a].tick == player->tracks[b].tick && a < b);
+}
+
+static void platform_midi_player_sift_down(struct platform_midi_player *player, int i)
+{
+    int *heap = player->heap;
+
+    while (1)
+    {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+
+        if (left < player->heap_count && platform_midi_player_before(player, heap[left], heap[smallest]))
+        {
+            smallest = left;
+        }
+        if (right < player->heap_count && platform_midi_player_before(player, heap[right], heap[smallest]))
+        {
+            smallest = right;
+        }
+        if (smallest == i)
+        {
+            return;
+        }
+
+        int swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+// Moves the head track on to its next event, dropping it from the heap when it's finished
+static void platform_midi_player_next_event(struct platform_midi_player *player)
+{
+    struct platform_midi_player_track *track = &player->tracks[player->heap[0]];
+
+    platform_midi_player_decode(track);
+
+    if (track->done)
+    {
+        player->heap[0] = player->heap[--player->heap_count];
+    }
+
+    platform_midi_player_sift_down(player, 0);
+}
+
+// Microseconds into the song at which tick falls, under the tempo in effect
+static double platform_midi_player_time(struct platform_midi_player *player, unsigned long long tick)
+{
+    if (!player->division)
+    {
+        return tick * 1000000.0 / player->ticks_per_second;
+    }
+
+    return player->tempo_time + (double)(tick - player->tempo_tick) * player->tempo / player->division;
+}
+
+// Runs meta events at the head, so that the head is always something to send
+static void platform_midi_player_skip_meta(struct platform_midi_player *player)
+{
+    while (player->heap_count)
+    {
+        struct platform_midi_player_track *track = &player->tracks[player->heap[0]];
+
+        if (track->kind != PLATFORM_MIDI_PLAY_META)
+        {
+            return;
+        }
+
+        if (track->meta_type == 0x51 && track->size == 3)
+        {
+            player->tempo_time = platform_midi_player_time(player, track->tick);
+            player->tempo_tick = track->tick;
+            player->tempo = (track->data[0] << 16) | (track->data[1] << 8) | track->data[2];
+        }
+        else if (track->meta_type == 0x2F)
+        {
+            track->done = 1;
+            player->heap[0] = player->heap[--player->heap_count];
+            platform_midi_player_sift_down(player, 0);
+            continue;
+        }
+
+        platform_midi_player_next_event(player);
+    }
+}
+
+unsigned long long platform_midi_player_next(struct platform_midi_player *player)
+{
+    if (!player->heap_count)
+    {
+        return 0;
+    }
+
+    return player->origin + (unsigned long long)(platform_midi_player_time(player, player->tracks[player->heap[0]].tick) * 1000.0);
+}
+
+static int platform_midi_player_write(struct platform_midi_player *player, const unsigned char *buf, int size)
+{
+    int result = platform_midi_write(player->driver, buf, size);
+
+    if (result < 0)
+    {
+        printf("Error writing MIDI file event\n");
+    }
+
+    return result;
+}
+
+// Sends every event due by deadline, all channel messages in as few writes as possible
+static int platform_midi_player_send(struct platform_midi_player *player, unsigned long long deadline)
+{
+    int batched = 0;
+    int sent = 0;
+    int result = 0;
+
+    while (player->heap_count && platform_midi_player_next(player) <= deadline)
+    {
+        struct platform_midi_player_track *track = &player->tracks[player->heap[0]];
+
+        if (track->kind == PLATFORM_MIDI_PLAY_MESSAGE && batched + track->size <= PLATFORM_MIDI_PLAY_BATCH_SIZE)
+        {
+            memcpy(player->batch + batched, track->msg, track->size);
+            batched += track->size;
+        }
+        else
+        {
+            if (batched && platform_midi_player_write(player, player->batch, batched) < 0)
+            {
+                return -1;
+            }
+            batched = 0;
+
+            if (track->kind == PLATFORM_MIDI_PLAY_MESSAGE)
+            {
+                memcpy(player->batch, track->msg, track->size);
+                batched = track->size;
+            }
+            else if (track->kind == PLATFORM_MIDI_PLAY_SYSEX && track->size < PLATFORM_MIDI_PLAY_BATCH_SIZE)
+            {
+                // The F0 isn't in the file's copy of the message
+                player->batch[0] = 0xF0;
+                memcpy(player->batch + 1, track->data, track->size);
+                result = platform_midi_player_write(player, player->batch, track->size + 1);
+            }
+            else if (track->kind == PLATFORM_MIDI_PLAY_SYSEX)
+            {
+                unsigned char status = 0xF0;
+                result = platform_midi_player_write(player, &status, 1);
+                if (result >= 0)
+                {
+                    result = platform_midi_player_write(player, track->data, track->size);
+                }
+            }
+            else if (track->size)
+            {
+                result = platform_midi_player_write(player, track->data, track->size);
+            }
+
+            if (result < 0)
+            {
+                return -1;
+            }
+        }
+
+        sent++;
+        platform_midi_player_next_event(player);
+        platform_midi_player_skip_meta(player);
+    }
+
+    if (batched && platform_midi_player_write(player, player->batch, batched) < 0)
+    {
+        return -1;
+    }
+
+    if (sent)
+    {
+        unsigned long long now = platform_midi_clock_now();
+        platform_midi_clock_stats_add(&player->lateness, now > deadline ? (now - deadline) / 1000.0 : 0);
+        player->events += sent;
+    }
+
+    return sent;
+}
+
+int platform_midi_player_wait(struct platform_midi_player *player)
+{
+    if (!player->heap_count)
+    {
+        return 0;
+    }
+
+    unsigned long long deadline = platform_midi_player_next(player);
+
+    platform_midi_clock_sleep_until(deadline - player->spin);
+    while (player->spin && platform_midi_clock_now() < deadline)
+    {
+    }
+
+    return platform_midi_player_send(player, deadline);
+}
+
+int platform_midi_player_poll(struct platform_midi_player *player)
+{
+    unsigned long long now = platform_midi_clock_now();
+    int sent = 0;
+
+    // Keep each write's lateness measured against its own deadline
+    while (player->heap_count && platform_midi_player_next(player) <= now)
+    {
+        int result = platform_midi_player_send(player, platform_midi_player_next(player));
+        if (result < 0)
+        {
+            return -1;
+        }
+        sent += result;
+    }
+
+    return sent;
+}
+
+void platform_midi_player_start(struct platform_midi_player *player)
+{
+    player->heap_count = 0;
+    player->tempo = 500000;
+    player->tempo_tick = 0;
+    player->tempo_time = 0;
+    player->events = 0;
+    platform_midi_clock_stats_reset(&player->lateness);
+
+    for (int i = 0; i < player->track_count; i++)
+    {
+        struct platform_midi_player_track *track = &player->tracks[i];
+
+        track->pos = track->start;
+        track->tick = 0;
+        track->running_status = 0;
+        track->done = 0;
+        platform_midi_player_decode(track);
+
+        if (!track->done)
+        {
+            int pos = player->heap_count++;
+            player->heap[pos] = i;
+
+            while (pos > 0 && platform_midi_player_before(player, player->heap[pos], player->heap[(pos - 1) / 2]))
+            {
+                int swap = player->heap[pos];
+                player->heap[pos] = player->heap[(pos - 1) / 2];
+                player->heap[(pos - 1) / 2] = swap;
+                pos = (pos - 1) / 2;
+            }
+        }
+    }
+
+    player->origin = platform_midi_clock_now();
+    platform_midi_player_skip_meta(player);
+}
+
+int platform_midi_file_map_open(struct platform_midi_file_map *map, const char *path, int sequential)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER size;
+
+    map->file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                   sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (map->file_handle == INVALID_HANDLE_VALUE)
+    {
+        printf("Failed to open %s\n", path);
+        return 0;
+    }
+
+    if (!GetFileSizeEx(map->file_handle, &size) || size.QuadPart == 0)
+    {
+        printf("Failed to map %s\n", path);
+        CloseHandle(map->file_handle);
+        return 0;
+    }
+
+    map->map_handle = CreateFileMappingA(map->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    map->data = map->map_handle ? (const unsigned char*)MapViewOfFile(map->map_handle, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!map->data)
+    {
+        printf("Failed to map %s\n", path);
+        if (map->map_handle)
+        {
+            CloseHandle(map->map_handle);
+        }
+        CloseHandle(map->file_handle);
+        return 0;
+    }
+
+    map->size = (size_t)size.QuadPart;
+    return 1;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        printf("Failed to open %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    if (0 != fstat(fd, &st) || st.st_size == 0)
+    {
+        printf("Failed to map %s\n", path);
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        printf("Failed to map %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    madvise(data, st.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+    map->data = (const unsigned char*)data;
+    map->size = st.st_size;
+    return 1;
+#endif
+}
+
+void platform_midi_file_map_close(struct platform_midi_file_map *map)
+{
+    if (!map->data)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(map->data);
+    CloseHandle(map->map_handle);
+    CloseHandle(map->file_handle);
+#else
+    munmap((void*)map->data, map->size);
+#endif
+    map->data = NULL;
+}
+
+int platform_midi_player_open(struct platform_midi_player *player, struct platform_midi_driver *driver, const char *path)
+{
+    memset(player, 0, sizeof(*player));
+    player->driver = driver;
+
+    if (!platform_midi_file_map_open(&player->file, path, 1))
+    {
+        return 0;
+    }
+
+    const unsigned char *pos = player->file.data;
+    const unsigned char *end = player->file.data + player->file.size;
+
+    if (player->file.size < 14 || memcmp(pos, "MThd", 4) || platform_midi_player_get32(pos + 4) < 6)
+    {
+        printf("Error: %s is not a MIDI file\n", path);
+        platform_midi_file_map_close(&player->file);
+        return 0;
+    }
+
+    player->format = (pos[8] << 8) | pos[9];
+    int declared = (pos[10] << 8) | pos[11];
+    unsigned int division = (pos[12] << 8) | pos[13];
+
+    if (division & 0x8000)
+    {
+        // SMPTE: frames per second (negated, 29 meaning 29.97) and ticks per frame
+        int fps = -(signed char)(division >> 8);
+        player->ticks_per_second = (fps == 29 ? 29.97 : fps) * (division & 0xFF);
+    }
+    else
+    {
+        player->division = division;
+    }
+
+    if ((!player->division && player->ticks_per_second <= 0) || declared == 0)
+    {
+        printf("Error: %s has no tracks or no timing\n", path);
+        platform_midi_file_map_close(&player->file);
+        return 0;
+    }
+
+    player->tracks = (struct platform_midi_player_track*)calloc(declared, sizeof(struct platform_midi_player_track));
+    player->heap = (int*)malloc(declared * sizeof(int));
+    if (!player->tracks || !player->heap)
+    {
+        printf("Failed to allocate MIDI file tracks\n");
+        platform_midi_player_close(player);
+        return 0;
+    }
+
+    // Just the chunk headers, the events are decoded as they're played
+    pos += 8 + platform_midi_player_get32(pos + 4);
+    while (player->track_count < declared && end - pos >= 8)
+    {
+        unsigned int length = platform_midi_player_get32(pos + 4);
+        const unsigned char *data = pos + 8;
+
+        if (length > (size_t)(end - data))
+        {
+            printf("Warn: %s is truncated\n", path);
+            length = end - data;
+        }
+
+        // Unknown chunks are skipped, as the spec asks
+        if (!memcmp(pos, "MTrk", 4))
+        {
+            struct platform_midi_player_track *track = &player->tracks[player->track_count++];
+            track->start = data;
+            track->end = data + length;
+        }
+
+        pos = data + length;
+    }
+
+    if (player->track_count < declared)
+    {
+        printf("Warn: %s declares %d tracks but has %d\n", path, declared, player->track_count);
+    }
+
+    platform_midi_player_start(player);
+    return 1;
+}
+
+void platform_midi_player_close(struct platform_midi_player *player)
+{
+    platform_midi_file_map_close(&player->file);
+
+    free(player->tracks);
+    free(player->heap);
+    player->tracks = NULL;
+    player->heap = NULL;
+    player->heap_count = 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,593 @@
+#ifndef _PLATFORM_MIDI_RECORD_H_
+#define _PLATFORM_MIDI_RECORD_H_
+
+#include "platform_midi.h"
+#include <stdio.h>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+/*
+ * platform_midi_record.h
+ *
+ * Records what a driver reads to a Standard MIDI File, format 0 or 1.
+ *
+ * The input tap only stamps each message and copies it into a lock-free queue.
+ * A background thread turns the queue into track events and writes them out in
+ * large blocks. When the disk stalls the queue grows, and once it's full new
+ * messages are dropped and counted, so platform_midi_read() never waits on the file.
+ *
+ * Every PLATFORM_MIDI_RECORD_SYNC_MS the file is ended with an End of Track and
+ * the track's length patched in, so after a crash it's a valid file missing at
+ * most the last sync period. The next events are written over that End of Track.
+ *
+ * The tap side may only be fed from one thread at a time, the one reading the driver.
+ */
+
+// Bytes of messages the queue holds, a power of two. Each message takes 6 more
+#ifndef PLATFORM_MIDI_RECORD_QUEUE_SIZE
+#define PLATFORM_MIDI_RECORD_QUEUE_SIZE (1 << 20)
+#endif
+
+// Encoded events are collected into writes of this many bytes
+#ifndef PLATFORM_MIDI_RECORD_WRITE_SIZE
+#define PLATFORM_MIDI_RECORD_WRITE_SIZE (1 << 16)
+#endif
+
+#ifndef PLATFORM_MIDI_RECORD_SYNC_MS
+#define PLATFORM_MIDI_RECORD_SYNC_MS 500
+#endif
+
+// Ticks per quarter note, and the tempo written to the file in microseconds per quarter note.
+// At the defaults a tick is about 0.5 ms
+#ifndef PLATFORM_MIDI_RECORD_DIVISION
+#define PLATFORM_MIDI_RECORD_DIVISION 960
+#endif
+
+#ifndef PLATFORM_MIDI_RECORD_TEMPO
+#define PLATFORM_MIDI_RECORD_TEMPO 500000
+#endif
+
+struct platform_midi_recorder_stats
+{
+    // Messages queued, and messages lost to a full queue
+    unsigned long long messages;
+    unsigned long long dropped;
+    // Bytes of track events written so far
+    unsigned long long written;
+    // Bytes waiting in the queue now, and the most there have ever been
+    unsigned int queue_depth;
+    unsigned int queue_max_depth;
+    unsigned int queue_size;
+};
+
+struct platform_midi_recorder
+{
+    FILE *file;
+    int format;
+    // Non-zero to record real-time messages (clock, active sensing...) too. Off by default
+    int realtime;
+
+    // Messages waiting for the writer, each after its 32-bit timestamp and 16-bit length
+    unsigned char *queue;
+    unsigned int read_pos;
+    unsigned int write_pos;
+
+    // Only written by the tap side
+    unsigned long long messages;
+    unsigned long long dropped;
+    unsigned int max_depth;
+
+    // Only used by the writer
+    unsigned char *out;
+    unsigned int out_used;
+    // Offsets in the file of the recorded track's length and of its first event
+    long length_offset;
+    long data_offset;
+    unsigned int track_length;
+    // Microseconds since the recording started, as of the timestamp last_time
+    long long elapsed;
+    unsigned int last_time;
+    unsigned long long last_tick;
+    int error;
+
+    int stop;
+#if defined(_WIN32)
+    void *thread;
+#else
+    pthread_t thread;
+#endif
+
+    struct platform_midi_tap tap;
+};
+
+// Creates path and starts the writer. format 0 puts everything in one track; format 1 puts the tempo
+// in a track of its own, followed by the recorded one. Returns 1 on success, 0 on failure
+int platform_midi_recorder_open(struct platform_midi_recorder *recorder, const char *path, int format);
+
+// Writes everything still queued, finishes the file and closes it. Detach the recorder first
+void platform_midi_recorder_close(struct platform_midi_recorder *recorder);
+
+// Queues buf, read at timestamp (platform_midi_event_time() microseconds). Never blocks.
+// Returns 1 if it was queued, 0 if it was dropped
+int platform_midi_recorder_feed(struct platform_midi_recorder *recorder, const unsigned char *buf, int size, unsigned int timestamp);
+
+// Records everything the driver reads, through an input tap
+void platform_midi_recorder_attach(struct platform_midi_recorder *recorder, struct platform_midi_driver *driver);
+void platform_midi_recorder_detach(struct platform_midi_recorder *recorder, struct platform_midi_driver *driver);
+
+// May be called from any thread while recording
+void platform_midi_recorder_get_stats(struct platform_midi_recorder *recorder, struct platform_midi_recorder_stats *stats);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLATFORM_MIDI_RECORD_HEADER 6
+
+// How long the writer sleeps when there's nothing queued
+#define PLATFORM_MIDI_RECORD_IDLE_MS 2
+
+static void platform_midi_recorder_sleep(int ms)
+{
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static void platform_midi_recorder_put32(unsigned char *out, unsigned int value)
+{
+    out[0] = (value >> 24) & 0xFF;
+    out[1] = (value >> 16) & 0xFF;
+    out[2] = (value >> 8) & 0xFF;
+    out[3] = value & 0xFF;
+}
+
+// Writes a variable-length quantity. Returns the number of bytes used, at most 4
+static int platform_midi_recorder_put_vlq(unsigned char *out, unsigned int value)
+{
+    unsigned char bytes[4];
+    int count = 0;
+
+    do
+    {
+        bytes[count++] = value & 0x7F;
+        value >>= 7;
+    } while (value && count < 4);
+
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = bytes[count - 1 - i] | (i < count - 1 ? 0x80 : 0);
+    }
+
+    return count;
+}
+
+static void platform_midi_recorder_queue_copy(struct platform_midi_recorder *recorder, unsigned int pos, const unsigned char *buf, unsigned int size)
+{
+    unsigned int offset = pos & (PLATFORM_MIDI_RECORD_QUEUE_SIZE - 1);
+    unsigned int first = PLATFORM_MIDI_RECORD_QUEUE_SIZE - offset;
+
+    if (first > size)
+    {
+        first = size;
+    }
+
+    memcpy(recorder->queue + offset, buf, first);
+    memcpy(recorder->queue, buf + first, size - first);
+}
+
+static void platform_midi_recorder_queue_read(struct platform_midi_recorder *recorder, unsigned int pos, unsigned char *out, unsigned int size)
+{
+    unsigned int offset = pos & (PLATFORM_MIDI_RECORD_QUEUE_SIZE - 1);
+    unsigned int first = PLATFORM_MIDI_RECORD_QUEUE_SIZE - offset;
+
+    if (first > size)
+    {
+        first = size;
+    }
+
+    memcpy(out, recorder->queue + offset, first);
+    memcpy(out + first, recorder->queue, size - first);
+}
+
+int platform_midi_recorder_feed(struct platform_midi_recorder *recorder, const unsigned char *buf, int size, unsigned int timestamp)
+{
+    if (size <= 0 || (!recorder->realtime && size == 1 && buf[0] >= 0xF8))
+    {
+        return 1;
+    }
+
+    // Longer than a record can say, e.g. a huge SysEx in one read. The rest is written as continuations
+    while (size > 0xFFFF)
+    {
+        if (!platform_midi_recorder_feed(recorder, buf, 0xFFFF, timestamp))
+        {
+            return 0;
+        }
+
+        buf += 0xFFFF;
+        size -= 0xFFFF;
+    }
+
+    unsigned int writePos = recorder->write_pos;
+    unsigned int depth = writePos - __atomic_load_n(&recorder->read_pos, __ATOMIC_ACQUIRE);
+    unsigned int needed = PLATFORM_MIDI_RECORD_HEADER + size;
+
+    if (PLATFORM_MIDI_RECORD_QUEUE_SIZE - depth < needed)
+    {
+        __atomic_store_n(&recorder->dropped, recorder->dropped + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    unsigned char header[PLATFORM_MIDI_RECORD_HEADER];
+    memcpy(header, &timestamp, 4);
+    header[4] = size & 0xFF;
+    header[5] = (size >> 8) & 0xFF;
+
+    platform_midi_recorder_queue_copy(recorder, writePos, header, PLATFORM_MIDI_RECORD_HEADER);
+    platform_midi_recorder_queue_copy(recorder, writePos + PLATFORM_MIDI_RECORD_HEADER, buf, size);
+    __atomic_store_n(&recorder->write_pos, writePos + needed, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&recorder->messages, recorder->messages + 1, __ATOMIC_RELAXED);
+    if (depth + needed > recorder->max_depth)
+    {
+        __atomic_store_n(&recorder->max_depth, depth + needed, __ATOMIC_RELAXED);
+    }
+
+    return 1;
+}
+
+static void platform_midi_recorder_tap_fn(void *ctx, int direction, const unsigned char *buf, int size)
+{
+    (void)direction;
+    platform_midi_recorder_feed((struct platform_midi_recorder*)ctx, buf, size, platform_midi_event_time());
+}
+
+void platform_midi_recorder_attach(struct platform_midi_recorder *recorder, struct platform_midi_driver *driver)
+{
+    recorder->tap.fn = platform_midi_recorder_tap_fn;
+    recorder->tap.ctx = recorder;
+    recorder->tap.directions = PLATFORM_MIDI_TAP_INPUT;
+    platform_midi_add_tap(driver, &recorder->tap);
+}
+
+void platform_midi_recorder_detach(struct platform_midi_recorder *recorder, struct platform_midi_driver *driver)
+{
+    platform_midi_remove_tap(driver, &recorder->tap);
+}
+
+void platform_midi_recorder_get_stats(struct platform_midi_recorder *recorder, struct platform_midi_recorder_stats *stats)
+{
+    unsigned int readPos = __atomic_load_n(&recorder->read_pos, __ATOMIC_ACQUIRE);
+
+    stats->messages = __atomic_load_n(&recorder->messages, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&recorder->dropped, __ATOMIC_RELAXED);
+    stats->written = __atomic_load_n(&recorder->track_length, __ATOMIC_RELAXED);
+    stats->queue_depth = __atomic_load_n(&recorder->write_pos, __ATOMIC_ACQUIRE) - readPos;
+    stats->queue_max_depth = __atomic_load_n(&recorder->max_depth, __ATOMIC_RELAXED);
+    stats->queue_size = PLATFORM_MIDI_RECORD_QUEUE_SIZE;
+}
+
+// Writer side
+
+static void platform_midi_recorder_flush(struct platform_midi_recorder *recorder)
+{
+    if (recorder->out_used && !recorder->error && fwrite(recorder->out, 1, recorder->out_used, recorder->file) != recorder->out_used)
+    {
+        printf("Error writing MIDI recording, stopped recording\n");
+        recorder->error = 1;
+    }
+
+    recorder->out_used = 0;
+}
+
+static void platform_midi_recorder_emit(struct platform_midi_recorder *recorder, const unsigned char *buf, unsigned int size)
+{
+    if (recorder->out_used + size > PLATFORM_MIDI_RECORD_WRITE_SIZE)
+    {
+        platform_midi_recorder_flush(recorder);
+    }
+
+    if (size > PLATFORM_MIDI_RECORD_WRITE_SIZE)
+    {
+        if (!recorder->error && fwrite(buf, 1, size, recorder->file) != size)
+        {
+            printf("Error writing MIDI recording, stopped recording\n");
+            recorder->error = 1;
+        }
+    }
+    else
+    {
+        memcpy(recorder->out + recorder->out_used, buf, size);
+        recorder->out_used += size;
+    }
+
+    __atomic_store_n(&recorder->track_length, recorder->track_length + size, __ATOMIC_RELAXED);
+}
+
+// Moves the recording's clock up to timestamp. Differences are taken as signed, since the writer
+// also advances it while idle and may be slightly ahead of a message stamped just before
+static void platform_midi_recorder_advance(struct platform_midi_recorder *recorder, unsigned int timestamp)
+{
+    recorder->elapsed += (int)(timestamp - recorder->last_time);
+    recorder->last_time = timestamp;
+}
+
+// Writes one message as a track event, at the recording's current time
+static void platform_midi_recorder_event(struct platform_midi_recorder *recorder, const unsigned char *buf, unsigned int size)
+{
+    unsigned char prefix[10];
+    int used = 0;
+    unsigned long long tick = recorder->elapsed > 0
+        ? (unsigned long long)recorder->elapsed * PLATFORM_MIDI_RECORD_DIVISION / PLATFORM_MIDI_RECORD_TEMPO
+        : 0;
+    unsigned long long delta = tick > recorder->last_tick ? tick - recorder->last_tick : 0;
+
+    // A delta beyond 28 bits (about 36 hours at the defaults) is clamped
+    used += platform_midi_recorder_put_vlq(prefix, delta > 0x0FFFFFFF ? 0x0FFFFFFF : (unsigned int)delta);
+    recorder->last_tick += delta;
+
+    if (buf[0] == 0xF0)
+    {
+        prefix[used++] = 0xF0;
+        used += platform_midi_recorder_put_vlq(prefix + used, size - 1);
+        buf++;
+        size--;
+    }
+    else if (buf[0] > 0xF0 || !(buf[0] & 0x80))
+    {
+        // SysEx continuations and system messages go out as escapes, since a status of 0xFF is a meta event
+        prefix[used++] = 0xF7;
+        used += platform_midi_recorder_put_vlq(prefix + used, size);
+    }
+
+    platform_midi_recorder_emit(recorder, prefix, used);
+    platform_midi_recorder_emit(recorder, buf, size);
+}
+
+// Finishes the file as it stands, then goes back to where the next event belongs
+static void platform_midi_recorder_sync(struct platform_midi_recorder *recorder)
+{
+    static const unsigned char endOfTrack[4] = { 0x00, 0xFF, 0x2F, 0x00 };
+    unsigned char length[4];
+
+    platform_midi_recorder_flush(recorder);
+    if (recorder->error)
+    {
+        return;
+    }
+
+    platform_midi_recorder_put32(length, recorder->track_length + sizeof(endOfTrack));
+
+    if (fwrite(endOfTrack, 1, sizeof(endOfTrack), recorder->file) != sizeof(endOfTrack)
+        || 0 != fseek(recorder->file, recorder->length_offset, SEEK_SET)
+        || fwrite(length, 1, sizeof(length), recorder->file) != sizeof(length)
+        || 0 != fflush(recorder->file)
+        || 0 != fseek(recorder->file, recorder->data_offset + recorder->track_length, SEEK_SET))
+    {
+        printf("Error writing MIDI recording, stopped recording\n");
+        recorder->error = 1;
+    }
+}
+
+// Writes everything queued. Returns the number of messages written
+static int platform_midi_recorder_drain(struct platform_midi_recorder *recorder)
+{
+    unsigned char header[PLATFORM_MIDI_RECORD_HEADER];
+    unsigned char message[0xFFFF];
+    unsigned int readPos = recorder->read_pos;
+    unsigned int writePos = __atomic_load_n(&recorder->write_pos, __ATOMIC_ACQUIRE);
+    int count = 0;
+
+    while (readPos != writePos)
+    {
+        unsigned int timestamp;
+
+        platform_midi_recorder_queue_read(recorder, readPos, header, PLATFORM_MIDI_RECORD_HEADER);
+        memcpy(&timestamp, header, 4);
+        unsigned int size = header[4] | (header[5] << 8);
+
+        platform_midi_recorder_queue_read(recorder, readPos + PLATFORM_MIDI_RECORD_HEADER, message, size);
+        readPos += PLATFORM_MIDI_RECORD_HEADER + size;
+        // The tap can have the space back now
+        __atomic_store_n(&recorder->read_pos, readPos, __ATOMIC_RELEASE);
+
+        platform_midi_recorder_advance(recorder, timestamp);
+
+        // One read is usually one message, but split it up in case it isn't
+        unsigned int offset = 0;
+        while (offset < size)
+        {
+            unsigned int length;
+
+            if (!(message[offset] & 0x80))
+            {
+                const unsigned char *end = (const unsigned char*)memchr(message + offset, 0xF7, size - offset);
+                length = end ? (unsigned int)(end - (message + offset)) + 1 : size - offset;
+            }
+            else
+            {
+                length = platform_midi_next_message(message + offset, size - offset);
+            }
+
+            platform_midi_recorder_event(recorder, message + offset, length);
+            offset += length;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI platform_midi_recorder_thread(LPVOID ctx)
+#else
+static void *platform_midi_recorder_thread(void *ctx)
+#endif
+{
+    struct platform_midi_recorder *recorder = (struct platform_midi_recorder*)ctx;
+    unsigned int lastSync = platform_midi_event_time();
+    int dirty = 0;
+
+    while (!__atomic_load_n(&recorder->stop, __ATOMIC_ACQUIRE))
+    {
+        if (platform_midi_recorder_drain(recorder))
+        {
+            dirty = 1;
+        }
+        else
+        {
+            // Keep the clock moving, so a gap longer than the timestamps wrap is still measured
+            platform_midi_recorder_advance(recorder, platform_midi_event_time());
+            platform_midi_recorder_sleep(PLATFORM_MIDI_RECORD_IDLE_MS);
+        }
+
+        if (dirty && platform_midi_event_time() - lastSync >= PLATFORM_MIDI_RECORD_SYNC_MS * 1000u)
+        {
+            platform_midi_recorder_sync(recorder);
+            lastSync = platform_midi_event_time();
+            dirty = 0;
+        }
+    }
+
+    platform_midi_recorder_drain(recorder);
+    return 0;
+}
+
+int platform_midi_recorder_open(struct platform_midi_recorder *recorder, const char *path, int format)
+{
+    unsigned char header[48];
+    int used = 0;
+
+    memset(recorder, 0, sizeof(*recorder));
+
+    if (format != 0 && format != 1)
+    {
+        printf("Error: can't record SMF format %d\n", format);
+        return 0;
+    }
+
+    recorder->file = fopen(path, "wb");
+    if (!recorder->file)
+    {
+        printf("Failed to create %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    recorder->queue = (unsigned char*)malloc(PLATFORM_MIDI_RECORD_QUEUE_SIZE);
+    recorder->out = (unsigned char*)malloc(PLATFORM_MIDI_RECORD_WRITE_SIZE);
+    if (!recorder->queue || !recorder->out)
+    {
+        printf("Failed to allocate recording buffers\n");
+        goto fail;
+    }
+
+    recorder->format = format;
+    recorder->last_time = platform_midi_event_time();
+
+    // Header chunk
+    memcpy(header, "MThd", 4);
+    platform_midi_recorder_put32(header + 4, 6);
+    header[8] = 0;
+    header[9] = format;
+    header[10] = 0;
+    header[11] = format + 1;
+    header[12] = (PLATFORM_MIDI_RECORD_DIVISION >> 8) & 0x7F;
+    header[13] = PLATFORM_MIDI_RECORD_DIVISION & 0xFF;
+    used = 14;
+
+    // Format 1 has a track holding just the tempo
+    static const unsigned char tempo[7] = {
+        0x00, 0xFF, 0x51, 0x03,
+        (PLATFORM_MIDI_RECORD_TEMPO >> 16) & 0xFF, (PLATFORM_MIDI_RECORD_TEMPO >> 8) & 0xFF, PLATFORM_MIDI_RECORD_TEMPO & 0xFF,
+    };
+
+    if (format == 1)
+    {
+        memcpy(header + used, "MTrk", 4);
+        platform_midi_recorder_put32(header + used + 4, sizeof(tempo) + 4);
+        memcpy(header + used + 8, tempo, sizeof(tempo));
+        memcpy(header + used + 8 + sizeof(tempo), "\x00\xFF\x2F\x00", 4);
+        used += 8 + sizeof(tempo) + 4;
+    }
+
+    // The recorded track, its length patched in on every sync
+    memcpy(header + used, "MTrk", 4);
+    platform_midi_recorder_put32(header + used + 4, 0);
+    recorder->length_offset = used + 4;
+    recorder->data_offset = used + 8;
+    used += 8;
+
+    if (fwrite(header, 1, used, recorder->file) != (size_t)used)
+    {
+        printf("Failed to write %s\n", path);
+        goto fail;
+    }
+
+    if (format == 0)
+    {
+        platform_midi_recorder_emit(recorder, tempo, sizeof(tempo));
+    }
+
+    platform_midi_recorder_sync(recorder);
+
+#if defined(_WIN32)
+    recorder->thread = CreateThread(NULL, 0, platform_midi_recorder_thread, recorder, 0, NULL);
+    if (!recorder->thread)
+#else
+    if (0 != pthread_create(&recorder->thread, NULL, platform_midi_recorder_thread, recorder))
+#endif
+    {
+        printf("Failed to start the recording thread\n");
+        goto fail;
+    }
+
+    return 1;
+
+fail:
+    fclose(recorder->file);
+    free(recorder->queue);
+    free(recorder->out);
+    recorder->file = NULL;
+    return 0;
+}
+
+void platform_midi_recorder_close(struct platform_midi_recorder *recorder)
+{
+    if (!recorder->file)
+    {
+        return;
+    }
+
+    __atomic_store_n(&recorder->stop, 1, __ATOMIC_RELEASE);
+
+#if defined(_WIN32)
+    WaitForSingleObject(recorder->thread, INFINITE);
+    CloseHandle(recorder->thread);
+#else
+    pthread_join(recorder->thread, NULL);
+#endif
+
+    platform_midi_recorder_sync(recorder);
+
+    if (0 != fclose(recorder->file))
+    {
+        printf("Error closing MIDI recording\n");
+    }
+
+    free(recorder->queue);
+    free(recorder->out);
+    recorder->file = NULL;
+}
+
+#endif
+
+#endif
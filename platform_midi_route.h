@@ -0,0 +1,550 @@
+#ifndef _PLATFORM_MIDI_ROUTE_H_
+#define _PLATFORM_MIDI_ROUTE_H_
+
+#include "platform_midi.h"
+
+/*
+ * platform_midi_route.h
+ *
+ * Routes messages between drivers: many inputs to many outputs, with channel
+ * remapping, transposition, velocity scaling and filtering by channel, message
+ * type and note range.
+ *
+ * Routes are described as a list of struct platform_midi_route and compiled into
+ * a table per input indexed by status byte. Each entry lists what to send where,
+ * with the data bytes mapped through 128-entry tables worked out up front, so a
+ * message costs one lookup for its status and one per data byte per destination,
+ * with no branching on the routes themselves.
+ *
+ * Messages are collected per output and written once per batch, so whatever
+ * several inputs send to one output in a pump is merged into a single write.
+ * Nothing is allocated or locked once the routes are compiled. The router is
+ * not synchronized; compile, process and pump from the same thread.
+ */
+
+#ifndef PLATFORM_MIDI_ROUTER_MAX_PORTS
+#define PLATFORM_MIDI_ROUTER_MAX_PORTS 16
+#endif
+
+// Bytes collected for each output before it's written
+#ifndef PLATFORM_MIDI_ROUTER_BATCH_SIZE
+#define PLATFORM_MIDI_ROUTER_BATCH_SIZE 4096
+#endif
+
+// Message types, for struct platform_midi_route's types
+#define PLATFORM_MIDI_ROUTE_NOTE_OFF         0x01
+#define PLATFORM_MIDI_ROUTE_NOTE_ON          0x02
+#define PLATFORM_MIDI_ROUTE_POLY_PRESSURE    0x04
+#define PLATFORM_MIDI_ROUTE_CONTROL_CHANGE   0x08
+#define PLATFORM_MIDI_ROUTE_PROGRAM_CHANGE   0x10
+#define PLATFORM_MIDI_ROUTE_CHANNEL_PRESSURE 0x20
+#define PLATFORM_MIDI_ROUTE_PITCH_BEND       0x40
+// SysEx, system common and real-time, passed on unchanged
+#define PLATFORM_MIDI_ROUTE_SYSTEM           0x80
+
+#define PLATFORM_MIDI_ROUTE_NOTES (PLATFORM_MIDI_ROUTE_NOTE_OFF | PLATFORM_MIDI_ROUTE_NOTE_ON)
+
+// For a route's input, to take messages from every input
+#define PLATFORM_MIDI_ROUTE_ANY -1
+
+// Zeroed, a route sends everything from its input to its output unchanged
+struct platform_midi_route
+{
+    // Indexes returned by platform_midi_router_add_input() / _add_output()
+    int input;
+    int output;
+
+    // Bitmask of channels to take, bit 0 for channel 1. 0 takes all of them
+    unsigned short channels;
+    // Bitmask of PLATFORM_MIDI_ROUTE_* types to take. 0 takes all of them
+    unsigned char types;
+    // Note messages and poly pressure outside note_min to note_max are left out. Both 0 takes all notes
+    unsigned char note_min;
+    unsigned char note_max;
+
+    // Channel to send on, 1-16, or 0 to keep each message's own
+    int channel;
+    // Semitones to move notes by; notes moved out of range are left out
+    int transpose;
+    // Note On velocities become velocity * velocity_scale + velocity_offset, kept within 1-127.
+    // A scale of 0 is taken as 1
+    float velocity_scale;
+    int velocity_offset;
+};
+
+struct platform_midi_route_action
+{
+    // Data bytes are looked up in these, where 0xFF leaves the message out
+    const unsigned char *data1;
+    const unsigned char *data2;
+    unsigned char output;
+    unsigned char status;
+};
+
+struct platform_midi_route_slot
+{
+    unsigned short first;
+    unsigned short count;
+};
+
+struct platform_midi_router
+{
+    struct platform_midi_driver *inputs[PLATFORM_MIDI_ROUTER_MAX_PORTS];
+    int input_count;
+    struct platform_midi_driver *outputs[PLATFORM_MIDI_ROUTER_MAX_PORTS];
+    int output_count;
+
+    // For each input and status byte from 0x80, what to do with it
+    struct platform_midi_route_slot table[PLATFORM_MIDI_ROUTER_MAX_PORTS][128];
+    struct platform_midi_route_action *actions;
+    int action_count;
+    // The identity map, then each route's note and velocity maps
+    unsigned char *maps;
+
+    unsigned char running_status[PLATFORM_MIDI_ROUTER_MAX_PORTS];
+    // Non-zero while a SysEx from the input carries on into its next read, as byte-stream
+    // backends deliver long ones in pieces
+    unsigned char in_sysex[PLATFORM_MIDI_ROUTER_MAX_PORTS];
+
+    // Messages taken in and sent out
+    unsigned long long messages_in;
+    unsigned long long messages_out;
+
+    int batched[PLATFORM_MIDI_ROUTER_MAX_PORTS];
+    unsigned char batch[PLATFORM_MIDI_ROUTER_MAX_PORTS][PLATFORM_MIDI_ROUTER_BATCH_SIZE];
+    unsigned char read_buf[PLATFORM_MIDI_ROUTER_BATCH_SIZE];
+};
+
+void platform_midi_router_init(struct platform_midi_router *router);
+void platform_midi_router_deinit(struct platform_midi_router *router);
+
+// Return the port's index, or -1 if there are already PLATFORM_MIDI_ROUTER_MAX_PORTS
+int platform_midi_router_add_input(struct platform_midi_router *router, struct platform_midi_driver *driver);
+int platform_midi_router_add_output(struct platform_midi_router *router, struct platform_midi_driver *driver);
+
+// Replaces the routes. Returns 1 on success, 0 if a route is invalid or allocation fails, leaving the old routes
+int platform_midi_router_compile(struct platform_midi_router *router, const struct platform_midi_route *routes, int count);
+
+// Routes messages as if read from an input, collecting them for the outputs.
+// Returns the number of messages queued, or -1 on a write error
+int platform_midi_router_process(struct platform_midi_router *router, int input, const unsigned char *buf, int size);
+
+// Writes out everything collected. Returns 0, or -1 if a write fails
+int platform_midi_router_flush(struct platform_midi_router *router);
+
+// Reads whatever each input has, routes it and flushes. Returns the number of messages sent, or -1 on error
+int platform_midi_router_pump(struct platform_midi_router *router);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+void platform_midi_router_init(struct platform_midi_router *router)
+{
+    memset(router, 0, sizeof(*router));
+}
+
+void platform_midi_router_deinit(struct platform_midi_router *router)
+{
+    free(router->actions);
+    free(router->maps);
+    router->actions = NULL;
+    router->maps = NULL;
+    router->action_count = 0;
+    memset(router->table, 0, sizeof(router->table));
+}
+
+int platform_midi_router_add_input(struct platform_midi_router *router, struct platform_midi_driver *driver)
+{
+    if (router->input_count >= PLATFORM_MIDI_ROUTER_MAX_PORTS)
+    {
+        printf("Error: a router takes at most %d inputs\n", PLATFORM_MIDI_ROUTER_MAX_PORTS);
+        return -1;
+    }
+
+    router->inputs[router->input_count] = driver;
+    return router->input_count++;
+}
+
+int platform_midi_router_add_output(struct platform_midi_router *router, struct platform_midi_driver *driver)
+{
+    if (router->output_count >= PLATFORM_MIDI_ROUTER_MAX_PORTS)
+    {
+        printf("Error: a router takes at most %d outputs\n", PLATFORM_MIDI_ROUTER_MAX_PORTS);
+        return -1;
+    }
+
+    router->outputs[router->output_count] = driver;
+    return router->output_count++;
+}
+
+// Whether route takes messages with this status byte from input
+static int platform_midi_route_matches(const struct platform_midi_route *route, int input, unsigned char status)
+{
+    int type = (status >> 4) - 8;
+
+    if (route->input != PLATFORM_MIDI_ROUTE_ANY && route->input != input)
+    {
+        return 0;
+    }
+
+    if (route->types && !(route->types & (1 << type)))
+    {
+        return 0;
+    }
+
+    return status >= 0xF0 || !route->channels || (route->channels & (1 << (status & 0x0F)));
+}
+
+int platform_midi_router_compile(struct platform_midi_router *router, const struct platform_midi_route *routes, int count)
+{
+    int actionCount = 0;
+
+    for (int r = 0; r < count; r++)
+    {
+        const struct platform_midi_route *route = &routes[r];
+
+        if ((route->input != PLATFORM_MIDI_ROUTE_ANY && (route->input < 0 || route->input >= router->input_count))
+            || route->output < 0 || route->output >= router->output_count
+            || route->channel < 0 || route->channel > 16 || route->note_min > route->note_max || route->note_max > 127)
+        {
+            printf("Error: MIDI route %d is invalid\n", r);
+            return 0;
+        }
+    }
+
+    for (int input = 0; input < router->input_count; input++)
+    {
+        for (int s = 0; s < 128; s++)
+        {
+            for (int r = 0; r < count; r++)
+            {
+                actionCount += platform_midi_route_matches(&routes[r], input, 0x80 + s);
+            }
+        }
+    }
+
+    if (actionCount > 0xFFFF)
+    {
+        printf("Error: too many MIDI routes\n");
+        return 0;
+    }
+
+    struct platform_midi_route_action *actions = (struct platform_midi_route_action*)malloc((actionCount ? actionCount : 1) * sizeof(struct platform_midi_route_action));
+    unsigned char *maps = (unsigned char*)malloc(128 + count * 256);
+    if (!actions || !maps)
+    {
+        printf("Failed to allocate MIDI routes\n");
+        free(actions);
+        free(maps);
+        return 0;
+    }
+
+    for (int n = 0; n < 128; n++)
+    {
+        maps[n] = n;
+    }
+
+    for (int r = 0; r < count; r++)
+    {
+        const struct platform_midi_route *route = &routes[r];
+        unsigned char *notes = maps + 128 + r * 256;
+        unsigned char *velocities = notes + 128;
+        float scale = route->velocity_scale ? route->velocity_scale : 1;
+
+        for (int n = 0; n < 128; n++)
+        {
+            int note = n + route->transpose;
+            int outside = (route->note_min || route->note_max) && (n < route->note_min || n > route->note_max);
+            notes[n] = (outside || note < 0 || note > 127) ? 0xFF : note;
+
+            // Velocity 0 is a Note Off, and has to stay one
+            int velocity = (int)(n * scale + route->velocity_offset + 0.5f);
+            velocities[n] = n == 0 ? 0 : velocity < 1 ? 1 : velocity > 127 ? 127 : velocity;
+        }
+    }
+
+    struct platform_midi_route_slot (*table)[128] = router->table;
+    int used = 0;
+
+    memset(router->table, 0, sizeof(router->table));
+    for (int input = 0; input < router->input_count; input++)
+    {
+        for (int s = 0; s < 128; s++)
+        {
+            unsigned char status = 0x80 + s;
+            int type = s >> 4;
+
+            table[input][s].first = used;
+
+            for (int r = 0; r < count; r++)
+            {
+                const struct platform_midi_route *route = &routes[r];
+                struct platform_midi_route_action *action = &actions[used];
+
+                if (!platform_midi_route_matches(route, input, status))
+                {
+                    continue;
+                }
+
+                action->output = route->output;
+                action->status = (status < 0xF0 && route->channel) ? (status & 0xF0) | (route->channel - 1) : status;
+                // Note Off, Note On and poly pressure have notes to map, and Note On a velocity
+                action->data1 = type <= 2 ? maps + 128 + r * 256 : maps;
+                action->data2 = type == 1 ? maps + 128 + r * 256 + 128 : maps;
+                used++;
+            }
+
+            table[input][s].count = used - table[input][s].first;
+        }
+    }
+
+    free(router->actions);
+    free(router->maps);
+    router->actions = actions;
+    router->maps = maps;
+    router->action_count = used;
+    return 1;
+}
+
+static int platform_midi_router_flush_output(struct platform_midi_router *router, int output)
+{
+    int size = router->batched[output];
+
+    router->batched[output] = 0;
+    if (size && platform_midi_write(router->outputs[output], router->batch[output], size) < 0)
+    {
+        printf("Error writing routed MIDI\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int platform_midi_router_flush(struct platform_midi_router *router)
+{
+    int result = 0;
+
+    for (int output = 0; output < router->output_count; output++)
+    {
+        if (platform_midi_router_flush_output(router, output) < 0)
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+// Sends a system message on unchanged, writing it straight out if it's bigger than a batch
+static int platform_midi_router_pass(struct platform_midi_router *router, int output, const unsigned char *msg, int length)
+{
+    if (router->batched[output] + length > PLATFORM_MIDI_ROUTER_BATCH_SIZE && platform_midi_router_flush_output(router, output) < 0)
+    {
+        return -1;
+    }
+
+    if (length > PLATFORM_MIDI_ROUTER_BATCH_SIZE)
+    {
+        if (platform_midi_write(router->outputs[output], msg, length) < 0)
+        {
+            printf("Error writing routed MIDI\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    memcpy(router->batch[output] + router->batched[output], msg, length);
+    router->batched[output] += length;
+    return 0;
+}
+
+int platform_midi_router_process(struct platform_midi_router *router, int input, const unsigned char *buf, int size)
+{
+    const struct platform_midi_route_slot *table = router->table[input];
+    const struct platform_midi_route_action *actions = router->actions;
+    unsigned char runningStatus = router->running_status[input];
+    unsigned char inSysex = router->in_sysex[input];
+    int queued = 0;
+    int i = 0;
+
+    while (i < size)
+    {
+        unsigned char status = buf[i];
+        const unsigned char *data = buf + i + 1;
+
+        if (status == 0xF0 || (inSysex && (status < 0x80 || status == 0xF7)))
+        {
+            // A SysEx, or more of one: up to its F7, or a status byte. A real-time message only
+            // interrupts it, and the end of the buffer leaves it to carry on in the next read
+            const struct platform_midi_route_slot *slot = &table[0xF0 - 0x80];
+            int end = (status == 0xF0) ? i + 1 : i;
+
+            while (end < size && !(buf[end] & 0x80))
+            {
+                end++;
+            }
+
+            if (end < size && buf[end] == 0xF7)
+            {
+                end++;
+                inSysex = 0;
+            }
+            else
+            {
+                inSysex = end == size || buf[end] >= 0xF8;
+            }
+
+            runningStatus = 0;
+            for (int a = slot->first; a < slot->first + slot->count; a++)
+            {
+                if (platform_midi_router_pass(router, actions[a].output, buf + i, end - i) < 0)
+                {
+                    router->running_status[input] = runningStatus;
+                    router->in_sysex[input] = inSysex;
+                    return -1;
+                }
+                queued += status == 0xF0;
+            }
+
+            router->messages_in += status == 0xF0;
+            i = end;
+            continue;
+        }
+
+        if (status >= 0x80 && status < 0xF8)
+        {
+            // Anything but real-time ends a SysEx, even without its F7
+            inSysex = 0;
+        }
+
+        if (status >= 0xF0)
+        {
+            int length = platform_midi_next_message(buf + i, size - i);
+            const struct platform_midi_route_slot *slot = &table[status - 0x80];
+
+            // Real-time messages don't cancel running status, everything else here does
+            if (status < 0xF8)
+            {
+                runningStatus = 0;
+            }
+
+            for (int a = slot->first; a < slot->first + slot->count; a++)
+            {
+                if (platform_midi_router_pass(router, actions[a].output, buf + i, length) < 0)
+                {
+                    router->running_status[input] = runningStatus;
+                    router->in_sysex[input] = inSysex;
+                    return -1;
+                }
+                queued++;
+            }
+
+            router->messages_in++;
+            i += length;
+            continue;
+        }
+
+        if (status & 0x80)
+        {
+            runningStatus = status;
+        }
+        else if (runningStatus)
+        {
+            status = runningStatus;
+            data = buf + i;
+        }
+        else
+        {
+            // Stray data byte
+            i++;
+            continue;
+        }
+
+        int length = platform_midi_msg_length(status);
+        int next = (int)(data - buf) + length - 1;
+
+        if (next > size || (data[0] & 0x80) || (length == 3 && (data[1] & 0x80)))
+        {
+            // Cut short, or interrupted by a status byte: pick up again at the next status byte
+            i = (int)(data - buf);
+            while (i < size && !(buf[i] & 0x80))
+            {
+                i++;
+            }
+            runningStatus = 0;
+            continue;
+        }
+
+        const struct platform_midi_route_slot *slot = &table[status - 0x80];
+        for (int a = slot->first; a < slot->first + slot->count; a++)
+        {
+            const struct platform_midi_route_action *action = &actions[a];
+            unsigned char data1 = action->data1[data[0]];
+
+            if (data1 == 0xFF)
+            {
+                continue;
+            }
+
+            int output = action->output;
+            if (router->batched[output] + 3 > PLATFORM_MIDI_ROUTER_BATCH_SIZE && platform_midi_router_flush_output(router, output) < 0)
+            {
+                router->running_status[input] = runningStatus;
+                router->in_sysex[input] = inSysex;
+                return -1;
+            }
+
+            unsigned char *out = router->batch[output] + router->batched[output];
+            out[0] = action->status;
+            out[1] = data1;
+            if (length == 3)
+            {
+                out[2] = action->data2[data[1]];
+            }
+            router->batched[output] += length;
+            queued++;
+        }
+
+        router->messages_in++;
+        i = next;
+    }
+
+    router->running_status[input] = runningStatus;
+    router->in_sysex[input] = inSysex;
+    router->messages_out += queued;
+    return queued;
+}
+
+int platform_midi_router_pump(struct platform_midi_router *router)
+{
+    int sent = 0;
+
+    for (int input = 0; input < router->input_count; input++)
+    {
+        struct platform_midi_driver *driver = router->inputs[input];
+
+        while (platform_midi_avail(driver))
+        {
+            int read = platform_midi_read(driver, router->read_buf, sizeof(router->read_buf));
+            if (read <= 0)
+            {
+                break;
+            }
+
+            int queued = platform_midi_router_process(router, input, router->read_buf, read);
+            if (queued < 0)
+            {
+                return -1;
+            }
+            sent += queued;
+        }
+    }
+
+    return platform_midi_router_flush(router) < 0 ? -1 : sent;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,446 @@
+#ifndef _PLATFORM_MIDI_SCAN_H_
+#define _PLATFORM_MIDI_SCAN_H_
+
+#include "platform_midi.h"
+#include <stddef.h>
+
+/*
+ * platform_midi_scan.h
+ *
+ * Vectorized search for status bytes (>= 0x80) in raw MIDI byte streams, and a
+ * framer built on it which splits a byte stream into complete messages.
+ *
+ * Bulk input is almost entirely data bytes, so the framer skips whole runs of
+ * SysEx payload or running-status data at a time instead of inspecting every byte.
+ * The SSE2 or AVX2 implementation is picked at runtime on x86, with a scalar fallback.
+ */
+
+// SysEx messages longer than this are delivered to the framer callback in pieces
+#ifndef PLATFORM_MIDI_SYSEX_CHUNK_SIZE
+#define PLATFORM_MIDI_SYSEX_CHUNK_SIZE 256
+#endif
+
+// Returns the index of the first status byte in buf, or len if there is none
+size_t platform_midi_scan_status(const unsigned char *buf, size_t len);
+
+// Stores the indices of up to max status bytes in positions, and returns how many were stored
+size_t platform_midi_scan_status_all(const unsigned char *buf, size_t len, unsigned int *positions, size_t max);
+
+// Returns the name of the implementation selected for this CPU
+const char *platform_midi_scan_impl(void);
+
+// Called once per complete message (or SysEx chunk). Return non-zero to stop framing
+typedef int (*platform_midi_frame_fn)(void *ctx, const unsigned char *msg, unsigned int len);
+
+struct platform_midi_framer
+{
+    // Status of the message being collected, which is also the running status for channel messages
+    unsigned char status;
+    unsigned char needed;
+    unsigned char count;
+    unsigned char data[2];
+    unsigned char in_sysex;
+    unsigned int sysex_len;
+    unsigned char sysex[PLATFORM_MIDI_SYSEX_CHUNK_SIZE];
+};
+
+void platform_midi_framer_init(struct platform_midi_framer *framer);
+
+// Frames as much of buf as possible and returns the number of bytes consumed,
+// which is less than len only if the callback asked to stop
+size_t platform_midi_framer_feed(struct platform_midi_framer *framer, const unsigned char *buf, size_t len, platform_midi_frame_fn fn, void *ctx);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PLATFORM_MIDI_SCAN_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define PLATFORM_MIDI_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+static size_t platform_midi_scan_status_scalar(const unsigned char *buf, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && !(buf[i] & 0x80))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+static size_t platform_midi_scan_status_all_scalar(const unsigned char *buf, size_t len, unsigned int *positions, size_t max)
+{
+    size_t found = 0;
+
+    for (size_t i = 0; i < len && found < max; i++)
+    {
+        if (buf[i] & 0x80)
+        {
+            positions[found++] = (unsigned int)i;
+        }
+    }
+
+    return found;
+}
+
+// Appends the index of each set bit in mask, starting at base
+static size_t platform_midi_scan_push_mask(unsigned long long mask, size_t base, unsigned int *positions, size_t found, size_t max)
+{
+    while (mask && found < max)
+    {
+        positions[found++] = (unsigned int)(base + __builtin_ctzll(mask));
+        mask &= mask - 1;
+    }
+
+    return found;
+}
+
+#ifdef PLATFORM_MIDI_SCAN_X86
+__attribute__((target("sse2")))
+static size_t platform_midi_scan_status_sse2(const unsigned char *buf, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(buf + i + 16));
+
+        // The sign bit of each byte is exactly the status bit
+        if (_mm_movemask_epi8(_mm_or_si128(a, b)))
+        {
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(a) | ((unsigned int)_mm_movemask_epi8(b) << 16);
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + platform_midi_scan_status_scalar(buf + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t platform_midi_scan_status_all_sse2(const unsigned char *buf, size_t len, unsigned int *positions, size_t max)
+{
+    size_t found = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= len && found < max; i += 16)
+    {
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(buf + i)));
+        found = platform_midi_scan_push_mask(mask, i, positions, found, max);
+    }
+
+    if (i < len && found < max)
+    {
+        size_t tail = platform_midi_scan_status_all_scalar(buf + i, len - i, positions + found, max - found);
+        for (size_t j = found; j < found + tail; j++)
+        {
+            positions[j] += (unsigned int)i;
+        }
+        found += tail;
+    }
+
+    return found;
+}
+
+__attribute__((target("avx2")))
+static size_t platform_midi_scan_status_avx2(const unsigned char *buf, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(buf + i + 32));
+
+        if (_mm256_movemask_epi8(_mm256_or_si256(a, b)))
+        {
+            unsigned long long mask = (unsigned int)_mm256_movemask_epi8(a) | ((unsigned long long)(unsigned int)_mm256_movemask_epi8(b) << 32);
+            return i + __builtin_ctzll(mask);
+        }
+    }
+
+    return i + platform_midi_scan_status_sse2(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t platform_midi_scan_status_all_avx2(const unsigned char *buf, size_t len, unsigned int *positions, size_t max)
+{
+    size_t found = 0;
+    size_t i = 0;
+
+    for (; i + 64 <= len && found < max; i += 64)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(buf + i + 32));
+        unsigned long long mask = (unsigned int)_mm256_movemask_epi8(a) | ((unsigned long long)(unsigned int)_mm256_movemask_epi8(b) << 32);
+        found = platform_midi_scan_push_mask(mask, i, positions, found, max);
+    }
+
+    if (i < len && found < max)
+    {
+        size_t tail = platform_midi_scan_status_all_sse2(buf + i, len - i, positions + found, max - found);
+        for (size_t j = found; j < found + tail; j++)
+        {
+            positions[j] += (unsigned int)i;
+        }
+        found += tail;
+    }
+
+    return found;
+}
+#endif
+
+#ifdef PLATFORM_MIDI_SCAN_NEON
+static size_t platform_midi_scan_status_neon(const unsigned char *buf, size_t len)
+{
+    size_t i = 0;
+
+    // NEON has no movemask, so only skip blocks here and locate the byte with the scalar loop
+    for (; i + 32 <= len; i += 32)
+    {
+        uint8x16_t v = vorrq_u8(vld1q_u8(buf + i), vld1q_u8(buf + i + 16));
+        if (vmaxvq_u8(v) & 0x80)
+        {
+            break;
+        }
+    }
+
+    return i + platform_midi_scan_status_scalar(buf + i, len - i);
+}
+#endif
+
+struct platform_midi_scan_fns
+{
+    const char *name;
+    size_t (*find)(const unsigned char*, size_t);
+    size_t (*find_all)(const unsigned char*, size_t, unsigned int*, size_t);
+};
+
+static const struct platform_midi_scan_fns *platform_midi_scan_select(void)
+{
+    static const struct platform_midi_scan_fns scalar = { "scalar", platform_midi_scan_status_scalar, platform_midi_scan_status_all_scalar };
+#ifdef PLATFORM_MIDI_SCAN_X86
+    static const struct platform_midi_scan_fns sse2 = { "sse2", platform_midi_scan_status_sse2, platform_midi_scan_status_all_sse2 };
+    static const struct platform_midi_scan_fns avx2 = { "avx2", platform_midi_scan_status_avx2, platform_midi_scan_status_all_avx2 };
+    static const struct platform_midi_scan_fns *selected = NULL;
+
+    // Racing threads all store the same pointer, so no locking is needed
+    if (!selected)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            selected = &avx2;
+        }
+        else if (__builtin_cpu_supports("sse2"))
+        {
+            selected = &sse2;
+        }
+        else
+        {
+            selected = &scalar;
+        }
+    }
+
+    return selected;
+#elif defined(PLATFORM_MIDI_SCAN_NEON)
+    static const struct platform_midi_scan_fns neon = { "neon", platform_midi_scan_status_neon, platform_midi_scan_status_all_scalar };
+    (void)scalar;
+    return &neon;
+#else
+    return &scalar;
+#endif
+}
+
+size_t platform_midi_scan_status(const unsigned char *buf, size_t len)
+{
+    return platform_midi_scan_select()->find(buf, len);
+}
+
+size_t platform_midi_scan_status_all(const unsigned char *buf, size_t len, unsigned int *positions, size_t max)
+{
+    return platform_midi_scan_select()->find_all(buf, len, positions, max);
+}
+
+const char *platform_midi_scan_impl(void)
+{
+    return platform_midi_scan_select()->name;
+}
+
+void platform_midi_framer_init(struct platform_midi_framer *framer)
+{
+    framer->status = 0;
+    framer->needed = 0;
+    framer->count = 0;
+    framer->in_sysex = 0;
+    framer->sysex_len = 0;
+}
+
+// Hands the collected SysEx bytes to the callback
+static int platform_midi_framer_flush_sysex(struct platform_midi_framer *framer, platform_midi_frame_fn fn, void *ctx)
+{
+    unsigned int len = framer->sysex_len;
+
+    framer->sysex_len = 0;
+    return len ? fn(ctx, framer->sysex, len) : 0;
+}
+
+size_t platform_midi_framer_feed(struct platform_midi_framer *framer, const unsigned char *buf, size_t len, platform_midi_frame_fn fn, void *ctx)
+{
+    size_t i = 0;
+
+    while (i < len)
+    {
+        if (framer->in_sysex)
+        {
+            // Copy the whole run of payload bytes up to the next status byte at once
+            size_t next = i + platform_midi_scan_status(buf + i, len - i);
+
+            while (i < next)
+            {
+                size_t room = PLATFORM_MIDI_SYSEX_CHUNK_SIZE - framer->sysex_len;
+                size_t n = (next - i < room) ? next - i : room;
+
+                memcpy(framer->sysex + framer->sysex_len, buf + i, n);
+                framer->sysex_len += n;
+                i += n;
+
+                if (framer->sysex_len == PLATFORM_MIDI_SYSEX_CHUNK_SIZE && platform_midi_framer_flush_sysex(framer, fn, ctx))
+                {
+                    return i;
+                }
+            }
+
+            if (i == len)
+            {
+                break;
+            }
+
+            if (buf[i] >= 0xF8)
+            {
+                // Realtime messages may be interleaved with SysEx data
+                if (fn(ctx, &buf[i++], 1))
+                {
+                    return i;
+                }
+                continue;
+            }
+
+            framer->in_sysex = 0;
+
+            if (buf[i] == 0xF7)
+            {
+                // A full chunk was flushed by the copy above, so there's always room for the terminator
+                framer->sysex[framer->sysex_len++] = buf[i++];
+                if (platform_midi_framer_flush_sysex(framer, fn, ctx))
+                {
+                    return i;
+                }
+                continue;
+            }
+
+            // Any other status byte ends the SysEx without a terminator, then gets handled normally
+            if (platform_midi_framer_flush_sysex(framer, fn, ctx))
+            {
+                return i;
+            }
+            continue;
+        }
+
+        unsigned char b = buf[i];
+
+        if (b & 0x80)
+        {
+            i++;
+
+            if (b >= 0xF8)
+            {
+                // Realtime messages don't interrupt the message being collected
+                if (fn(ctx, &b, 1))
+                {
+                    return i;
+                }
+                continue;
+            }
+
+            framer->count = 0;
+
+            if (b == 0xF0)
+            {
+                framer->status = 0;
+                framer->in_sysex = 1;
+                framer->sysex[0] = b;
+                framer->sysex_len = 1;
+                continue;
+            }
+
+            if (b == 0xF7)
+            {
+                // Stray terminator
+                framer->status = 0;
+                continue;
+            }
+
+            framer->needed = platform_midi_msg_length(b) - 1;
+            framer->status = b;
+
+            if (framer->needed == 0)
+            {
+                framer->status = 0;
+                if (fn(ctx, &b, 1))
+                {
+                    return i;
+                }
+            }
+            continue;
+        }
+
+        if (!framer->status)
+        {
+            // Data byte without a status, drop everything up to the next status byte
+            i += platform_midi_scan_status(buf + i, len - i);
+            continue;
+        }
+
+        // Split the run of data bytes into messages using the running status
+        size_t next = i + platform_midi_scan_status(buf + i, len - i);
+
+        while (i < next)
+        {
+            framer->data[framer->count++] = buf[i++];
+
+            if (framer->count == framer->needed)
+            {
+                unsigned char msg[3] = { framer->status, framer->data[0], framer->data[1] };
+
+                framer->count = 0;
+                if (framer->status >= 0xF0)
+                {
+                    // System common messages cancel running status, so the rest of the run is stray
+                    framer->status = 0;
+                    if (fn(ctx, msg, framer->needed + 1))
+                    {
+                        return i;
+                    }
+                    i = next;
+                    break;
+                }
+
+                if (fn(ctx, msg, framer->needed + 1))
+                {
+                    return i;
+                }
+            }
+        }
+    }
+
+    return len;
+}
+
+#endif
+
+#endif
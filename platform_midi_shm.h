@@ -0,0 +1,698 @@
+#ifndef _PLATFORM_MIDI_SHM_H_
+#define _PLATFORM_MIDI_SHM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Shared-memory backend for passing MIDI between processes on the same host
+ *
+ * Each ring is a named POSIX shared memory object with exactly one writer and any
+ * number of readers. Readers keep their own position, so a slow reader never holds
+ * up the writer or the other readers; if it falls a whole ring behind it loses the
+ * overwritten messages and its next read returns -1.
+ *
+ * Writers publish with a single atomic store and only make a futex syscall when a
+ * reader is actually sleeping in platform_midi_shm_wait(). A blocking driver's
+ * platform_midi_read() sleeps there too. platform_midi_fds() gives an eventfd for
+ * poll() or epoll, signalled by a thread that sleeps on the futex for this reader,
+ * so once it's asked for the writer always makes the syscall.
+ *
+ * A ring's writer holds an flock() on it, so another can only take over once the
+ * first has closed it or exited, whichever PID namespace either is in.
+ */
+
+// Default ring size in bytes for rings this process creates, must be a power of two
+#ifndef PLATFORM_MIDI_SHM_SIZE
+#define PLATFORM_MIDI_SHM_SIZE 65536
+#endif
+
+// How many times platform_midi_shm_wait() checks for input before sleeping on the futex
+#ifndef PLATFORM_MIDI_SHM_SPIN
+#define PLATFORM_MIDI_SHM_SPIN 1000
+#endif
+
+struct platform_midi_shm_options
+{
+    // Name of the ring to read from, or NULL to only write
+    const char *input;
+    // Name of the ring to write to, or NULL to only read
+    const char *output;
+    // Size in bytes of any ring that has to be created, 0 for the common queue_size or else PLATFORM_MIDI_SHM_SIZE
+    unsigned int size;
+};
+
+// Set options->shm to a struct platform_midi_shm_options, or leave it NULL to write to a ring named after the client
+struct platform_midi_driver *platform_midi_init_shm(const char *name, const struct platform_midi_options *options);
+void platform_midi_deinit_shm(struct platform_midi_driver *driver);
+int platform_midi_read_shm(struct platform_midi_driver *driver, unsigned char *out, int size);
+int platform_midi_avail_shm(struct platform_midi_driver *driver);
+int platform_midi_write_shm(struct platform_midi_driver *driver, const unsigned char *buf, int size);
+int platform_midi_fds_shm(struct platform_midi_driver *driver, int *fds, int max);
+
+// Blocks until input is available or timeoutMs passes (-1 waits forever).
+// Returns 1 if input is available, 0 on timeout
+int platform_midi_shm_wait(struct platform_midi_driver *driver, int timeoutMs);
+
+// Removes a ring's name, it is freed once every process has closed it
+int platform_midi_shm_unlink(const char *name);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define PLATFORM_MIDI_SHM_MAGIC 0x504D5348
+#define PLATFORM_MIDI_SHM_VERSION 1
+
+#define PLATFORM_MIDI_SHM_UNINIT 0
+#define PLATFORM_MIDI_SHM_INITIALIZING 1
+#define PLATFORM_MIDI_SHM_READY 2
+
+// Records are a 4-byte length followed by the message, padded to 4 bytes
+#define PLATFORM_MIDI_SHM_ALIGN(x) (((x) + 3) & ~3u)
+
+struct platform_midi_shm_ring
+{
+    unsigned int state;
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;
+    // The current writer's pid in its own namespace, only for messages; ownership is the flock
+    int writer_pid;
+
+    // Written by the writer on every write, kept away from the reader-written fields
+    unsigned long long write_reserve __attribute__((aligned(64)));
+    unsigned long long write_pos;
+    unsigned int wake_seq;
+
+    unsigned int waiters __attribute__((aligned(64)));
+
+    unsigned char data[] __attribute__((aligned(64)));
+};
+
+struct platform_midi_shm_driver
+{
+    platform_midi_deinit_fn deinitFn;
+    platform_midi_avail_fn availFn;
+    platform_midi_read_fn readFn;
+    platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
+    void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    unsigned int read_time;
+
+    struct platform_midi_shm_ring *in_ring;
+    size_t in_map_size;
+    unsigned long long read_pos;
+
+    struct platform_midi_shm_ring *out_ring;
+    size_t out_map_size;
+    // Kept open while writing, holding the writer's flock
+    int out_fd;
+
+    // Signalled by the bridge thread when the input ring has new messages, once platform_midi_fds() asks for it
+    int event_fd;
+    pthread_t bridge;
+    unsigned long long bridge_pos;
+    int bridge_stop;
+};
+
+static long platform_midi_shm_futex(unsigned int *addr, int op, unsigned int val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static void platform_midi_shm_path(char *out, size_t size, const char *name)
+{
+    snprintf(out, size, "/platform_midi-%s", name);
+}
+
+// Opens or creates a ring and maps it, returning NULL on failure. If fdOut isn't NULL the
+// descriptor is left open and stored there, otherwise it's closed once mapped
+static struct platform_midi_shm_ring *platform_midi_shm_attach(const char *name, unsigned int size, size_t *mapSize, int *fdOut)
+{
+    char path[256];
+    struct stat st;
+
+    if (size == 0)
+    {
+        size = PLATFORM_MIDI_SHM_SIZE;
+    }
+
+    if (size < 256 || (size & (size - 1)))
+    {
+        printf("Shared memory ring size must be a power of two of at least 256, not %u\n", size);
+        return NULL;
+    }
+
+    platform_midi_shm_path(path, sizeof(path), name);
+
+    // Only the process that creates the object sizes it, so nobody can shrink it under someone else's mapping
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+    {
+        if (0 != ftruncate(fd, sizeof(struct platform_midi_shm_ring) + size))
+        {
+            printf("Failed to size shared memory %s: %s\n", path, strerror(errno));
+            close(fd);
+            shm_unlink(path);
+            return NULL;
+        }
+    }
+    else if (errno == EEXIST)
+    {
+        fd = shm_open(path, O_RDWR, 0600);
+    }
+
+    if (fd < 0)
+    {
+        printf("Failed to open shared memory %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    // Someone else created it, wait for them to size it
+    for (int tries = 0; ; tries++)
+    {
+        if (0 != fstat(fd, &st))
+        {
+            printf("Failed to stat shared memory %s: %s\n", path, strerror(errno));
+            close(fd);
+            return NULL;
+        }
+
+        if (st.st_size != 0 || tries == 1000)
+        {
+            break;
+        }
+
+        struct timespec ts = { 0, 1000000 };
+        nanosleep(&ts, NULL);
+    }
+
+    if ((size_t)st.st_size < sizeof(struct platform_midi_shm_ring) + 256)
+    {
+        printf("Shared memory %s is too small\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+        printf("Failed to map shared memory %s: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    struct platform_midi_shm_ring *ring = (struct platform_midi_shm_ring*)map;
+    unsigned int state = PLATFORM_MIDI_SHM_UNINIT;
+
+    if (__atomic_compare_exchange_n(&ring->state, &state, PLATFORM_MIDI_SHM_INITIALIZING, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+        unsigned int dataSize = st.st_size - sizeof(struct platform_midi_shm_ring);
+
+        // Round down to a power of two in case the object was sized by someone else
+        while (dataSize & (dataSize - 1))
+        {
+            dataSize &= dataSize - 1;
+        }
+
+        ring->magic = PLATFORM_MIDI_SHM_MAGIC;
+        ring->version = PLATFORM_MIDI_SHM_VERSION;
+        ring->size = dataSize;
+        ring->writer_pid = 0;
+        ring->write_reserve = 0;
+        ring->write_pos = 0;
+        ring->wake_seq = 0;
+        ring->waiters = 0;
+        __atomic_store_n(&ring->state, PLATFORM_MIDI_SHM_READY, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        while (__atomic_load_n(&ring->state, __ATOMIC_ACQUIRE) != PLATFORM_MIDI_SHM_READY)
+        {
+            sched_yield();
+        }
+    }
+
+    if (ring->magic != PLATFORM_MIDI_SHM_MAGIC || ring->version != PLATFORM_MIDI_SHM_VERSION)
+    {
+        printf("Shared memory %s is not a compatible MIDI ring\n", path);
+        munmap(map, st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    if (fdOut)
+    {
+        *fdOut = fd;
+    }
+    else
+    {
+        close(fd);
+    }
+
+    *mapSize = st.st_size;
+    return ring;
+}
+
+struct platform_midi_driver *platform_midi_init_shm(const char *name, const struct platform_midi_options *options)
+{
+    struct platform_midi_shm_options shmOptions = { NULL, name, 0 };
+
+    if (options && options->shm)
+    {
+        shmOptions = *options->shm;
+    }
+
+    if (!shmOptions.size && options)
+    {
+        shmOptions.size = options->queue_size;
+    }
+
+    void *alloc = malloc(sizeof(struct platform_midi_shm_driver));
+
+    if (!alloc)
+    {
+        printf("Failed to allocate driver struct\n");
+        return NULL;
+    }
+
+    struct platform_midi_shm_driver *shm_driver = (struct platform_midi_shm_driver*)alloc;
+    shm_driver->deinitFn = platform_midi_deinit_shm;
+    shm_driver->availFn = platform_midi_avail_shm;
+    shm_driver->readFn = platform_midi_read_shm;
+    shm_driver->writeFn = platform_midi_write_shm;
+    shm_driver->fdsFn = platform_midi_fds_shm;
+    shm_driver->readEventsFn = NULL;
+    shm_driver->writeEventsFn = NULL;
+    shm_driver->readUmpFn = NULL;
+    shm_driver->writeUmpFn = NULL;
+    shm_driver->writeMultiFn = NULL;
+    shm_driver->data = options ? options->user_data : NULL;
+    shm_driver->taps = NULL;
+    shm_driver->blocking = options ? options->blocking : 0;
+    shm_driver->stream_out = 0;
+    platform_midi_realtime_init(&shm_driver->realtime_out);
+    shm_driver->read_held = NULL;
+    shm_driver->read_held_len = 0;
+    shm_driver->read_held_capacity = 0;
+    shm_driver->read_held_time = 0;
+    shm_driver->read_time = 0;
+
+    shm_driver->in_ring = NULL;
+    shm_driver->in_map_size = 0;
+    shm_driver->read_pos = 0;
+    shm_driver->out_ring = NULL;
+    shm_driver->out_map_size = 0;
+    shm_driver->out_fd = -1;
+    shm_driver->event_fd = -1;
+    shm_driver->bridge_pos = 0;
+    shm_driver->bridge_stop = 0;
+
+    if (shmOptions.output)
+    {
+        shm_driver->out_ring = platform_midi_shm_attach(shmOptions.output, shmOptions.size, &shm_driver->out_map_size, &shm_driver->out_fd);
+        if (!shm_driver->out_ring)
+        {
+            platform_midi_deinit_shm((struct platform_midi_driver*)shm_driver);
+            return NULL;
+        }
+
+        // The kernel drops the lock if the writer dies, so a crashed writer never blocks the ring
+        if (0 != flock(shm_driver->out_fd, LOCK_EX | LOCK_NB))
+        {
+            printf("Shared memory ring %s already has a writer (pid %d)\n", shmOptions.output,
+                   __atomic_load_n(&shm_driver->out_ring->writer_pid, __ATOMIC_ACQUIRE));
+            munmap(shm_driver->out_ring, shm_driver->out_map_size);
+            shm_driver->out_ring = NULL;
+            platform_midi_deinit_shm((struct platform_midi_driver*)shm_driver);
+            return NULL;
+        }
+
+        __atomic_store_n(&shm_driver->out_ring->writer_pid, getpid(), __ATOMIC_RELEASE);
+    }
+
+    if (shmOptions.input)
+    {
+        shm_driver->in_ring = platform_midi_shm_attach(shmOptions.input, shmOptions.size, &shm_driver->in_map_size, NULL);
+        if (!shm_driver->in_ring)
+        {
+            platform_midi_deinit_shm((struct platform_midi_driver*)shm_driver);
+            return NULL;
+        }
+
+        // Only see messages written from now on
+        shm_driver->read_pos = __atomic_load_n(&shm_driver->in_ring->write_pos, __ATOMIC_ACQUIRE);
+    }
+
+    return (struct platform_midi_driver*)shm_driver;
+}
+
+void platform_midi_deinit_shm(struct platform_midi_driver *driver)
+{
+    struct platform_midi_shm_driver *shm_driver = (struct platform_midi_shm_driver*)driver;
+
+    if (shm_driver->out_ring)
+    {
+        __atomic_store_n(&shm_driver->out_ring->writer_pid, 0, __ATOMIC_RELEASE);
+        munmap(shm_driver->out_ring, shm_driver->out_map_size);
+    }
+
+    if (shm_driver->out_fd >= 0)
+    {
+        // Releases the writer's lock
+        close(shm_driver->out_fd);
+    }
+
+    if (shm_driver->event_fd >= 0)
+    {
+        // Wake the bridge thread; anyone else sleeping on the ring just finds nothing new
+        __atomic_store_n(&shm_driver->bridge_stop, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&shm_driver->in_ring->wake_seq, 1, __ATOMIC_SEQ_CST);
+        platform_midi_shm_futex(&shm_driver->in_ring->wake_seq, FUTEX_WAKE, INT_MAX, NULL);
+        pthread_join(shm_driver->bridge, NULL);
+        close(shm_driver->event_fd);
+    }
+
+    if (shm_driver->in_ring)
+    {
+        munmap(shm_driver->in_ring, shm_driver->in_map_size);
+    }
+
+    free(shm_driver);
+}
+
+static void platform_midi_shm_copy_out(const struct platform_midi_shm_ring *ring, unsigned long long pos, unsigned char *out, unsigned int len)
+{
+    unsigned int offset = pos & (ring->size - 1);
+    unsigned int first = (offset + len <= ring->size) ? len : ring->size - offset;
+
+    memcpy(out, &ring->data[offset], first);
+    memcpy(out + first, ring->data, len - first);
+}
+
+static void platform_midi_shm_copy_in(struct platform_midi_shm_ring *ring, unsigned long long pos, const unsigned char *in, unsigned int len)
+{
+    unsigned int offset = pos & (ring->size - 1);
+    unsigned int first = (offset + len <= ring->size) ? len : ring->size - offset;
+
+    memcpy(&ring->data[offset], in, first);
+    memcpy(ring->data, in + first, len - first);
+}
+
+// Returns non-zero if the writer may have overwritten anything from pos onward
+static int platform_midi_shm_overrun(const struct platform_midi_shm_ring *ring, unsigned long long pos)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&ring->write_reserve, __ATOMIC_RELAXED) - pos > ring->size;
+}
+
+int platform_midi_read_shm(struct platform_midi_driver *driver, unsigned char *out, int size)
+{
+    struct platform_midi_shm_driver *shm_driver = (struct platform_midi_shm_driver*)driver;
+    struct platform_midi_shm_ring *ring = shm_driver->in_ring;
+
+    if (!ring)
+    {
+        return 0;
+    }
+
+    unsigned long long pos = shm_driver->read_pos;
+    unsigned long long end = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+
+    if (pos == end && shm_driver->event_fd >= 0)
+    {
+        // Clear the eventfd before looking again, so a write after that look signals it afresh
+        uint64_t count;
+        if (read(shm_driver->event_fd, &count, sizeof(count)) > 0)
+        {
+            end = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    // Sleep on the futex rather than in platform_midi_read()'s fallback
+    while (pos == end && shm_driver->blocking)
+    {
+        platform_midi_shm_wait(driver, -1);
+        end = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+    }
+
+    if (pos == end)
+    {
+        return 0;
+    }
+
+    unsigned int length;
+    platform_midi_shm_copy_out(ring, pos, (unsigned char*)&length, sizeof(length));
+
+    if (platform_midi_shm_overrun(ring, pos) || length > ring->size)
+    {
+        printf("Err: shared memory reader overrun, messages were lost\n");
+        shm_driver->read_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+        return -1;
+    }
+
+    int toCopy = (size < (int)length) ? size : (int)length;
+    platform_midi_shm_copy_out(ring, pos + sizeof(length), out, toCopy);
+
+    // The writer could have lapped us while we were copying
+    if (platform_midi_shm_overrun(ring, pos))
+    {
+        printf("Err: shared memory reader overrun, messages were lost\n");
+        shm_driver->read_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+        return -1;
+    }
+
+    shm_driver->read_pos = pos + sizeof(length) + PLATFORM_MIDI_SHM_ALIGN(length);
+    return toCopy;
+}
+
+int platform_midi_avail_shm(struct platform_midi_driver *driver)
+{
+    struct platform_midi_shm_driver *shm_driver = (struct platform_midi_shm_driver*)driver;
+    struct platform_midi_shm_ring *ring = shm_driver->in_ring;
+    int count = 0;
+
+    if (!ring)
+    {
+        return 0;
+    }
+
+    unsigned long long pos = shm_driver->read_pos;
+    unsigned long long end = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+
+    while (pos < end)
+    {
+        unsigned int length;
+        platform_midi_shm_copy_out(ring, pos, (unsigned char*)&length, sizeof(length));
+
+        if (platform_midi_shm_overrun(ring, pos))
+        {
+            // The next read will report the overrun
+            return count + 1;
+        }
+
+        pos += sizeof(length) + PLATFORM_MIDI_SHM_ALIGN(length);
+        count++;
+    }
+
+    return count;
+}
+
+int platform_midi_write_shm(struct platform_midi_driver *driver, const unsigned char *buf, int size)
+{
+    struct platform_midi_shm_driver *shm_driver = (struct platform_midi_shm_driver*)driver;
+    struct platform_midi_shm_ring *ring = shm_driver->out_ring;
+
+    if (!ring)
+    {
+        printf("Err: shared memory driver has no output ring\n");
+        return -1;
+    }
+
+    unsigned long long pos = ring->write_pos;
+    int written = 0;
+
+    while (written < size)
+    {
+        unsigned int length = platform_midi_next_message(buf + written, size - written);
+        unsigned int recordSize = sizeof(length) + PLATFORM_MIDI_SHM_ALIGN(length);
+
+        if (recordSize > ring->size / 2)
+        {
+            printf("Err: %u byte message is too large for the shared memory ring\n", length);
+            break;
+        }
+
+        // Tell readers which bytes are about to change before changing them
+        __atomic_store_n(&ring->write_reserve, pos + recordSize, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        platform_midi_shm_copy_in(ring, pos, (const unsigned char*)&length, sizeof(length));
+        platform_midi_shm_copy_in(ring, pos + sizeof(length), buf + written, length);
+
+        pos += recordSize;
+        written += length;
+    }
+
+    if (written == 0)
+    {
+        return -1;
+    }
+
+    // Publish everything at once, and only pay for a syscall if someone is asleep
+    __atomic_store_n(&ring->write_pos, pos, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&ring->wake_seq, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ring->waiters, __ATOMIC_SEQ_CST))
+    {
+        platform_midi_shm_futex(&ring->wake_seq, FUTEX_WAKE, INT_MAX, NULL);
+    }
+
+    return written;
+}
+
+int platform_midi_shm_wait(struct platform_midi_driver *driver, int timeoutMs)
+{
+    struct platform_midi_shm_driver *shm_driver = (struct platform_midi_shm_driver*)driver;
+    struct platform_midi_shm_ring *ring = shm_driver->in_ring;
+    struct timespec timeout;
+
+    if (!ring)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < PLATFORM_MIDI_SHM_SPIN; i++)
+    {
+        if (__atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE) != shm_driver->read_pos)
+        {
+            return 1;
+        }
+    }
+
+    if (timeoutMs >= 0)
+    {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    }
+
+    unsigned int seq = __atomic_load_n(&ring->wake_seq, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+
+    // Re-check after registering, or a write in between could be missed
+    if (__atomic_load_n(&ring->write_pos, __ATOMIC_SEQ_CST) == shm_driver->read_pos)
+    {
+        platform_midi_shm_futex(&ring->wake_seq, FUTEX_WAIT, seq, (timeoutMs >= 0) ? &timeout : NULL);
+    }
+
+    __atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE) != shm_driver->read_pos;
+}
+
+// Turns futex wake-ups on the input ring into eventfd signals, for poll() and epoll
+static void *platform_midi_shm_bridge(void *arg)
+{
+    struct platform_midi_shm_driver *shm_driver = (struct platform_midi_shm_driver*)arg;
+    struct platform_midi_shm_ring *ring = shm_driver->in_ring;
+    unsigned long long signalled = shm_driver->bridge_pos;
+
+    // Registered for as long as the thread runs, so every write wakes it
+    __atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+
+    while (!__atomic_load_n(&shm_driver->bridge_stop, __ATOMIC_SEQ_CST))
+    {
+        unsigned int seq = __atomic_load_n(&ring->wake_seq, __ATOMIC_SEQ_CST);
+        unsigned long long end = __atomic_load_n(&ring->write_pos, __ATOMIC_SEQ_CST);
+
+        if (end != signalled)
+        {
+            uint64_t one = 1;
+            signalled = end;
+            if (write(shm_driver->event_fd, &one, sizeof(one)) < 0)
+            {
+                // Only fails if the counter is saturated, which is still readable
+            }
+            continue;
+        }
+
+        platform_midi_shm_futex(&ring->wake_seq, FUTEX_WAIT, seq, NULL);
+    }
+
+    __atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+int platform_midi_fds_shm(struct platform_midi_driver *driver, int *fds, int max)
+{
+    struct platform_midi_shm_driver *shm_driver = (struct platform_midi_shm_driver*)driver;
+
+    if (!shm_driver->in_ring || max < 1)
+    {
+        return 0;
+    }
+
+    // Nothing to signal until someone wants to poll
+    if (shm_driver->event_fd < 0)
+    {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0)
+        {
+            printf("Failed to create shared memory eventfd: %s\n", strerror(errno));
+            return 0;
+        }
+
+        shm_driver->event_fd = fd;
+        shm_driver->bridge_pos = shm_driver->read_pos;
+        if (0 != pthread_create(&shm_driver->bridge, NULL, platform_midi_shm_bridge, shm_driver))
+        {
+            printf("Failed to start shared memory wake-up thread\n");
+            close(fd);
+            shm_driver->event_fd = -1;
+            return 0;
+        }
+    }
+
+    fds[0] = shm_driver->event_fd;
+    return 1;
+}
+
+int platform_midi_shm_unlink(const char *name)
+{
+    char path[256];
+    platform_midi_shm_path(path, sizeof(path), name);
+
+    return shm_unlink(path);
+}
+#endif
+
+#endif
@@ -0,0 +1,514 @@
+#ifndef _PLATFORM_MIDI_STATE_H_
+#define _PLATFORM_MIDI_STATE_H_
+
+#include "platform_midi.h"
+#include "platform_midi_scan.h"
+
+/*
+ * platform_midi_state.h
+ *
+ * Incrementally tracks per-channel MIDI state (held notes, controllers, program,
+ * pitch bend, channel pressure, RPN/NRPN) as messages pass through a driver.
+ *
+ * All queries are O(1) array lookups. A snapshot is a plain struct copy, and
+ * platform_midi_state_diff() produces the messages needed to go from one snapshot
+ * to another.
+ *
+ * The tracker is not synchronized; query it from the thread that reads/writes the driver.
+ */
+
+#define PLATFORM_MIDI_STATE_CHANNELS 16
+
+// Number of registered parameters tracked per channel:
+// pitch bend sensitivity, fine tuning, coarse tuning, tuning program, tuning bank, modulation depth
+#define PLATFORM_MIDI_STATE_RPNS 6
+
+// Value of an RPN/NRPN selector when no parameter is selected
+#define PLATFORM_MIDI_STATE_PARAM_NULL 0x3FFF
+
+struct platform_midi_state_parser
+{
+    unsigned char status;
+    unsigned char count;
+    unsigned char needed;
+    unsigned char in_sysex;
+    unsigned char data[2];
+};
+
+struct platform_midi_state
+{
+    // Held notes, one bit per note
+    unsigned int notes[PLATFORM_MIDI_STATE_CHANNELS][4];
+    unsigned char cc[PLATFORM_MIDI_STATE_CHANNELS][128];
+    unsigned short pitch_bend[PLATFORM_MIDI_STATE_CHANNELS];
+    // Currently selected RPN and NRPN, or PLATFORM_MIDI_STATE_PARAM_NULL
+    unsigned short rpn[PLATFORM_MIDI_STATE_CHANNELS];
+    unsigned short nrpn[PLATFORM_MIDI_STATE_CHANNELS];
+    unsigned short rpn_values[PLATFORM_MIDI_STATE_CHANNELS][PLATFORM_MIDI_STATE_RPNS];
+    // Value of the most recently selected NRPN
+    unsigned short nrpn_value[PLATFORM_MIDI_STATE_CHANNELS];
+    unsigned char program[PLATFORM_MIDI_STATE_CHANNELS];
+    unsigned char pressure[PLATFORM_MIDI_STATE_CHANNELS];
+    // Non-zero if data entry currently applies to the NRPN rather than the RPN
+    unsigned char nrpn_active[PLATFORM_MIDI_STATE_CHANNELS];
+
+    // Bitmask of channels modified since the last snapshot
+    unsigned int changed;
+
+    // One parser per direction, so input and output may be tracked by the same state
+    struct platform_midi_state_parser parsers[2];
+    struct platform_midi_tap tap;
+};
+
+void platform_midi_state_init(struct platform_midi_state *state);
+void platform_midi_state_update(struct platform_midi_state *state, const unsigned char *buf, int size);
+
+void platform_midi_state_attach(struct platform_midi_state *state, struct platform_midi_driver *driver, int directions);
+void platform_midi_state_detach(struct platform_midi_state *state, struct platform_midi_driver *driver);
+
+void platform_midi_state_snapshot(struct platform_midi_state *state, struct platform_midi_state *out);
+int platform_midi_state_diff(const struct platform_midi_state *from, const struct platform_midi_state *to, unsigned char *out, int size);
+// Returns the number of Note Offs sent, or -1 if a write failed. Notes not turned off stay held
+int platform_midi_state_all_notes_off(struct platform_midi_state *state, struct platform_midi_driver *driver);
+
+static inline int platform_midi_state_note_held(const struct platform_midi_state *state, unsigned char channel, unsigned char note)
+{
+    return (state->notes[channel & 0x0F][(note & 0x7F) >> 5] >> (note & 0x1F)) & 1;
+}
+
+static inline unsigned char platform_midi_state_cc(const struct platform_midi_state *state, unsigned char channel, unsigned char cc)
+{
+    return state->cc[channel & 0x0F][cc & 0x7F];
+}
+
+static inline unsigned char platform_midi_state_program(const struct platform_midi_state *state, unsigned char channel)
+{
+    return state->program[channel & 0x0F];
+}
+
+static inline unsigned short platform_midi_state_pitch_bend(const struct platform_midi_state *state, unsigned char channel)
+{
+    return state->pitch_bend[channel & 0x0F];
+}
+
+static inline unsigned char platform_midi_state_pressure(const struct platform_midi_state *state, unsigned char channel)
+{
+    return state->pressure[channel & 0x0F];
+}
+
+// Returns the 14-bit value of a tracked RPN, or -1 if the parameter is not tracked
+static inline int platform_midi_state_rpn(const struct platform_midi_state *state, unsigned char channel, unsigned short param)
+{
+    return (param < PLATFORM_MIDI_STATE_RPNS) ? state->rpn_values[channel & 0x0F][param] : -1;
+}
+
+// Returns the 14-bit value of the currently selected NRPN, or -1 if it is not the given parameter
+static inline int platform_midi_state_nrpn(const struct platform_midi_state *state, unsigned char channel, unsigned short param)
+{
+    return (state->nrpn[channel & 0x0F] == param) ? state->nrpn_value[channel & 0x0F] : -1;
+}
+
+static inline int platform_midi_state_held_count(const struct platform_midi_state *state, unsigned char channel)
+{
+    const unsigned int *bits = state->notes[channel & 0x0F];
+    return __builtin_popcount(bits[0]) + __builtin_popcount(bits[1]) + __builtin_popcount(bits[2]) + __builtin_popcount(bits[3]);
+}
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+static void platform_midi_state_reset_channel(struct platform_midi_state *state, unsigned char ch)
+{
+    memset(state->notes[ch], 0, sizeof(state->notes[ch]));
+    memset(state->cc[ch], 0, sizeof(state->cc[ch]));
+    state->pitch_bend[ch] = 0x2000;
+    state->rpn[ch] = PLATFORM_MIDI_STATE_PARAM_NULL;
+    state->nrpn[ch] = PLATFORM_MIDI_STATE_PARAM_NULL;
+    memset(state->rpn_values[ch], 0, sizeof(state->rpn_values[ch]));
+    state->nrpn_value[ch] = 0;
+    state->program[ch] = 0;
+    state->pressure[ch] = 0;
+    state->nrpn_active[ch] = 0;
+}
+
+void platform_midi_state_init(struct platform_midi_state *state)
+{
+    memset(state, 0, sizeof(*state));
+
+    for (unsigned char ch = 0; ch < PLATFORM_MIDI_STATE_CHANNELS; ch++)
+    {
+        platform_midi_state_reset_channel(state, ch);
+    }
+}
+
+// Applies a 7-bit data entry byte to the selected RPN/NRPN. msb selects the coarse half
+static void platform_midi_state_data_entry(struct platform_midi_state *state, unsigned char ch, int msb, unsigned char value)
+{
+    unsigned short *target = NULL;
+
+    if (state->nrpn_active[ch])
+    {
+        if (state->nrpn[ch] != PLATFORM_MIDI_STATE_PARAM_NULL)
+        {
+            target = &state->nrpn_value[ch];
+        }
+    }
+    else if (state->rpn[ch] < PLATFORM_MIDI_STATE_RPNS)
+    {
+        target = &state->rpn_values[ch][state->rpn[ch]];
+    }
+
+    if (target)
+    {
+        *target = msb ? ((value << 7) | (*target & 0x7F)) : ((*target & 0x3F80) | value);
+    }
+}
+
+static void platform_midi_state_controller(struct platform_midi_state *state, unsigned char ch, unsigned char cc, unsigned char value)
+{
+    state->cc[ch][cc] = value;
+
+    switch (cc)
+    {
+        case 6: // Data Entry MSB
+        case 38: // Data Entry LSB
+            platform_midi_state_data_entry(state, ch, cc == 6, value);
+            break;
+
+        case 98: // NRPN LSB
+        case 99: // NRPN MSB
+        {
+            unsigned short nrpn = (cc == 99) ? ((value << 7) | (state->nrpn[ch] & 0x7F)) : ((state->nrpn[ch] & 0x3F80) | value);
+
+            // Only the selected NRPN's value is tracked
+            if (nrpn != state->nrpn[ch])
+            {
+                state->nrpn[ch] = nrpn;
+                state->nrpn_value[ch] = 0;
+            }
+            state->nrpn_active[ch] = 1;
+            break;
+        }
+
+        case 100: // RPN LSB
+            state->rpn[ch] = (state->rpn[ch] & 0x3F80) | value;
+            state->nrpn_active[ch] = 0;
+            break;
+
+        case 101: // RPN MSB
+            state->rpn[ch] = (value << 7) | (state->rpn[ch] & 0x7F);
+            state->nrpn_active[ch] = 0;
+            break;
+
+        case 121: // Reset All Controllers, per RP-015
+            state->cc[ch][1] = 0;
+            state->cc[ch][11] = 127;
+            memset(&state->cc[ch][64], 0, 4);
+            state->cc[ch][121] = 0;
+            state->pitch_bend[ch] = 0x2000;
+            state->pressure[ch] = 0;
+            state->rpn[ch] = PLATFORM_MIDI_STATE_PARAM_NULL;
+            state->nrpn[ch] = PLATFORM_MIDI_STATE_PARAM_NULL;
+            break;
+
+        case 123: // All Notes Off
+        case 124: // Omni Off
+        case 125: // Omni On
+        case 126: // Mono On
+        case 127: // Poly On
+            memset(state->notes[ch], 0, sizeof(state->notes[ch]));
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void platform_midi_state_apply(struct platform_midi_state *state, unsigned char status, const unsigned char *data)
+{
+    unsigned char ch = status & 0x0F;
+
+    switch (status & 0xF0)
+    {
+        case 0x90: // Note On
+            if (data[1])
+            {
+                state->notes[ch][data[0] >> 5] |= (1u << (data[0] & 0x1F));
+                break;
+            }
+            // Note On with velocity 0 is a Note Off
+            // fall through
+        case 0x80: // Note Off
+            state->notes[ch][data[0] >> 5] &= ~(1u << (data[0] & 0x1F));
+            break;
+
+        case 0xB0: // Controller
+            platform_midi_state_controller(state, ch, data[0], data[1]);
+            break;
+
+        case 0xC0: // Program Select
+            state->program[ch] = data[0];
+            break;
+
+        case 0xD0: // Channel Pressure
+            state->pressure[ch] = data[0];
+            break;
+
+        case 0xE0: // Pitch Wheel
+            state->pitch_bend[ch] = (data[1] << 7) | data[0];
+            break;
+
+        default:
+            // Poly aftertouch and system messages do not affect the tracked state
+            return;
+    }
+
+    state->changed |= (1u << ch);
+}
+
+static void platform_midi_state_feed(struct platform_midi_state *state, struct platform_midi_state_parser *parser, const unsigned char *buf, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        unsigned char b = buf[i];
+
+        if (b >= 0xF8)
+        {
+            // Realtime messages may appear anywhere and don't affect running status
+            continue;
+        }
+
+        if (b & 0x80)
+        {
+            parser->in_sysex = (b == 0xF0);
+            parser->count = 0;
+
+            if (b == 0xF0 || b == 0xF7)
+            {
+                parser->status = 0;
+                continue;
+            }
+
+            parser->status = b;
+            parser->needed = platform_midi_msg_length(b) - 1;
+
+            if (parser->needed == 0)
+            {
+                // Single-byte system common message, nothing to track
+                parser->status = 0;
+            }
+            continue;
+        }
+
+        if (parser->in_sysex || !parser->status)
+        {
+            // Skip the rest of the SysEx payload or stray data in one go
+            i += platform_midi_scan_status(buf + i + 1, size - i - 1);
+            continue;
+        }
+
+        parser->data[parser->count++] = b;
+        if (parser->count == parser->needed)
+        {
+            platform_midi_state_apply(state, parser->status, parser->data);
+            parser->count = 0;
+
+            if (parser->status >= 0xF0)
+            {
+                // System common messages cancel running status
+                parser->status = 0;
+            }
+        }
+    }
+}
+
+void platform_midi_state_update(struct platform_midi_state *state, const unsigned char *buf, int size)
+{
+    platform_midi_state_feed(state, &state->parsers[0], buf, size);
+}
+
+static void platform_midi_state_tap_fn(void *ctx, int direction, const unsigned char *buf, int size)
+{
+    struct platform_midi_state *state = (struct platform_midi_state*)ctx;
+    platform_midi_state_feed(state, &state->parsers[(direction == PLATFORM_MIDI_TAP_OUTPUT) ? 1 : 0], buf, size);
+}
+
+void platform_midi_state_attach(struct platform_midi_state *state, struct platform_midi_driver *driver, int directions)
+{
+    state->tap.fn = platform_midi_state_tap_fn;
+    state->tap.ctx = state;
+    state->tap.directions = directions;
+    platform_midi_add_tap(driver, &state->tap);
+}
+
+void platform_midi_state_detach(struct platform_midi_state *state, struct platform_midi_driver *driver)
+{
+    platform_midi_remove_tap(driver, &state->tap);
+}
+
+void platform_midi_state_snapshot(struct platform_midi_state *state, struct platform_midi_state *out)
+{
+    memcpy(out, state, sizeof(*state));
+    out->tap.next = NULL;
+    state->changed = 0;
+}
+
+// Appends a message to out if it fits, returning the new write position or -1 when full
+static int platform_midi_state_emit(unsigned char *out, int pos, int size, unsigned char status, unsigned char d1, unsigned char d2)
+{
+    int len = (int)platform_midi_msg_length(status);
+
+    if (pos + len > size)
+    {
+        return -1;
+    }
+
+    out[pos++] = status;
+    if (len > 1) out[pos++] = d1;
+    if (len > 2) out[pos++] = d2;
+
+    return pos;
+}
+
+#define PLATFORM_MIDI_STATE_EMIT(status, d1, d2) \
+    do { \
+        int next = platform_midi_state_emit(out, pos, size, (status), (d1), (d2)); \
+        if (next < 0) return pos; \
+        pos = next; \
+    } while (0)
+
+int platform_midi_state_diff(const struct platform_midi_state *from, const struct platform_midi_state *to, unsigned char *out, int size)
+{
+    int pos = 0;
+
+    for (unsigned char ch = 0; ch < PLATFORM_MIDI_STATE_CHANNELS; ch++)
+    {
+        int params = 0;
+
+        if (0 != memcmp(from->notes[ch], to->notes[ch], sizeof(to->notes[ch])))
+        {
+            for (int word = 0; word < 4; word++)
+            {
+                unsigned int changed = from->notes[ch][word] ^ to->notes[ch][word];
+
+                while (changed)
+                {
+                    int bit = __builtin_ctz(changed);
+                    unsigned char note = (word << 5) | bit;
+                    int on = (to->notes[ch][word] >> bit) & 1;
+
+                    PLATFORM_MIDI_STATE_EMIT((on ? 0x90 : 0x80) | ch, note, on ? 0x40 : 0x00);
+                    changed &= changed - 1;
+                }
+            }
+        }
+
+        if (from->program[ch] != to->program[ch])
+        {
+            PLATFORM_MIDI_STATE_EMIT(0xC0 | ch, to->program[ch], 0);
+        }
+
+        if (0 != memcmp(from->cc[ch], to->cc[ch], sizeof(to->cc[ch])))
+        {
+            for (unsigned char cc = 0; cc < 120; cc++)
+            {
+                // Parameter selection and data entry are reproduced from the RPN values below
+                if (cc == 6 || cc == 38 || (cc >= 96 && cc <= 101))
+                {
+                    continue;
+                }
+
+                if (from->cc[ch][cc] != to->cc[ch][cc])
+                {
+                    PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, cc, to->cc[ch][cc]);
+                }
+            }
+        }
+
+        for (unsigned short rpn = 0; rpn < PLATFORM_MIDI_STATE_RPNS; rpn++)
+        {
+            unsigned short value = to->rpn_values[ch][rpn];
+
+            if (from->rpn_values[ch][rpn] != value)
+            {
+                PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, 101, rpn >> 7);
+                PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, 100, rpn & 0x7F);
+                PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, 6, value >> 7);
+                PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, 38, value & 0x7F);
+                params = 1;
+            }
+        }
+
+        if (to->nrpn[ch] != PLATFORM_MIDI_STATE_PARAM_NULL
+            && (from->nrpn[ch] != to->nrpn[ch] || from->nrpn_value[ch] != to->nrpn_value[ch]))
+        {
+            PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, 99, to->nrpn[ch] >> 7);
+            PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, 98, to->nrpn[ch] & 0x7F);
+            PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, 6, to->nrpn_value[ch] >> 7);
+            PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, 38, to->nrpn_value[ch] & 0x7F);
+            params = 1;
+        }
+
+        // Leave the same parameter selected as in the target state
+        if (params || from->rpn[ch] != to->rpn[ch] || from->nrpn[ch] != to->nrpn[ch] || from->nrpn_active[ch] != to->nrpn_active[ch])
+        {
+            unsigned short param = to->nrpn_active[ch] ? to->nrpn[ch] : to->rpn[ch];
+            unsigned char msb = to->nrpn_active[ch] ? 99 : 101;
+
+            PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, msb, param >> 7);
+            PLATFORM_MIDI_STATE_EMIT(0xB0 | ch, msb - 1, param & 0x7F);
+        }
+
+        if (from->pressure[ch] != to->pressure[ch])
+        {
+            PLATFORM_MIDI_STATE_EMIT(0xD0 | ch, to->pressure[ch], 0);
+        }
+
+        if (from->pitch_bend[ch] != to->pitch_bend[ch])
+        {
+            PLATFORM_MIDI_STATE_EMIT(0xE0 | ch, to->pitch_bend[ch] & 0x7F, to->pitch_bend[ch] >> 7);
+        }
+    }
+
+    return pos;
+}
+
+#undef PLATFORM_MIDI_STATE_EMIT
+
+int platform_midi_state_all_notes_off(struct platform_midi_state *state, struct platform_midi_driver *driver)
+{
+    int sent = 0;
+
+    for (unsigned char ch = 0; ch < PLATFORM_MIDI_STATE_CHANNELS; ch++)
+    {
+        for (int word = 0; word < 4; word++)
+        {
+            // Copy the bits first, the write may be observed by this same tracker
+            unsigned int held = state->notes[ch][word];
+
+            while (held)
+            {
+                int bit = __builtin_ctz(held);
+                unsigned char packet[3] = { (unsigned char)(0x80 | ch), (unsigned char)((word << 5) | bit), 0x00 };
+
+                if (platform_midi_write(driver, packet, sizeof(packet)) != (int)sizeof(packet))
+                {
+                    printf("Error sending Note Off %d on channel %d\n", packet[1], ch + 1);
+                    return -1;
+                }
+
+                // Only a note that was turned off stops being held
+                state->notes[ch][word] &= ~(1u << bit);
+                state->changed |= (1u << ch);
+                sent++;
+
+                held &= held - 1;
+            }
+        }
+    }
+
+    return sent;
+}
+
+#endif
+
+#endif
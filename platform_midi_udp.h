@@ -0,0 +1,681 @@
+#ifndef _PLATFORM_MIDI_UDP_H_
+#define _PLATFORM_MIDI_UDP_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * UDP network-MIDI backend
+ *
+ * Writes are batched: messages are packed into datagrams which are sent together with
+ * one sendmmsg() once the oldest message has waited latency_us, once PLATFORM_MIDI_UDP_BATCH
+ * datagrams are full, or on platform_midi_udp_flush(). There is no background thread, so
+ * the budget is checked on every write/read/avail call. A timerfd is included in
+ * platform_midi_fds() so that apps sleeping in poll() wake up to flush in time.
+ * Reads pull up to PLATFORM_MIDI_UDP_BATCH datagrams per recvmmsg().
+ *
+ * Datagram format, all integers big-endian:
+ *   0   'P' 'M'
+ *   2   version (1)
+ *   3   number of messages in the datagram
+ *   4   32-bit sender id, random per driver
+ *   8   32-bit sequence number, +1 per datagram from that sender
+ *   12  messages, each a 16-bit length followed by one complete MIDI message
+ *
+ * Receivers track sequence numbers per sender id to count lost and reordered datagrams.
+ */
+
+#ifndef PLATFORM_MIDI_UDP_PORT
+#define PLATFORM_MIDI_UDP_PORT 5004
+#endif
+
+// Datagrams sent or received per syscall
+#ifndef PLATFORM_MIDI_UDP_BATCH
+#define PLATFORM_MIDI_UDP_BATCH 16
+#endif
+
+// Largest datagram sent or accepted, which limits the size of a single SysEx
+#ifndef PLATFORM_MIDI_UDP_MAX_DATAGRAM
+#define PLATFORM_MIDI_UDP_MAX_DATAGRAM 8192
+#endif
+
+// Socket receive buffer size requested from the kernel
+#ifndef PLATFORM_MIDI_UDP_RCVBUF
+#define PLATFORM_MIDI_UDP_RCVBUF (1 << 20)
+#endif
+
+struct platform_midi_udp_options
+{
+    // Local address and port to receive on, NULL/0 for 127.0.0.1 and PLATFORM_MIDI_UDP_PORT
+    const char *bind_addr;
+    unsigned short bind_port;
+    // Where writes are sent, NULL/0 for 127.0.0.1 and PLATFORM_MIDI_UDP_PORT
+    const char *peer_addr;
+    unsigned short peer_port;
+    // How long a written message may wait to be batched with others, 0 to send every write immediately
+    unsigned int latency_us;
+    // Datagrams are closed once they reach this size, 0 for 1400 to avoid IP fragmentation
+    unsigned int mtu;
+};
+
+struct platform_midi_udp_stats
+{
+    unsigned long long sent_datagrams;
+    unsigned long long sent_messages;
+    unsigned long long received_datagrams;
+    unsigned long long received_messages;
+    // Datagrams skipped over in a sender's sequence
+    unsigned long long lost;
+    // Datagrams that arrived after a later one from the same sender
+    unsigned long long reordered;
+    // Datagrams that weren't in this format
+    unsigned long long invalid;
+};
+
+// Set options->udp to a struct platform_midi_udp_options, or leave it NULL to talk to 127.0.0.1:PLATFORM_MIDI_UDP_PORT
+// both ways with 1 ms of batching
+struct platform_midi_driver *platform_midi_init_udp(const char *name, const struct platform_midi_options *options);
+void platform_midi_deinit_udp(struct platform_midi_driver *driver);
+int platform_midi_read_udp(struct platform_midi_driver *driver, unsigned char *out, int size);
+int platform_midi_avail_udp(struct platform_midi_driver *driver);
+int platform_midi_write_udp(struct platform_midi_driver *driver, const unsigned char *buf, int size);
+int platform_midi_fds_udp(struct platform_midi_driver *driver, int *fds, int max);
+
+// Sends any batched messages now. Returns the number of datagrams sent, or -1 on error
+int platform_midi_udp_flush(struct platform_midi_driver *driver);
+
+void platform_midi_udp_get_stats(struct platform_midi_driver *driver, struct platform_midi_udp_stats *stats);
+
+#ifdef PLATFORM_MIDI_IMPLEMENTATION
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#define PLATFORM_MIDI_UDP_HEADER_SIZE 12
+#define PLATFORM_MIDI_UDP_VERSION 1
+#define PLATFORM_MIDI_UDP_MAX_SOURCES 16
+
+// struct mmsghdr, sendmmsg() and recvmmsg() are only declared with _GNU_SOURCE,
+// which a header can't count on, so this mirrors the kernel's struct for the raw syscalls
+struct platform_midi_udp_mmsghdr
+{
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+struct platform_midi_udp_source
+{
+    uint32_t id;
+    uint32_t next_seq;
+    int used;
+};
+
+struct platform_midi_udp_driver
+{
+    platform_midi_deinit_fn deinitFn;
+    platform_midi_avail_fn availFn;
+    platform_midi_read_fn readFn;
+    platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
+    void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    unsigned int read_time;
+
+    int sock;
+    int timer;
+    struct sockaddr_in peer;
+    unsigned int latency_us;
+    unsigned int mtu;
+    uint32_t id;
+    uint32_t seq;
+
+    // Datagrams being filled, only the last one is still open
+    unsigned char out[PLATFORM_MIDI_UDP_BATCH][PLATFORM_MIDI_UDP_MAX_DATAGRAM];
+    unsigned int out_len[PLATFORM_MIDI_UDP_BATCH];
+    int out_used;
+    unsigned long long batch_start;
+    int timer_armed;
+    unsigned long long timer_deadline;
+
+    // Datagrams from the last recvmmsg(), read from in_pos in datagram in_index
+    unsigned char in[PLATFORM_MIDI_UDP_BATCH][PLATFORM_MIDI_UDP_MAX_DATAGRAM];
+    unsigned int in_len[PLATFORM_MIDI_UDP_BATCH];
+    int in_count;
+    int in_index;
+    unsigned int in_pos;
+    unsigned int in_remaining;
+
+    struct platform_midi_udp_source sources[PLATFORM_MIDI_UDP_MAX_SOURCES];
+    int next_source;
+
+    struct platform_midi_udp_stats stats;
+};
+
+static unsigned long long platform_midi_udp_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static void platform_midi_udp_put32(unsigned char *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static uint32_t platform_midi_udp_get32(const unsigned char *in)
+{
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+static int platform_midi_udp_resolve(struct sockaddr_in *addr, const char *host, unsigned short port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port ? port : PLATFORM_MIDI_UDP_PORT);
+
+    if (1 != inet_pton(AF_INET, host ? host : "127.0.0.1", &addr->sin_addr))
+    {
+        printf("Invalid IPv4 address: %s\n", host);
+        return 0;
+    }
+
+    return 1;
+}
+
+struct platform_midi_driver *platform_midi_init_udp(const char *name, const struct platform_midi_options *options)
+{
+    const struct platform_midi_udp_options defaults = { NULL, 0, NULL, 0, 1000, 0 };
+    const struct platform_midi_udp_options *udpOptions = (options && options->udp) ? options->udp : &defaults;
+    struct sockaddr_in local;
+
+    (void)name;
+
+    void *alloc = malloc(sizeof(struct platform_midi_udp_driver));
+
+    if (!alloc)
+    {
+        printf("Failed to allocate driver struct\n");
+        return NULL;
+    }
+
+    struct platform_midi_udp_driver *udp_driver = (struct platform_midi_udp_driver*)alloc;
+    udp_driver->deinitFn = platform_midi_deinit_udp;
+    udp_driver->availFn = platform_midi_avail_udp;
+    udp_driver->readFn = platform_midi_read_udp;
+    udp_driver->writeFn = platform_midi_write_udp;
+    udp_driver->fdsFn = platform_midi_fds_udp;
+    udp_driver->readEventsFn = NULL;
+    udp_driver->writeEventsFn = NULL;
+    udp_driver->readUmpFn = NULL;
+    udp_driver->writeUmpFn = NULL;
+    udp_driver->writeMultiFn = NULL;
+    udp_driver->data = options ? options->user_data : NULL;
+    udp_driver->taps = NULL;
+    udp_driver->blocking = options ? options->blocking : 0;
+    udp_driver->stream_out = 1;
+    platform_midi_realtime_init(&udp_driver->realtime_out);
+    udp_driver->read_held = NULL;
+    udp_driver->read_held_len = 0;
+    udp_driver->read_held_capacity = 0;
+    udp_driver->read_held_time = 0;
+    udp_driver->read_time = 0;
+
+    udp_driver->sock = -1;
+    udp_driver->timer = -1;
+    udp_driver->latency_us = udpOptions->latency_us;
+    udp_driver->mtu = udpOptions->mtu ? udpOptions->mtu : 1400;
+    udp_driver->out_used = 0;
+    udp_driver->timer_armed = 0;
+    udp_driver->in_count = 0;
+    udp_driver->in_index = 0;
+    udp_driver->in_pos = 0;
+    udp_driver->in_remaining = 0;
+    udp_driver->next_source = 0;
+    memset(udp_driver->sources, 0, sizeof(udp_driver->sources));
+    memset(&udp_driver->stats, 0, sizeof(udp_driver->stats));
+
+    if (udp_driver->mtu > PLATFORM_MIDI_UDP_MAX_DATAGRAM)
+    {
+        udp_driver->mtu = PLATFORM_MIDI_UDP_MAX_DATAGRAM;
+    }
+
+    // The sender id only has to differ between senders talking to the same receiver
+    udp_driver->id = ((uint32_t)getpid() << 16) ^ (uint32_t)platform_midi_udp_now_us() ^ (uint32_t)(uintptr_t)udp_driver;
+    udp_driver->seq = 0;
+
+    if (!platform_midi_udp_resolve(&local, udpOptions->bind_addr, udpOptions->bind_port)
+        || !platform_midi_udp_resolve(&udp_driver->peer, udpOptions->peer_addr, udpOptions->peer_port))
+    {
+        platform_midi_deinit_udp((struct platform_midi_driver*)udp_driver);
+        return NULL;
+    }
+
+    udp_driver->sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (udp_driver->sock < 0)
+    {
+        printf("Failed to create UDP socket: %s\n", strerror(errno));
+        platform_midi_deinit_udp((struct platform_midi_driver*)udp_driver);
+        return NULL;
+    }
+
+    int rcvbuf = (options && options->queue_size) ? (int)options->queue_size : PLATFORM_MIDI_UDP_RCVBUF;
+    setsockopt(udp_driver->sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    if (0 != bind(udp_driver->sock, (struct sockaddr*)&local, sizeof(local)))
+    {
+        printf("Failed to bind UDP socket to port %u: %s\n", ntohs(local.sin_port), strerror(errno));
+        platform_midi_deinit_udp((struct platform_midi_driver*)udp_driver);
+        return NULL;
+    }
+
+    udp_driver->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (udp_driver->timer < 0)
+    {
+        printf("Failed to create batching timer: %s\n", strerror(errno));
+        platform_midi_deinit_udp((struct platform_midi_driver*)udp_driver);
+        return NULL;
+    }
+
+    printf("UDP MIDI listening on port %u, sending to port %u\n", ntohs(local.sin_port), ntohs(udp_driver->peer.sin_port));
+
+    return (struct platform_midi_driver*)udp_driver;
+}
+
+void platform_midi_deinit_udp(struct platform_midi_driver *driver)
+{
+    struct platform_midi_udp_driver *udp_driver = (struct platform_midi_udp_driver*)driver;
+
+    if (udp_driver->sock >= 0)
+    {
+        platform_midi_udp_flush(driver);
+        close(udp_driver->sock);
+    }
+
+    if (udp_driver->timer >= 0)
+    {
+        close(udp_driver->timer);
+    }
+
+    free(udp_driver);
+}
+
+int platform_midi_udp_flush(struct platform_midi_driver *driver)
+{
+    struct platform_midi_udp_driver *udp_driver = (struct platform_midi_udp_driver*)driver;
+    struct platform_midi_udp_mmsghdr msgs[PLATFORM_MIDI_UDP_BATCH];
+    struct iovec iovs[PLATFORM_MIDI_UDP_BATCH];
+    int count = udp_driver->out_used;
+    int sent = 0;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < count; i++)
+    {
+        iovs[i].iov_base = udp_driver->out[i];
+        iovs[i].iov_len = udp_driver->out_len[i];
+        msgs[i].msg_hdr.msg_name = &udp_driver->peer;
+        msgs[i].msg_hdr.msg_namelen = sizeof(udp_driver->peer);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+
+        udp_driver->stats.sent_messages += udp_driver->out[i][3];
+    }
+
+    udp_driver->out_used = 0;
+
+    while (sent < count)
+    {
+        int result = (int)syscall(SYS_sendmmsg, udp_driver->sock, msgs + sent, count - sent, 0);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            printf("Err: couldn't send UDP MIDI datagrams: %s\n", strerror(errno));
+            return -1;
+        }
+
+        sent += result;
+    }
+
+    udp_driver->stats.sent_datagrams += sent;
+    return sent;
+}
+
+// Flushes the batch if its latency budget is up and keeps the wakeup timer in step
+static void platform_midi_udp_service(struct platform_midi_udp_driver *udp_driver)
+{
+    if (!udp_driver->out_used && !udp_driver->timer_armed)
+    {
+        return;
+    }
+
+    unsigned long long now = platform_midi_udp_now_us();
+
+    if (udp_driver->out_used && now - udp_driver->batch_start >= udp_driver->latency_us)
+    {
+        platform_midi_udp_flush((struct platform_midi_driver*)udp_driver);
+    }
+
+    if (udp_driver->timer_armed && now >= udp_driver->timer_deadline)
+    {
+        uint64_t expirations;
+        if (read(udp_driver->timer, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        {
+            printf("Err: couldn't read batching timer: %s\n", strerror(errno));
+        }
+
+        udp_driver->timer_armed = 0;
+    }
+
+    if (udp_driver->out_used && !udp_driver->timer_armed)
+    {
+        // A batch started after the timer was set, make sure it still gets woken up for
+        unsigned long long deadline = udp_driver->batch_start + udp_driver->latency_us;
+        unsigned long long wait = (deadline > now) ? deadline - now : 1;
+        struct itimerspec spec;
+
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = wait / 1000000;
+        spec.it_value.tv_nsec = (wait % 1000000) * 1000;
+
+        timerfd_settime(udp_driver->timer, 0, &spec, NULL);
+        udp_driver->timer_armed = 1;
+        udp_driver->timer_deadline = now + wait;
+    }
+}
+
+int platform_midi_write_udp(struct platform_midi_driver *driver, const unsigned char *buf, int size)
+{
+    struct platform_midi_udp_driver *udp_driver = (struct platform_midi_udp_driver*)driver;
+    int written = 0;
+
+    while (written < size)
+    {
+        unsigned int length = platform_midi_next_message(buf + written, size - written);
+
+        if (PLATFORM_MIDI_UDP_HEADER_SIZE + 2 + length > PLATFORM_MIDI_UDP_MAX_DATAGRAM)
+        {
+            printf("Err: %u byte message is too large for a UDP MIDI datagram\n", length);
+            break;
+        }
+
+        int current = udp_driver->out_used - 1;
+
+        // Start a new datagram if this one would go over the MTU, unless it's empty anyway
+        if (current < 0
+            || udp_driver->out[current][3] == 255
+            || (udp_driver->out[current][3] > 0 && udp_driver->out_len[current] + 2 + length > udp_driver->mtu))
+        {
+            if (udp_driver->out_used == PLATFORM_MIDI_UDP_BATCH)
+            {
+                if (0 > platform_midi_udp_flush(driver))
+                {
+                    break;
+                }
+            }
+
+            if (udp_driver->out_used == 0)
+            {
+                udp_driver->batch_start = platform_midi_udp_now_us();
+            }
+
+            current = udp_driver->out_used++;
+            unsigned char *header = udp_driver->out[current];
+            header[0] = 'P';
+            header[1] = 'M';
+            header[2] = PLATFORM_MIDI_UDP_VERSION;
+            header[3] = 0;
+            platform_midi_udp_put32(header + 4, udp_driver->id);
+            platform_midi_udp_put32(header + 8, udp_driver->seq++);
+            udp_driver->out_len[current] = PLATFORM_MIDI_UDP_HEADER_SIZE;
+        }
+
+        unsigned char *dgram = udp_driver->out[current];
+        unsigned int pos = udp_driver->out_len[current];
+
+        dgram[pos] = length >> 8;
+        dgram[pos + 1] = length & 0xFF;
+        memcpy(dgram + pos + 2, buf + written, length);
+
+        udp_driver->out_len[current] = pos + 2 + length;
+        dgram[3]++;
+        written += length;
+    }
+
+    if (udp_driver->latency_us == 0)
+    {
+        platform_midi_udp_flush(driver);
+    }
+    else
+    {
+        platform_midi_udp_service(udp_driver);
+    }
+
+    return (written > 0) ? written : -1;
+}
+
+// Checks a received datagram's header and updates the loss counters from its sequence number
+static int platform_midi_udp_accept(struct platform_midi_udp_driver *udp_driver, const unsigned char *dgram, unsigned int len)
+{
+    if (len < PLATFORM_MIDI_UDP_HEADER_SIZE || dgram[0] != 'P' || dgram[1] != 'M' || dgram[2] != PLATFORM_MIDI_UDP_VERSION)
+    {
+        udp_driver->stats.invalid++;
+        return 0;
+    }
+
+    uint32_t id = platform_midi_udp_get32(dgram + 4);
+    uint32_t seq = platform_midi_udp_get32(dgram + 8);
+    struct platform_midi_udp_source *source = NULL;
+
+    for (int i = 0; i < PLATFORM_MIDI_UDP_MAX_SOURCES; i++)
+    {
+        if (udp_driver->sources[i].used && udp_driver->sources[i].id == id)
+        {
+            source = &udp_driver->sources[i];
+            break;
+        }
+    }
+
+    if (!source)
+    {
+        // Forget the oldest sender if there are too many
+        source = &udp_driver->sources[udp_driver->next_source];
+        udp_driver->next_source = (udp_driver->next_source + 1) % PLATFORM_MIDI_UDP_MAX_SOURCES;
+        source->id = id;
+        source->next_seq = seq;
+        source->used = 1;
+    }
+
+    int32_t gap = (int32_t)(seq - source->next_seq);
+    if (gap < 0)
+    {
+        udp_driver->stats.reordered++;
+    }
+    else
+    {
+        udp_driver->stats.lost += gap;
+        source->next_seq = seq + 1;
+    }
+
+    udp_driver->stats.received_datagrams++;
+    return 1;
+}
+
+// Receives more datagrams once the current ones are used up. Returns 0 if there's nothing to read
+static int platform_midi_udp_fill(struct platform_midi_udp_driver *udp_driver)
+{
+    while (udp_driver->in_remaining == 0)
+    {
+        if (udp_driver->in_index + 1 < udp_driver->in_count)
+        {
+            int index = ++udp_driver->in_index;
+            const unsigned char *dgram = udp_driver->in[index];
+
+            if (platform_midi_udp_accept(udp_driver, dgram, udp_driver->in_len[index]))
+            {
+                udp_driver->in_pos = PLATFORM_MIDI_UDP_HEADER_SIZE;
+                udp_driver->in_remaining = dgram[3];
+            }
+            continue;
+        }
+
+        struct platform_midi_udp_mmsghdr msgs[PLATFORM_MIDI_UDP_BATCH];
+        struct iovec iovs[PLATFORM_MIDI_UDP_BATCH];
+
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < PLATFORM_MIDI_UDP_BATCH; i++)
+        {
+            iovs[i].iov_base = udp_driver->in[i];
+            iovs[i].iov_len = PLATFORM_MIDI_UDP_MAX_DATAGRAM;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int result = (int)syscall(SYS_recvmmsg, udp_driver->sock, msgs, PLATFORM_MIDI_UDP_BATCH, MSG_DONTWAIT, NULL);
+        if (result <= 0)
+        {
+            if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                printf("Err: couldn't receive UDP MIDI datagrams: %s\n", strerror(errno));
+                return -1;
+            }
+
+            return 0;
+        }
+
+        for (int i = 0; i < result; i++)
+        {
+            udp_driver->in_len[i] = msgs[i].msg_len;
+        }
+
+        udp_driver->in_count = result;
+        udp_driver->in_index = -1;
+    }
+
+    return 1;
+}
+
+int platform_midi_read_udp(struct platform_midi_driver *driver, unsigned char *out, int size)
+{
+    struct platform_midi_udp_driver *udp_driver = (struct platform_midi_udp_driver*)driver;
+
+    platform_midi_udp_service(udp_driver);
+
+    const unsigned char *dgram;
+    unsigned int pos;
+    unsigned int length;
+
+    while (1)
+    {
+        int result = platform_midi_udp_fill(udp_driver);
+        if (result <= 0)
+        {
+            return result;
+        }
+
+        dgram = udp_driver->in[udp_driver->in_index];
+        pos = udp_driver->in_pos;
+
+        unsigned int dgramLen = udp_driver->in_len[udp_driver->in_index];
+        length = (pos + 2 <= dgramLen) ? ((dgram[pos] << 8) | dgram[pos + 1]) : 0;
+
+        if (length > 0 && pos + 2 + length <= dgramLen)
+        {
+            break;
+        }
+
+        // Truncated or corrupt, skip the rest of the datagram
+        udp_driver->stats.invalid++;
+        udp_driver->in_remaining = 0;
+    }
+
+    unsigned int toCopy = ((unsigned int)size < length) ? (unsigned int)size : length;
+    memcpy(out, dgram + pos + 2, toCopy);
+
+    udp_driver->in_pos = pos + 2 + length;
+    udp_driver->in_remaining--;
+    udp_driver->stats.received_messages++;
+
+    return toCopy;
+}
+
+int platform_midi_avail_udp(struct platform_midi_driver *driver)
+{
+    struct platform_midi_udp_driver *udp_driver = (struct platform_midi_udp_driver*)driver;
+
+    platform_midi_udp_service(udp_driver);
+
+    if (platform_midi_udp_fill(udp_driver) <= 0)
+    {
+        return 0;
+    }
+
+    // Datagrams after the current one haven't been checked yet, but the count is in the same place
+    int count = udp_driver->in_remaining;
+    for (int i = udp_driver->in_index + 1; i < udp_driver->in_count; i++)
+    {
+        if (udp_driver->in_len[i] >= PLATFORM_MIDI_UDP_HEADER_SIZE)
+        {
+            count += udp_driver->in[i][3];
+        }
+    }
+
+    return count;
+}
+
+int platform_midi_fds_udp(struct platform_midi_driver *driver, int *fds, int max)
+{
+    struct platform_midi_udp_driver *udp_driver = (struct platform_midi_udp_driver*)driver;
+    int count = 0;
+
+    if (count < max)
+    {
+        fds[count++] = udp_driver->sock;
+    }
+
+    if (count < max && udp_driver->latency_us > 0)
+    {
+        fds[count++] = udp_driver->timer;
+    }
+
+    return count;
+}
+
+void platform_midi_udp_get_stats(struct platform_midi_driver *driver, struct platform_midi_udp_stats *stats)
+{
+    *stats = ((struct platform_midi_udp_driver*)driver)->stats;
+}
+#endif
+
+#endif
@@ -1,12 +1,15 @@
 #ifndef _PLATFORM_MIDI_WINDOWS_H_
 #define _PLATFORM_MIDI_WINDOWS_H_
 
-struct platform_midi_driver *platform_midi_init_winmm(const char *name, void *data);
+struct platform_midi_driver *platform_midi_init_winmm(const char *name, const struct platform_midi_options *options);
 void platform_midi_deinit_winmm(struct platform_midi_driver *driver);
 int platform_midi_read_winmm(struct platform_midi_driver *driver, unsigned char *out, int size);
 int platform_midi_avail_winmm(struct platform_midi_driver *driver);
 int platform_midi_write_winmm(struct platform_midi_driver *driver, const unsigned char *buf, int size);
 
+// Returns how many received messages were dropped because the input queue was full
+unsigned int platform_midi_winmm_dropped(struct platform_midi_driver *driver);
+
 #ifdef PLATFORM_MIDI_IMPLEMENTATION
 
 #include <windows.h>
@@ -23,7 +26,22 @@ struct platform_midi_winmm_driver
     platform_midi_avail_fn availFn;
     platform_midi_read_fn readFn;
     platform_midi_write_fn writeFn;
+    platform_midi_fds_fn fdsFn;
+    platform_midi_read_events_fn readEventsFn;
+    platform_midi_write_events_fn writeEventsFn;
+    platform_midi_read_ump_fn readUmpFn;
+    platform_midi_write_ump_fn writeUmpFn;
+    platform_midi_write_multi_fn writeMultiFn;
     void *data;
+    struct platform_midi_tap *taps;
+    int blocking;
+    int stream_out;
+    struct platform_midi_realtime_lane realtime_out;
+    unsigned char *read_held;
+    int read_held_len;
+    int read_held_capacity;
+    unsigned int read_held_time;
+    unsigned int read_time;
 
     struct platform_midi_ringbuf buffer;
 
@@ -94,7 +112,7 @@ void CALLBACK platform_midi_winmm_callback(HMIDIIN midiIn, UINT wMsg, DWORD_PTR
 }
 
 
-struct platform_midi_driver *platform_midi_init_winmm(const char* name, void *data)
+struct platform_midi_driver *platform_midi_init_winmm(const char* name, const struct platform_midi_options *options)
 {
     void *alloc = malloc(sizeof(struct platform_midi_winmm_driver));
 
@@ -109,7 +127,22 @@ struct platform_midi_driver *platform_midi_init_winmm(const char* name, void *da
     winmm_driver->availFn = platform_midi_avail_winmm;
     winmm_driver->readFn = platform_midi_read_winmm;
     winmm_driver->writeFn = platform_midi_write_winmm;
-    winmm_driver->data = data;
+    winmm_driver->fdsFn = NULL;
+    winmm_driver->readEventsFn = NULL;
+    winmm_driver->writeEventsFn = NULL;
+    winmm_driver->readUmpFn = NULL;
+    winmm_driver->writeUmpFn = NULL;
+    winmm_driver->writeMultiFn = NULL;
+    winmm_driver->data = options ? options->user_data : NULL;
+    winmm_driver->taps = NULL;
+    winmm_driver->blocking = options ? options->blocking : 0;
+    winmm_driver->stream_out = 0;
+    platform_midi_realtime_init(&winmm_driver->realtime_out);
+    winmm_driver->read_held = NULL;
+    winmm_driver->read_held_len = 0;
+    winmm_driver->read_held_capacity = 0;
+    winmm_driver->read_held_time = 0;
+    winmm_driver->read_time = 0;
     winmm_driver->inCount = 0;
 
     char errorText[MAXERRORLENGTH];
@@ -186,7 +219,7 @@ void platform_midi_deinit_winmm(struct platform_midi_driver *driver)
 int platform_midi_read_winmm(struct platform_midi_driver *driver, unsigned char * out, int size)
 {
     struct platform_midi_winmm_driver *winmm_driver = (struct platform_midi_winmm_driver*)driver;
-    return platform_midi_pop_packet(&winmm_driver->buffer, out, size);
+    return platform_midi_pop_packet_timed(&winmm_driver->buffer, out, size, &winmm_driver->read_time);
 }
 
 int platform_midi_avail_winmm(struct platform_midi_driver *driver)
@@ -202,6 +235,11 @@ int platform_midi_write_winmm(struct platform_midi_driver *driver, const unsigne
     return 0;
 }
 
+unsigned int platform_midi_winmm_dropped(struct platform_midi_driver *driver)
+{
+    return platform_midi_buffer_dropped(&((struct platform_midi_winmm_driver*)driver)->buffer);
+}
+
 #endif
 
 #endif
@@ -0,0 +1,78 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include "platform_midi_clock.h"
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * clock_follower_test.c
+ *
+ * Queues clocks on the NULL loopback at a steady 5 ms (500 BPM) and reads them
+ * in bursts of a quarter note, as an app polling every 120 ms would. A follower
+ * attached to the driver must still see the steady rate: lock, estimate the
+ * tempo to within 2%, and measure jitter far below the polling interval. Exits
+ * non-zero otherwise
+ *
+ */
+
+#define PERIOD_NS 5000000ull
+#define BURST 24
+#define CLOCKS (BURST * 10)
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    struct platform_midi_options options = { 0 };
+    const char *backends[] = { "NULL", NULL };
+    struct platform_midi_clock_follower follower;
+    unsigned char clock = 0xF8;
+    unsigned char buf[16];
+
+    (void)argc;
+    (void)argv;
+
+    options.backends = backends;
+    struct platform_midi_driver *driver = platform_midi_init_ex("clock_follower_test", &options);
+    if (!driver)
+    {
+        return 1;
+    }
+
+    platform_midi_clock_follower_init(&follower);
+    platform_midi_clock_follower_attach(&follower, driver);
+
+    unsigned long long start = now_ns();
+    for (int i = 0; i < CLOCKS; i++)
+    {
+        // Spin rather than sleep, so the clocks go out on time even on a busy machine
+        while (now_ns() < start + (i + 1) * PERIOD_NS)
+        {
+        }
+        platform_midi_write(driver, &clock, 1);
+
+        if (i % BURST == BURST - 1)
+        {
+            while (platform_midi_read(driver, buf, sizeof(buf)) > 0)
+            {
+            }
+        }
+    }
+
+    double bpm = platform_midi_clock_follower_bpm(&follower);
+    double expected = 60e9 / (PERIOD_NS * PLATFORM_MIDI_CLOCK_PPQN);
+    double jitter = platform_midi_clock_stddev(&follower.jitter);
+    int failed = !follower.locked || bpm < expected * 0.98 || bpm > expected * 1.02 || jitter > 2000;
+
+    printf("%s BPM %.1f (expected %.1f), %slocked, jitter %.1f us\n", failed ? "FAIL" : "ok  ",
+           bpm, expected, follower.locked ? "" : "not ", jitter);
+
+    platform_midi_clock_follower_detach(&follower, driver);
+    platform_midi_deinit(driver);
+    return failed;
+}
@@ -0,0 +1,112 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ * ringbuf_test.c
+ *
+ * Pushes notes and SysEx of varying lengths into an input queue from one thread,
+ * waiting whenever platform_midi_buffer_full() says it might have to drop, as
+ * the RawMIDI backend does, and pops them on another. Every message must come
+ * out whole and in order, and none may be dropped. Exits non-zero otherwise
+ *
+ */
+
+#define MESSAGES 2000000
+
+static struct platform_midi_ringbuf buf;
+static int producerDone;
+
+static int make_message(unsigned int seq, unsigned char *msg)
+{
+    if (seq % 5 == 4)
+    {
+        int length = 4 + seq % 300;
+
+        msg[0] = 0xF0;
+        msg[1] = (seq >> 14) & 0x7F;
+        msg[2] = (seq >> 7) & 0x7F;
+        msg[3] = seq & 0x7F;
+        memset(msg + 4, seq % 101, length - 5);
+        msg[length - 1] = 0xF7;
+        return length;
+    }
+
+    msg[0] = 0x90;
+    msg[1] = (seq >> 7) & 0x7F;
+    msg[2] = seq & 0x7F;
+    return 3;
+}
+
+static void *producer_thread(void *arg)
+{
+    unsigned char msg[512];
+
+    (void)arg;
+    for (unsigned int seq = 0; seq < MESSAGES; seq++)
+    {
+        int length = make_message(seq, msg);
+
+        while (platform_midi_buffer_full(&buf, length))
+        {
+            sched_yield();
+        }
+        platform_midi_push_packet(&buf, msg, length);
+    }
+
+    __atomic_store_n(&producerDone, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned char expected[512];
+    unsigned char out[512];
+    pthread_t producer;
+    int failed = 0;
+
+    (void)argc;
+    (void)argv;
+
+    platform_midi_buffer_init(&buf);
+    pthread_create(&producer, NULL, producer_thread, NULL);
+
+    for (unsigned int seq = 0; seq < MESSAGES && !failed; seq++)
+    {
+        int length = make_message(seq, expected);
+        int size;
+
+        while (0 == (size = platform_midi_pop_packet(&buf, out, sizeof(out))))
+        {
+            sched_yield();
+        }
+
+        if (size != length || memcmp(out, expected, length))
+        {
+            printf("FAIL: message %u came out as %d bytes, expected %d\n", seq, size, length);
+            failed = 1;
+        }
+    }
+
+    // The producer may be waiting for room
+    while (failed && !__atomic_load_n(&producerDone, __ATOMIC_ACQUIRE))
+    {
+        platform_midi_pop_packet(&buf, out, sizeof(out));
+    }
+    pthread_join(producer, NULL);
+
+    if (!failed && platform_midi_buffer_dropped(&buf))
+    {
+        printf("FAIL: %u messages dropped\n", platform_midi_buffer_dropped(&buf));
+        failed = 1;
+    }
+
+    if (!failed)
+    {
+        printf("ok   %d messages\n", MESSAGES);
+    }
+    return failed;
+}
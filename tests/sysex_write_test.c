@@ -0,0 +1,150 @@
+#define PLATFORM_MIDI_IMPLEMENTATION
+#include "platform_midi.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * sysex_write_test.c
+ *
+ * Writes a 1 KB SysEx with platform_midi_write() through backends that send each
+ * message whole (the NULL loopback, shared memory, and JACK when built with
+ * JACK=1 and a server is running) and checks that it arrives as one message,
+ * byte for byte. Exits non-zero on any mismatch
+ *
+ */
+
+#define SYSEX_SIZE 1024
+
+static unsigned char sysex[SYSEX_SIZE];
+
+static unsigned long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+// Writes the SysEx to out, reads from in for up to a second. Returns 0 if it came back intact
+static int check(const char *backend, struct platform_midi_driver *out, struct platform_midi_driver *in)
+{
+    static unsigned char received[SYSEX_SIZE * 2];
+    int read = 0;
+
+    int written = platform_midi_write(out, sysex, SYSEX_SIZE);
+    if (written != SYSEX_SIZE)
+    {
+        printf("FAIL %s: wrote %d of %d bytes\n", backend, written, SYSEX_SIZE);
+        return 1;
+    }
+
+    unsigned long long giveUp = now_ms() + 1000;
+    while (read == 0 && now_ms() < giveUp)
+    {
+        read = platform_midi_read(in, received, sizeof(received));
+        if (read == 0)
+        {
+            struct timespec ts = { 0, 1000000 };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    if (read != SYSEX_SIZE || memcmp(received, sysex, SYSEX_SIZE))
+    {
+        printf("FAIL %s: received %d bytes, expected the %d written in one message\n", backend, read, SYSEX_SIZE);
+        return 1;
+    }
+
+    printf("ok   %s\n", backend);
+    return 0;
+}
+
+static struct platform_midi_driver *open_backend(const char *backend, struct platform_midi_options *options)
+{
+    const char *backends[] = { backend, NULL };
+    options->backends = backends;
+    return platform_midi_init_ex("sysex_write_test", options);
+}
+
+int main(int argc, char** argv)
+{
+    int failed = 0;
+
+    sysex[0] = 0xF0;
+    for (int i = 1; i < SYSEX_SIZE - 1; i++)
+    {
+        sysex[i] = (i * 7) & 0x7F;
+    }
+    sysex[SYSEX_SIZE - 1] = 0xF7;
+
+    struct platform_midi_options options = { 0 };
+    struct platform_midi_driver *null = open_backend("NULL", &options);
+    if (!null)
+    {
+        return 1;
+    }
+    failed |= check("NULL", null, null);
+    platform_midi_deinit(null);
+
+#ifdef PLATFORM_MIDI_SHM
+    struct platform_midi_shm_options writerOptions = { NULL, "sysex_write_test", 0 };
+    struct platform_midi_shm_options readerOptions = { "sysex_write_test", NULL, 0 };
+
+    platform_midi_shm_unlink("sysex_write_test");
+    options.shm = &writerOptions;
+    struct platform_midi_driver *writer = open_backend("SharedMemory", &options);
+    options.shm = &readerOptions;
+    struct platform_midi_driver *reader = open_backend("SharedMemory", &options);
+    options.shm = NULL;
+
+    if (!writer || !reader)
+    {
+        printf("FAIL SharedMemory: could not open the ring\n");
+        failed = 1;
+    }
+    else
+    {
+        failed |= check("SharedMemory", writer, reader);
+    }
+
+    if (writer)
+    {
+        platform_midi_deinit(writer);
+    }
+    if (reader)
+    {
+        platform_midi_deinit(reader);
+    }
+    platform_midi_shm_unlink("sysex_write_test");
+#endif
+
+#ifdef PLATFORM_MIDI_JACK
+    struct platform_midi_driver *jack = open_backend("JACK", &options);
+    if (!jack)
+    {
+        printf("skip JACK: no server running\n");
+    }
+    else
+    {
+        jack_client_t *client = platform_midi_jack_client(jack);
+        char out[256];
+        char in[256];
+
+        snprintf(out, sizeof(out), "%s:out", jack_get_client_name(client));
+        snprintf(in, sizeof(in), "%s:in", jack_get_client_name(client));
+
+        if (0 != jack_connect(client, out, in))
+        {
+            printf("FAIL JACK: could not connect %s to %s\n", out, in);
+            failed = 1;
+        }
+        else
+        {
+            failed |= check("JACK", jack, jack);
+        }
+        platform_midi_deinit(jack);
+    }
+#endif
+
+    return failed;
+}